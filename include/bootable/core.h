@@ -25,6 +25,7 @@
  * */
 
 #include <bootable/core/arch.h>
+#include <bootable/core/arena.h>
 #include <bootable/core/dap.h>
 #include <bootable/core/dir.h>
 #include <bootable/core/e820.h>
@@ -32,6 +33,7 @@
 #include <bootable/core/file.h>
 #include <bootable/core/fs.h>
 #include <bootable/core/gpt.h>
+#include <bootable/core/lz4.h>
 #include <bootable/core/mbr.h>
 #include <bootable/core/memory.h>
 #include <bootable/core/partition.h>
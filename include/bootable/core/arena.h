@@ -0,0 +1,102 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file arena.h API related to allocating many
+ * small blocks of memory that are released together.
+ * */
+
+#ifndef BOOTABLE_ARENA_H
+#define BOOTABLE_ARENA_H
+
+#include <bootable/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of bytes in the first chunk
+ * that an arena allocates.
+ * */
+
+#define BOOTABLE_ARENA_MIN_CHUNK 0x10000ULL
+
+/** The largest number of bytes that an arena
+ * allocates in one chunk for small blocks.
+ * Larger blocks get a chunk of their own.
+ * */
+
+#define BOOTABLE_ARENA_MAX_CHUNK 0x1000000ULL
+
+/** A block of memory that an arena
+ * hands out pieces of.
+ * */
+
+struct bootable_arena_chunk {
+	/** The chunk that was allocated before this one. */
+	struct bootable_arena_chunk *next;
+	/** The number of bytes that follow the chunk header. */
+	bootable_uint64 size;
+	/** The number of bytes that have been handed out. */
+	bootable_uint64 used;
+};
+
+/** Hands out memory by advancing a pointer
+ * through large chunks. Individual blocks
+ * cannot be released. Instead, all of them
+ * are released at once by @ref bootable_arena_done.
+ * Each new chunk is twice as large as the last one,
+ * so a large number of blocks only takes a few chunks.
+ * */
+
+struct bootable_arena {
+	/** The chunk that blocks are currently
+	 * being allocated from. */
+	struct bootable_arena_chunk *chunks;
+	/** The size of the next chunk to allocate. */
+	bootable_uint64 next_chunk_size;
+};
+
+/** Initializes an arena. No memory is
+ * allocated until the first block is requested.
+ * @param arena An uninitialized arena.
+ * */
+
+void bootable_arena_init(struct bootable_arena *arena);
+
+/** Releases all the memory that was
+ * allocated by the arena.
+ * @param arena An initialized arena.
+ * */
+
+void bootable_arena_done(struct bootable_arena *arena);
+
+/** Allocates a block of memory from the arena.
+ * The block is aligned to sixteen bytes.
+ * @param arena An initialized arena.
+ * @param size The number of bytes to allocate.
+ * @returns The address of the block on success.
+ * If there is no more memory, null is returned.
+ * */
+
+void *bootable_arena_alloc(struct bootable_arena *arena, bootable_uint64 size);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_ARENA_H */
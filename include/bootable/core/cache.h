@@ -0,0 +1,183 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file cache.h API related to the block cache stream.
+ * */
+
+#ifndef BOOTABLE_CACHE_H
+#define BOOTABLE_CACHE_H
+
+#include <bootable/core/stream.h>
+#include <bootable/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The default number of bytes
+ * in a block of the cache.
+ * */
+
+#ifndef BOOTABLE_CACHE_BLOCK_SIZE
+#define BOOTABLE_CACHE_BLOCK_SIZE 4096
+#endif
+
+/** The default number of blocks
+ * that the cache holds.
+ * */
+
+#ifndef BOOTABLE_CACHE_BLOCK_COUNT
+#define BOOTABLE_CACHE_BLOCK_COUNT 64
+#endif
+
+/** A block of data held by the cache.
+ * */
+
+struct bootable_cache_block {
+	/** The offset of the block within
+	 * the backing stream. This is a
+	 * multiple of the block size. */
+	bootable_uint64 offset;
+	/** The data of the block. */
+	unsigned char *data;
+	/** The offset, within the block, of the
+	 * first byte that was written but not
+	 * yet flushed to the backing stream. */
+	bootable_uint64 dirty_begin;
+	/** The offset, within the block, after
+	 * the last byte that was written but not
+	 * yet flushed. If this is zero, the block
+	 * is clean. */
+	bootable_uint64 dirty_end;
+	/** Whether or not the block holds data. */
+	bootable_bool used;
+	/** Whether or not the bytes outside of the
+	 * dirty range were read from the backing stream. */
+	bootable_bool loaded;
+	/** The next block in the same hash bucket. */
+	struct bootable_cache_block *hash_next;
+	/** The block that was used more recently. */
+	struct bootable_cache_block *lru_prev;
+	/** The block that was used less recently. */
+	struct bootable_cache_block *lru_next;
+};
+
+/** A stream that holds blocks of another
+ * stream in memory. Reads are served from the
+ * cache, writes are kept in the cache until it
+ * is flushed or the block has to make room for
+ * another one. Blocks are replaced in the order
+ * they were least recently used.
+ * */
+
+struct bootable_cache {
+	/** The stream of the cache. */
+	struct bootable_stream stream;
+	/** The stream being cached. */
+	struct bootable_stream *backend;
+	/** The size of the backing stream,
+	 * as of the last flush. */
+	bootable_uint64 backend_size;
+	/** The size of the stream, including
+	 * the data that was not flushed yet. */
+	bootable_uint64 size;
+	/** The position of the next read
+	 * or write operation. */
+	bootable_uint64 position;
+	/** The number of bytes in a block.
+	 * This is a power of two. */
+	bootable_uint64 block_size;
+	/** The base two logarithm of the block size. */
+	unsigned int block_shift;
+	/** The number of blocks in the cache. */
+	bootable_uint64 block_count;
+	/** The array of blocks. */
+	struct bootable_cache_block *blocks;
+	/** The data of all blocks. */
+	unsigned char *data;
+	/** Blocks indexed by their offset. */
+	struct bootable_cache_block **buckets;
+	/** The number of hash buckets.
+	 * This is a power of two. */
+	bootable_uint64 bucket_count;
+	/** Room to sort the dirty
+	 * blocks, when flushing. */
+	struct bootable_cache_block **dirty;
+	/** The most recently used block. */
+	struct bootable_cache_block *lru_head;
+	/** The least recently used block. */
+	struct bootable_cache_block *lru_tail;
+};
+
+/** Initializes a cache structure.
+ * @param cache The cache to initialize.
+ * */
+
+void bootable_cache_init(struct bootable_cache *cache);
+
+/** Flushes the cache and releases
+ * the memory allocated by it.
+ * @param cache An initialized cache.
+ * */
+
+void bootable_cache_done(struct bootable_cache *cache);
+
+/** Assigns the stream to be cached. If a
+ * stream was already assigned, it is flushed
+ * first.
+ * @param cache An initialized cache.
+ * @param backend The stream to cache. It has to
+ * report its size.
+ * @param block_size The number of bytes in a block.
+ * This has to be a power of two. If it is zero, then
+ * @ref BOOTABLE_CACHE_BLOCK_SIZE is used.
+ * @param block_count The number of blocks to hold.
+ * If this is zero, then @ref BOOTABLE_CACHE_BLOCK_COUNT
+ * is used.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_cache_setup(struct bootable_cache *cache,
+                         struct bootable_stream *backend,
+                         bootable_uint64 block_size,
+                         bootable_uint64 block_count);
+
+/** Writes all modified blocks to the backing
+ * stream. Modified blocks that are adjacent
+ * are written with a single call.
+ * @param cache An initialized cache.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_cache_flush(struct bootable_cache *cache);
+
+/** Flushes the cache and then discards all blocks,
+ * so that the next reads come from the backing stream.
+ * This should be called if the backing stream was
+ * modified without going through the cache.
+ * @param cache An initialized cache.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_cache_invalidate(struct bootable_cache *cache);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_CACHE_H */
@@ -0,0 +1,96 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file crc32.h API related to CRC32 checksums.
+ * */
+
+#ifndef BOOTABLE_CRC32_H
+#define BOOTABLE_CRC32_H
+
+#include <bootable/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Enumerates the implementations
+ * of the checksum calculation.
+ * */
+
+enum bootable_crc32_kernel {
+	/** Processes one bit at a time.
+	 * This works everywhere and is
+	 * used as the reference. */
+	BOOTABLE_CRC32_PORTABLE,
+	/** Processes sixteen bytes at a
+	 * time with lookup tables. */
+	BOOTABLE_CRC32_SLICE16,
+	/** Folds sixty-four bytes at a time with
+	 * carry-less multiplication. This needs an
+	 * x86_64 processor with PCLMULQDQ and SSE4.1. */
+	BOOTABLE_CRC32_PCLMUL
+};
+
+/** Calculates the CRC32 checksum of a buffer,
+ * as used by GPT, with the polynomial 0x04C11DB7.
+ * @param buf The buffer to calculate the checksum of.
+ * @param buf_size The number of bytes in the buffer.
+ * @returns The checksum of the buffer.
+ * */
+
+bootable_uint32 bootable_crc32(const void *buf, bootable_uint64 buf_size);
+
+/** Continues a checksum calculation with more data.
+ * Calculating the checksum of two buffers in a row is
+ * the same as calculating the checksum of both at once.
+ * @param crc The checksum of the data before the
+ * buffer. This is zero for the first buffer.
+ * @param buf The buffer to add to the checksum.
+ * @param buf_size The number of bytes in the buffer.
+ * @returns The checksum including the buffer.
+ * */
+
+bootable_uint32 bootable_crc32_update(bootable_uint32 crc,
+                                      const void *buf,
+                                      bootable_uint64 buf_size);
+
+/** Gets the implementation that is used by
+ * @ref bootable_crc32_update. Unless it was set
+ * explicitly, this is the fastest implementation
+ * that the processor supports.
+ * @returns The implementation in use.
+ * */
+
+enum bootable_crc32_kernel bootable_crc32_get_kernel(void);
+
+/** Selects the implementation used by
+ * @ref bootable_crc32_update. This is meant
+ * for testing and benchmarks.
+ * @param kernel The implementation to use.
+ * @returns Zero on success. If the processor does
+ * not support the implementation, then @ref BOOTABLE_ENOSYS
+ * is returned and the implementation is not changed.
+ * */
+
+int bootable_crc32_set_kernel(enum bootable_crc32_kernel kernel);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_CRC32_H */
@@ -27,7 +27,9 @@
 extern "C" {
 #endif
 
+struct bootable_arena;
 struct bootable_file;
+struct bootable_file_source;
 struct bootable_stream;
 
 /** A directory in a Pure64 image.
@@ -46,8 +48,77 @@ struct bootable_dir {
 	struct bootable_dir *subdirs;
 	/** The files in the directory. */
 	struct bootable_file *files;
+	/** The number of subdirectories that fit
+	 * in the subdirectory array. */
+	bootable_uint64 subdir_capacity;
+	/** The number of files that fit
+	 * in the file array. */
+	bootable_uint64 file_capacity;
+	/** An open addressing hash table of the names
+	 * of the children. A slot is zero if it is empty.
+	 * Otherwise, it holds the array index of the child
+	 * plus one, shifted left by one bit, and the lowest
+	 * bit is set for subdirectories. The table is built
+	 * when the first name is looked up. */
+	bootable_uint64 *child_index;
+	/** The number of slots in the hash table.
+	 * This is zero until the table is built. */
+	bootable_uint64 child_index_size;
+	/** If this is not null, the memory of the directory
+	 * and of everything in it comes from this arena.
+	 * Children inherit the arena when they are added.
+	 * In that case, @ref bootable_dir_free does not
+	 * release anything, since the arena owns the memory. */
+	struct bootable_arena *arena;
 };
 
+/** The number of directories that a walk can be
+ * inside of before its stack is moved to the heap.
+ * */
+
+#define BOOTABLE_DIR_WALK_DEPTH 32
+
+/** The functions that are called while a
+ * directory tree is walked by @ref bootable_dir_walk.
+ * Either function may be null. If a function returns
+ * a non-zero value, the walk stops and that value
+ * is returned by @ref bootable_dir_walk.
+ * */
+
+struct bootable_dir_visitor {
+	/** Passed to the functions of the visitor. */
+	void *data;
+	/** Called for a directory before its subdirectories
+	 * are visited. The subdirectories of the directory may
+	 * be changed by this function, since they are only
+	 * read after it returns. The depth of the directory
+	 * that the walk starts at is zero. */
+	int (*enter)(void *data, struct bootable_dir *dir, bootable_uint64 depth);
+	/** Called for a directory after its subdirectories
+	 * have been visited. This function may release the
+	 * subdirectories, but not the directory itself. */
+	int (*leave)(void *data, struct bootable_dir *dir, bootable_uint64 depth);
+};
+
+/** Initializes a directory visitor
+ * so that it does nothing.
+ * @param visitor The visitor to initialize.
+ * */
+
+void bootable_dir_visitor_init(struct bootable_dir_visitor *visitor);
+
+/** Visits a directory and all of its subdirectories,
+ * in depth-first order. The stack of the walk is kept
+ * in a small array and moved to the heap for deep trees,
+ * so that deep trees can not use up the call stack.
+ * @param dir The directory to start at.
+ * @param visitor The functions to call for each directory.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_dir_walk(struct bootable_dir *dir,
+                      const struct bootable_dir_visitor *visitor);
+
 /** Initializes a directory structure.
  * @param dir An uninitialized directory structure.
  * */
@@ -76,6 +147,20 @@ int bootable_dir_export(struct bootable_dir *dir, struct bootable_stream *out);
 
 int bootable_dir_import(struct bootable_dir *dir, struct bootable_stream *in);
 
+/** Deserializes a directory from a stream, without
+ * reading the data of the files in it. See @ref
+ * bootable_file_import_lazy for details.
+ * @param dir An initialized directory structure.
+ * @param in The stream to read the directory from.
+ * @param source Where the file data is read from later.
+ * If this is null, the file data is read right away.
+ * @returns Zero on success, non-zero on failure.
+ * */
+
+int bootable_dir_import_lazy(struct bootable_dir *dir,
+                             struct bootable_stream *in,
+                             struct bootable_file_source *source);
+
 /** Adds a file to the directory.
  * This function will fail if the name of the file exists.
  * @param dir An initialized directory structure.
@@ -94,6 +179,30 @@ int bootable_dir_add_file(struct bootable_dir *dir, const char *name);
 
 int bootable_dir_add_subdir(struct bootable_dir *dir, const char *name);
 
+/** Adds a file to the directory, with a name
+ * that does not have to be null-terminated.
+ * @param dir An initialized directory structure.
+ * @param name The characters of the file name.
+ * @param name_size The number of characters in the name.
+ * @returns Zero on success, non-zero on failure.
+ * */
+
+int bootable_dir_add_file_n(struct bootable_dir *dir,
+                            const char *name,
+                            bootable_uint64 name_size);
+
+/** Adds a subdirectory to the directory, with a
+ * name that does not have to be null-terminated.
+ * @param dir An initialized directory structure.
+ * @param name The characters of the subdirectory name.
+ * @param name_size The number of characters in the name.
+ * @returns Zero on success, non-zero on failure.
+ * */
+
+int bootable_dir_add_subdir_n(struct bootable_dir *dir,
+                              const char *name,
+                              bootable_uint64 name_size);
+
 /** Checks if a name exists in the directory as either a
  * file or a directory.
  * @param dir An initialized directory.
@@ -101,7 +210,51 @@ int bootable_dir_add_subdir(struct bootable_dir *dir, const char *name);
  * @returns True if the name is found, false if it is not.
  * */
 
-bootable_bool bootable_dir_name_exists(const struct bootable_dir *dir, const char *name);
+bootable_bool bootable_dir_name_exists(struct bootable_dir *dir, const char *name);
+
+/** Finds a file in the directory.
+ * @param dir An initialized directory.
+ * @param name The name of the file.
+ * @returns The file, if it is found.
+ * Otherwise, a null pointer is returned.
+ * */
+
+struct bootable_file *bootable_dir_find_file(struct bootable_dir *dir, const char *name);
+
+/** Finds a subdirectory in the directory.
+ * @param dir An initialized directory.
+ * @param name The name of the subdirectory.
+ * @returns The subdirectory, if it is found.
+ * Otherwise, a null pointer is returned.
+ * */
+
+struct bootable_dir *bootable_dir_find_subdir(struct bootable_dir *dir, const char *name);
+
+/** Finds a file in the directory, by a name
+ * that does not have to be null-terminated.
+ * @param dir An initialized directory.
+ * @param name The characters of the file name.
+ * @param name_size The number of characters in the name.
+ * @returns The file, if it is found.
+ * Otherwise, a null pointer is returned.
+ * */
+
+struct bootable_file *bootable_dir_find_file_n(struct bootable_dir *dir,
+                                               const char *name,
+                                               bootable_uint64 name_size);
+
+/** Finds a subdirectory in the directory, by a
+ * name that does not have to be null-terminated.
+ * @param dir An initialized directory.
+ * @param name The characters of the subdirectory name.
+ * @param name_size The number of characters in the name.
+ * @returns The subdirectory, if it is found.
+ * Otherwise, a null pointer is returned.
+ * */
+
+struct bootable_dir *bootable_dir_find_subdir_n(struct bootable_dir *dir,
+                                                const char *name,
+                                                bootable_uint64 name_size);
 
 /** Sets the name of the directory.
  * @param dir An initialized directory.
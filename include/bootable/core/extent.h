@@ -0,0 +1,154 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file extent.h API related to tracking free space.
+ * */
+
+#ifndef BOOTABLE_EXTENT_H
+#define BOOTABLE_EXTENT_H
+
+#include <bootable/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Enumerates the ways that space
+ * can be chosen for an allocation.
+ * */
+
+enum bootable_placement {
+	/** Use the free extent with the
+	 * lowest address that fits. */
+	BOOTABLE_PLACEMENT_FIRST_FIT,
+	/** Use the smallest free extent that
+	 * fits, to keep large extents intact. */
+	BOOTABLE_PLACEMENT_BEST_FIT
+};
+
+/** A range of free units. An extent is kept in
+ * two trees at once: one ordered by address, used
+ * to merge neighbors and for first-fit placement,
+ * and one ordered by length, used for best-fit
+ * placement. Both trees are treaps.
+ * */
+
+struct bootable_extent {
+	/** The first unit of the extent. */
+	bootable_uint64 first;
+	/** The number of units in the extent. */
+	bootable_uint64 count;
+	/** The largest count found in the subtree
+	 * of this extent, in the address tree. */
+	bootable_uint64 max_count;
+	/** The heap priority of the extent. */
+	bootable_uint32 priority;
+	/** The children in the address tree. */
+	struct bootable_extent *addr_child[2];
+	/** The children in the length tree. */
+	struct bootable_extent *size_child[2];
+};
+
+/** Tracks the free units of a range, such as the
+ * sectors of a disk that are not used by partitions.
+ * Allocating and freeing take logarithmic time in the
+ * number of free extents.
+ * */
+
+struct bootable_extent_map {
+	/** The root of the address tree. */
+	struct bootable_extent *addr_root;
+	/** The root of the length tree. */
+	struct bootable_extent *size_root;
+	/** The number of free extents. */
+	bootable_uint64 extent_count;
+	/** The state of the priority generator. */
+	bootable_uint32 seed;
+};
+
+/** Initializes an extent map.
+ * There are no free units at first.
+ * @param map The map to initialize.
+ * */
+
+void bootable_extent_map_init(struct bootable_extent_map *map);
+
+/** Releases the memory allocated by a map.
+ * @param map An initialized extent map.
+ * */
+
+void bootable_extent_map_done(struct bootable_extent_map *map);
+
+/** Removes all free extents from a map.
+ * @param map An initialized extent map.
+ * */
+
+void bootable_extent_map_clear(struct bootable_extent_map *map);
+
+/** Marks a range of units as free. The range
+ * is merged with free extents that it touches.
+ * @param map An initialized extent map.
+ * @param first The first unit of the range.
+ * @param count The number of units in the range.
+ * @returns Zero on success, an error code on failure.
+ * If part of the range is already free, then
+ * @ref BOOTABLE_EINVAL is returned.
+ * */
+
+int bootable_extent_map_free(struct bootable_extent_map *map,
+                             bootable_uint64 first,
+                             bootable_uint64 count);
+
+/** Marks a specific range of units as used.
+ * @param map An initialized extent map.
+ * @param first The first unit of the range.
+ * @param count The number of units in the range.
+ * @returns Zero on success, an error code on failure.
+ * If part of the range is not free, then
+ * @ref BOOTABLE_ENOSPC is returned.
+ * */
+
+int bootable_extent_map_reserve(struct bootable_extent_map *map,
+                                bootable_uint64 first,
+                                bootable_uint64 count);
+
+/** Finds free units and marks them as used.
+ * @param map An initialized extent map.
+ * @param count The number of units to allocate.
+ * @param alignment The first unit of the allocation
+ * is a multiple of this. Zero and one both mean that
+ * there is no alignment.
+ * @param placement How the free extent is chosen.
+ * @param first A pointer to the variable that receives
+ * the first unit of the allocation.
+ * @returns Zero on success, an error code on failure.
+ * If no free extent fits, then @ref BOOTABLE_ENOSPC
+ * is returned.
+ * */
+
+int bootable_extent_map_allocate(struct bootable_extent_map *map,
+                                 bootable_uint64 count,
+                                 bootable_uint64 alignment,
+                                 enum bootable_placement placement,
+                                 bootable_uint64 *first);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_EXTENT_H */
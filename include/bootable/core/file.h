@@ -27,8 +27,33 @@
 extern "C" {
 #endif
 
+struct bootable_arena;
+struct bootable_file_blocks;
 struct bootable_stream;
 
+/** Describes where the data of files that
+ * were imported without their data can be found.
+ * */
+
+struct bootable_file_source {
+	/** The stream that the files were imported from.
+	 * It has to remain valid until the files are
+	 * released or their data is loaded. */
+	struct bootable_stream *stream;
+	/** The number of bytes that @ref bootable_file_read
+	 * may still keep in memory. When a file is read and
+	 * its data fits in this budget, all of its data is
+	 * loaded so that later reads do not go to the stream.
+	 * If this is zero, every read goes to the stream. */
+	bootable_uint64 cache_budget;
+	/** A file descriptor of the host, with the same
+	 * contents as @ref stream. If this is not negative,
+	 * data that is exported is copied from it with
+	 * @ref bootable_stream_copy_from_fd, so that the
+	 * host can copy it without buffering it. */
+	int fd;
+};
+
 /** A Pure64 file.
  * */
 
@@ -41,6 +66,35 @@ struct bootable_file {
 	char *name;
 	/** The file data. */
 	void *data;
+	/** If this is not null, the name and data are
+	 * allocated from this arena and are released with
+	 * it, instead of with @ref bootable_file_free. Files
+	 * in a file system use the arena of the file system. */
+	struct bootable_arena *arena;
+	/** If the data has not been loaded yet, this
+	 * describes where it is. In that case, @ref
+	 * bootable_file::data is null. Once the data
+	 * is loaded, this is set to null. */
+	struct bootable_file_source *source;
+	/** The position of the data in the source
+	 * stream, if the data has not been loaded yet. */
+	bootable_uint64 data_offset;
+	/** A hash of the data in the source. This is only
+	 * used while the data has not been loaded, so that
+	 * the data does not have to be read to find files
+	 * with the same contents. See @ref bootable_file_hash. */
+	bootable_uint64 data_hash;
+	/** Whether or not @ref bootable_file::data_hash is known. */
+	bootable_bool data_hash_valid;
+	/** Whether or not the data is compressed when the
+	 * file is exported to the second version of the file
+	 * system. The first version does not support this. */
+	bootable_bool compress;
+	/** If the data has not been loaded and it is
+	 * compressed in the source stream, this is the
+	 * index of its blocks. Reads only decompress the
+	 * blocks that they need. Otherwise, this is null. */
+	struct bootable_file_blocks *blocks;
 };
 
 /** Initializes a file structure.
@@ -63,6 +117,39 @@ void bootable_file_free(struct bootable_file *file);
 
 int bootable_file_export(struct bootable_file *file, struct bootable_stream *out);
 
+/** Writes only the data of a file to a stream,
+ * at the current position of the stream. If the
+ * data has not been loaded and the stream already
+ * contains it at that position, then it is skipped.
+ * @param file An initialized file structure.
+ * @param out The stream to write the data to.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_file_export_data(struct bootable_file *file, struct bootable_stream *out);
+
+/** Writes the data of a file as it is stored, at the
+ * current position of a stream. This is the same as
+ * @ref bootable_file_export_data, except that data which
+ * has not been loaded and is compressed in the source
+ * stream is copied without being decompressed.
+ * @param file An initialized file structure.
+ * @param out The stream to write the data to.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_file_export_stored(struct bootable_file *file, struct bootable_stream *out);
+
+/** Gets the number of bytes that the data of
+ * a file takes up where it is stored. This is
+ * only different from @ref bootable_file::data_size
+ * if the data is compressed in the source stream.
+ * @param file An initialized file structure.
+ * @returns The number of bytes of stored data.
+ * */
+
+bootable_uint64 bootable_file_stored_size(const struct bootable_file *file);
+
 /** Deserializes a file from a stream.
  * @param file An initialized file structure.
  * @param in The stream to read the file from.
@@ -71,6 +158,23 @@ int bootable_file_export(struct bootable_file *file, struct bootable_stream *out
 
 int bootable_file_import(struct bootable_file *file, struct bootable_stream *in);
 
+/** Deserializes a file from a stream, without
+ * reading its data. The position of the data is
+ * recorded instead, and the data is read from the
+ * stream when it is needed.
+ * @param file An initialized file structure.
+ * @param in The stream to read the file from.
+ * @param source Where the data is read from later.
+ * The stream of the source is normally @p in. If this
+ * is null, the data is read right away, like in @ref
+ * bootable_file_import.
+ * @returns Zero on success, non-zero on failure.
+ * */
+
+int bootable_file_import_lazy(struct bootable_file *file,
+                              struct bootable_stream *in,
+                              struct bootable_file_source *source);
+
 /** Sets the name of the file.
  * @param file An initialized file structure.
  * @param name The new name of the file.
@@ -79,6 +183,56 @@ int bootable_file_import(struct bootable_file *file, struct bootable_stream *in)
 
 int bootable_file_set_name(struct bootable_file *file, const char *name);
 
+/** Changes the size of the file data.
+ * The data that fits in the new size is kept.
+ * If the file grows, the new bytes are not initialized.
+ * Use this instead of allocating the data directly,
+ * so that the data comes from the right allocator.
+ * @param file An initialized file structure.
+ * @param data_size The new size of the file data.
+ * @returns Zero on success, non-zero on failure.
+ * */
+
+int bootable_file_resize(struct bootable_file *file, bootable_uint64 data_size);
+
+/** Reads part of the file data. If the data has not
+ * been loaded, it is read from the stream it was imported
+ * from, or loaded if it fits in the cache budget. If it is
+ * compressed there, only the blocks that contain the range
+ * are decompressed.
+ * @param file An initialized file structure.
+ * @param offset The position within the file to read from.
+ * @param buf The buffer to put the data in.
+ * @param size The number of bytes to read.
+ * @returns Zero on success, non-zero on failure. If the
+ * range is not within the file, @ref BOOTABLE_EINVAL is returned.
+ * */
+
+int bootable_file_read(struct bootable_file *file,
+                       bootable_uint64 offset,
+                       void *buf,
+                       bootable_uint64 size);
+
+/** Loads the file data into memory, if it has not
+ * been loaded yet. Afterwards, @ref bootable_file::data
+ * may be accessed directly.
+ * @param file An initialized file structure.
+ * @returns Zero on success, non-zero on failure.
+ * */
+
+int bootable_file_load(struct bootable_file *file);
+
+/** Computes a hash of the data of a file. Files with
+ * the same contents have the same hash. If the data has
+ * not been loaded, the hash is kept in the file, so that
+ * the data is only read once.
+ * @param file An initialized file structure.
+ * @param hash Assigned the hash of the data.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_file_hash(struct bootable_file *file, bootable_uint64 *hash);
+
 #ifdef __cplusplus
 } /* extern "C" { */
 #endif
@@ -21,7 +21,9 @@
 #ifndef BOOTABLE_FS_H
 #define BOOTABLE_FS_H
 
+#include <bootable/core/arena.h>
 #include <bootable/core/dir.h>
+#include <bootable/core/file.h>
 
 /** The correct value of a Pure64 file
  * system signature. This is a hexidecimal
@@ -30,6 +32,64 @@
 
 #define BOOTABLE_SIGNATURE 0x5346343665727550ULL
 
+/** The signature of the second version of the
+ * Pure64 file system. This is a hexidecimal version
+ * of the string "Pure64F2". This version starts with
+ * a table of every directory and file, so that a file
+ * can be found without reading the whole file system.
+ * */
+
+#define BOOTABLE_SIGNATURE_V2 0x3246343665727550ULL
+
+/** The number of bytes in the header of
+ * the second version of the file system. */
+
+#define BOOTABLE_FS_HEADER_SIZE 64
+
+/** The number of bytes in an entry of the node
+ * table of the second version of the file system. */
+
+#define BOOTABLE_FS_NODE_SIZE 32
+
+/** The alignment, in bytes, of the file data in
+ * the second version of the file system. Each file
+ * starts on a sector, relative to the file system. */
+
+#define BOOTABLE_FS_DATA_ALIGNMENT 512
+
+/** Set in @ref bootable_fs_node::flags
+ * when the node is a directory. */
+
+#define BOOTABLE_FS_NODE_DIR 0x01
+
+/** Set in @ref bootable_fs_node::flags when the
+ * data of a file is compressed. The data then starts
+ * with a @ref bootable_fs_blocks header, which is
+ * followed by the stored size of each block, as a
+ * 32-bit integer, and then by the blocks. Each block
+ * is compressed on its own, so that part of a file
+ * can be read without decompressing all of it.
+ * */
+
+#define BOOTABLE_FS_NODE_COMPRESSED 0x02
+
+/** The number of bytes of file data that
+ * are compressed together, when files are
+ * compressed by this library. */
+
+#define BOOTABLE_FS_BLOCK_SIZE 0x10000
+
+/** The number of bytes in the header
+ * of the data of a compressed file. */
+
+#define BOOTABLE_FS_BLOCKS_HEADER_SIZE 16
+
+/** Set in the stored size of a block when
+ * the block did not get smaller when it was
+ * compressed, and is stored as it is. */
+
+#define BOOTABLE_FS_BLOCK_RAW 0x80000000U
+
 /** The sector that contains the file
  * system used by Pure64.
  * */
@@ -43,6 +103,118 @@ extern "C" {
 struct bootable_file;
 struct bootable_stream;
 
+/** The header of the second version of the file
+ * system. All offsets are relative to the start of
+ * the file system, which is where the header is.
+ * */
+
+struct bootable_fs_header {
+	/** Equal to @ref BOOTABLE_SIGNATURE_V2. */
+	bootable_uint64 signature;
+	/** The number of bytes in the file system,
+	 * up to the end of the last file. */
+	bootable_uint64 size;
+	/** The number of entries in the node table. */
+	bootable_uint64 node_count;
+	/** The offset of the node table. */
+	bootable_uint64 node_offset;
+	/** The offset of the names of the nodes. */
+	bootable_uint64 name_offset;
+	/** The number of bytes of names. */
+	bootable_uint64 name_size;
+	/** The offset of the first file data. */
+	bootable_uint64 data_offset;
+	/** The offset of a table with a 64-bit hash of the
+	 * data of each node, in the order of the node table.
+	 * The hashes of directories are zero. This table is
+	 * only used to find files with the same contents, and
+	 * it is optional. If there is none, this is zero. */
+	bootable_uint64 hash_offset;
+};
+
+/** An entry in the node table of the second version
+ * of the file system. The first node is the root
+ * directory. The children of a directory are next to
+ * each other in the table and are sorted by name, so
+ * that they can be searched with a binary search. Names
+ * are compared byte by byte, and a name that is the start
+ * of another name comes first.
+ * */
+
+struct bootable_fs_node {
+	/** The offset of the name, relative
+	 * to the start of the name table. */
+	bootable_uint32 name_offset;
+	/** The number of bytes in the name. */
+	bootable_uint32 name_size;
+	/** A combination of @ref BOOTABLE_FS_NODE_DIR
+	 * and @ref BOOTABLE_FS_NODE_COMPRESSED. */
+	bootable_uint32 flags;
+	/** For a directory, the index of the first
+	 * child. For a file, the offset of the data.
+	 * Files with the same contents may share their data. */
+	bootable_uint64 first;
+	/** For a directory, the number of children.
+	 * For a file, the number of bytes of data, as
+	 * it is stored. */
+	bootable_uint64 count;
+};
+
+/** The header of the data of a compressed file.
+ * See @ref BOOTABLE_FS_NODE_COMPRESSED.
+ * */
+
+struct bootable_fs_blocks {
+	/** The number of bytes in the file,
+	 * once it is decompressed. */
+	bootable_uint64 data_size;
+	/** The number of bytes in each block,
+	 * once it is decompressed. The last
+	 * block may be smaller. */
+	bootable_uint32 block_size;
+	/** The number of blocks. */
+	bootable_uint32 block_count;
+};
+
+/** A directory that was found by its path.
+ * These are kept by the file system so that
+ * paths that share a parent directory do not
+ * each have to be resolved from the root.
+ * */
+
+struct bootable_dentry {
+	/** The hash of the normalized path. */
+	bootable_uint64 hash;
+	/** The normalized path, without a leading
+	 * separator and with the names separated by
+	 * '/'. If the entry is empty, this is null. */
+	char *path;
+	/** The number of characters in the path. */
+	bootable_uint64 path_size;
+	/** The directory that the path leads to. */
+	struct bootable_dir *dir;
+};
+
+/** Statistics about the files in a file system.
+ * */
+
+struct bootable_fs_stats {
+	/** The number of directories, including the root. */
+	bootable_uint64 dir_count;
+	/** The number of files. */
+	bootable_uint64 file_count;
+	/** The number of bytes of file data. */
+	bootable_uint64 data_size;
+	/** The number of bytes of file data that the
+	 * file system stores. The second version of the
+	 * file system counts files that have the same contents
+	 * only once, while the first one stores every copy and
+	 * this equals @ref bootable_fs_stats::data_size. The
+	 * difference between the two is the amount of space
+	 * saved by sharing the data. */
+	bootable_uint64 unique_data_size;
+};
+
 /** Pure64 file system.
  * Used for storing kernels and
  * various files that assist in
@@ -51,16 +223,41 @@ struct bootable_stream;
  * */
 
 struct bootable_fs {
-	/** File system signature (see @ref BOOTABLE_SIGNATURE). */
+	/** File system signature (see @ref BOOTABLE_SIGNATURE).
+	 * This is set when the file system is imported, and it
+	 * chooses the version that the file system is exported
+	 * as. It may be set to @ref BOOTABLE_SIGNATURE_V2 before
+	 * the file system is exported. */
 	bootable_uint64 signature;
 	/** The number of bytes occupied by the file system. This
 	 * is useful for determining the amount of memory needed
 	 * to load the file system. This value is calculed only
 	 * when the file system is exported. */
 	bootable_uint64 size;
+	/** The memory of every directory and file
+	 * in the file system, including their names
+	 * and data. Since the root directory points
+	 * to this arena, the file system structure
+	 * must not be moved after it is initialized. */
+	struct bootable_arena arena;
 	/** The root directory of the
 	 * file system. */
 	struct bootable_dir root;
+	/** Where the data of the files is read from,
+	 * if the file system was imported with @ref
+	 * bootable_fs_import_lazy. */
+	struct bootable_file_source source;
+	/** An open addressing hash table of directories
+	 * that have been resolved by their path. The table
+	 * is emptied whenever a directory array moves in memory.
+	 * It only tracks changes made through the functions in
+	 * this file, so directories must be added with @ref
+	 * bootable_fs_make_dir and not by modifying the tree. */
+	struct bootable_dentry *dentries;
+	/** The number of slots in the directory entry table. */
+	bootable_uint64 dentry_table_size;
+	/** The number of directories in the directory entry table. */
+	bootable_uint64 dentry_count;
 };
 
 /** Initializes a file system structure.
@@ -92,6 +289,25 @@ int bootable_fs_export(struct bootable_fs *fs, struct bootable_stream *out);
 
 int bootable_fs_import(struct bootable_fs *fs, struct bootable_stream *in);
 
+/** Imports the file system from a stream, without
+ * reading the file data. Only the names and positions
+ * of the files are kept in memory, and the data is read
+ * when it is accessed with @ref bootable_file_read.
+ * The stream has to remain valid for as long as the
+ * file system is used. The file system can be exported
+ * back to the same stream. In that case, the data is
+ * moved within the stream instead of being loaded.
+ * @param fs An initialized file system structure.
+ * @param in The stream to import the file system from.
+ * @param cache_size The number of bytes of file data that
+ * may be kept in memory after being read. This may be zero.
+ * @returns Zero on success, non-zero on failure.
+ * */
+
+int bootable_fs_import_lazy(struct bootable_fs *fs,
+                            struct bootable_stream *in,
+                            bootable_uint64 cache_size);
+
 /** Creates a file in the file system.
  * @param fs An initialized file system structure.
  * @param path The path of the file to create.
@@ -124,6 +340,84 @@ struct bootable_file *bootable_fs_open_file(struct bootable_fs *fs, const char *
 
 struct bootable_dir *bootable_fs_open_dir(struct bootable_fs *fs, const char *path);
 
+/** Finds a file or directory, starting at a
+ * certain directory instead of the root directory.
+ * This does not use the directory entry table of the
+ * file system, so it can be used with a directory that
+ * was returned by @ref bootable_fs_open_dir to avoid
+ * resolving the same leading directories many times.
+ * @param dir The directory to start at.
+ * @param path The path of the entry, relative to @p dir.
+ * A ".." at the start of the path refers to @p dir itself.
+ * If the path has no names in it, @p dir is the result.
+ * @param subdir If the entry is a directory, it is assigned
+ * to this pointer. Otherwise, it is set to null. This parameter
+ * may be null if the caller is not looking for a directory.
+ * @param file If the entry is a file, it is assigned to this
+ * pointer. Otherwise, it is set to null. This parameter may
+ * be null if the caller is not looking for a file.
+ * @returns Zero on success, an error code on failure.
+ * If there is no entry at the path, or the entry is not
+ * one of the types that the caller asked for, then
+ * @ref BOOTABLE_ENOENT is returned.
+ * */
+
+int bootable_fs_lookup_at(struct bootable_dir *dir,
+                          const char *path,
+                          struct bootable_dir **subdir,
+                          struct bootable_file **file);
+
+/** Visits every directory in the file system, starting
+ * at the root directory. See @ref bootable_dir_walk.
+ * Entries must not be added with the functions in this
+ * file while the walk is in progress, since that can move
+ * the directories that the walk is inside of.
+ * @param fs An initialized file system structure.
+ * @param visitor The functions to call for each directory.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_fs_walk(struct bootable_fs *fs,
+                     const struct bootable_dir_visitor *visitor);
+
+/** Counts the directories and files in a file system,
+ * and how much of the file data is shared by files that
+ * have the same contents. Files that have not been loaded
+ * are read to compute their hash, unless it is already known.
+ * @param fs An initialized file system structure.
+ * @param stats Assigned the statistics of the file system.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_fs_stats(struct bootable_fs *fs, struct bootable_fs_stats *stats);
+
+/** Finds the data of a file in the second version of
+ * the file system, without importing the file system.
+ * Only the header, the nodes along the path and the
+ * names that are compared are read, so this is meant
+ * for loaders that have to read as little as possible.
+ * @param stream The stream that contains the file system,
+ * with the file system starting at offset zero.
+ * @param path The path of the file.
+ * @param offset Assigned the offset of the file data,
+ * relative to the start of the file system.
+ * @param size Assigned the number of bytes of file data,
+ * as it is stored.
+ * @param flags Assigned the flags of the file. If @ref
+ * BOOTABLE_FS_NODE_COMPRESSED is set, the data has to be
+ * decompressed with @ref bootable_lz4_decompress before
+ * it is used.
+ * @returns Zero on success, an error code on failure.
+ * If the stream does not contain the second version of
+ * the file system, then @ref BOOTABLE_EINVAL is returned.
+ * */
+
+int bootable_fs_locate(struct bootable_stream *stream,
+                       const char *path,
+                       bootable_uint64 *offset,
+                       bootable_uint64 *size,
+                       bootable_uint32 *flags);
+
 #ifdef __cplusplus
 } /* extern "C" { */
 #endif
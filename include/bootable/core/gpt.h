@@ -21,6 +21,7 @@
 #ifndef BOOTABLE_GPT_H
 #define BOOTABLE_GPT_H
 
+#include <bootable/core/extent.h>
 #include <bootable/core/uuid.h>
 
 #ifndef BOOTABLE_GPT_INVALID_LBA
@@ -53,6 +54,17 @@
 
 #endif
 
+#ifndef BOOTABLE_GPT_NO_ENTRY
+
+/** This value is used in place of an entry
+ * index, where there is no entry to refer to.
+ * @ingroup core-api
+ * */
+
+#define BOOTABLE_GPT_NO_ENTRY 0xffffffff
+
+#endif
+
 #ifndef BOOTABLE_GPT_MINIMUM_SIZE
 
 /** This value is the size, in bytes,
@@ -231,20 +243,70 @@ int bootable_gpt_entry_export(const struct bootable_gpt_entry *entry, struct boo
 
 int bootable_gpt_entry_import(struct bootable_gpt_entry *entry, struct bootable_stream *stream);
 
+/** A hash index of partition entries.
+ * Each bucket is a doubly linked list of
+ * entries, so that entries can be added and
+ * removed in constant time. This should only
+ * be used within the library.
+ * @ingroup core-api
+ * */
+
+struct bootable_gpt_index {
+	/** The first entry of each bucket. */
+	bootable_uint32 *buckets;
+	/** The number of buckets. This
+	 * is always a power of two. */
+	bootable_uint32 bucket_count;
+	/** The next entry in the bucket of each entry. */
+	bootable_uint32 *next;
+	/** The previous entry in the bucket of each entry. */
+	bootable_uint32 *prev;
+	/** The hash of each entry, from when
+	 * it was added to the index. */
+	bootable_uint32 *hashes;
+};
+
 /** This structure represents a
  * GUID partition table.
  * @ingroup core-api
  * */
 
 struct bootable_gpt {
-	/** The primary GPT header. */
-	struct bootable_gpt_header primary_header;
-	/** The backup GPT header. */
-	struct bootable_gpt_header backup_header;
-	/** The primary array of partition entries. */
-	struct bootable_gpt_entry *primary_entries;
-	/** The backup array of partition entries. */
-	struct bootable_gpt_entry *backup_entries;
+	/** The primary GPT header. The backup
+	 * header is made from this one when the
+	 * table is exported. */
+	struct bootable_gpt_header header;
+	/** The partition entries. The same array is
+	 * exported as both the primary and the backup
+	 * entry array. */
+	struct bootable_gpt_entry *entries;
+	/** The number of entries in each entry array.
+	 * When the table is formatted, this is the
+	 * number of entries that are reserved. */
+	bootable_uint32 entry_count;
+	/** The entry array as it was imported. While
+	 * this is set, entries are decoded from it when
+	 * they are first accessed. It is released once
+	 * the table is searched or changed. */
+	unsigned char *raw_entries;
+	/** A bitmap of the entries that have been
+	 * decoded from the imported entry array. */
+	bootable_uint64 *decoded_entries;
+	/** A bitmap of the entry slots that are in use.
+	 * A slot is in use once the entry has been given
+	 * a type, a name or space on the disk. */
+	bootable_uint64 *used_slots;
+	/** Used entries, indexed by name. */
+	struct bootable_gpt_index name_index;
+	/** Used entries, indexed by type UUID. */
+	struct bootable_gpt_index type_index;
+	/** The LBAs between the first and last usable
+	 * LBA that are not used by a partition. */
+	struct bootable_extent_map free_extents;
+	/** The alignment, in bytes, of new partitions. */
+	bootable_uint64 alignment;
+	/** How space is chosen for new partitions. */
+	enum bootable_placement placement;
 };
 
 /** Initializes a GPT  structure.
@@ -303,6 +365,22 @@ bootable_uint32 bootable_gpt_alloc(struct bootable_gpt *gpt,
 int bootable_gpt_format(struct bootable_gpt *gpt,
                       bootable_uint64 disk_size);
 
+/** Sets the number of partition entries that
+ * are reserved when the table is formatted.
+ * The default is @ref BOOTABLE_GPT_ENTRY_COUNT.
+ * This has to be called before the table is
+ * formatted or imported.
+ * @param gpt An initialized GPT structure.
+ * @param entry_count The number of entries.
+ * @returns Zero on success, an error code on failure.
+ * Once the structure has a table, @ref BOOTABLE_EINVAL
+ * is returned for any count other than its own.
+ * @ingroup core-api
+ * */
+
+int bootable_gpt_set_entry_count(struct bootable_gpt *gpt,
+                                 bootable_uint32 entry_count);
+
 /** Locates the first unused entry in the partition
  * header entry array.
  * @param gpt An initialized GPT structure.
@@ -315,9 +393,71 @@ int bootable_gpt_format(struct bootable_gpt *gpt,
  * @ingroup core-api
  * */
 
-int bootable_gpt_find_unused_entry(const struct bootable_gpt *gpt,
+int bootable_gpt_find_unused_entry(struct bootable_gpt *gpt,
                                  bootable_uint32 *entry_index);
 
+/** Finds a used entry by its name.
+ * @param gpt An initialized GPT structure.
+ * @param name The name, as UTF-16, to look for.
+ * @param entry_index A pointer to the variable that
+ * receives the index of the entry.
+ * @returns Zero if the entry is found. If it is
+ * not, then @ref BOOTABLE_ENOENT is returned.
+ * @ingroup core-api
+ * */
+
+int bootable_gpt_find_entry_by_name(struct bootable_gpt *gpt,
+                                    const bootable_uint16 *name,
+                                    bootable_uint32 *entry_index);
+
+/** Finds a used entry by its name,
+ * using UTF-8 encoding.
+ * @param gpt An initialized GPT structure.
+ * @param name The name, as UTF-8, to look for.
+ * @param entry_index A pointer to the variable that
+ * receives the index of the entry.
+ * @returns Zero if the entry is found. If it is
+ * not, then @ref BOOTABLE_ENOENT is returned. If the
+ * name is not valid UTF-8, @ref BOOTABLE_EINVAL is returned.
+ * @ingroup core-api
+ * */
+
+int bootable_gpt_find_entry_by_name_utf8(struct bootable_gpt *gpt,
+                                         const char *name,
+                                         bootable_uint32 *entry_index);
+
+/** Finds a used entry of a certain type.
+ * If there are several entries of the type,
+ * the rest can be found with @ref
+ * bootable_gpt_find_next_entry_by_type.
+ * @param gpt An initialized GPT structure.
+ * @param type_uuid The UUID string of the type.
+ * @param entry_index A pointer to the variable that
+ * receives the index of the entry.
+ * @returns Zero if an entry is found. If none
+ * is, then @ref BOOTABLE_ENOENT is returned.
+ * @ingroup core-api
+ * */
+
+int bootable_gpt_find_entry_by_type(struct bootable_gpt *gpt,
+                                    const char *type_uuid,
+                                    bootable_uint32 *entry_index);
+
+/** Finds the next used entry of a certain type.
+ * @param gpt An initialized GPT structure.
+ * @param type_uuid The UUID string of the type.
+ * @param entry_index On input, an entry that was found
+ * by the last search for this type. On output, the next
+ * entry of that type.
+ * @returns Zero if an entry is found. If there are
+ * no more, then @ref BOOTABLE_ENOENT is returned.
+ * @ingroup core-api
+ * */
+
+int bootable_gpt_find_next_entry_by_type(struct bootable_gpt *gpt,
+                                         const char *type_uuid,
+                                         bootable_uint32 *entry_index);
+
 /** Gets the offset, in bytes, of a partition described
  * in the partition table.
  * @param gpt An initialized GPT structure.
@@ -328,7 +468,7 @@ int bootable_gpt_find_unused_entry(const struct bootable_gpt *gpt,
  * @ingroup core-api
  * */
 
-int bootable_gpt_get_partition_offset(const struct bootable_gpt *gpt,
+int bootable_gpt_get_partition_offset(struct bootable_gpt *gpt,
                                     bootable_uint32 entry_index,
                                     bootable_uint64 *offset);
 
@@ -342,22 +482,47 @@ int bootable_gpt_get_partition_offset(const struct bootable_gpt *gpt,
  * @ingroup core-api
  * */
 
-int bootable_gpt_get_partition_size(const struct bootable_gpt *gpt,
+int bootable_gpt_get_partition_size(struct bootable_gpt *gpt,
                                   bootable_uint32 entry_index,
                                   bootable_uint64 *size);
 
-/** Import GPT data from a stream.
+/** Import GPT data from a stream. The header and
+ * the entry array are each read with one call, and
+ * their checksums are checked. The backup table is
+ * only read if the primary table is damaged. Entries
+ * are decoded when they are first accessed.
  * @param gpt The GPT structure to hold the data.
  * @param stream The stream to read the GPT data from.
  * @returns Zero on success, an error
- * code on failure.
+ * code on failure. If neither table is
+ * valid, then @ref BOOTABLE_EINVAL is returned.
  * @ingroup core-api
  * */
 
 int bootable_gpt_import(struct bootable_gpt *gpt,
                       struct bootable_stream *stream);
 
-/** Export GPT data to a stream.
+/** Import GPT data from a stream, checking both
+ * the primary and the backup table. If one of them
+ * has a bad checksum, the other one is used. If both
+ * are valid but differ, the primary table is used.
+ * @param gpt The GPT structure to hold the data.
+ * @param stream The stream to read the GPT data from.
+ * @param repair_needed A pointer to a variable that
+ * is set if the two tables did not match. Exporting
+ * the GPT data writes both tables again.
+ * @returns Zero on success, an error code on failure.
+ * If neither table is valid, then @ref BOOTABLE_EINVAL
+ * is returned.
+ * @ingroup core-api
+ * */
+
+int bootable_gpt_import_verified(struct bootable_gpt *gpt,
+                                 struct bootable_stream *stream,
+                                 bootable_bool *repair_needed);
+
+/** Export GPT data to a stream. Both the
+ * primary and the backup table are written.
  * @param gpt The GPT structure containing
  * the data to export to the stream.
  * @param stream The stream to export the
@@ -372,6 +537,8 @@ int bootable_gpt_export(const struct bootable_gpt *gpt,
 
 /** Gets an entry structure by reference
  * of its index within the partition table.
+ * If the table was imported, only this entry
+ * is decoded.
  * @param gpt An initialized GPT structure.
  * @param index The index of the partition entry.
  * @returns A pointer to the entry is returned
@@ -380,7 +547,7 @@ int bootable_gpt_export(const struct bootable_gpt *gpt,
  * @ingroup core-api
  * */
 
-const struct bootable_gpt_entry *bootable_gpt_get_entry(const struct bootable_gpt *gpt,
+const struct bootable_gpt_entry *bootable_gpt_get_entry(struct bootable_gpt *gpt,
                                                     bootable_uint32 index);
 
 /** Sets the UUID type of the partition entry.
@@ -417,6 +584,7 @@ int bootable_gpt_set_entry_name(struct bootable_gpt *gpt,
  * @param gpt An initialized GPT structure.
  * @param entry_index The index of the entry to set the name of.
  * @param name The name, as UTF-8, to assign the entry.
+ * Names that do not fit into the entry are cut off.
  * @returns Zero on success, an error code on failure.
  * @ingroup core-api
  * */
@@ -440,6 +608,61 @@ int bootable_gpt_set_entry_size(struct bootable_gpt *gpt,
                               bootable_uint32 entry_index,
                               bootable_uint64 size);
 
+/** Sets the alignment of partitions that are
+ * allocated after this call. The default is one
+ * mebibyte. If an aligned partition does not fit
+ * on the disk, it is placed on the next free LBA.
+ * @param gpt An initialized GPT structure.
+ * @param alignment The alignment, in bytes. This
+ * must be a non-zero multiple of 512.
+ * @returns Zero on success, an error code on failure.
+ * @ingroup core-api
+ * */
+
+int bootable_gpt_set_alignment(struct bootable_gpt *gpt,
+                               bootable_uint64 alignment);
+
+/** Sets how free space is chosen for partitions
+ * that are allocated after this call. The default
+ * is @ref BOOTABLE_PLACEMENT_FIRST_FIT.
+ * @param gpt An initialized GPT structure.
+ * @param placement The placement strategy.
+ * @ingroup core-api
+ * */
+
+void bootable_gpt_set_placement(struct bootable_gpt *gpt,
+                                enum bootable_placement placement);
+
+/** Places a partition entry at a specific offset.
+ * If the entry already had space, that space is freed first.
+ * @param gpt An initialized GPT structure.
+ * @param entry_index The index of the GPT entry.
+ * @param offset The offset, in bytes, of the partition.
+ * This must be a multiple of 512.
+ * @param size The size, in bytes, that the partition
+ * should be able to fit.
+ * @returns Zero on success, an error code on failure.
+ * If the space is not free, then @ref BOOTABLE_ENOSPC
+ * is returned.
+ * @ingroup core-api
+ * */
+
+int bootable_gpt_set_entry_offset(struct bootable_gpt *gpt,
+                                  bootable_uint32 entry_index,
+                                  bootable_uint64 offset,
+                                  bootable_uint64 size);
+
+/** Removes a partition entry and
+ * frees the space that it used.
+ * @param gpt An initialized GPT structure.
+ * @param entry_index The index of the GPT entry.
+ * @returns Zero on success, an error code on failure.
+ * @ingroup core-api
+ * */
+
+int bootable_gpt_remove_entry(struct bootable_gpt *gpt,
+                              bootable_uint32 entry_index);
+
 #ifdef __cplusplus
 } /* extern "C" { */
 #endif
@@ -0,0 +1,103 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file lz4.h API related to compressing blocks of data,
+ * in the block format of LZ4.
+ * */
+
+#ifndef BOOTABLE_LZ4_H
+#define BOOTABLE_LZ4_H
+
+#include <bootable/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The largest number of bytes that can
+ * be compressed with one call to @ref
+ * bootable_lz4_compress. */
+
+#define BOOTABLE_LZ4_MAX_INPUT 0x10000
+
+/** The number of entries in the table
+ * that is used to find matches. */
+
+#define BOOTABLE_LZ4_TABLE_SIZE 4096
+
+/** The memory used while data is compressed.
+ * This is kept out of the compression function,
+ * so that it does not have to be on the stack and
+ * can be reused for many blocks.
+ * */
+
+struct bootable_lz4 {
+	/** The position of the last occurrence of
+	 * each four byte sequence, by its hash. */
+	bootable_uint16 table[BOOTABLE_LZ4_TABLE_SIZE];
+};
+
+/** Compresses a block of data. The block can be
+ * decompressed on its own, without any other block.
+ * @param lz4 The memory to use while compressing.
+ * It does not have to be initialized.
+ * @param src The data to compress.
+ * @param src_size The number of bytes to compress. This
+ * can not be more than @ref BOOTABLE_LZ4_MAX_INPUT.
+ * @param dst The buffer to put the compressed data in.
+ * @param dst_capacity The number of bytes that fit in @p dst.
+ * @param dst_size Assigned the number of compressed bytes.
+ * @returns Zero on success, an error code on failure. If
+ * the compressed data does not fit in @p dst, then @ref
+ * BOOTABLE_ENOSPC is returned. Callers can use this to store
+ * data that does not compress as it is, by passing a buffer
+ * that is smaller than the input.
+ * */
+
+int bootable_lz4_compress(struct bootable_lz4 *lz4,
+                          const void *src,
+                          bootable_uint64 src_size,
+                          void *dst,
+                          bootable_uint64 dst_capacity,
+                          bootable_uint64 *dst_size);
+
+/** Decompresses a block of data. The compressed data is
+ * checked as it is decompressed, so it does not have to
+ * come from a trusted source.
+ * @param src The compressed data.
+ * @param src_size The number of bytes of compressed data.
+ * @param dst The buffer to put the decompressed data in.
+ * @param dst_capacity The number of bytes that fit in @p dst.
+ * @param dst_size Assigned the number of decompressed bytes.
+ * @returns Zero on success, an error code on failure. If the
+ * compressed data is damaged, then @ref BOOTABLE_EINVAL is
+ * returned. If it does not fit in @p dst, then @ref
+ * BOOTABLE_ENOSPC is returned.
+ * */
+
+int bootable_lz4_decompress(const void *src,
+                            bootable_uint64 src_size,
+                            void *dst,
+                            bootable_uint64 dst_capacity,
+                            bootable_uint64 *dst_size);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_LZ4_H */
@@ -0,0 +1,123 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file memstream.h API related to streams kept in memory.
+ * */
+
+#ifndef BOOTABLE_MEMSTREAM_H
+#define BOOTABLE_MEMSTREAM_H
+
+#include <bootable/core/stream.h>
+#include <bootable/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** A stream whose data is kept in memory.
+ * The memory is either owned by the stream,
+ * in which case it grows as data is written,
+ * or provided by the caller, in which case
+ * the stream cannot grow past it.
+ * */
+
+struct bootable_memstream {
+	/** The stream structure. */
+	struct bootable_stream stream;
+	/** The data of the stream. */
+	unsigned char *data;
+	/** The number of bytes in the stream. */
+	bootable_uint64 size;
+	/** The number of bytes that the
+	 * memory block can hold. */
+	bootable_uint64 reserved;
+	/** The position of the next read
+	 * or write operation. */
+	bootable_uint64 position;
+	/** Whether or not the memory block was
+	 * provided by the caller. If it was, then
+	 * it is not resized or released. */
+	bootable_bool fixed;
+};
+
+/** Initializes a memory stream. The stream
+ * starts out empty and owns its memory.
+ * @param memstream The stream to initialize.
+ * */
+
+void bootable_memstream_init(struct bootable_memstream *memstream);
+
+/** Releases the memory owned by the stream.
+ * @param memstream An initialized memory stream.
+ * */
+
+void bootable_memstream_done(struct bootable_memstream *memstream);
+
+/** Uses a buffer provided by the caller as the
+ * data of the stream. The buffer has to remain valid
+ * for as long as the stream uses it. Writes that go
+ * past the end of the buffer fail with @ref BOOTABLE_ENOSPC.
+ * @param memstream An initialized memory stream.
+ * @param buf The buffer to use.
+ * @param buf_size The number of bytes in the buffer.
+ * This is also the initial size of the stream.
+ * */
+
+void bootable_memstream_wrap(struct bootable_memstream *memstream,
+                             void *buf,
+                             bootable_uint64 buf_size);
+
+/** Makes sure the stream can hold a number of
+ * bytes without having to allocate more memory.
+ * @param memstream An initialized memory stream.
+ * @param size The number of bytes to make room for.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_memstream_reserve(struct bootable_memstream *memstream,
+                               bootable_uint64 size);
+
+/** Changes the size of the stream. If the
+ * stream grows, the new bytes are zero.
+ * @param memstream An initialized memory stream.
+ * @param size The new size of the stream.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_memstream_resize(struct bootable_memstream *memstream,
+                              bootable_uint64 size);
+
+/** Takes the memory block out of the stream.
+ * The stream is empty afterwards.
+ * @param memstream An initialized memory stream.
+ * @param size A pointer to the variable that receives
+ * the number of bytes in the stream. This may be null.
+ * @returns The memory block, which the caller has to
+ * release with @ref bootable_free, unless it was provided
+ * with @ref bootable_memstream_wrap. If the stream is empty,
+ * this may be null.
+ * */
+
+void *bootable_memstream_release(struct bootable_memstream *memstream,
+                                 bootable_uint64 *size);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_MEMSTREAM_H */
@@ -50,6 +50,54 @@ struct bootable_path {
 	bootable_uint64 name_count;
 };
 
+/** The number of names that a path view
+ * can hold before it has to allocate memory.
+ * */
+
+#define BOOTABLE_PATH_VIEW_DEPTH 16
+
+/** A name within a path string. The characters
+ * are not copied out of the string, so they
+ * are not null-terminated.
+ * */
+
+struct bootable_path_slice {
+	/** The first character of the name. */
+	const char *data;
+	/** The number of characters in the name. */
+	bootable_uint64 size;
+};
+
+/** Iterates the names in a path string without
+ * allocating memory. The names "." and ".." are
+ * returned like any other name.
+ * */
+
+struct bootable_path_iterator {
+	/** The next character to examine. */
+	const char *pos;
+};
+
+/** A normalized path, in which the names refer
+ * to the string that the path was parsed from.
+ * The string must outlive the view. Since the
+ * view may point to its own storage, it must not
+ * be copied to another structure.
+ * */
+
+struct bootable_path_view {
+	/** The names of the path. This points to
+	 * @ref bootable_path_view::inline_names unless
+	 * the path is deeper than @ref BOOTABLE_PATH_VIEW_DEPTH. */
+	struct bootable_path_slice *names;
+	/** The number of names in the path. */
+	bootable_uint64 name_count;
+	/** The number of names that fit in the name array. */
+	bootable_uint64 name_capacity;
+	/** The storage for paths that are not very deep. */
+	struct bootable_path_slice inline_names[BOOTABLE_PATH_VIEW_DEPTH];
+};
+
 /** Initializes a path structure.
  * @param path An uninitialized
  * path structure.
@@ -115,6 +163,53 @@ int bootable_path_parse(struct bootable_path *path,
 int bootable_path_push_child(struct bootable_path *path,
                            const char *name);
 
+/** Starts iterating the names of a path string.
+ * @param iterator The iterator to initialize.
+ * @param path_string The string to iterate. It
+ * must outlive the iterator.
+ * */
+
+void bootable_path_iterator_init(struct bootable_path_iterator *iterator,
+                                 const char *path_string);
+
+/** Gets the next name in the path string.
+ * Repeated separators are skipped.
+ * @param iterator An initialized path iterator.
+ * @param name Receives the next name.
+ * @returns True if a name was found, false if
+ * the end of the string was reached.
+ * */
+
+bootable_bool bootable_path_iterator_next(struct bootable_path_iterator *iterator,
+                                          struct bootable_path_slice *name);
+
+/** Initializes a path view.
+ * @param view An uninitialized path view.
+ * */
+
+void bootable_path_view_init(struct bootable_path_view *view);
+
+/** Releases memory allocated by a path view.
+ * This only does something if the view held
+ * a path that was deeper than @ref BOOTABLE_PATH_VIEW_DEPTH.
+ * @param view An initialized path view.
+ * */
+
+void bootable_path_view_done(struct bootable_path_view *view);
+
+/** Parses and normalizes a path string.
+ * The '.' and '..' references are resolved
+ * in the same way as @ref bootable_path_normalize.
+ * The names that the view had before are discarded.
+ * @param view An initialized path view.
+ * @param path_string The string to parse. It must
+ * outlive the view, or the next call to this function.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_path_view_parse(struct bootable_path_view *view,
+                             const char *path_string);
+
 #ifdef __cplusplus
 } /* extern "C" { */
 #endif
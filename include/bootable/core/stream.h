@@ -43,6 +43,18 @@ struct bootable_stream {
 	int (*set_pos)(void *data, bootable_uint64 offset);
 	/** Write callback */
 	int (*write)(void *data, const void *buf, bootable_uint64 buf_size);
+	/** Positional read callback. This is optional and
+	 * does not use or modify the stream position. */
+	int (*read_at)(void *data, bootable_uint64 pos, void *buf, bootable_uint64 buf_size);
+	/** Positional write callback. This is optional and
+	 * does not use or modify the stream position. */
+	int (*write_at)(void *data, bootable_uint64 pos, const void *buf, bootable_uint64 buf_size);
+	/** Copy callback. This is optional and copies data
+	 * from a file descriptor of the host to a position
+	 * in the stream, without passing it through a buffer
+	 * of the caller. It does not use or modify the stream
+	 * position. */
+	int (*copy_from_fd)(void *data, bootable_uint64 pos, int fd, bootable_uint64 fd_offset, bootable_uint64 size);
 };
 
 /** Initializes the stream for use.
@@ -99,6 +111,64 @@ int bootable_stream_set_pos(struct bootable_stream *stream, bootable_uint64 pos)
 
 int bootable_stream_write(struct bootable_stream *stream, const void *buf, bootable_uint64 buf_size);
 
+/** Reads data from a specific position in the stream.
+ * If the stream implements a positional read callback,
+ * the position of the stream is not used or modified.
+ * Otherwise, this function falls back to setting the
+ * position and then reading, which leaves the stream
+ * position at the end of the data that was read.
+ * @param stream An initialized stream structure.
+ * @param pos The position to read the data from.
+ * @param buf The buffer to put the data in.
+ * @param buf_size The number of bytes to read and
+ * the size of the buffer.
+ * @returns Zero on success, non-zero on failure.
+ * */
+
+int bootable_stream_read_at(struct bootable_stream *stream,
+                            bootable_uint64 pos,
+                            void *buf,
+                            bootable_uint64 buf_size);
+
+/** Writes data to a specific position in the stream.
+ * If the stream implements a positional write callback,
+ * the position of the stream is not used or modified.
+ * Otherwise, this function falls back to setting the
+ * position and then writing, which leaves the stream
+ * position at the end of the data that was written.
+ * @param stream An initialized stream structure.
+ * @param pos The position to write the data to.
+ * @param buf The buffer containing the data.
+ * @param buf_size The number of bytes in the buffer.
+ * @returns Zero on success, non-zero on failure.
+ * */
+
+int bootable_stream_write_at(struct bootable_stream *stream,
+                             bootable_uint64 pos,
+                             const void *buf,
+                             bootable_uint64 buf_size);
+
+/** Copies data from a file descriptor of the host
+ * to a specific position in the stream. The data is
+ * moved by the stream implementation, which may be able
+ * to do so without copying it through user space.
+ * @param stream An initialized stream structure.
+ * @param pos The position to write the data to.
+ * @param fd The file descriptor to read the data from.
+ * @param fd_offset The offset to start reading from.
+ * @param size The number of bytes to copy.
+ * @returns Zero on success, non-zero on failure. If
+ * the stream cannot copy from a file descriptor, then
+ * @ref BOOTABLE_ENOSYS is returned and the caller
+ * has to read and write the data itself.
+ * */
+
+int bootable_stream_copy_from_fd(struct bootable_stream *stream,
+                                 bootable_uint64 pos,
+                                 int fd,
+                                 bootable_uint64 fd_offset,
+                                 bootable_uint64 size);
+
 #ifdef __cplusplus
 } /* extern "C" { */
 #endif
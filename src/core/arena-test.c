@@ -0,0 +1,112 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <bootable/core/arena.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned int count_chunks(const struct bootable_arena *arena) {
+
+	unsigned int count = 0;
+
+	for (const struct bootable_arena_chunk *chunk = arena->chunks; chunk != NULL; chunk = chunk->next)
+		count++;
+
+	return count;
+}
+
+static void test_small(void) {
+
+	struct bootable_arena arena;
+	unsigned char *a;
+	unsigned char *b;
+
+	bootable_arena_init(&arena);
+
+	a = bootable_arena_alloc(&arena, 3);
+	b = bootable_arena_alloc(&arena, 5);
+	assert((a != NULL) && (b != NULL));
+	assert((((uintptr_t) a) % 16) == 0);
+	assert((((uintptr_t) b) % 16) == 0);
+	assert(b == (a + 16));
+	assert(count_chunks(&arena) == 1);
+
+	/* many small blocks only take a few chunks */
+	for (unsigned int i = 0; i < 100000; i++) {
+		a = bootable_arena_alloc(&arena, 40);
+		assert(a != NULL);
+		memset(a, 0xff, 40);
+	}
+
+	assert(count_chunks(&arena) < 10);
+
+	bootable_arena_done(&arena);
+	assert(arena.chunks == NULL);
+}
+
+static void test_large(void) {
+
+	struct bootable_arena arena;
+	struct bootable_arena_chunk *first;
+	unsigned char *a;
+	unsigned char *b;
+
+	bootable_arena_init(&arena);
+
+	a = bootable_arena_alloc(&arena, 16);
+	assert(a != NULL);
+
+	first = arena.chunks;
+
+	b = bootable_arena_alloc(&arena, BOOTABLE_ARENA_MIN_CHUNK * 4);
+	assert(b != NULL);
+	memset(b, 0, BOOTABLE_ARENA_MIN_CHUNK * 4);
+
+	/* small blocks still come from the first chunk */
+	assert(arena.chunks == first);
+	assert(bootable_arena_alloc(&arena, 16) == (a + 16));
+	assert(count_chunks(&arena) == 2);
+
+	bootable_arena_done(&arena);
+}
+
+static void test_overflow(void) {
+
+	struct bootable_arena arena;
+
+	bootable_arena_init(&arena);
+
+	/* sizes that wrap around when rounded up */
+	assert(bootable_arena_alloc(&arena, (bootable_uint64) -1) == NULL);
+	assert(bootable_arena_alloc(&arena, ((bootable_uint64) -1) - 8) == NULL);
+	assert(bootable_arena_alloc(&arena, ((bootable_uint64) -1) - 15 - sizeof(struct bootable_arena_chunk)) == NULL);
+	assert(arena.chunks == NULL);
+
+	assert(bootable_arena_alloc(&arena, 16) != NULL);
+
+	bootable_arena_done(&arena);
+}
+
+int main(void) {
+	test_small();
+	test_large();
+	test_overflow();
+	return EXIT_SUCCESS;
+}
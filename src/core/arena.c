@@ -0,0 +1,130 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bootable/core/arena.h>
+
+#include <bootable/core/memory.h>
+
+/** The alignment of every block,
+ * and of the chunk headers. */
+
+#define ARENA_ALIGNMENT 16ULL
+
+static bootable_uint64 align_up(bootable_uint64 size) {
+	return (size + (ARENA_ALIGNMENT - 1)) & ~(ARENA_ALIGNMENT - 1);
+}
+
+static unsigned char *chunk_data(struct bootable_arena_chunk *chunk) {
+	return ((unsigned char *) chunk) + align_up(sizeof(*chunk));
+}
+
+static struct bootable_arena_chunk *chunk_create(bootable_uint64 size) {
+
+	struct bootable_arena_chunk *chunk;
+
+	chunk = bootable_malloc(align_up(sizeof(*chunk)) + size);
+	if (chunk == bootable_null)
+		return bootable_null;
+
+	chunk->next = bootable_null;
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+void bootable_arena_init(struct bootable_arena *arena) {
+	arena->chunks = bootable_null;
+	arena->next_chunk_size = BOOTABLE_ARENA_MIN_CHUNK;
+}
+
+void bootable_arena_done(struct bootable_arena *arena) {
+
+	struct bootable_arena_chunk *chunk;
+	struct bootable_arena_chunk *next;
+
+	chunk = arena->chunks;
+
+	while (chunk != bootable_null) {
+		next = chunk->next;
+		bootable_free(chunk);
+		chunk = next;
+	}
+
+	arena->chunks = bootable_null;
+	arena->next_chunk_size = BOOTABLE_ARENA_MIN_CHUNK;
+}
+
+void *bootable_arena_alloc(struct bootable_arena *arena, bootable_uint64 size) {
+
+	struct bootable_arena_chunk *chunk;
+	unsigned char *addr;
+
+	/* Sizes this close to the limit would wrap
+	 * around when rounded up or when the chunk
+	 * header is added to them. */
+
+	if (size > (((bootable_uint64) -1) - (ARENA_ALIGNMENT - 1) - align_up(sizeof(*chunk))))
+		return bootable_null;
+
+	size = align_up(size);
+
+	chunk = arena->chunks;
+
+	if ((chunk != bootable_null) && ((chunk->size - chunk->used) >= size)) {
+		addr = chunk_data(chunk) + chunk->used;
+		chunk->used += size;
+		return addr;
+	}
+
+	if (size > (arena->next_chunk_size / 4)) {
+
+		/* Large blocks get a chunk of their own,
+		 * which goes behind the current chunk so
+		 * that its free space is not wasted. */
+
+		chunk = chunk_create(size);
+		if (chunk == bootable_null)
+			return bootable_null;
+
+		chunk->used = size;
+
+		if (arena->chunks == bootable_null) {
+			arena->chunks = chunk;
+		} else {
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		}
+
+		return chunk_data(chunk);
+	}
+
+	chunk = chunk_create(arena->next_chunk_size);
+	if (chunk == bootable_null)
+		return bootable_null;
+
+	if (arena->next_chunk_size < BOOTABLE_ARENA_MAX_CHUNK)
+		arena->next_chunk_size *= 2;
+
+	chunk->next = arena->chunks;
+	chunk->used = size;
+
+	arena->chunks = chunk;
+
+	return chunk_data(chunk);
+}
@@ -0,0 +1,302 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "blocks.h"
+
+#include <bootable/core/arena.h>
+#include <bootable/core/error.h>
+#include <bootable/core/fs.h>
+#include <bootable/core/lz4.h>
+#include <bootable/core/memory.h>
+#include <bootable/core/stream.h>
+#include <bootable/core/string.h>
+
+#include "schema.h"
+
+#define BLOCKS_FIELDS(X, T) \
+	X(T, data_size,   0x00, BOOTABLE_SCHEMA_UINT64, 8) \
+	X(T, block_size,  0x08, BOOTABLE_SCHEMA_UINT32, 4) \
+	X(T, block_count, 0x0c, BOOTABLE_SCHEMA_UINT32, 4)
+
+static const struct bootable_schema_field blocks_fields[] = {
+	BLOCKS_FIELDS(BOOTABLE_SCHEMA_FIELD, struct bootable_fs_blocks)
+};
+
+BLOCKS_FIELDS(BOOTABLE_SCHEMA_CHECK_FIELD, struct bootable_fs_blocks)
+
+static const struct bootable_schema blocks_schema = BOOTABLE_SCHEMA_INIT(struct bootable_fs_blocks, blocks_fields, BOOTABLE_FS_BLOCKS_HEADER_SIZE,
+	BOOTABLE_SCHEMA_IDENTITY(struct bootable_fs_blocks, BOOTABLE_FS_BLOCKS_HEADER_SIZE,
+	                         BLOCKS_FIELDS(BOOTABLE_SCHEMA_SAME_OFFSET, struct bootable_fs_blocks),
+	                         BLOCKS_FIELDS(BOOTABLE_SCHEMA_FIELD_SIZE, struct bootable_fs_blocks)));
+
+static bootable_uint32 load_uint32(const unsigned char *buf) {
+	return ((bootable_uint32) buf[0])
+	     | (((bootable_uint32) buf[1]) << 8)
+	     | (((bootable_uint32) buf[2]) << 16)
+	     | (((bootable_uint32) buf[3]) << 24);
+}
+
+static void store_uint32(unsigned char *buf, bootable_uint32 n) {
+	buf[0] = (unsigned char) n;
+	buf[1] = (unsigned char) (n >> 8);
+	buf[2] = (unsigned char) (n >> 16);
+	buf[3] = (unsigned char) (n >> 24);
+}
+
+static bootable_uint64 count_blocks(bootable_uint64 data_size,
+                                    bootable_uint64 block_size) {
+
+	return (data_size / block_size) + (((data_size % block_size) != 0) ? 1 : 0);
+}
+
+bootable_uint64 bootable_blocks_size(const struct bootable_file_blocks *blocks,
+                                     bootable_uint64 index) {
+
+	bootable_uint64 left = blocks->data_size - (index * blocks->block_size);
+
+	return (left < blocks->block_size) ? left : blocks->block_size;
+}
+
+/** Fills in the offsets of the blocks from their
+ * stored sizes, and checks that they are sensible. */
+
+static int index_blocks(struct bootable_file_blocks *blocks,
+                        const unsigned char *sizes) {
+
+	bootable_uint64 offset;
+	bootable_uint64 size;
+	bootable_uint32 entry;
+
+	offset = BOOTABLE_FS_BLOCKS_HEADER_SIZE + (blocks->block_count * 4);
+
+	for (bootable_uint64 i = 0; i < blocks->block_count; i++) {
+
+		entry = load_uint32(&sizes[i * 4]);
+
+		size = entry & ~BOOTABLE_FS_BLOCK_RAW;
+
+		blocks->raw[i] = (entry & BOOTABLE_FS_BLOCK_RAW) ? 1 : 0;
+
+		/* Blocks that are stored as they are have to
+		 * have their real size, and compressed blocks
+		 * have to fit in the buffer they are read into. */
+		if (blocks->raw[i] && (size != bootable_blocks_size(blocks, i)))
+			return BOOTABLE_EINVAL;
+		else if (!blocks->raw[i] && ((size == 0) || (size > blocks->block_size)))
+			return BOOTABLE_EINVAL;
+
+		if (size > (blocks->stored_size - offset))
+			return BOOTABLE_EINVAL;
+
+		blocks->offsets[i] = offset;
+
+		offset += size;
+	}
+
+	if (offset != blocks->stored_size)
+		return BOOTABLE_EINVAL;
+
+	blocks->offsets[blocks->block_count] = offset;
+
+	return 0;
+}
+
+int bootable_blocks_open(struct bootable_file_blocks **blocks_ptr,
+                         struct bootable_arena *arena,
+                         struct bootable_stream *stream,
+                         bootable_uint64 offset,
+                         bootable_uint64 stored_size) {
+
+	int err;
+	unsigned char buf[BOOTABLE_FS_BLOCKS_HEADER_SIZE];
+	unsigned char *sizes;
+	unsigned char *addr;
+	bootable_uint64 alloc_size;
+	struct bootable_fs_blocks header;
+	struct bootable_file_blocks *blocks;
+
+	if (stored_size < BOOTABLE_FS_BLOCKS_HEADER_SIZE)
+		return BOOTABLE_EINVAL;
+
+	err = bootable_stream_read_at(stream, offset, buf, sizeof(buf));
+	if (err != 0)
+		return err;
+
+	bootable_schema_decode(&blocks_schema, &header, buf);
+
+	if ((header.block_size == 0)
+	 || (header.block_size > BOOTABLE_LZ4_MAX_INPUT)
+	 || ((header.block_size % 8) != 0)
+	 || (header.block_count != count_blocks(header.data_size, header.block_size))
+	 || (header.block_count > ((stored_size - BOOTABLE_FS_BLOCKS_HEADER_SIZE) / 4)))
+		return BOOTABLE_EINVAL;
+
+	sizes = bootable_malloc(((bootable_uint64) header.block_count) * 4);
+	if ((sizes == bootable_null) && (header.block_count > 0))
+		return BOOTABLE_ENOMEM;
+
+	alloc_size = sizeof(*blocks)
+	           + ((((bootable_uint64) header.block_count) + 1) * sizeof(blocks->offsets[0]))
+	           + header.block_count;
+
+	if (arena != bootable_null)
+		addr = bootable_arena_alloc(arena, alloc_size);
+	else
+		addr = bootable_malloc(alloc_size);
+
+	if (addr == bootable_null) {
+		bootable_free(sizes);
+		return BOOTABLE_ENOMEM;
+	}
+
+	blocks = (struct bootable_file_blocks *) addr;
+	blocks->data_size = header.data_size;
+	blocks->block_size = header.block_size;
+	blocks->block_count = header.block_count;
+	blocks->stored_size = stored_size;
+	blocks->offsets = (bootable_uint64 *) &addr[sizeof(*blocks)];
+	blocks->raw = (unsigned char *) &blocks->offsets[header.block_count + 1];
+
+	err = bootable_stream_read_at(stream, offset + BOOTABLE_FS_BLOCKS_HEADER_SIZE, sizes, ((bootable_uint64) header.block_count) * 4);
+	if (err == 0)
+		err = index_blocks(blocks, sizes);
+
+	bootable_free(sizes);
+
+	if (err != 0) {
+		bootable_blocks_free(blocks, arena);
+		return err;
+	}
+
+	*blocks_ptr = blocks;
+
+	return 0;
+}
+
+void bootable_blocks_free(struct bootable_file_blocks *blocks,
+                          struct bootable_arena *arena) {
+
+	if (arena == bootable_null)
+		bootable_free(blocks);
+}
+
+int bootable_blocks_read(const struct bootable_file_blocks *blocks,
+                         struct bootable_stream *stream,
+                         bootable_uint64 offset,
+                         bootable_uint64 index,
+                         void *dst,
+                         void *scratch) {
+
+	int err;
+	bootable_uint64 size;
+	bootable_uint64 stored_size;
+	bootable_uint64 data_size;
+
+	size = bootable_blocks_size(blocks, index);
+
+	stored_size = blocks->offsets[index + 1] - blocks->offsets[index];
+
+	if (blocks->raw[index])
+		return bootable_stream_read_at(stream, offset + blocks->offsets[index], dst, size);
+
+	err = bootable_stream_read_at(stream, offset + blocks->offsets[index], scratch, stored_size);
+	if (err != 0)
+		return err;
+
+	err = bootable_lz4_decompress(scratch, stored_size, dst, size, &data_size);
+	if (err != 0)
+		return BOOTABLE_EINVAL;
+
+	/* A block that is too short is as
+	 * damaged as one that is too long. */
+	if (data_size != size)
+		return BOOTABLE_EINVAL;
+
+	return 0;
+}
+
+int bootable_blocks_pack(const void *data,
+                         bootable_uint64 data_size,
+                         unsigned char **stored_ptr,
+                         bootable_uint64 *stored_size_ptr) {
+
+	int err;
+	const unsigned char *src = (const unsigned char *) data;
+	unsigned char *stored;
+	struct bootable_lz4 *lz4;
+	struct bootable_fs_blocks header;
+	bootable_uint64 block_count;
+	bootable_uint64 offset;
+	bootable_uint64 size;
+	bootable_uint64 packed_size;
+
+	block_count = count_blocks(data_size, BOOTABLE_FS_BLOCK_SIZE);
+	if (block_count > 0xffffffffULL)
+		return BOOTABLE_EINVAL;
+
+	header.data_size = data_size;
+	header.block_size = BOOTABLE_FS_BLOCK_SIZE;
+	header.block_count = (bootable_uint32) block_count;
+
+	/* Blocks never take up more room than
+	 * they do when they are not compressed. */
+	stored = bootable_malloc(BOOTABLE_FS_BLOCKS_HEADER_SIZE + (block_count * 4) + data_size);
+	if (stored == bootable_null)
+		return BOOTABLE_ENOMEM;
+
+	lz4 = bootable_malloc(sizeof(*lz4));
+	if (lz4 == bootable_null) {
+		bootable_free(stored);
+		return BOOTABLE_ENOMEM;
+	}
+
+	bootable_schema_encode(&blocks_schema, &header, stored);
+
+	offset = BOOTABLE_FS_BLOCKS_HEADER_SIZE + (block_count * 4);
+
+	for (bootable_uint64 i = 0; i < block_count; i++) {
+
+		size = data_size - (i * BOOTABLE_FS_BLOCK_SIZE);
+		if (size > BOOTABLE_FS_BLOCK_SIZE)
+			size = BOOTABLE_FS_BLOCK_SIZE;
+
+		/* The block is only compressed if
+		 * that makes it smaller. */
+		err = bootable_lz4_compress(lz4, &src[i * BOOTABLE_FS_BLOCK_SIZE], size, &stored[offset], size - 1, &packed_size);
+		if (err == 0) {
+			store_uint32(&stored[BOOTABLE_FS_BLOCKS_HEADER_SIZE + (i * 4)], (bootable_uint32) packed_size);
+		} else if (err == BOOTABLE_ENOSPC) {
+			bootable_memcpy(&stored[offset], &src[i * BOOTABLE_FS_BLOCK_SIZE], size);
+			store_uint32(&stored[BOOTABLE_FS_BLOCKS_HEADER_SIZE + (i * 4)], ((bootable_uint32) size) | BOOTABLE_FS_BLOCK_RAW);
+			packed_size = size;
+		} else {
+			bootable_free(lz4);
+			bootable_free(stored);
+			return err;
+		}
+
+		offset += packed_size;
+	}
+
+	bootable_free(lz4);
+
+	*stored_ptr = stored;
+	*stored_size_ptr = offset;
+
+	return 0;
+}
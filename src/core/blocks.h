@@ -0,0 +1,138 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOOTABLE_BLOCKS_H
+#define BOOTABLE_BLOCKS_H
+
+#include <bootable/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct bootable_arena;
+struct bootable_stream;
+
+/** The index of the blocks of a compressed
+ * file, so that a block can be found without
+ * reading the ones in front of it.
+ * */
+
+struct bootable_file_blocks {
+	/** The number of bytes in the file,
+	 * once it is decompressed. */
+	bootable_uint64 data_size;
+	/** The number of bytes in each
+	 * block, once it is decompressed. */
+	bootable_uint64 block_size;
+	/** The number of blocks. */
+	bootable_uint64 block_count;
+	/** The number of bytes that the
+	 * compressed file takes up. */
+	bootable_uint64 stored_size;
+	/** The offset of each block, relative to the
+	 * start of the compressed file. There is one more
+	 * offset than there are blocks, so that the stored
+	 * size of each block is the difference between two
+	 * offsets. */
+	bootable_uint64 *offsets;
+	/** Whether or not each block is
+	 * stored without being compressed. */
+	unsigned char *raw;
+};
+
+/** Reads the index of a compressed file.
+ * @param blocks Assigned the index.
+ * @param arena If this is not null, the index
+ * is allocated from this arena. Otherwise, it is
+ * allocated with @ref bootable_malloc.
+ * @param stream The stream that contains the file.
+ * @param offset The position of the compressed file.
+ * @param stored_size The number of bytes that the
+ * compressed file takes up.
+ * @returns Zero on success, an error code on failure.
+ * If the index does not describe exactly @p stored_size
+ * bytes, then @ref BOOTABLE_EINVAL is returned.
+ * */
+
+int bootable_blocks_open(struct bootable_file_blocks **blocks,
+                         struct bootable_arena *arena,
+                         struct bootable_stream *stream,
+                         bootable_uint64 offset,
+                         bootable_uint64 stored_size);
+
+/** Releases an index that was not
+ * allocated from an arena.
+ * @param blocks The index to release. This may be null.
+ * @param arena The arena that was passed when the index was read.
+ * */
+
+void bootable_blocks_free(struct bootable_file_blocks *blocks,
+                          struct bootable_arena *arena);
+
+/** Gets the number of bytes in a block,
+ * once it is decompressed.
+ * @param blocks The index of a compressed file.
+ * @param index The index of the block.
+ * @returns The number of bytes in the block.
+ * */
+
+bootable_uint64 bootable_blocks_size(const struct bootable_file_blocks *blocks,
+                                     bootable_uint64 index);
+
+/** Reads and decompresses one block.
+ * @param blocks The index of the compressed file.
+ * @param stream The stream that contains the file.
+ * @param offset The position of the compressed file.
+ * @param index The index of the block.
+ * @param dst Where the block is decompressed to. This
+ * has to fit the number of bytes of the block.
+ * @param scratch A buffer of @ref BOOTABLE_FS_BLOCK_SIZE
+ * bytes for the compressed block. It is not used for
+ * blocks that are stored as they are.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_blocks_read(const struct bootable_file_blocks *blocks,
+                         struct bootable_stream *stream,
+                         bootable_uint64 offset,
+                         bootable_uint64 index,
+                         void *dst,
+                         void *scratch);
+
+/** Compresses data into the format of a compressed file.
+ * @param data The data to compress.
+ * @param data_size The number of bytes of data.
+ * @param stored Assigned the compressed file. This is
+ * allocated with @ref bootable_malloc and is released
+ * by the caller.
+ * @param stored_size Assigned the number of bytes
+ * of the compressed file.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_blocks_pack(const void *data,
+                         bootable_uint64 data_size,
+                         unsigned char **stored,
+                         bootable_uint64 *stored_size);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_BLOCKS_H */
@@ -0,0 +1,227 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bootable/core/cache.h>
+#include <bootable/core/error.h>
+#include <bootable/core/memstream.h>
+#include <bootable/core/stream.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The number of bytes in the backing stream. */
+
+#define BACKEND_SIZE 4096
+
+/** The number of bytes in a block of the caches in this test. */
+
+#define BLOCK_SIZE 512
+
+static void fill_backend(struct bootable_memstream *backend) {
+
+	unsigned char buf[BACKEND_SIZE];
+
+	for (size_t i = 0; i < sizeof(buf); i++)
+		buf[i] = (unsigned char) (i * 7);
+
+	bootable_memstream_init(backend);
+	assert(bootable_stream_write_at(&backend->stream, 0, buf, sizeof(buf)) == 0);
+}
+
+static int backend_matches(const struct bootable_memstream *backend,
+                           bootable_uint64 offset,
+                           bootable_uint64 size) {
+
+	for (bootable_uint64 i = offset; i < (offset + size); i++) {
+		if (backend->data[i] != (unsigned char) (i * 7))
+			return 0;
+	}
+
+	return 1;
+}
+
+static void test_read(void) {
+
+	struct bootable_memstream backend;
+	struct bootable_cache cache;
+	unsigned char buf[1500];
+
+	fill_backend(&backend);
+
+	bootable_cache_init(&cache);
+	assert(bootable_cache_setup(&cache, &backend.stream, BLOCK_SIZE, 4) == 0);
+
+	/* across one block boundary */
+	assert(bootable_stream_read_at(&cache.stream, 500, buf, 100) == 0);
+	for (size_t i = 0; i < 100; i++)
+		assert(buf[i] == (unsigned char) ((500 + i) * 7));
+
+	/* across several blocks, some of them cached */
+	assert(bootable_stream_read_at(&cache.stream, 300, buf, sizeof(buf)) == 0);
+	for (size_t i = 0; i < sizeof(buf); i++)
+		assert(buf[i] == (unsigned char) ((300 + i) * 7));
+
+	/* past the end of the stream */
+	assert(bootable_stream_read_at(&cache.stream, BACKEND_SIZE - 10, buf, 20) != 0);
+
+	bootable_cache_done(&cache);
+	bootable_memstream_done(&backend);
+}
+
+static void test_write_back(void) {
+
+	struct bootable_memstream backend;
+	struct bootable_cache cache;
+	unsigned char buf[64];
+
+	fill_backend(&backend);
+
+	bootable_cache_init(&cache);
+	assert(bootable_cache_setup(&cache, &backend.stream, BLOCK_SIZE, 4) == 0);
+
+	/* A write across two blocks that were never read. */
+	memset(buf, 0xaa, sizeof(buf));
+	assert(bootable_stream_write_at(&cache.stream, BLOCK_SIZE - 20, buf, 40) == 0);
+
+	/* Nothing reaches the backing stream yet. */
+	assert(backend_matches(&backend, 0, BACKEND_SIZE));
+
+	/* The bytes around the write still come
+	 * from the backing stream. */
+	assert(bootable_stream_read_at(&cache.stream, BLOCK_SIZE - 30, buf, 60) == 0);
+	for (size_t i = 0; i < 60; i++) {
+		if ((i >= 10) && (i < 50))
+			assert(buf[i] == 0xaa);
+		else
+			assert(buf[i] == (unsigned char) ((BLOCK_SIZE - 30 + i) * 7));
+	}
+
+	/* A second write that leaves a gap in the same block. */
+	memset(buf, 0xbb, sizeof(buf));
+	assert(bootable_stream_write_at(&cache.stream, BLOCK_SIZE + 100, buf, 10) == 0);
+
+	assert(bootable_cache_flush(&cache) == 0);
+
+	for (bootable_uint64 i = 0; i < BACKEND_SIZE; i++) {
+		if ((i >= (BLOCK_SIZE - 20)) && (i < (BLOCK_SIZE + 20)))
+			assert(backend.data[i] == 0xaa);
+		else if ((i >= (BLOCK_SIZE + 100)) && (i < (BLOCK_SIZE + 110)))
+			assert(backend.data[i] == 0xbb);
+		else
+			assert(backend.data[i] == (unsigned char) (i * 7));
+	}
+
+	bootable_cache_done(&cache);
+	bootable_memstream_done(&backend);
+}
+
+static void test_evict(void) {
+
+	struct bootable_memstream backend;
+	struct bootable_cache cache;
+	unsigned char buf[16];
+
+	fill_backend(&backend);
+
+	bootable_cache_init(&cache);
+	assert(bootable_cache_setup(&cache, &backend.stream, BLOCK_SIZE, 2) == 0);
+
+	memset(buf, 0x11, sizeof(buf));
+	assert(bootable_stream_write_at(&cache.stream, 0, buf, sizeof(buf)) == 0);
+
+	memset(buf, 0x22, sizeof(buf));
+	assert(bootable_stream_write_at(&cache.stream, BLOCK_SIZE, buf, sizeof(buf)) == 0);
+
+	assert(backend_matches(&backend, 0, BACKEND_SIZE));
+
+	/* The third block evicts the least recently
+	 * used one, which is written back first. */
+	memset(buf, 0x33, sizeof(buf));
+	assert(bootable_stream_write_at(&cache.stream, BLOCK_SIZE * 5, buf, sizeof(buf)) == 0);
+
+	assert(backend.data[0] == 0x11);
+	assert(backend.data[15] == 0x11);
+	assert(backend_matches(&backend, 16, BACKEND_SIZE - 16));
+
+	/* The evicted block is read back from the stream. */
+	assert(bootable_stream_read_at(&cache.stream, 0, buf, sizeof(buf)) == 0);
+	for (size_t i = 0; i < sizeof(buf); i++)
+		assert(buf[i] == 0x11);
+
+	assert(bootable_cache_flush(&cache) == 0);
+
+	assert(backend.data[BLOCK_SIZE] == 0x22);
+	assert(backend.data[BLOCK_SIZE * 5] == 0x33);
+	assert(backend.data[(BLOCK_SIZE * 5) + 16] == (unsigned char) (((BLOCK_SIZE * 5) + 16) * 7));
+
+	bootable_cache_done(&cache);
+	bootable_memstream_done(&backend);
+}
+
+static void test_write_through(void) {
+
+	struct bootable_memstream backend;
+	struct bootable_cache cache;
+	unsigned char small[8];
+	unsigned char large[BLOCK_SIZE * 3];
+	bootable_uint64 size;
+
+	fill_backend(&backend);
+
+	bootable_cache_init(&cache);
+	assert(bootable_cache_setup(&cache, &backend.stream, BLOCK_SIZE, 2) == 0);
+
+	memset(small, 0x44, sizeof(small));
+	assert(bootable_stream_write_at(&cache.stream, 10, small, sizeof(small)) == 0);
+
+	/* A write larger than the cache goes straight to
+	 * the stream, and the cached block is updated so
+	 * that flushing it does not undo the write. */
+	memset(large, 0x55, sizeof(large));
+	assert(bootable_stream_write_at(&cache.stream, 0, large, sizeof(large)) == 0);
+
+	assert(backend.data[0] == 0x55);
+
+	assert(bootable_cache_flush(&cache) == 0);
+
+	for (size_t i = 0; i < sizeof(large); i++)
+		assert(backend.data[i] == 0x55);
+
+	assert(backend_matches(&backend, sizeof(large), BACKEND_SIZE - sizeof(large)));
+
+	/* Writes past the end grow the stream once they are flushed. */
+	assert(bootable_stream_write_at(&cache.stream, BACKEND_SIZE + 100, small, sizeof(small)) == 0);
+	assert(bootable_stream_get_size(&cache.stream, &size) == 0);
+	assert(size == (BACKEND_SIZE + 100 + sizeof(small)));
+
+	assert(bootable_cache_flush(&cache) == 0);
+	assert(backend.size == (BACKEND_SIZE + 100 + sizeof(small)));
+	assert(backend.data[BACKEND_SIZE + 100] == 0x44);
+
+	bootable_cache_done(&cache);
+	bootable_memstream_done(&backend);
+}
+
+int main(void) {
+	test_read();
+	test_write_back();
+	test_evict();
+	test_write_through();
+	return EXIT_SUCCESS;
+}
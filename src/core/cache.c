@@ -0,0 +1,819 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bootable/core/cache.h>
+
+#include <bootable/core/error.h>
+#include <bootable/core/memory.h>
+#include <bootable/core/string.h>
+
+#ifndef NULL
+#define NULL ((void *) 0x00)
+#endif
+
+static bootable_uint64 hash_offset(const struct bootable_cache *cache,
+                                   bootable_uint64 offset) {
+
+	return (offset >> cache->block_shift) & (cache->bucket_count - 1);
+}
+
+static void lru_remove(struct bootable_cache *cache,
+                       struct bootable_cache_block *block) {
+
+	if (block->lru_prev != NULL)
+		block->lru_prev->lru_next = block->lru_next;
+	else
+		cache->lru_head = block->lru_next;
+
+	if (block->lru_next != NULL)
+		block->lru_next->lru_prev = block->lru_prev;
+	else
+		cache->lru_tail = block->lru_prev;
+
+	block->lru_prev = NULL;
+	block->lru_next = NULL;
+}
+
+static void lru_push(struct bootable_cache *cache,
+                     struct bootable_cache_block *block) {
+
+	block->lru_prev = NULL;
+	block->lru_next = cache->lru_head;
+
+	if (cache->lru_head != NULL)
+		cache->lru_head->lru_prev = block;
+	else
+		cache->lru_tail = block;
+
+	cache->lru_head = block;
+}
+
+static void lru_append(struct bootable_cache *cache,
+                       struct bootable_cache_block *block) {
+
+	block->lru_next = NULL;
+	block->lru_prev = cache->lru_tail;
+
+	if (cache->lru_tail != NULL)
+		cache->lru_tail->lru_next = block;
+	else
+		cache->lru_head = block;
+
+	cache->lru_tail = block;
+}
+
+static void hash_remove(struct bootable_cache *cache,
+                        struct bootable_cache_block *block) {
+
+	struct bootable_cache_block **link = &cache->buckets[hash_offset(cache, block->offset)];
+
+	while (*link != NULL) {
+		if (*link == block) {
+			*link = block->hash_next;
+			break;
+		}
+		link = &(*link)->hash_next;
+	}
+
+	block->hash_next = NULL;
+}
+
+static struct bootable_cache_block *find_block(struct bootable_cache *cache,
+                                               bootable_uint64 offset) {
+
+	struct bootable_cache_block *block = cache->buckets[hash_offset(cache, offset)];
+
+	while (block != NULL) {
+		if (block->offset == offset)
+			return block;
+		block = block->hash_next;
+	}
+
+	return NULL;
+}
+
+static int flush_block(struct bootable_cache *cache,
+                       struct bootable_cache_block *block) {
+
+	if (block->dirty_end == 0)
+		return 0;
+
+	int err = bootable_stream_write_at(cache->backend,
+	                                   block->offset + block->dirty_begin,
+	                                   &block->data[block->dirty_begin],
+	                                   block->dirty_end - block->dirty_begin);
+	if (err != 0)
+		return err;
+
+	if ((block->offset + block->dirty_end) > cache->backend_size)
+		cache->backend_size = block->offset + block->dirty_end;
+
+	block->dirty_begin = 0;
+	block->dirty_end = 0;
+
+	return 0;
+}
+
+/* Reads the part of a block that is outside
+ * of its dirty range from the backing stream. */
+
+static int load_range(struct bootable_cache *cache,
+                      struct bootable_cache_block *block,
+                      bootable_uint64 begin,
+                      bootable_uint64 end) {
+
+	if (begin >= end)
+		return 0;
+
+	/* The part of the block past the end
+	 * of the backing stream reads as zero. */
+
+	bootable_uint64 valid = 0;
+
+	if (cache->backend_size > block->offset)
+		valid = cache->backend_size - block->offset;
+
+	bootable_uint64 read_end = (end < valid) ? end : valid;
+
+	if (begin < read_end) {
+		int err = bootable_stream_read_at(cache->backend,
+		                                  block->offset + begin,
+		                                  &block->data[begin],
+		                                  read_end - begin);
+		if (err != 0)
+			return err;
+	} else {
+		read_end = begin;
+	}
+
+	bootable_memset(&block->data[read_end], 0, end - read_end);
+
+	return 0;
+}
+
+static int load_block(struct bootable_cache *cache,
+                      struct bootable_cache_block *block) {
+
+	if (block->loaded)
+		return 0;
+
+	int err = 0;
+
+	if (block->dirty_end == 0) {
+		err = load_range(cache, block, 0, cache->block_size);
+	} else {
+		err = load_range(cache, block, 0, block->dirty_begin);
+		if (err == 0)
+			err = load_range(cache, block, block->dirty_end, cache->block_size);
+	}
+
+	if (err != 0)
+		return err;
+
+	block->loaded = bootable_true;
+
+	return 0;
+}
+
+/* Gets the block at an offset, making room for
+ * it if it is not in the cache. The block that is
+ * returned becomes the most recently used one. */
+
+static int get_block(struct bootable_cache *cache,
+                     bootable_uint64 offset,
+                     struct bootable_cache_block **block_ptr) {
+
+	struct bootable_cache_block *block = find_block(cache, offset);
+	if (block != NULL) {
+		lru_remove(cache, block);
+		lru_push(cache, block);
+		*block_ptr = block;
+		return 0;
+	}
+
+	/* Unused blocks are at the end
+	 * of the list, so they go first. */
+
+	block = cache->lru_tail;
+
+	if (block->used) {
+
+		int err = flush_block(cache, block);
+		if (err != 0)
+			return err;
+
+		hash_remove(cache, block);
+	}
+
+	lru_remove(cache, block);
+
+	block->offset = offset;
+	block->dirty_begin = 0;
+	block->dirty_end = 0;
+	block->used = bootable_true;
+	block->loaded = bootable_false;
+
+	bootable_uint64 bucket = hash_offset(cache, offset);
+
+	block->hash_next = cache->buckets[bucket];
+
+	cache->buckets[bucket] = block;
+
+	lru_push(cache, block);
+
+	*block_ptr = block;
+
+	return 0;
+}
+
+static void reset_blocks(struct bootable_cache *cache) {
+
+	cache->lru_head = NULL;
+	cache->lru_tail = NULL;
+
+	for (bootable_uint64 i = 0; i < cache->bucket_count; i++)
+		cache->buckets[i] = NULL;
+
+	for (bootable_uint64 i = 0; i < cache->block_count; i++) {
+		struct bootable_cache_block *block = &cache->blocks[i];
+		block->offset = 0;
+		block->data = &cache->data[i * cache->block_size];
+		block->dirty_begin = 0;
+		block->dirty_end = 0;
+		block->used = bootable_false;
+		block->loaded = bootable_false;
+		block->hash_next = NULL;
+		lru_push(cache, block);
+	}
+}
+
+/* Writes the dirty blocks that overlap a range,
+ * so that the range can be accessed directly. */
+
+static int flush_range(struct bootable_cache *cache,
+                       bootable_uint64 pos,
+                       bootable_uint64 size) {
+
+	for (bootable_uint64 i = 0; i < cache->block_count; i++) {
+
+		struct bootable_cache_block *block = &cache->blocks[i];
+
+		if (!block->used || (block->dirty_end == 0))
+			continue;
+
+		if ((block->offset < (pos + size))
+		 && ((block->offset + cache->block_size) > pos)) {
+			int err = flush_block(cache, block);
+			if (err != 0)
+				return err;
+		}
+	}
+
+	return 0;
+}
+
+/* Writes and then discards the blocks
+ * that overlap a range. Discarded blocks
+ * are the first ones to be reused. */
+
+static int drop_range(struct bootable_cache *cache,
+                      bootable_uint64 pos,
+                      bootable_uint64 size) {
+
+	int err = flush_range(cache, pos, size);
+	if (err != 0)
+		return err;
+
+	for (bootable_uint64 i = 0; i < cache->block_count; i++) {
+
+		struct bootable_cache_block *block = &cache->blocks[i];
+
+		if (!block->used
+		 || (block->offset >= (pos + size))
+		 || ((block->offset + cache->block_size) <= pos))
+			continue;
+
+		hash_remove(cache, block);
+
+		block->used = bootable_false;
+		block->loaded = bootable_false;
+
+		lru_remove(cache, block);
+		lru_append(cache, block);
+	}
+
+	return 0;
+}
+
+/* Writes a run of adjacent dirty blocks. The run
+ * is copied into one buffer so that the backing
+ * stream only sees a single write. */
+
+static int flush_run(struct bootable_cache *cache,
+                     struct bootable_cache_block **run,
+                     bootable_uint64 run_size) {
+
+	if (run_size == 1)
+		return flush_block(cache, run[0]);
+
+	bootable_uint64 begin = run[0]->dirty_begin;
+	bootable_uint64 end = ((run_size - 1) * cache->block_size) + run[run_size - 1]->dirty_end;
+
+	unsigned char *buf = bootable_malloc(end - begin);
+	if (buf == NULL) {
+		/* write them one by one instead */
+		for (bootable_uint64 i = 0; i < run_size; i++) {
+			int err = flush_block(cache, run[i]);
+			if (err != 0)
+				return err;
+		}
+		return 0;
+	}
+
+	bootable_uint64 buf_pos = 0;
+
+	for (bootable_uint64 i = 0; i < run_size; i++) {
+		bootable_uint64 copy_size = run[i]->dirty_end - run[i]->dirty_begin;
+		bootable_memcpy(&buf[buf_pos], &run[i]->data[run[i]->dirty_begin], copy_size);
+		buf_pos += copy_size;
+	}
+
+	int err = bootable_stream_write_at(cache->backend, run[0]->offset + begin, buf, end - begin);
+
+	bootable_free(buf);
+
+	if (err != 0)
+		return err;
+
+	if ((run[0]->offset + end) > cache->backend_size)
+		cache->backend_size = run[0]->offset + end;
+
+	for (bootable_uint64 i = 0; i < run_size; i++) {
+		run[i]->dirty_begin = 0;
+		run[i]->dirty_end = 0;
+	}
+
+	return 0;
+}
+
+static int cache_read_at(void *cache_ptr,
+                         bootable_uint64 pos,
+                         void *buf,
+                         bootable_uint64 buf_size) {
+
+	struct bootable_cache *cache = (struct bootable_cache *) cache_ptr;
+	if ((cache == NULL) || (cache->backend == NULL))
+		return BOOTABLE_EFAULT;
+
+	if ((pos > cache->size) || (buf_size > (cache->size - pos)))
+		return BOOTABLE_EINVAL;
+
+	/* Transfers that would replace the
+	 * whole cache go to the stream directly. */
+
+	if (buf_size >= (cache->block_size * cache->block_count)) {
+
+		int err = flush_range(cache, pos, buf_size);
+		if (err != 0)
+			return err;
+
+		return bootable_stream_read_at(cache->backend, pos, buf, buf_size);
+	}
+
+	unsigned char *buf8 = (unsigned char *) buf;
+
+	while (buf_size > 0) {
+
+		bootable_uint64 block_pos = pos & (cache->block_size - 1);
+
+		bootable_uint64 copy_size = cache->block_size - block_pos;
+		if (copy_size > buf_size)
+			copy_size = buf_size;
+
+		struct bootable_cache_block *block = NULL;
+
+		int err = get_block(cache, pos - block_pos, &block);
+		if (err != 0)
+			return err;
+
+		err = load_block(cache, block);
+		if (err != 0)
+			return err;
+
+		bootable_memcpy(buf8, &block->data[block_pos], copy_size);
+
+		buf8 += copy_size;
+		buf_size -= copy_size;
+		pos += copy_size;
+	}
+
+	return 0;
+}
+
+static int cache_write_at(void *cache_ptr,
+                          bootable_uint64 pos,
+                          const void *buf,
+                          bootable_uint64 buf_size) {
+
+	struct bootable_cache *cache = (struct bootable_cache *) cache_ptr;
+	if ((cache == NULL) || (cache->backend == NULL))
+		return BOOTABLE_EFAULT;
+
+	if ((pos + buf_size) < pos)
+		return BOOTABLE_EINVAL;
+
+	const unsigned char *buf8 = (const unsigned char *) buf;
+
+	if (buf_size >= (cache->block_size * cache->block_count)) {
+
+		int err = bootable_stream_write_at(cache->backend, pos, buf, buf_size);
+		if (err != 0)
+			return err;
+
+		if ((pos + buf_size) > cache->backend_size)
+			cache->backend_size = pos + buf_size;
+
+		if ((pos + buf_size) > cache->size)
+			cache->size = pos + buf_size;
+
+		/* Keep the blocks that overlap the
+		 * write in sync with the stream. */
+
+		for (bootable_uint64 i = 0; i < cache->block_count; i++) {
+
+			struct bootable_cache_block *block = &cache->blocks[i];
+			if (!block->used)
+				continue;
+
+			bootable_uint64 begin = (block->offset > pos) ? block->offset : pos;
+			bootable_uint64 end = block->offset + cache->block_size;
+			if (end > (pos + buf_size))
+				end = pos + buf_size;
+
+			if (begin < end)
+				bootable_memcpy(&block->data[begin - block->offset], &buf8[begin - pos], end - begin);
+		}
+
+		return 0;
+	}
+
+	while (buf_size > 0) {
+
+		bootable_uint64 block_pos = pos & (cache->block_size - 1);
+
+		bootable_uint64 copy_size = cache->block_size - block_pos;
+		if (copy_size > buf_size)
+			copy_size = buf_size;
+
+		struct bootable_cache_block *block = NULL;
+
+		int err = get_block(cache, pos - block_pos, &block);
+		if (err != 0)
+			return err;
+
+		bootable_uint64 begin = block_pos;
+		bootable_uint64 end = block_pos + copy_size;
+
+		/* A block that was not read only tracks
+		 * one dirty range, so a write that leaves
+		 * a gap in it needs the rest of the block. */
+
+		if (!block->loaded
+		 && (block->dirty_end != 0)
+		 && ((end < block->dirty_begin) || (begin > block->dirty_end))) {
+			err = load_block(cache, block);
+			if (err != 0)
+				return err;
+		}
+
+		bootable_memcpy(&block->data[block_pos], buf8, copy_size);
+
+		if (block->dirty_end == 0) {
+			block->dirty_begin = begin;
+			block->dirty_end = end;
+		} else {
+			if (begin < block->dirty_begin)
+				block->dirty_begin = begin;
+			if (end > block->dirty_end)
+				block->dirty_end = end;
+		}
+
+		if ((block->dirty_begin == 0) && (block->dirty_end == cache->block_size))
+			block->loaded = bootable_true;
+
+		buf8 += copy_size;
+		buf_size -= copy_size;
+		pos += copy_size;
+
+		if (pos > cache->size)
+			cache->size = pos;
+	}
+
+	return 0;
+}
+
+static int cache_copy_from_fd(void *cache_ptr,
+                              bootable_uint64 pos,
+                              int fd,
+                              bootable_uint64 fd_offset,
+                              bootable_uint64 size) {
+
+	struct bootable_cache *cache = (struct bootable_cache *) cache_ptr;
+	if ((cache == NULL) || (cache->backend == NULL))
+		return BOOTABLE_EFAULT;
+
+	if ((pos + size) < pos)
+		return BOOTABLE_EINVAL;
+
+	if (cache->backend->copy_from_fd == NULL)
+		return BOOTABLE_ENOSYS;
+
+	/* The copy bypasses the cache, so the
+	 * blocks it covers would become stale. */
+
+	int err = drop_range(cache, pos, size);
+	if (err != 0)
+		return err;
+
+	err = bootable_stream_copy_from_fd(cache->backend, pos, fd, fd_offset, size);
+	if (err != 0)
+		return err;
+
+	if ((pos + size) > cache->backend_size)
+		cache->backend_size = pos + size;
+
+	if ((pos + size) > cache->size)
+		cache->size = pos + size;
+
+	return 0;
+}
+
+static int cache_read(void *cache_ptr, void *buf, bootable_uint64 buf_size) {
+
+	struct bootable_cache *cache = (struct bootable_cache *) cache_ptr;
+	if (cache == NULL)
+		return BOOTABLE_EFAULT;
+
+	int err = cache_read_at(cache, cache->position, buf, buf_size);
+	if (err != 0)
+		return err;
+
+	cache->position += buf_size;
+
+	return 0;
+}
+
+static int cache_write(void *cache_ptr, const void *buf, bootable_uint64 buf_size) {
+
+	struct bootable_cache *cache = (struct bootable_cache *) cache_ptr;
+	if (cache == NULL)
+		return BOOTABLE_EFAULT;
+
+	int err = cache_write_at(cache, cache->position, buf, buf_size);
+	if (err != 0)
+		return err;
+
+	cache->position += buf_size;
+
+	return 0;
+}
+
+static int cache_set_pos(void *cache_ptr, bootable_uint64 pos) {
+
+	struct bootable_cache *cache = (struct bootable_cache *) cache_ptr;
+	if (cache == NULL)
+		return BOOTABLE_EFAULT;
+
+	cache->position = pos;
+
+	return 0;
+}
+
+static int cache_get_pos(void *cache_ptr, bootable_uint64 *pos) {
+
+	struct bootable_cache *cache = (struct bootable_cache *) cache_ptr;
+	if (cache == NULL)
+		return BOOTABLE_EFAULT;
+
+	if (pos != NULL)
+		*pos = cache->position;
+
+	return 0;
+}
+
+static int cache_get_size(void *cache_ptr, bootable_uint64 *size) {
+
+	struct bootable_cache *cache = (struct bootable_cache *) cache_ptr;
+	if (cache == NULL)
+		return BOOTABLE_EFAULT;
+
+	if (size != NULL)
+		*size = cache->size;
+
+	return 0;
+}
+
+void bootable_cache_init(struct bootable_cache *cache) {
+	bootable_stream_init(&cache->stream);
+	cache->stream.data = cache;
+	cache->stream.read = cache_read;
+	cache->stream.write = cache_write;
+	cache->stream.read_at = cache_read_at;
+	cache->stream.write_at = cache_write_at;
+	cache->stream.copy_from_fd = cache_copy_from_fd;
+	cache->stream.set_pos = cache_set_pos;
+	cache->stream.get_pos = cache_get_pos;
+	cache->stream.get_size = cache_get_size;
+	cache->backend = NULL;
+	cache->backend_size = 0;
+	cache->size = 0;
+	cache->position = 0;
+	cache->block_size = 0;
+	cache->block_shift = 0;
+	cache->block_count = 0;
+	cache->blocks = NULL;
+	cache->data = NULL;
+	cache->buckets = NULL;
+	cache->bucket_count = 0;
+	cache->dirty = NULL;
+	cache->lru_head = NULL;
+	cache->lru_tail = NULL;
+}
+
+void bootable_cache_done(struct bootable_cache *cache) {
+
+	bootable_cache_flush(cache);
+
+	bootable_free(cache->blocks);
+	bootable_free(cache->data);
+	bootable_free(cache->buckets);
+	bootable_free(cache->dirty);
+
+	cache->backend = NULL;
+	cache->blocks = NULL;
+	cache->data = NULL;
+	cache->buckets = NULL;
+	cache->dirty = NULL;
+	cache->block_count = 0;
+	cache->bucket_count = 0;
+	cache->lru_head = NULL;
+	cache->lru_tail = NULL;
+}
+
+int bootable_cache_setup(struct bootable_cache *cache,
+                         struct bootable_stream *backend,
+                         bootable_uint64 block_size,
+                         bootable_uint64 block_count) {
+
+	if (block_size == 0)
+		block_size = BOOTABLE_CACHE_BLOCK_SIZE;
+
+	if (block_count == 0)
+		block_count = BOOTABLE_CACHE_BLOCK_COUNT;
+
+	if ((block_size & (block_size - 1)) != 0)
+		return BOOTABLE_EINVAL;
+
+	bootable_uint64 backend_size = 0;
+
+	int err = bootable_stream_get_size(backend, &backend_size);
+	if (err != 0)
+		return err;
+
+	bootable_uint64 bucket_count = 1;
+
+	while (bucket_count < (block_count * 2))
+		bucket_count *= 2;
+
+	struct bootable_cache_block *blocks = bootable_malloc(block_count * sizeof(blocks[0]));
+	unsigned char *data = bootable_malloc(block_count * block_size);
+	struct bootable_cache_block **buckets = bootable_malloc(bucket_count * sizeof(buckets[0]));
+	struct bootable_cache_block **dirty = bootable_malloc(block_count * sizeof(dirty[0]));
+
+	if ((blocks == NULL) || (data == NULL) || (buckets == NULL) || (dirty == NULL)) {
+		bootable_free(blocks);
+		bootable_free(data);
+		bootable_free(buckets);
+		bootable_free(dirty);
+		return BOOTABLE_ENOMEM;
+	}
+
+	bootable_cache_done(cache);
+
+	unsigned int block_shift = 0;
+
+	while ((((bootable_uint64) 1) << block_shift) < block_size)
+		block_shift++;
+
+	cache->backend = backend;
+	cache->backend_size = backend_size;
+	cache->size = backend_size;
+	cache->position = 0;
+	cache->block_size = block_size;
+	cache->block_shift = block_shift;
+	cache->block_count = block_count;
+	cache->blocks = blocks;
+	cache->data = data;
+	cache->buckets = buckets;
+	cache->bucket_count = bucket_count;
+	cache->dirty = dirty;
+
+	reset_blocks(cache);
+
+	return 0;
+}
+
+int bootable_cache_flush(struct bootable_cache *cache) {
+
+	if (cache->backend == NULL)
+		return 0;
+
+	bootable_uint64 dirty_count = 0;
+
+	/* Sort the dirty blocks by offset. There are
+	 * few enough of them for an insertion sort. */
+
+	for (bootable_uint64 i = 0; i < cache->block_count; i++) {
+
+		struct bootable_cache_block *block = &cache->blocks[i];
+		if (!block->used || (block->dirty_end == 0))
+			continue;
+
+		bootable_uint64 j = dirty_count;
+
+		while ((j > 0) && (cache->dirty[j - 1]->offset > block->offset)) {
+			cache->dirty[j] = cache->dirty[j - 1];
+			j--;
+		}
+
+		cache->dirty[j] = block;
+
+		dirty_count++;
+	}
+
+	bootable_uint64 run_begin = 0;
+
+	while (run_begin < dirty_count) {
+
+		bootable_uint64 run_end = run_begin + 1;
+
+		while (run_end < dirty_count) {
+
+			const struct bootable_cache_block *prev = cache->dirty[run_end - 1];
+			const struct bootable_cache_block *next = cache->dirty[run_end];
+
+			if (((prev->offset + cache->block_size) != next->offset)
+			 || (prev->dirty_end != cache->block_size)
+			 || (next->dirty_begin != 0))
+				break;
+
+			run_end++;
+		}
+
+		int err = flush_run(cache, &cache->dirty[run_begin], run_end - run_begin);
+		if (err != 0)
+			return err;
+
+		run_begin = run_end;
+	}
+
+	return 0;
+}
+
+int bootable_cache_invalidate(struct bootable_cache *cache) {
+
+	if (cache->backend == NULL)
+		return 0;
+
+	int err = bootable_cache_flush(cache);
+	if (err != 0)
+		return err;
+
+	bootable_uint64 backend_size = 0;
+
+	err = bootable_stream_get_size(cache->backend, &backend_size);
+	if (err != 0)
+		return err;
+
+	cache->backend_size = backend_size;
+	cache->size = backend_size;
+
+	reset_blocks(cache);
+
+	return 0;
+}
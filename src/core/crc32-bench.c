@@ -0,0 +1,84 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bootable/core/crc32.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Measures the throughput of each CRC32 implementation
+ * over a buffer the size of a GPT entry array. */
+
+#define BUFFER_SIZE 16384
+
+#define ITERATION_COUNT 20000
+
+static double now(void) {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static void bench(const char *name,
+                  enum bootable_crc32_kernel kernel,
+                  const unsigned char *buf,
+                  unsigned int iteration_count) {
+
+	if (bootable_crc32_set_kernel(kernel) != 0) {
+		printf("%-10s : not supported\n", name);
+		return;
+	}
+
+	bootable_uint32 crc = 0;
+
+	double start = now();
+
+	for (unsigned int i = 0; i < iteration_count; i++)
+		crc = bootable_crc32_update(crc, buf, BUFFER_SIZE);
+
+	double elapsed = now() - start;
+
+	double mib = ((double) BUFFER_SIZE * iteration_count) / (1024.0 * 1024.0);
+
+	printf("%-10s : %10.1f MiB/s (crc %08x)\n", name, mib / elapsed, (unsigned int) crc);
+}
+
+int main(int argc, const char **argv) {
+
+	unsigned int iteration_count = ITERATION_COUNT;
+
+	if (argc > 1)
+		iteration_count = (unsigned int) strtoul(argv[1], NULL, 10);
+
+	static unsigned char buf[BUFFER_SIZE];
+
+	for (unsigned int i = 0; i < BUFFER_SIZE; i++)
+		buf[i] = (unsigned char) ((i * 31) ^ (i >> 3));
+
+	/* the portable loop is much slower */
+
+	bench("portable", BOOTABLE_CRC32_PORTABLE, buf, (iteration_count / 20) + 1);
+	bench("slice16", BOOTABLE_CRC32_SLICE16, buf, iteration_count);
+	bench("pclmul", BOOTABLE_CRC32_PCLMUL, buf, iteration_count);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bootable/core/crc32.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const enum bootable_crc32_kernel kernels[] = {
+	BOOTABLE_CRC32_PORTABLE,
+	BOOTABLE_CRC32_SLICE16,
+	BOOTABLE_CRC32_PCLMUL
+};
+
+static void test_known(void) {
+
+	for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+
+		if (bootable_crc32_set_kernel(kernels[i]) != 0)
+			continue;
+
+		assert(bootable_crc32("", 0) == 0x00000000);
+		assert(bootable_crc32("123456789", 9) == 0xCBF43926);
+		assert(bootable_crc32("The quick brown fox jumps over the lazy dog", 43) == 0x414FA339);
+	}
+}
+
+static void test_kernels(void) {
+
+	unsigned char buf[16384 + 64];
+
+	unsigned int seed = 1;
+
+	for (size_t i = 0; i < sizeof(buf); i++) {
+		seed = (seed * 1103515245) + 12345;
+		buf[i] = (unsigned char) (seed >> 16);
+	}
+
+	/* every size and alignment that the kernels
+	 * handle differently, plus a GPT entry array */
+
+	static const size_t sizes[] = { 1, 15, 16, 17, 63, 64, 65, 92, 127, 128, 200, 511, 1000, 16384 };
+
+	for (size_t offset = 0; offset < 16; offset++) {
+
+		for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+
+			assert(bootable_crc32_set_kernel(BOOTABLE_CRC32_PORTABLE) == 0);
+
+			bootable_uint32 expected = bootable_crc32(&buf[offset], sizes[j]);
+
+			for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+
+				if (bootable_crc32_set_kernel(kernels[i]) != 0)
+					continue;
+
+				assert(bootable_crc32(&buf[offset], sizes[j]) == expected);
+
+				/* split the buffer in two */
+
+				size_t half = sizes[j] / 3;
+
+				bootable_uint32 crc = bootable_crc32_update(0, &buf[offset], half);
+
+				crc = bootable_crc32_update(crc, &buf[offset + half], sizes[j] - half);
+
+				assert(crc == expected);
+			}
+		}
+	}
+}
+
+int main(void) {
+	test_known();
+	test_kernels();
+	return EXIT_SUCCESS;
+}
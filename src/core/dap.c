@@ -18,56 +18,30 @@
 
 #include <bootable/core/dap.h>
 
-#include <bootable/core/stream.h>
+#include "schema.h"
 
-#include "misc.h"
+#define DAP_FIELDS(X, T) \
+	X(T, reserved,     0x00, BOOTABLE_SCHEMA_BYTES,  2) \
+	X(T, sector_count, 0x02, BOOTABLE_SCHEMA_UINT16, 2) \
+	X(T, address,      0x04, BOOTABLE_SCHEMA_UINT16, 2) \
+	X(T, segment,      0x06, BOOTABLE_SCHEMA_UINT16, 2) \
+	X(T, sector,       0x08, BOOTABLE_SCHEMA_UINT64, 8)
 
-int bootable_dap_read(struct bootable_dap *dap, struct bootable_stream *stream) {
-
-	int err = bootable_stream_read(stream, dap->reserved, sizeof(dap->reserved));
-	if (err != 0)
-		return err;
-
-	err = decode_uint16(&dap->sector_count, stream);
-	if (err != 0)
-		return err;
+static const struct bootable_schema_field dap_fields[] = {
+	DAP_FIELDS(BOOTABLE_SCHEMA_FIELD, struct bootable_dap)
+};
 
-	err = decode_uint16(&dap->address, stream);
-	if (err != 0)
-		return err;
+DAP_FIELDS(BOOTABLE_SCHEMA_CHECK_FIELD, struct bootable_dap)
 
-	err = decode_uint16(&dap->segment, stream);
-	if (err != 0)
-		return err;
+const struct bootable_schema bootable_dap_schema = BOOTABLE_SCHEMA_INIT(struct bootable_dap, dap_fields, 16,
+	BOOTABLE_SCHEMA_IDENTITY(struct bootable_dap, 16,
+	                         DAP_FIELDS(BOOTABLE_SCHEMA_SAME_OFFSET, struct bootable_dap),
+	                         DAP_FIELDS(BOOTABLE_SCHEMA_FIELD_SIZE, struct bootable_dap)));
 
-	err = decode_uint64(&dap->sector, stream);
-	if (err != 0)
-		return err;
-
-	return 0;
+int bootable_dap_read(struct bootable_dap *dap, struct bootable_stream *stream) {
+	return bootable_schema_read(&bootable_dap_schema, dap, stream);
 }
 
 int bootable_dap_write(const struct bootable_dap *dap, struct bootable_stream *stream) {
-
-	int err = bootable_stream_write(stream, dap->reserved, sizeof(dap->reserved));
-	if (err != 0)
-		return err;
-
-	err = encode_uint16(dap->sector_count, stream);
-	if (err != 0)
-		return err;
-
-	err = encode_uint16(dap->address, stream);
-	if (err != 0)
-		return err;
-
-	err = encode_uint16(dap->segment, stream);
-	if (err != 0)
-		return err;
-
-	err = encode_uint64(dap->sector, stream);
-	if (err != 0)
-		return err;
-
-	return 0;
+	return bootable_schema_write(&bootable_dap_schema, dap, stream);
 }
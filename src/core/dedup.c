@@ -0,0 +1,190 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dedup.h"
+
+#include <bootable/core/error.h>
+#include <bootable/core/file.h>
+#include <bootable/core/memory.h>
+#include <bootable/core/string.h>
+
+/** The number of slots in the table
+ * when it is first allocated. */
+
+#define DEDUP_MIN_TABLE_SIZE 64
+
+/** The number of bytes compared at a time
+ * when the data of a file is not in memory. */
+
+#define DEDUP_COMPARE_SIZE 0x1000
+
+void bootable_dedup_init(struct bootable_dedup *dedup) {
+	dedup->table = bootable_null;
+	dedup->table_size = 0;
+	dedup->count = 0;
+}
+
+void bootable_dedup_done(struct bootable_dedup *dedup) {
+	bootable_free(dedup->table);
+	dedup->table = bootable_null;
+	dedup->table_size = 0;
+	dedup->count = 0;
+}
+
+static void place(struct bootable_dedup_entry *table,
+                  bootable_uint64 table_size,
+                  const struct bootable_dedup_entry *entry) {
+
+	bootable_uint64 mask = table_size - 1;
+	bootable_uint64 i = entry->hash & mask;
+
+	while (table[i].file != bootable_null)
+		i = (i + 1) & mask;
+
+	table[i] = *entry;
+}
+
+static int grow(struct bootable_dedup *dedup) {
+
+	bootable_uint64 table_size;
+	struct bootable_dedup_entry *table;
+
+	table_size = dedup->table_size * 2;
+	if (table_size < DEDUP_MIN_TABLE_SIZE)
+		table_size = DEDUP_MIN_TABLE_SIZE;
+
+	table = bootable_malloc(table_size * sizeof(table[0]));
+	if (table == bootable_null)
+		return BOOTABLE_ENOMEM;
+
+	for (bootable_uint64 i = 0; i < table_size; i++)
+		table[i].file = bootable_null;
+
+	for (bootable_uint64 i = 0; i < dedup->table_size; i++) {
+		if (dedup->table[i].file != bootable_null)
+			place(table, table_size, &dedup->table[i]);
+	}
+
+	bootable_free(dedup->table);
+
+	dedup->table = table;
+	dedup->table_size = table_size;
+
+	return 0;
+}
+
+/** Compares the data of two files
+ * that have the same size and hash. */
+
+static int same_data(struct bootable_file *a,
+                     struct bootable_file *b,
+                     bootable_bool *same) {
+
+	int err;
+	unsigned char a_buf[DEDUP_COMPARE_SIZE];
+	unsigned char b_buf[DEDUP_COMPARE_SIZE];
+	bootable_uint64 piece;
+
+	/* Data at the same place in the same
+	 * stream does not have to be read. */
+	if ((a->source != bootable_null)
+	 && (b->source != bootable_null)
+	 && (a->source->stream == b->source->stream)
+	 && (a->data_offset == b->data_offset)
+	 && ((a->blocks == bootable_null) == (b->blocks == bootable_null))) {
+		*same = bootable_true;
+		return 0;
+	}
+
+	if ((a->source == bootable_null) && (b->source == bootable_null)) {
+		*same = (bootable_memcmp(a->data, b->data, a->data_size) == 0);
+		return 0;
+	}
+
+	for (bootable_uint64 offset = 0; offset < a->data_size; offset += piece) {
+
+		piece = a->data_size - offset;
+		if (piece > DEDUP_COMPARE_SIZE)
+			piece = DEDUP_COMPARE_SIZE;
+
+		err = bootable_file_read(a, offset, a_buf, piece);
+		if (err != 0)
+			return err;
+
+		err = bootable_file_read(b, offset, b_buf, piece);
+		if (err != 0)
+			return err;
+
+		if (bootable_memcmp(a_buf, b_buf, piece) != 0) {
+			*same = bootable_false;
+			return 0;
+		}
+	}
+
+	*same = bootable_true;
+
+	return 0;
+}
+
+int bootable_dedup_add(struct bootable_dedup *dedup,
+                       struct bootable_file *file,
+                       bootable_uint64 hash,
+                       bootable_uint64 id,
+                       bootable_uint64 *original) {
+
+	int err;
+	bootable_bool same;
+	bootable_uint64 mask;
+	bootable_uint64 i;
+	struct bootable_dedup_entry entry;
+
+	entry.hash = hash;
+	entry.file = file;
+	entry.id = id;
+
+	if ((dedup->count + 1) > (dedup->table_size / 2)) {
+		err = grow(dedup);
+		if (err != 0)
+			return err;
+	}
+
+	mask = dedup->table_size - 1;
+
+	for (i = entry.hash & mask; dedup->table[i].file != bootable_null; i = (i + 1) & mask) {
+
+		if ((dedup->table[i].hash != entry.hash)
+		 || (dedup->table[i].file->data_size != file->data_size))
+			continue;
+
+		err = same_data(dedup->table[i].file, file, &same);
+		if (err != 0)
+			return err;
+
+		if (same) {
+			*original = dedup->table[i].id;
+			return 0;
+		}
+	}
+
+	dedup->table[i] = entry;
+	dedup->count++;
+
+	*original = id;
+
+	return 0;
+}
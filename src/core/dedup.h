@@ -0,0 +1,91 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOOTABLE_DEDUP_H
+#define BOOTABLE_DEDUP_H
+
+#include <bootable/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct bootable_file;
+
+/** A file in a deduplication table. */
+
+struct bootable_dedup_entry {
+	/** The hash of the file data. */
+	bootable_uint64 hash;
+	/** The file. If the entry is empty, this is null. */
+	struct bootable_file *file;
+	/** The number that the file was added with. */
+	bootable_uint64 id;
+};
+
+/** Finds files that have the same contents. Files
+ * are grouped by the hash of their data, and files
+ * with the same hash are compared before they are
+ * considered to be the same.
+ * */
+
+struct bootable_dedup {
+	/** An open addressing hash table of files. */
+	struct bootable_dedup_entry *table;
+	/** The number of slots in the table. */
+	bootable_uint64 table_size;
+	/** The number of files in the table. */
+	bootable_uint64 count;
+};
+
+/** Initializes an empty deduplication table.
+ * @param dedup An uninitialized deduplication table.
+ * */
+
+void bootable_dedup_init(struct bootable_dedup *dedup);
+
+/** Releases the memory of a deduplication table.
+ * @param dedup An initialized deduplication table.
+ * */
+
+void bootable_dedup_done(struct bootable_dedup *dedup);
+
+/** Looks for a file that was added before and has the
+ * same contents as another file. If there is none, the
+ * file is added to the table.
+ * @param dedup An initialized deduplication table.
+ * @param file The file to look for.
+ * @param hash The hash of the file data, from @ref bootable_file_hash.
+ * @param id A number that identifies the file to the caller.
+ * @param original Assigned the number of the first file
+ * with the same contents. If the file was added to the
+ * table, this is @p id.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_dedup_add(struct bootable_dedup *dedup,
+                       struct bootable_file *file,
+                       bootable_uint64 hash,
+                       bootable_uint64 id,
+                       bootable_uint64 *original);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_DEDUP_H */
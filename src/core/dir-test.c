@@ -0,0 +1,195 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <bootable/core/dir.h>
+#include <bootable/core/error.h>
+#include <bootable/core/file.h>
+#include <bootable/core/memstream.h>
+#include <bootable/core/stream.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void test_lookup(void) {
+
+	char name[32];
+	struct bootable_dir dir;
+	struct bootable_dir *subdir;
+	struct bootable_file *file;
+
+	bootable_dir_init(&dir);
+
+	/* before the index is built */
+	for (unsigned int i = 0; i < 10; i++) {
+		snprintf(name, sizeof(name), "file-%u", i);
+		assert(bootable_dir_add_file(&dir, name) == 0);
+	}
+
+	assert(bootable_dir_find_file(&dir, "file-3") == &dir.files[3]);
+	assert(dir.child_index_size != 0);
+
+	/* maintained by inserts, through several rehashes */
+	for (unsigned int i = 0; i < 1000; i++) {
+		snprintf(name, sizeof(name), "dir-%u", i);
+		assert(bootable_dir_add_subdir(&dir, name) == 0);
+	}
+
+	for (unsigned int i = 10; i < 1000; i++) {
+		snprintf(name, sizeof(name), "file-%u", i);
+		assert(bootable_dir_add_file(&dir, name) == 0);
+	}
+
+	assert(dir.file_capacity >= dir.file_count);
+	assert(dir.subdir_capacity >= dir.subdir_count);
+	assert((dir.child_index_size / 2) >= 2000);
+
+	for (unsigned int i = 0; i < 1000; i++) {
+
+		snprintf(name, sizeof(name), "file-%u", i);
+		file = bootable_dir_find_file(&dir, name);
+		assert(file != NULL);
+		assert(strcmp(file->name, name) == 0);
+		assert(bootable_dir_find_subdir(&dir, name) == NULL);
+
+		snprintf(name, sizeof(name), "dir-%u", i);
+		subdir = bootable_dir_find_subdir(&dir, name);
+		assert(subdir != NULL);
+		assert(strcmp(subdir->name, name) == 0);
+		assert(bootable_dir_find_file(&dir, name) == NULL);
+	}
+
+	assert(bootable_dir_add_file(&dir, "dir-5") == BOOTABLE_EEXIST);
+	assert(bootable_dir_add_subdir(&dir, "file-5") == BOOTABLE_EEXIST);
+	assert(!bootable_dir_name_exists(&dir, "file-1000"));
+
+	bootable_dir_free(&dir);
+}
+
+struct walk_log {
+	char order[64];
+	unsigned int count;
+	bootable_uint64 max_depth;
+};
+
+static int log_enter(void *data, struct bootable_dir *dir, bootable_uint64 depth) {
+	struct walk_log *log = (struct walk_log *) data;
+	log->order[log->count++] = dir->name[0];
+	if (depth > log->max_depth)
+		log->max_depth = depth;
+	return 0;
+}
+
+static int log_leave(void *data, struct bootable_dir *dir, bootable_uint64 depth) {
+	struct walk_log *log = (struct walk_log *) data;
+	(void) depth;
+	log->order[log->count++] = (char) (dir->name[0] - 'a' + 'A');
+	return 0;
+}
+
+static void test_walk_order(void) {
+
+	struct bootable_dir dir;
+	struct bootable_dir_visitor visitor;
+	struct walk_log log;
+
+	bootable_dir_init(&dir);
+	assert(bootable_dir_add_subdir(&dir, "a") == 0);
+	assert(bootable_dir_add_subdir(&dir, "b") == 0);
+	assert(bootable_dir_add_subdir(&dir.subdirs[0], "c") == 0);
+	assert(bootable_dir_add_subdir(&dir.subdirs[0], "d") == 0);
+	assert(bootable_dir_add_subdir(&dir.subdirs[0].subdirs[1], "e") == 0);
+
+	dir.name = malloc(2);
+	strcpy(dir.name, "r");
+	dir.name_size = 1;
+
+	memset(&log, 0, sizeof(log));
+
+	bootable_dir_visitor_init(&visitor);
+	visitor.data = &log;
+	visitor.enter = log_enter;
+	visitor.leave = log_leave;
+
+	assert(bootable_dir_walk(&dir, &visitor) == 0);
+	assert(strcmp(log.order, "racCdeEDAbBR") == 0);
+	assert(log.max_depth == 3);
+
+	bootable_dir_free(&dir);
+}
+
+/** A tree that is much deeper than the inline
+ * stack of a walk, and deep enough to overflow
+ * a small thread stack if it were recursive. */
+
+static void test_deep(void) {
+
+	const unsigned int depth = 10000;
+	struct bootable_dir dir;
+	struct bootable_dir *subdir;
+	struct bootable_memstream stream;
+
+	bootable_dir_init(&dir);
+
+	subdir = &dir;
+
+	for (unsigned int i = 0; i < depth; i++) {
+		assert(bootable_dir_add_subdir(subdir, "d") == 0);
+		subdir = &subdir->subdirs[0];
+	}
+
+	assert(bootable_dir_add_file(subdir, "f") == 0);
+
+	bootable_memstream_init(&stream);
+	assert(bootable_dir_export(&dir, &stream.stream) == 0);
+	bootable_dir_free(&dir);
+
+	bootable_dir_init(&dir);
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_dir_import(&dir, &stream.stream) == 0);
+
+	subdir = &dir;
+
+	for (unsigned int i = 0; i < depth; i++) {
+		assert(subdir->subdir_count == 1);
+		subdir = &subdir->subdirs[0];
+	}
+
+	assert(subdir->file_count == 1);
+	assert(strcmp(subdir->files[0].name, "f") == 0);
+
+	bootable_dir_free(&dir);
+
+	/* A directory that claims more entries than
+	 * the stream could hold is rejected before
+	 * memory is allocated for them. */
+	memset(stream.data + 8, 0xff, 8);
+	bootable_dir_init(&dir);
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_dir_import(&dir, &stream.stream) == BOOTABLE_EINVAL);
+	bootable_dir_free(&dir);
+
+	bootable_memstream_done(&stream);
+}
+
+int main(void) {
+	test_lookup();
+	test_walk_order();
+	test_deep();
+	return EXIT_SUCCESS;
+}
@@ -17,6 +17,7 @@
  */
 
 #include <bootable/core/dir.h>
+#include <bootable/core/arena.h>
 #include <bootable/core/error.h>
 #include <bootable/core/file.h>
 #include <bootable/core/memory.h>
@@ -25,6 +26,249 @@
 #include <bootable/core/string.h>
 
 #include "misc.h"
+#include "writer.h"
+
+/** The number of children that fit in
+ * an array when it is first allocated. */
+
+#define DIR_MIN_CAPACITY 4
+
+/** The number of slots in the hash table
+ * when it is first built. */
+
+#define DIR_MIN_INDEX_SIZE 16
+
+/** Set in a hash table slot if the
+ * child is a subdirectory. */
+
+#define DIR_INDEX_SUBDIR 1
+
+static bootable_uint64 hash_name(const char *name, bootable_uint64 name_size) {
+
+	bootable_uint64 hash = 0xcbf29ce484222325ULL;
+
+	for (bootable_uint64 i = 0; i < name_size; i++) {
+		hash ^= (unsigned char) name[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static bootable_bool names_equal(const char *a, bootable_uint64 a_size,
+                                 const char *b, bootable_uint64 b_size) {
+
+	if (a_size != b_size)
+		return bootable_false;
+
+	return bootable_memcmp(a, b, a_size) == 0;
+}
+
+static bootable_bool slot_matches(const struct bootable_dir *dir,
+                                  bootable_uint64 slot,
+                                  const char *name,
+                                  bootable_uint64 name_size) {
+
+	bootable_uint64 index = (slot >> 1) - 1;
+
+	if (slot & DIR_INDEX_SUBDIR)
+		return names_equal(dir->subdirs[index].name, dir->subdirs[index].name_size, name, name_size);
+	else
+		return names_equal(dir->files[index].name, dir->files[index].name_size, name, name_size);
+}
+
+static void *dir_alloc(struct bootable_dir *dir, bootable_uint64 size) {
+	if (dir->arena != bootable_null)
+		return bootable_arena_alloc(dir->arena, size);
+	else
+		return bootable_malloc(size);
+}
+
+static void dir_release(struct bootable_dir *dir, void *addr) {
+	if (dir->arena == bootable_null)
+		bootable_free(addr);
+}
+
+static char *copy_name(struct bootable_dir *dir, const char *name, bootable_uint64 name_size) {
+
+	char *tmp_name;
+
+	tmp_name = dir_alloc(dir, name_size + 1);
+	if (tmp_name == bootable_null)
+		return bootable_null;
+
+	bootable_memcpy(tmp_name, name, name_size);
+
+	tmp_name[name_size] = 0;
+
+	return tmp_name;
+}
+
+static void index_insert(bootable_uint64 *table,
+                         bootable_uint64 table_size,
+                         const char *name,
+                         bootable_uint64 name_size,
+                         bootable_uint64 slot) {
+
+	bootable_uint64 mask = table_size - 1;
+	bootable_uint64 i = hash_name(name, name_size) & mask;
+
+	while (table[i] != 0)
+		i = (i + 1) & mask;
+
+	table[i] = slot;
+}
+
+static int index_rebuild(struct bootable_dir *dir, bootable_uint64 table_size) {
+
+	bootable_uint64 *table;
+
+	table = dir_alloc(dir, table_size * sizeof(table[0]));
+	if (table == bootable_null)
+		return BOOTABLE_ENOMEM;
+
+	for (bootable_uint64 i = 0; i < table_size; i++)
+		table[i] = 0;
+
+	for (bootable_uint64 i = 0; i < dir->subdir_count; i++)
+		index_insert(table, table_size, dir->subdirs[i].name, dir->subdirs[i].name_size, ((i + 1) << 1) | DIR_INDEX_SUBDIR);
+
+	for (bootable_uint64 i = 0; i < dir->file_count; i++)
+		index_insert(table, table_size, dir->files[i].name, dir->files[i].name_size, (i + 1) << 1);
+
+	dir_release(dir, dir->child_index);
+
+	dir->child_index = table;
+	dir->child_index_size = table_size;
+
+	return 0;
+}
+
+/** Gets the number of hash table slots
+ * needed to keep the table at most half full. */
+
+static bootable_uint64 index_size_for(bootable_uint64 child_count) {
+
+	bootable_uint64 table_size = DIR_MIN_INDEX_SIZE;
+
+	while (table_size < (child_count * 2))
+		table_size *= 2;
+
+	return table_size;
+}
+
+/** Adds the last child that was appended
+ * to one of the arrays to the hash table.
+ * If the table is not built yet, this does
+ * nothing. If the table cannot grow, it is
+ * dropped and built again on the next lookup. */
+
+static void index_add(struct bootable_dir *dir,
+                      const char *name,
+                      bootable_uint64 name_size,
+                      bootable_uint64 slot) {
+
+	bootable_uint64 child_count;
+
+	if (dir->child_index_size == 0)
+		return;
+
+	child_count = dir->subdir_count + dir->file_count;
+
+	if ((child_count * 2) > dir->child_index_size) {
+		if (index_rebuild(dir, dir->child_index_size * 2) != 0) {
+			dir_release(dir, dir->child_index);
+			dir->child_index = bootable_null;
+			dir->child_index_size = 0;
+		}
+		return;
+	}
+
+	index_insert(dir->child_index, dir->child_index_size, name, name_size, slot);
+}
+
+/** Finds the hash table slot of a child.
+ * The table is built if it does not exist yet.
+ * @returns The slot value, or zero if there is
+ * no child with the name. */
+
+static bootable_uint64 index_find(struct bootable_dir *dir,
+                                  const char *name,
+                                  bootable_uint64 name_size) {
+
+	bootable_uint64 i;
+	bootable_uint64 mask;
+	bootable_uint64 slot;
+
+	if ((dir->subdir_count + dir->file_count) == 0)
+		return 0;
+
+	if (dir->child_index_size == 0) {
+		if (index_rebuild(dir, index_size_for(dir->subdir_count + dir->file_count)) != 0) {
+			/* Fall back to scanning the arrays. */
+			for (i = 0; i < dir->subdir_count; i++) {
+				if (names_equal(dir->subdirs[i].name, dir->subdirs[i].name_size, name, name_size))
+					return ((i + 1) << 1) | DIR_INDEX_SUBDIR;
+			}
+			for (i = 0; i < dir->file_count; i++) {
+				if (names_equal(dir->files[i].name, dir->files[i].name_size, name, name_size))
+					return (i + 1) << 1;
+			}
+			return 0;
+		}
+	}
+
+	mask = dir->child_index_size - 1;
+
+	i = hash_name(name, name_size) & mask;
+
+	for (;;) {
+		slot = dir->child_index[i];
+		if (slot == 0)
+			return 0;
+		else if (slot_matches(dir, slot, name, name_size))
+			return slot;
+		i = (i + 1) & mask;
+	}
+}
+
+/** Makes room for at least one more
+ * element in a child array. The capacity
+ * doubles each time the array grows. */
+
+static int reserve_one(struct bootable_dir *dir,
+                       void **array,
+                       bootable_uint64 *capacity,
+                       bootable_uint64 count,
+                       bootable_uint64 element_size) {
+
+	void *tmp;
+	bootable_uint64 new_capacity;
+
+	if (count < *capacity)
+		return 0;
+
+	new_capacity = *capacity * 2;
+	if (new_capacity < DIR_MIN_CAPACITY)
+		new_capacity = DIR_MIN_CAPACITY;
+
+	if (dir->arena == bootable_null) {
+		tmp = bootable_realloc(*array, new_capacity * element_size);
+		if (tmp == bootable_null)
+			return BOOTABLE_ENOMEM;
+	} else {
+		tmp = bootable_arena_alloc(dir->arena, new_capacity * element_size);
+		if (tmp == bootable_null)
+			return BOOTABLE_ENOMEM;
+		if (*array != bootable_null)
+			bootable_memcpy(tmp, *array, count * element_size);
+	}
+
+	*array = tmp;
+	*capacity = new_capacity;
+
+	return 0;
+}
 
 void bootable_dir_init(struct bootable_dir *dir) {
 	dir->name_size = 0;
@@ -33,120 +277,301 @@ void bootable_dir_init(struct bootable_dir *dir) {
 	dir->name = bootable_null;
 	dir->subdirs = bootable_null;
 	dir->files = bootable_null;
+	dir->subdir_capacity = 0;
+	dir->file_capacity = 0;
+	dir->child_index = bootable_null;
+	dir->child_index_size = 0;
+	dir->arena = bootable_null;
 }
 
-void bootable_dir_free(struct bootable_dir *dir) {
+void bootable_dir_visitor_init(struct bootable_dir_visitor *visitor) {
+	visitor->data = bootable_null;
+	visitor->enter = bootable_null;
+	visitor->leave = bootable_null;
+}
 
-	bootable_free(dir->name);
+/** A directory that a walk is inside of. */
 
-	for (bootable_uint64 i = 0; i < dir->subdir_count; i++)
-		bootable_dir_free(&dir->subdirs[i]);
+struct walk_frame {
+	/** The directory. */
+	struct bootable_dir *dir;
+	/** The index of the next subdirectory to visit. */
+	bootable_uint64 next;
+};
 
-	for (bootable_uint64 i = 0; i < dir->file_count; i++)
-		bootable_file_free(&dir->files[i]);
+int bootable_dir_walk(struct bootable_dir *dir,
+                      const struct bootable_dir_visitor *visitor) {
+
+	int err;
+	struct walk_frame inline_frames[BOOTABLE_DIR_WALK_DEPTH];
+	struct walk_frame *frames;
+	struct walk_frame *tmp;
+	struct walk_frame *frame;
+	struct bootable_dir *subdir;
+	bootable_uint64 capacity;
+	bootable_uint64 count;
+
+	if (visitor->enter != bootable_null) {
+		err = visitor->enter(visitor->data, dir, 0);
+		if (err != 0)
+			return err;
+	}
+
+	frames = inline_frames;
+	frames[0].dir = dir;
+	frames[0].next = 0;
+	capacity = BOOTABLE_DIR_WALK_DEPTH;
+	count = 1;
+	err = 0;
+
+	while (count > 0) {
+
+		frame = &frames[count - 1];
+
+		if (frame->next >= frame->dir->subdir_count) {
+
+			if (visitor->leave != bootable_null) {
+				err = visitor->leave(visitor->data, frame->dir, count - 1);
+				if (err != 0)
+					break;
+			}
 
-	bootable_free(dir->subdirs);
-	bootable_free(dir->files);
+			count--;
+			continue;
+		}
+
+		subdir = &frame->dir->subdirs[frame->next++];
+
+		if (visitor->enter != bootable_null) {
+			err = visitor->enter(visitor->data, subdir, count);
+			if (err != 0)
+				break;
+		}
+
+		if (count >= capacity) {
+
+			tmp = bootable_malloc(capacity * 2 * sizeof(frames[0]));
+			if (tmp == bootable_null) {
+				err = BOOTABLE_ENOMEM;
+				break;
+			}
+
+			bootable_memcpy(tmp, frames, count * sizeof(frames[0]));
+
+			if (frames != inline_frames)
+				bootable_free(frames);
+
+			frames = tmp;
+			capacity *= 2;
+		}
+
+		frames[count].dir = subdir;
+		frames[count].next = 0;
+		count++;
+	}
+
+	if (frames != inline_frames)
+		bootable_free(frames);
+
+	return err;
+}
+
+static void release_dir(struct bootable_dir *dir) {
+
+	if (dir->arena == bootable_null) {
+
+		bootable_free(dir->name);
+
+		for (bootable_uint64 i = 0; i < dir->file_count; i++)
+			bootable_file_free(&dir->files[i]);
+
+		bootable_free(dir->subdirs);
+		bootable_free(dir->files);
+		bootable_free(dir->child_index);
+	}
 
 	dir->name = bootable_null;
 	dir->subdirs = bootable_null;
 	dir->files = bootable_null;
+	dir->subdir_count = 0;
+	dir->file_count = 0;
+	dir->subdir_capacity = 0;
+	dir->file_capacity = 0;
+	dir->child_index = bootable_null;
+	dir->child_index_size = 0;
+}
+
+static int free_visit(void *data, struct bootable_dir *dir, bootable_uint64 depth) {
+	(void) data;
+	(void) depth;
+	release_dir(dir);
+	return 0;
+}
+
+void bootable_dir_free(struct bootable_dir *dir) {
+
+	struct bootable_dir_visitor visitor;
+
+	/* Everything in a directory that uses an arena,
+	 * including its children, is released with the
+	 * arena, so there is nothing to walk here. */
+	if (dir->arena != bootable_null) {
+		release_dir(dir);
+		return;
+	}
+
+	bootable_dir_visitor_init(&visitor);
+	visitor.leave = free_visit;
+
+	/* This only fails if a very deep tree needs more
+	 * stack than there is memory. The directory is still
+	 * emptied then, though the subdirectories are leaked. */
+	if (bootable_dir_walk(dir, &visitor) != 0)
+		release_dir(dir);
 }
 
 int bootable_dir_add_file(struct bootable_dir *dir, const char *name) {
+	return bootable_dir_add_file_n(dir, name, bootable_strlen(name));
+}
+
+int bootable_dir_add_subdir(struct bootable_dir *dir, const char *name) {
+	return bootable_dir_add_subdir_n(dir, name, bootable_strlen(name));
+}
+
+int bootable_dir_add_file_n(struct bootable_dir *dir,
+                            const char *name,
+                            bootable_uint64 name_size) {
 
 	int err;
-	struct bootable_file *files;
-	bootable_uint64 files_size;
+	struct bootable_file *file;
 
-	if (bootable_dir_name_exists(dir, name))
+	if (index_find(dir, name, name_size) != 0)
 		return BOOTABLE_EEXIST;
 
-	files_size = dir->file_count + 1;
-	files_size *= sizeof(dir->files[0]);
+	err = reserve_one(dir,
+	                  (void **) &dir->files,
+	                  &dir->file_capacity,
+	                  dir->file_count,
+	                  sizeof(dir->files[0]));
+	if (err != 0)
+		return err;
 
-	files = dir->files;
+	file = &dir->files[dir->file_count];
 
-	files = bootable_realloc(files, files_size);
-	if (files == bootable_null) {
-		return BOOTABLE_ENOMEM;
-	}
+	bootable_file_init(file);
 
-	bootable_file_init(&files[dir->file_count]);
+	file->arena = dir->arena;
+	file->name = copy_name(dir, name, name_size);
+	if (file->name == bootable_null)
+		return BOOTABLE_ENOMEM;
 
-	err = bootable_file_set_name(&files[dir->file_count], name);
-	if (err != 0) {
-		bootable_file_free(&files[dir->file_count]);
-		return err;
-	}
+	file->name_size = name_size;
 
-	dir->files = files;
 	dir->file_count++;
 
+	index_add(dir, file->name, name_size, dir->file_count << 1);
+
 	return 0;
 }
 
-int bootable_dir_add_subdir(struct bootable_dir *dir, const char *name) {
+int bootable_dir_add_subdir_n(struct bootable_dir *dir,
+                              const char *name,
+                              bootable_uint64 name_size) {
 
 	int err;
-	struct bootable_dir *subdirs;
-	bootable_uint64 subdirs_size;
+	struct bootable_dir *subdir;
 
-	if (bootable_dir_name_exists(dir, name))
+	if (index_find(dir, name, name_size) != 0)
 		return BOOTABLE_EEXIST;
 
-	subdirs_size = dir->subdir_count + 1;
-	subdirs_size *= sizeof(dir->subdirs[0]);
+	err = reserve_one(dir,
+	                  (void **) &dir->subdirs,
+	                  &dir->subdir_capacity,
+	                  dir->subdir_count,
+	                  sizeof(dir->subdirs[0]));
+	if (err != 0)
+		return err;
 
-	subdirs = dir->subdirs;
+	subdir = &dir->subdirs[dir->subdir_count];
 
-	subdirs = bootable_realloc(subdirs, subdirs_size);
-	if (subdirs == bootable_null) {
-		return BOOTABLE_ENOMEM;
-	}
+	bootable_dir_init(subdir);
 
-	bootable_dir_init(&subdirs[dir->subdir_count]);
+	subdir->arena = dir->arena;
+	subdir->name = copy_name(dir, name, name_size);
+	if (subdir->name == bootable_null)
+		return BOOTABLE_ENOMEM;
 
-	err = bootable_dir_set_name(&subdirs[dir->subdir_count], name);
-	if (err != 0) {
-		bootable_dir_free(&subdirs[dir->subdir_count]);
-		return err;
-	}
+	subdir->name_size = name_size;
 
-	dir->subdirs = subdirs;
 	dir->subdir_count++;
 
+	index_add(dir, subdir->name, name_size, (dir->subdir_count << 1) | DIR_INDEX_SUBDIR);
+
 	return 0;
 }
 
-int bootable_dir_export(struct bootable_dir *dir, struct bootable_stream *out) {
+static int export_file(struct bootable_writer *writer, struct bootable_file *file) {
 
 	int err;
 
-	err = encode_uint64(dir->name_size, out);
+	err = bootable_writer_uint64(writer, file->name_size);
 	if (err != 0)
 		return err;
 
-	err = encode_uint64(dir->subdir_count, out);
+	err = bootable_writer_uint64(writer, file->data_size);
 	if (err != 0)
 		return err;
 
-	err = encode_uint64(dir->file_count, out);
+	err = bootable_writer_write(writer, file->name, file->name_size);
 	if (err != 0)
 		return err;
 
-	err = bootable_stream_write(out, dir->name, dir->name_size);
+	if (file->source == bootable_null)
+		return bootable_writer_write(writer, file->data, file->data_size);
+
+	/* The data is copied or skipped
+	 * at the position of the stream. */
+	err = bootable_writer_flush(writer);
 	if (err != 0)
 		return err;
 
-	for (bootable_uint64 i = 0; i < dir->subdir_count; i++) {
-		err = bootable_dir_export(&dir->subdirs[i], out);
-		if (err != 0)
-			return err;
-	}
+	return bootable_file_export_data(file, writer->stream);
+}
+
+static int export_enter(void *data, struct bootable_dir *dir, bootable_uint64 depth) {
+
+	int err;
+	struct bootable_writer *writer = (struct bootable_writer *) data;
+
+	(void) depth;
+
+	err = bootable_writer_uint64(writer, dir->name_size);
+	if (err != 0)
+		return err;
+
+	err = bootable_writer_uint64(writer, dir->subdir_count);
+	if (err != 0)
+		return err;
+
+	err = bootable_writer_uint64(writer, dir->file_count);
+	if (err != 0)
+		return err;
+
+	return bootable_writer_write(writer, dir->name, dir->name_size);
+}
+
+/** The files of a directory come after
+ * all of its subdirectories in the stream. */
+
+static int export_leave(void *data, struct bootable_dir *dir, bootable_uint64 depth) {
+
+	int err;
+	struct bootable_writer *writer = (struct bootable_writer *) data;
+
+	(void) depth;
 
 	for (bootable_uint64 i = 0; i < dir->file_count; i++) {
-		err = bootable_file_export(&dir->files[i], out);
+		err = export_file(writer, &dir->files[i]);
 		if (err != 0)
 			return err;
 	}
@@ -154,54 +579,154 @@ int bootable_dir_export(struct bootable_dir *dir, struct bootable_stream *out) {
 	return 0;
 }
 
+int bootable_dir_export(struct bootable_dir *dir, struct bootable_stream *out) {
+
+	int err;
+	struct bootable_writer writer;
+	struct bootable_dir_visitor visitor;
+
+	err = bootable_writer_init(&writer, out);
+	if (err != 0)
+		return err;
+
+	bootable_dir_visitor_init(&visitor);
+	visitor.data = &writer;
+	visitor.enter = export_enter;
+	visitor.leave = export_leave;
+
+	err = bootable_dir_walk(dir, &visitor);
+	if (err == 0)
+		err = bootable_writer_flush(&writer);
+
+	bootable_writer_done(&writer);
+
+	return err;
+}
+
 int bootable_dir_import(struct bootable_dir *dir, struct bootable_stream *in) {
+	return bootable_dir_import_lazy(dir, in, bootable_null);
+}
+
+/** The state of a directory import. */
+
+struct import_state {
+	/** The stream being imported from. */
+	struct bootable_stream *in;
+	/** Where file data is read from later,
+	 * or null if it is read right away. */
+	struct bootable_file_source *source;
+	/** The size of the stream, or zero
+	 * if the stream can not tell. */
+	bootable_uint64 stream_size;
+};
+
+/** Checks that the entries that a directory claims
+ * to have could fit in what is left of the stream,
+ * before any memory is allocated for them. Every
+ * directory takes at least 24 bytes, and every
+ * file takes at least 16 bytes. */
+
+static bootable_bool counts_fit(const struct import_state *state,
+                                const struct bootable_dir *dir) {
+
+	bootable_uint64 pos;
+	bootable_uint64 left;
+
+	if (state->stream_size == 0)
+		return (dir->subdir_count < (0xffffffffffffffffULL / sizeof(struct bootable_dir)))
+		    && (dir->file_count < (0xffffffffffffffffULL / sizeof(struct bootable_file)));
+
+	if ((bootable_stream_get_pos(state->in, &pos) != 0) || (pos > state->stream_size))
+		return bootable_false;
+
+	left = state->stream_size - pos;
+
+	if (dir->name_size > left)
+		return bootable_false;
+
+	left -= dir->name_size;
+
+	if (dir->subdir_count > (left / 24))
+		return bootable_false;
+
+	left -= dir->subdir_count * 24;
+
+	return dir->file_count <= (left / 16);
+}
+
+static int import_enter(void *data, struct bootable_dir *dir, bootable_uint64 depth) {
 
 	int err;
+	struct import_state *state = (struct import_state *) data;
+
+	(void) depth;
 
-	err = decode_uint64(&dir->name_size, in);
+	err = decode_uint64(&dir->name_size, state->in);
 	if (err != 0)
 		return err;
 
-	err = decode_uint64(&dir->subdir_count, in);
+	err = decode_uint64(&dir->subdir_count, state->in);
 	if (err != 0)
 		return err;
 
-	err = decode_uint64(&dir->file_count, in);
+	err = decode_uint64(&dir->file_count, state->in);
 	if (err != 0)
 		return err;
 
-	dir->name = bootable_malloc(dir->name_size + 1);
-	dir->subdirs = bootable_malloc(dir->subdir_count * sizeof(dir->subdirs[0]));
-	dir->files = bootable_malloc(dir->file_count * sizeof(dir->files[0]));
+	if (!counts_fit(state, dir)) {
+		dir->subdir_count = 0;
+		dir->file_count = 0;
+		return BOOTABLE_EINVAL;
+	}
+
+	dir->name = dir_alloc(dir, dir->name_size + 1);
+	dir->subdirs = dir_alloc(dir, dir->subdir_count * sizeof(dir->subdirs[0]));
+	dir->files = dir_alloc(dir, dir->file_count * sizeof(dir->files[0]));
 	if ((dir->name == bootable_null)
 	 || (dir->subdirs == bootable_null)
 	 || (dir->files == bootable_null)) {
-		bootable_free(dir->name);
-		bootable_free(dir->subdirs);
-		bootable_free(dir->files);
+		dir_release(dir, dir->name);
+		dir_release(dir, dir->subdirs);
+		dir_release(dir, dir->files);
+		dir->name = bootable_null;
+		dir->subdirs = bootable_null;
+		dir->files = bootable_null;
+		dir->subdir_count = 0;
+		dir->file_count = 0;
 		return BOOTABLE_ENOMEM;
 	}
 
-	err = bootable_stream_read(in, dir->name, dir->name_size);
+	dir->subdir_capacity = dir->subdir_count;
+	dir->file_capacity = dir->file_count;
+
+	for (bootable_uint64 i = 0; i < dir->subdir_count; i++) {
+		bootable_dir_init(&dir->subdirs[i]);
+		dir->subdirs[i].arena = dir->arena;
+	}
+
+	for (bootable_uint64 i = 0; i < dir->file_count; i++) {
+		bootable_file_init(&dir->files[i]);
+		dir->files[i].arena = dir->arena;
+	}
+
+	err = bootable_stream_read(state->in, dir->name, dir->name_size);
 	if (err != 0)
 		return err;
 
 	dir->name[dir->name_size] = 0;
 
-	for (bootable_uint64 i = 0; i < dir->subdir_count; i++)
-		bootable_dir_init(&dir->subdirs[i]);
+	return 0;
+}
 
-	for (bootable_uint64 i = 0; i < dir->file_count; i++)
-		bootable_file_init(&dir->files[i]);
+static int import_leave(void *data, struct bootable_dir *dir, bootable_uint64 depth) {
 
-	for (bootable_uint64 i = 0; i < dir->subdir_count; i++) {
-		err = bootable_dir_import(&dir->subdirs[i], in);
-		if (err != 0)
-			return err;
-	}
+	int err;
+	struct import_state *state = (struct import_state *) data;
+
+	(void) depth;
 
 	for (bootable_uint64 i = 0; i < dir->file_count; i++) {
-		err = bootable_file_import(&dir->files[i], in);
+		err = bootable_file_import_lazy(&dir->files[i], state->in, state->source);
 		if (err != 0)
 			return err;
 	}
@@ -209,21 +734,63 @@ int bootable_dir_import(struct bootable_dir *dir, struct bootable_stream *in) {
 	return 0;
 }
 
-bootable_bool bootable_dir_name_exists(const struct bootable_dir *dir, const char *name) {
+int bootable_dir_import_lazy(struct bootable_dir *dir,
+                             struct bootable_stream *in,
+                             struct bootable_file_source *source) {
 
-	bootable_uint64 i;
+	struct import_state state;
+	struct bootable_dir_visitor visitor;
 
-	for (i = 0; i < dir->file_count; i++) {
-		if (bootable_strcmp(dir->files[i].name, name) == 0)
-			return bootable_true;
-	}
+	state.in = in;
+	state.source = source;
 
-	for (i = 0; i < dir->subdir_count; i++) {
-		if (bootable_strcmp(dir->subdirs[i].name, name) == 0)
-			return bootable_true;
-	}
+	if (bootable_stream_get_size(in, &state.stream_size) != 0)
+		state.stream_size = 0;
+
+	bootable_dir_visitor_init(&visitor);
+	visitor.data = &state;
+	visitor.enter = import_enter;
+	visitor.leave = import_leave;
+
+	return bootable_dir_walk(dir, &visitor);
+}
+
+bootable_bool bootable_dir_name_exists(struct bootable_dir *dir, const char *name) {
+	return index_find(dir, name, bootable_strlen(name)) != 0;
+}
 
-	return bootable_false;
+struct bootable_file *bootable_dir_find_file(struct bootable_dir *dir, const char *name) {
+	return bootable_dir_find_file_n(dir, name, bootable_strlen(name));
+}
+
+struct bootable_dir *bootable_dir_find_subdir(struct bootable_dir *dir, const char *name) {
+	return bootable_dir_find_subdir_n(dir, name, bootable_strlen(name));
+}
+
+struct bootable_file *bootable_dir_find_file_n(struct bootable_dir *dir,
+                                               const char *name,
+                                               bootable_uint64 name_size) {
+
+	bootable_uint64 slot;
+
+	slot = index_find(dir, name, name_size);
+	if ((slot == 0) || (slot & DIR_INDEX_SUBDIR))
+		return bootable_null;
+
+	return &dir->files[(slot >> 1) - 1];
+}
+
+struct bootable_dir *bootable_dir_find_subdir_n(struct bootable_dir *dir,
+                                                const char *name,
+                                                bootable_uint64 name_size) {
+
+	bootable_uint64 slot;
+
+	slot = index_find(dir, name, name_size);
+	if ((slot == 0) || !(slot & DIR_INDEX_SUBDIR))
+		return bootable_null;
+
+	return &dir->subdirs[(slot >> 1) - 1];
 }
 
 int bootable_dir_set_name(struct bootable_dir *dir, const char *name) {
@@ -233,15 +800,11 @@ int bootable_dir_set_name(struct bootable_dir *dir, const char *name) {
 
 	name_size = bootable_strlen(name);
 
-	tmp_name = bootable_malloc(name_size + 1);
+	tmp_name = copy_name(dir, name, name_size);
 	if (tmp_name == bootable_null)
 		return BOOTABLE_ENOMEM;
 
-	bootable_memcpy(tmp_name, name, name_size);
-
-	tmp_name[name_size] = 0;
-
-	bootable_free(dir->name);
+	dir_release(dir, dir->name);
 
 	dir->name = tmp_name;
 	dir->name_size = name_size;
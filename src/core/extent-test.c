@@ -0,0 +1,197 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bootable/core/extent.h>
+#include <bootable/core/error.h>
+#include <bootable/core/gpt.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void test_merge(void) {
+
+	struct bootable_extent_map map;
+	bootable_extent_map_init(&map);
+
+	assert(bootable_extent_map_free(&map, 10, 10) == 0);
+	assert(bootable_extent_map_free(&map, 30, 10) == 0);
+	assert(map.extent_count == 2);
+
+	/* overlaps */
+	assert(bootable_extent_map_free(&map, 15, 2) == BOOTABLE_EINVAL);
+	assert(bootable_extent_map_free(&map, 25, 6) == BOOTABLE_EINVAL);
+
+	/* bridges both extents */
+	assert(bootable_extent_map_free(&map, 20, 10) == 0);
+	assert(map.extent_count == 1);
+	assert(map.addr_root->first == 10);
+	assert(map.addr_root->count == 30);
+
+	assert(bootable_extent_map_reserve(&map, 15, 5) == 0);
+	assert(map.extent_count == 2);
+	assert(bootable_extent_map_reserve(&map, 14, 2) == BOOTABLE_ENOSPC);
+
+	bootable_extent_map_done(&map);
+}
+
+static void test_placement(void) {
+
+	struct bootable_extent_map map;
+	bootable_extent_map_init(&map);
+
+	assert(bootable_extent_map_free(&map, 0, 100) == 0);
+	assert(bootable_extent_map_free(&map, 200, 10) == 0);
+	assert(bootable_extent_map_free(&map, 300, 20) == 0);
+
+	bootable_uint64 first = 0;
+
+	assert(bootable_extent_map_allocate(&map, 10, 1, BOOTABLE_PLACEMENT_FIRST_FIT, &first) == 0);
+	assert(first == 0);
+
+	assert(bootable_extent_map_allocate(&map, 10, 1, BOOTABLE_PLACEMENT_BEST_FIT, &first) == 0);
+	assert(first == 200);
+
+	assert(bootable_extent_map_allocate(&map, 10, 8, BOOTABLE_PLACEMENT_BEST_FIT, &first) == 0);
+	assert(first == 304);
+
+	assert(bootable_extent_map_allocate(&map, 10, 64, BOOTABLE_PLACEMENT_FIRST_FIT, &first) == 0);
+	assert(first == 64);
+
+	assert(bootable_extent_map_allocate(&map, 100, 1, BOOTABLE_PLACEMENT_FIRST_FIT, &first) == BOOTABLE_ENOSPC);
+
+	bootable_extent_map_done(&map);
+}
+
+/* Compares the map against a plain
+ * bitmap of free units. */
+
+static void test_random(void) {
+
+	enum { unit_count = 4096 };
+
+	static unsigned char used[unit_count];
+
+	struct bootable_extent_map map;
+	bootable_extent_map_init(&map);
+
+	assert(bootable_extent_map_free(&map, 0, unit_count) == 0);
+
+	unsigned int seed = 1;
+
+	for (unsigned int i = 0; i < 20000; i++) {
+
+		seed = (seed * 1103515245) + 12345;
+
+		bootable_uint64 count = ((seed >> 16) % 32) + 1;
+		bootable_uint64 alignment = 1 << ((seed >> 8) % 4);
+		bootable_uint64 first = 0;
+
+		if ((seed >> 24) & 1) {
+
+			enum bootable_placement placement = (seed >> 25) & 1;
+
+			int err = bootable_extent_map_allocate(&map, count, alignment, placement, &first);
+			if (err != 0) {
+				assert(err == BOOTABLE_ENOSPC);
+				continue;
+			}
+
+			assert((first % alignment) == 0);
+			assert((first + count) <= unit_count);
+
+			for (bootable_uint64 j = first; j < (first + count); j++) {
+				assert(!used[j]);
+				used[j] = 1;
+			}
+
+		} else {
+
+			first = (seed >> 4) % unit_count;
+			if ((first + count) > unit_count)
+				count = unit_count - first;
+
+			int all_used = 1;
+			for (bootable_uint64 j = first; j < (first + count); j++)
+				all_used &= used[j];
+
+			int err = bootable_extent_map_free(&map, first, count);
+			if (all_used) {
+				assert(err == 0);
+				memset(&used[first], 0, count);
+			} else {
+				assert(err == BOOTABLE_EINVAL);
+			}
+		}
+	}
+
+	/* the map must hold exactly the free runs */
+
+	bootable_uint64 run_count = 0;
+
+	for (bootable_uint64 j = 0; j < unit_count; j++) {
+		if (!used[j] && ((j == 0) || used[j - 1]))
+			run_count++;
+	}
+
+	assert(map.extent_count == run_count);
+
+	bootable_extent_map_done(&map);
+}
+
+static void test_gpt(void) {
+
+	struct bootable_gpt gpt;
+	bootable_gpt_init(&gpt);
+
+	assert(bootable_gpt_format(&gpt, 8 * 1024 * 1024) == 0);
+
+	assert(bootable_gpt_set_entry_size(&gpt, 0, 4096) == 0);
+	assert(gpt.entries[0].first_lba == 2048);
+	assert(gpt.entries[0].last_lba == 2055);
+
+	assert(bootable_gpt_set_entry_size(&gpt, 1, 512) == 0);
+	assert(gpt.entries[1].first_lba == 4096);
+
+	/* resizing frees the old space */
+	assert(bootable_gpt_set_entry_size(&gpt, 0, 8192) == 0);
+	assert(gpt.entries[0].first_lba == 2048);
+
+	assert(bootable_gpt_set_entry_offset(&gpt, 2, 34 * 512, 512) == 0);
+	assert(gpt.entries[2].first_lba == 34);
+	assert(bootable_gpt_set_entry_offset(&gpt, 3, 4096 * 512, 512) == BOOTABLE_ENOSPC);
+
+	assert(bootable_gpt_remove_entry(&gpt, 1) == 0);
+	assert(bootable_gpt_set_entry_offset(&gpt, 3, 4096 * 512, 512) == 0);
+
+	/* too large to be aligned, but still fits */
+	assert(bootable_gpt_set_entry_size(&gpt, 4, 11000 * 512) == 0);
+	assert(gpt.entries[4].first_lba == 4097);
+
+	assert(bootable_gpt_set_entry_size(&gpt, 128, 512) == BOOTABLE_EINVAL);
+
+	bootable_gpt_done(&gpt);
+}
+
+int main(void) {
+	test_merge();
+	test_placement();
+	test_random();
+	test_gpt();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,463 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bootable/core/extent.h>
+
+#include <bootable/core/error.h>
+#include <bootable/core/memory.h>
+
+#ifndef NULL
+#define NULL ((void *) 0x00)
+#endif
+
+static bootable_uint32 next_priority(struct bootable_extent_map *map) {
+
+	bootable_uint32 x = map->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	map->seed = x;
+	return x;
+}
+
+static bootable_uint64 max_count_of(const struct bootable_extent *extent) {
+	if (extent == NULL)
+		return 0;
+	else
+		return extent->max_count;
+}
+
+static void update(struct bootable_extent *extent) {
+
+	bootable_uint64 left = max_count_of(extent->addr_child[0]);
+	bootable_uint64 right = max_count_of(extent->addr_child[1]);
+
+	extent->max_count = extent->count;
+	if (left > extent->max_count)
+		extent->max_count = left;
+	if (right > extent->max_count)
+		extent->max_count = right;
+}
+
+/* Address tree */
+
+static void addr_split(struct bootable_extent *root,
+                       bootable_uint64 first,
+                       struct bootable_extent **left,
+                       struct bootable_extent **right) {
+
+	if (root == NULL) {
+		*left = NULL;
+		*right = NULL;
+	} else if (root->first < first) {
+		addr_split(root->addr_child[1], first, &root->addr_child[1], right);
+		update(root);
+		*left = root;
+	} else {
+		addr_split(root->addr_child[0], first, left, &root->addr_child[0]);
+		update(root);
+		*right = root;
+	}
+}
+
+static struct bootable_extent *addr_merge(struct bootable_extent *left,
+                                          struct bootable_extent *right) {
+
+	if (left == NULL)
+		return right;
+	else if (right == NULL)
+		return left;
+
+	if (left->priority > right->priority) {
+		left->addr_child[1] = addr_merge(left->addr_child[1], right);
+		update(left);
+		return left;
+	} else {
+		right->addr_child[0] = addr_merge(left, right->addr_child[0]);
+		update(right);
+		return right;
+	}
+}
+
+static void addr_insert(struct bootable_extent_map *map,
+                        struct bootable_extent *extent) {
+
+	struct bootable_extent *left;
+	struct bootable_extent *right;
+
+	extent->addr_child[0] = NULL;
+	extent->addr_child[1] = NULL;
+	update(extent);
+
+	addr_split(map->addr_root, extent->first, &left, &right);
+	map->addr_root = addr_merge(addr_merge(left, extent), right);
+}
+
+static void addr_remove(struct bootable_extent_map *map,
+                        const struct bootable_extent *extent) {
+
+	struct bootable_extent *left;
+	struct bootable_extent *middle;
+	struct bootable_extent *right;
+
+	addr_split(map->addr_root, extent->first, &left, &middle);
+	addr_split(middle, extent->first + 1, &middle, &right);
+	map->addr_root = addr_merge(left, right);
+}
+
+/** Finds the extent with the largest
+ * address that is less than or equal to @p first.
+ * */
+
+static struct bootable_extent *addr_floor(const struct bootable_extent_map *map,
+                                          bootable_uint64 first) {
+
+	struct bootable_extent *extent = map->addr_root;
+	struct bootable_extent *floor = NULL;
+
+	while (extent != NULL) {
+		if (extent->first <= first) {
+			floor = extent;
+			extent = extent->addr_child[1];
+		} else {
+			extent = extent->addr_child[0];
+		}
+	}
+
+	return floor;
+}
+
+/** Finds the extent with the smallest
+ * address that is greater than @p first.
+ * */
+
+static struct bootable_extent *addr_above(const struct bootable_extent_map *map,
+                                          bootable_uint64 first) {
+
+	struct bootable_extent *extent = map->addr_root;
+	struct bootable_extent *above = NULL;
+
+	while (extent != NULL) {
+		if (extent->first > first) {
+			above = extent;
+			extent = extent->addr_child[0];
+		} else {
+			extent = extent->addr_child[1];
+		}
+	}
+
+	return above;
+}
+
+/* Length tree */
+
+static bootable_bool size_less(const struct bootable_extent *a,
+                               bootable_uint64 count,
+                               bootable_uint64 first) {
+
+	if (a->count != count)
+		return a->count < count;
+	else
+		return a->first < first;
+}
+
+static void size_split(struct bootable_extent *root,
+                       bootable_uint64 count,
+                       bootable_uint64 first,
+                       struct bootable_extent **left,
+                       struct bootable_extent **right) {
+
+	if (root == NULL) {
+		*left = NULL;
+		*right = NULL;
+	} else if (size_less(root, count, first)) {
+		size_split(root->size_child[1], count, first, &root->size_child[1], right);
+		*left = root;
+	} else {
+		size_split(root->size_child[0], count, first, left, &root->size_child[0]);
+		*right = root;
+	}
+}
+
+static struct bootable_extent *size_merge(struct bootable_extent *left,
+                                          struct bootable_extent *right) {
+
+	if (left == NULL)
+		return right;
+	else if (right == NULL)
+		return left;
+
+	if (left->priority > right->priority) {
+		left->size_child[1] = size_merge(left->size_child[1], right);
+		return left;
+	} else {
+		right->size_child[0] = size_merge(left, right->size_child[0]);
+		return right;
+	}
+}
+
+static void size_insert(struct bootable_extent_map *map,
+                        struct bootable_extent *extent) {
+
+	struct bootable_extent *left;
+	struct bootable_extent *right;
+
+	extent->size_child[0] = NULL;
+	extent->size_child[1] = NULL;
+
+	size_split(map->size_root, extent->count, extent->first, &left, &right);
+	map->size_root = size_merge(size_merge(left, extent), right);
+}
+
+static void size_remove(struct bootable_extent_map *map,
+                        const struct bootable_extent *extent) {
+
+	struct bootable_extent *left;
+	struct bootable_extent *middle;
+	struct bootable_extent *right;
+
+	size_split(map->size_root, extent->count, extent->first, &left, &middle);
+	size_split(middle, extent->count, extent->first + 1, &middle, &right);
+	map->size_root = size_merge(left, right);
+}
+
+/* Both trees */
+
+static int insert(struct bootable_extent_map *map,
+                  bootable_uint64 first,
+                  bootable_uint64 count) {
+
+	struct bootable_extent *extent;
+
+	extent = bootable_malloc(sizeof(*extent));
+	if (extent == NULL)
+		return BOOTABLE_ENOMEM;
+
+	extent->first = first;
+	extent->count = count;
+	extent->priority = next_priority(map);
+
+	addr_insert(map, extent);
+	size_insert(map, extent);
+
+	map->extent_count++;
+
+	return 0;
+}
+
+static void erase(struct bootable_extent_map *map,
+                  struct bootable_extent *extent) {
+
+	addr_remove(map, extent);
+	size_remove(map, extent);
+
+	bootable_free(extent);
+
+	map->extent_count--;
+}
+
+static bootable_uint64 align_up(bootable_uint64 first,
+                                bootable_uint64 alignment) {
+
+	bootable_uint64 remainder;
+
+	if (alignment <= 1)
+		return first;
+
+	remainder = first % alignment;
+	if (remainder == 0)
+		return first;
+
+	return first + (alignment - remainder);
+}
+
+static bootable_bool fits(const struct bootable_extent *extent,
+                          bootable_uint64 count,
+                          bootable_uint64 alignment) {
+
+	bootable_uint64 first = align_up(extent->first, alignment);
+	bootable_uint64 end = extent->first + extent->count;
+
+	if (first < extent->first)
+		return bootable_false;
+
+	return (first <= end) && ((end - first) >= count);
+}
+
+static struct bootable_extent *first_fit(struct bootable_extent *extent,
+                                         bootable_uint64 count,
+                                         bootable_uint64 alignment) {
+
+	struct bootable_extent *found;
+
+	if ((extent == NULL) || (extent->max_count < count))
+		return NULL;
+
+	found = first_fit(extent->addr_child[0], count, alignment);
+	if (found != NULL)
+		return found;
+
+	if (fits(extent, count, alignment))
+		return extent;
+
+	return first_fit(extent->addr_child[1], count, alignment);
+}
+
+static struct bootable_extent *best_fit(struct bootable_extent *extent,
+                                        bootable_uint64 count,
+                                        bootable_uint64 alignment) {
+
+	struct bootable_extent *found;
+
+	if (extent == NULL)
+		return NULL;
+
+	if (extent->count < count)
+		return best_fit(extent->size_child[1], count, alignment);
+
+	found = best_fit(extent->size_child[0], count, alignment);
+	if (found != NULL)
+		return found;
+
+	if (fits(extent, count, alignment))
+		return extent;
+
+	return best_fit(extent->size_child[1], count, alignment);
+}
+
+void bootable_extent_map_init(struct bootable_extent_map *map) {
+	map->addr_root = NULL;
+	map->size_root = NULL;
+	map->extent_count = 0;
+	map->seed = 0x9e3779b9;
+}
+
+void bootable_extent_map_done(struct bootable_extent_map *map) {
+	bootable_extent_map_clear(map);
+}
+
+void bootable_extent_map_clear(struct bootable_extent_map *map) {
+
+	while (map->addr_root != NULL)
+		erase(map, map->addr_root);
+}
+
+int bootable_extent_map_free(struct bootable_extent_map *map,
+                             bootable_uint64 first,
+                             bootable_uint64 count) {
+
+	struct bootable_extent *prev;
+	struct bootable_extent *next;
+
+	if (count == 0)
+		return 0;
+	else if ((first + count) < first)
+		return BOOTABLE_EINVAL;
+
+	prev = addr_floor(map, first);
+	next = addr_above(map, first);
+
+	if ((prev != NULL) && ((prev->first + prev->count) > first))
+		return BOOTABLE_EINVAL;
+	else if ((next != NULL) && (next->first < (first + count)))
+		return BOOTABLE_EINVAL;
+
+	if ((prev != NULL) && ((prev->first + prev->count) == first)) {
+		first = prev->first;
+		count += prev->count;
+		erase(map, prev);
+	}
+
+	if ((next != NULL) && (next->first == (first + count))) {
+		count += next->count;
+		erase(map, next);
+	}
+
+	return insert(map, first, count);
+}
+
+int bootable_extent_map_reserve(struct bootable_extent_map *map,
+                                bootable_uint64 first,
+                                bootable_uint64 count) {
+
+	struct bootable_extent *extent;
+	bootable_uint64 extent_first;
+	bootable_uint64 extent_end;
+	int err;
+
+	if (count == 0)
+		return 0;
+	else if ((first + count) < first)
+		return BOOTABLE_ENOSPC;
+
+	extent = addr_floor(map, first);
+	if ((extent == NULL)
+	 || ((extent->first + extent->count) < (first + count)))
+		return BOOTABLE_ENOSPC;
+
+	extent_first = extent->first;
+	extent_end = extent->first + extent->count;
+
+	erase(map, extent);
+
+	if (extent_first < first) {
+		err = insert(map, extent_first, first - extent_first);
+		if (err != 0)
+			return err;
+	}
+
+	if ((first + count) < extent_end) {
+		err = insert(map, first + count, extent_end - (first + count));
+		if (err != 0)
+			return err;
+	}
+
+	return 0;
+}
+
+int bootable_extent_map_allocate(struct bootable_extent_map *map,
+                                 bootable_uint64 count,
+                                 bootable_uint64 alignment,
+                                 enum bootable_placement placement,
+                                 bootable_uint64 *first) {
+
+	struct bootable_extent *extent;
+	bootable_uint64 aligned_first;
+	int err;
+
+	if (count == 0)
+		return BOOTABLE_EINVAL;
+
+	if (placement == BOOTABLE_PLACEMENT_BEST_FIT)
+		extent = best_fit(map->size_root, count, alignment);
+	else
+		extent = first_fit(map->addr_root, count, alignment);
+
+	if (extent == NULL)
+		return BOOTABLE_ENOSPC;
+
+	aligned_first = align_up(extent->first, alignment);
+
+	err = bootable_extent_map_reserve(map, aligned_first, count);
+	if (err != 0)
+		return err;
+
+	*first = aligned_first;
+
+	return 0;
+}
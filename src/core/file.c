@@ -17,11 +17,14 @@
  */
 
 #include <bootable/core/file.h>
+#include <bootable/core/arena.h>
 #include <bootable/core/error.h>
+#include <bootable/core/fs.h>
 #include <bootable/core/memory.h>
 #include <bootable/core/stream.h>
 #include <bootable/core/string.h>
 
+#include "blocks.h"
 #include "misc.h"
 
 void bootable_file_init(struct bootable_file *file) {
@@ -29,13 +32,108 @@ void bootable_file_init(struct bootable_file *file) {
 	file->data_size = 0;
 	file->name = bootable_null;
 	file->data = bootable_null;
+	file->arena = bootable_null;
+	file->source = bootable_null;
+	file->data_offset = 0;
+	file->data_hash = 0;
+	file->data_hash_valid = bootable_false;
+	file->compress = bootable_false;
+	file->blocks = bootable_null;
 }
 
 void bootable_file_free(struct bootable_file *file) {
-	bootable_free(file->name);
-	bootable_free(file->data);
+	if (file->arena == bootable_null) {
+		bootable_free(file->name);
+		bootable_free(file->data);
+	}
+	bootable_blocks_free(file->blocks, file->arena);
 	file->name = bootable_null;
 	file->data = bootable_null;
+	file->source = bootable_null;
+	file->data_hash_valid = bootable_false;
+	file->blocks = bootable_null;
+}
+
+static void *file_alloc(struct bootable_file *file, bootable_uint64 size) {
+	if (file->arena != bootable_null)
+		return bootable_arena_alloc(file->arena, size);
+	else
+		return bootable_malloc(size);
+}
+
+static void file_release(struct bootable_file *file, void *addr) {
+	if (file->arena == bootable_null)
+		bootable_free(addr);
+}
+
+/** The number of bytes copied at a time
+ * when data that has not been loaded is
+ * exported to another stream. */
+
+#define FILE_COPY_SIZE 0x10000
+
+/** Exports data that has not been loaded, as
+ * it is stored. If the data is already where it
+ * would be written to, it is skipped. If the source
+ * has a file descriptor and the output stream can
+ * copy from it, the copy is left to the output stream.
+ * Otherwise, it is copied in pieces. */
+
+static int export_unloaded(struct bootable_file *file, struct bootable_stream *out) {
+
+	int err;
+	bootable_uint64 pos;
+	bootable_uint64 copied;
+	bootable_uint64 piece;
+	bootable_uint64 stored_size;
+	void *buf;
+
+	stored_size = bootable_file_stored_size(file);
+
+	err = bootable_stream_get_pos(out, &pos);
+	if (err != 0)
+		return err;
+
+	if (file->source->stream == out) {
+		if (pos == file->data_offset)
+			return bootable_stream_set_pos(out, pos + stored_size);
+		/* Copying forward would overwrite data
+		 * that has not been copied yet. */
+		if ((pos > file->data_offset) && (pos < (file->data_offset + stored_size)))
+			return BOOTABLE_EINVAL;
+	}
+
+	if (file->source->fd >= 0) {
+		err = bootable_stream_copy_from_fd(out, pos, file->source->fd, file->data_offset, stored_size);
+		if (err == 0)
+			return bootable_stream_set_pos(out, pos + stored_size);
+		else if (err != BOOTABLE_ENOSYS)
+			return err;
+	}
+
+	buf = bootable_malloc(FILE_COPY_SIZE);
+	if (buf == bootable_null)
+		return BOOTABLE_ENOMEM;
+
+	for (copied = 0; copied < stored_size; copied += piece) {
+
+		piece = stored_size - copied;
+		if (piece > FILE_COPY_SIZE)
+			piece = FILE_COPY_SIZE;
+
+		err = bootable_stream_read_at(file->source->stream, file->data_offset + copied, buf, piece);
+		if (err == 0)
+			err = bootable_stream_write_at(out, pos + copied, buf, piece);
+
+		if (err != 0) {
+			bootable_free(buf);
+			return err;
+		}
+	}
+
+	bootable_free(buf);
+
+	return bootable_stream_set_pos(out, pos + stored_size);
 }
 
 int bootable_file_export(struct bootable_file *file, struct bootable_stream *out) {
@@ -54,16 +152,83 @@ int bootable_file_export(struct bootable_file *file, struct bootable_stream *out
 	if (err != 0)
 		return err;
 
-	err = bootable_stream_write(out, file->data, file->data_size);
-	if (err != 0)
-		return err;
+	return bootable_file_export_data(file, out);
+}
+
+/** Allocates the buffers that compressed blocks are
+ * read with. The first half is for a decompressed block,
+ * and the second half is for a compressed one. */
+
+static unsigned char *alloc_block_buffers(void) {
+	return bootable_malloc(BOOTABLE_FS_BLOCK_SIZE * 2);
+}
+
+/** Exports data that is compressed in
+ * the source stream, decompressing it
+ * one block at a time. */
+
+static int export_blocks(struct bootable_file *file, struct bootable_stream *out) {
+
+	int err;
+	unsigned char *buf;
+
+	buf = alloc_block_buffers();
+	if (buf == bootable_null)
+		return BOOTABLE_ENOMEM;
+
+	for (bootable_uint64 i = 0; i < file->blocks->block_count; i++) {
+
+		err = bootable_blocks_read(file->blocks, file->source->stream, file->data_offset, i, buf, &buf[BOOTABLE_FS_BLOCK_SIZE]);
+		if (err == 0)
+			err = bootable_stream_write(out, buf, bootable_blocks_size(file->blocks, i));
+
+		if (err != 0) {
+			bootable_free(buf);
+			return err;
+		}
+	}
+
+	bootable_free(buf);
 
 	return 0;
 }
 
+int bootable_file_export_data(struct bootable_file *file, struct bootable_stream *out) {
+
+	if (file->blocks != bootable_null)
+		return export_blocks(file, out);
+	else if (file->source != bootable_null)
+		return export_unloaded(file, out);
+
+	return bootable_stream_write(out, file->data, file->data_size);
+}
+
+int bootable_file_export_stored(struct bootable_file *file, struct bootable_stream *out) {
+
+	if (file->source != bootable_null)
+		return export_unloaded(file, out);
+
+	return bootable_stream_write(out, file->data, file->data_size);
+}
+
+bootable_uint64 bootable_file_stored_size(const struct bootable_file *file) {
+
+	if (file->blocks != bootable_null)
+		return file->blocks->stored_size;
+
+	return file->data_size;
+}
+
 int bootable_file_import(struct bootable_file *file, struct bootable_stream *in) {
+	return bootable_file_import_lazy(file, in, bootable_null);
+}
+
+int bootable_file_import_lazy(struct bootable_file *file,
+                              struct bootable_stream *in,
+                              struct bootable_file_source *source) {
 
 	int err;
+	bootable_uint64 pos;
 
 	err = decode_uint64(&file->name_size, in);
 	if (err != 0)
@@ -73,13 +238,9 @@ int bootable_file_import(struct bootable_file *file, struct bootable_stream *in)
 	if (err != 0)
 		return err;
 
-	file->name = bootable_malloc(file->name_size + 1);
-	file->data = bootable_malloc(file->data_size);
-	if ((file->name == bootable_null) || (file->data == bootable_null)) {
-		bootable_free(file->name);
-		bootable_free(file->data);
+	file->name = file_alloc(file, file->name_size + 1);
+	if (file->name == bootable_null)
 		return BOOTABLE_ENOMEM;
-	}
 
 	err = bootable_stream_read(in, file->name, file->name_size);
 	if (err != 0)
@@ -87,6 +248,29 @@ int bootable_file_import(struct bootable_file *file, struct bootable_stream *in)
 
 	file->name[file->name_size] = 0;
 
+	if (source != bootable_null) {
+
+		err = bootable_stream_get_pos(in, &pos);
+		if (err != 0)
+			return err;
+
+		if ((pos + file->data_size) < pos)
+			return BOOTABLE_EINVAL;
+
+		err = bootable_stream_set_pos(in, pos + file->data_size);
+		if (err != 0)
+			return err;
+
+		file->source = source;
+		file->data_offset = pos;
+
+		return 0;
+	}
+
+	file->data = file_alloc(file, file->data_size);
+	if (file->data == bootable_null)
+		return BOOTABLE_ENOMEM;
+
 	err = bootable_stream_read(in, file->data, file->data_size);
 	if (err != 0)
 		return err;
@@ -101,7 +285,7 @@ int bootable_file_set_name(struct bootable_file *file, const char *name) {
 
 	name_size = bootable_strlen(name);
 
-	tmp_name = bootable_malloc(name_size + 1);
+	tmp_name = file_alloc(file, name_size + 1);
 	if (tmp_name == bootable_null) {
 		return BOOTABLE_ENOMEM;
 	}
@@ -110,10 +294,253 @@ int bootable_file_set_name(struct bootable_file *file, const char *name) {
 
 	tmp_name[name_size] = 0;
 
-	bootable_free(file->name);
+	file_release(file, file->name);
 
 	file->name = tmp_name;
 	file->name_size = name_size;
 
 	return 0;
 }
+
+int bootable_file_resize(struct bootable_file *file, bootable_uint64 data_size) {
+
+	int err;
+	void *data;
+
+	err = bootable_file_load(file);
+	if (err != 0)
+		return err;
+
+	if (file->arena == bootable_null) {
+		data = bootable_realloc(file->data, data_size);
+		if ((data == bootable_null) && (data_size > 0))
+			return BOOTABLE_ENOMEM;
+	} else {
+		data = bootable_arena_alloc(file->arena, data_size);
+		if (data == bootable_null)
+			return BOOTABLE_ENOMEM;
+		if (file->data != bootable_null)
+			bootable_memcpy(data, file->data, (data_size < file->data_size) ? data_size : file->data_size);
+	}
+
+	file->data = data;
+	file->data_size = data_size;
+
+	return 0;
+}
+
+/** Reads part of the data of a file that is
+ * compressed in the source stream. Blocks that
+ * are read completely are decompressed right
+ * into the buffer of the caller. */
+
+static int read_blocks(struct bootable_file *file,
+                       bootable_uint64 offset,
+                       void *buf,
+                       bootable_uint64 size) {
+
+	int err;
+	unsigned char *dst = (unsigned char *) buf;
+	unsigned char *tmp;
+	bootable_uint64 block_size = file->blocks->block_size;
+	bootable_uint64 block_start;
+	bootable_uint64 block_end;
+	bootable_uint64 piece_start;
+	bootable_uint64 piece_end;
+
+	if (size == 0)
+		return 0;
+
+	tmp = alloc_block_buffers();
+	if (tmp == bootable_null)
+		return BOOTABLE_ENOMEM;
+
+	err = 0;
+
+	for (bootable_uint64 i = offset / block_size; (err == 0) && ((i * block_size) < (offset + size)); i++) {
+
+		block_start = i * block_size;
+		block_end = block_start + bootable_blocks_size(file->blocks, i);
+
+		piece_start = (offset > block_start) ? offset : block_start;
+		piece_end = ((offset + size) < block_end) ? (offset + size) : block_end;
+
+		if ((piece_start == block_start) && (piece_end == block_end)) {
+			err = bootable_blocks_read(file->blocks, file->source->stream, file->data_offset, i, &dst[block_start - offset], &tmp[BOOTABLE_FS_BLOCK_SIZE]);
+			continue;
+		}
+
+		err = bootable_blocks_read(file->blocks, file->source->stream, file->data_offset, i, tmp, &tmp[BOOTABLE_FS_BLOCK_SIZE]);
+		if (err == 0)
+			bootable_memcpy(&dst[piece_start - offset], &tmp[piece_start - block_start], piece_end - piece_start);
+	}
+
+	bootable_free(tmp);
+
+	return err;
+}
+
+/** Reads part of the data of a file
+ * that has not been loaded. */
+
+static int read_unloaded(struct bootable_file *file,
+                         bootable_uint64 offset,
+                         void *buf,
+                         bootable_uint64 size) {
+
+	if (file->blocks != bootable_null)
+		return read_blocks(file, offset, buf, size);
+
+	return bootable_stream_read_at(file->source->stream, file->data_offset + offset, buf, size);
+}
+
+int bootable_file_read(struct bootable_file *file,
+                       bootable_uint64 offset,
+                       void *buf,
+                       bootable_uint64 size) {
+
+	int err;
+	struct bootable_file_source *source;
+
+	if ((offset > file->data_size) || (size > (file->data_size - offset)))
+		return BOOTABLE_EINVAL;
+
+	source = file->source;
+
+	if ((source != bootable_null)
+	 && (file->data_size <= source->cache_budget)) {
+
+		err = bootable_file_load(file);
+		if (err != 0)
+			return err;
+
+		/* Only data that was actually
+		 * loaded counts against the budget. */
+		source->cache_budget -= file->data_size;
+	}
+
+	if (file->source != bootable_null)
+		return read_unloaded(file, offset, buf, size);
+
+	bootable_memcpy(buf, ((const unsigned char *) file->data) + offset, size);
+
+	return 0;
+}
+
+int bootable_file_load(struct bootable_file *file) {
+
+	int err;
+	void *data;
+
+	if (file->source == bootable_null)
+		return 0;
+
+	data = file_alloc(file, file->data_size);
+	if (data == bootable_null)
+		return BOOTABLE_ENOMEM;
+
+	err = read_unloaded(file, 0, data, file->data_size);
+	if (err != 0) {
+		file_release(file, data);
+		return err;
+	}
+
+	bootable_blocks_free(file->blocks, file->arena);
+
+	file->data = data;
+	file->source = bootable_null;
+	file->data_hash_valid = bootable_false;
+	file->blocks = bootable_null;
+
+	return 0;
+}
+
+/** Mixes eight bytes of data into a hash. */
+
+static bootable_uint64 hash_word(bootable_uint64 hash, bootable_uint64 word) {
+	hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+	return hash ^ (hash >> 32);
+}
+
+/** Adds data to a hash, eight bytes at a time. Only
+ * the last piece of data may have a size that is not
+ * a multiple of eight, so that the result does not
+ * depend on how the data was split into pieces. */
+
+static bootable_uint64 hash_piece(bootable_uint64 hash,
+                                  const unsigned char *data,
+                                  bootable_uint64 size) {
+
+	bootable_uint64 word;
+	bootable_uint64 i;
+
+	for (i = 0; (i + 8) <= size; i += 8) {
+		word = 0;
+		for (unsigned int j = 0; j < 8; j++)
+			word |= ((bootable_uint64) data[i + j]) << (j * 8);
+		hash = hash_word(hash, word);
+	}
+
+	if (i < size) {
+		word = 0;
+		for (unsigned int j = 0; (i + j) < size; j++)
+			word |= ((bootable_uint64) data[i + j]) << (j * 8);
+		hash = hash_word(hash, word);
+	}
+
+	return hash;
+}
+
+static bootable_uint64 hash_finish(bootable_uint64 hash, bootable_uint64 size) {
+	hash = hash_word(hash, size);
+	hash ^= hash >> 29;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	return hash ^ (hash >> 32);
+}
+
+int bootable_file_hash(struct bootable_file *file, bootable_uint64 *hash) {
+
+	int err;
+	unsigned char *buf;
+	bootable_uint64 piece;
+	bootable_uint64 tmp = 0x9e3779b97f4a7c15ULL;
+
+	if (file->source == bootable_null) {
+		tmp = hash_piece(tmp, file->data, file->data_size);
+		*hash = hash_finish(tmp, file->data_size);
+		return 0;
+	}
+
+	if (file->data_hash_valid) {
+		*hash = file->data_hash;
+		return 0;
+	}
+
+	buf = bootable_malloc(FILE_COPY_SIZE);
+	if (buf == bootable_null)
+		return BOOTABLE_ENOMEM;
+
+	for (bootable_uint64 offset = 0; offset < file->data_size; offset += piece) {
+
+		piece = file->data_size - offset;
+		if (piece > FILE_COPY_SIZE)
+			piece = FILE_COPY_SIZE;
+
+		err = read_unloaded(file, offset, buf, piece);
+		if (err != 0) {
+			bootable_free(buf);
+			return err;
+		}
+
+		tmp = hash_piece(tmp, buf, piece);
+	}
+
+	bootable_free(buf);
+
+	file->data_hash = hash_finish(tmp, file->data_size);
+	file->data_hash_valid = bootable_true;
+
+	*hash = file->data_hash;
+
+	return 0;
+}
@@ -0,0 +1,685 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <bootable/core/fs.h>
+#include <bootable/core/error.h>
+#include <bootable/core/file.h>
+#include <bootable/core/memstream.h>
+#include <bootable/core/stream.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void test_cache(void) {
+
+	char path[64];
+	struct bootable_fs fs;
+	struct bootable_dir *dir;
+	struct bootable_file *file;
+
+	bootable_fs_init(&fs);
+
+	assert(bootable_fs_make_dir(&fs, "/a") == 0);
+	assert(bootable_fs_make_dir(&fs, "/a/b") == 0);
+	assert(bootable_fs_make_file(&fs, "/a/b/f") == 0);
+	assert(bootable_fs_open_file(&fs, "/a/b/f") != NULL);
+	assert(fs.dentry_count == 2);
+
+	/* Adding siblings of 'a' moves the
+	 * root's subdirectory array, which
+	 * must not leave stale entries behind. */
+	for (unsigned int i = 0; i < 100; i++) {
+		snprintf(path, sizeof(path), "/d%u", i);
+		assert(bootable_fs_make_dir(&fs, path) == 0);
+		snprintf(path, sizeof(path), "/a/b/f%u", i);
+		assert(bootable_fs_make_file(&fs, path) == 0);
+	}
+
+	dir = bootable_fs_open_dir(&fs, "/a/b");
+	assert(dir != NULL);
+	assert(dir == &fs.root.subdirs[0].subdirs[0]);
+
+	file = bootable_fs_open_file(&fs, "a/./b/../b/f99");
+	assert(file != NULL);
+	assert(strcmp(file->name, "f99") == 0);
+
+	assert(bootable_fs_open_dir(&fs, "/a/c") == NULL);
+	assert(bootable_fs_open_file(&fs, "/a/c/f") == NULL);
+	assert(bootable_fs_make_file(&fs, "/a/c/f") == BOOTABLE_ENOENT);
+
+	bootable_fs_free(&fs);
+}
+
+static void test_lookup_at(void) {
+
+	struct bootable_fs fs;
+	struct bootable_dir *a;
+	struct bootable_dir *dir;
+	struct bootable_file *file;
+
+	bootable_fs_init(&fs);
+
+	assert(bootable_fs_make_dir(&fs, "/a") == 0);
+	assert(bootable_fs_make_dir(&fs, "/a/b") == 0);
+	assert(bootable_fs_make_file(&fs, "/a/b/f") == 0);
+
+	a = bootable_fs_open_dir(&fs, "/a");
+	assert(a != NULL);
+
+	assert(bootable_fs_lookup_at(a, "b/f", &dir, &file) == 0);
+	assert(dir == NULL);
+	assert(file != NULL);
+	assert(strcmp(file->name, "f") == 0);
+
+	assert(bootable_fs_lookup_at(a, "b", &dir, &file) == 0);
+	assert(dir == &a->subdirs[0]);
+	assert(file == NULL);
+
+	assert(bootable_fs_lookup_at(a, "b", NULL, &file) == BOOTABLE_ENOENT);
+	assert(bootable_fs_lookup_at(a, "b/f", &dir, NULL) == BOOTABLE_ENOENT);
+	assert(bootable_fs_lookup_at(a, "b/g", &dir, &file) == BOOTABLE_ENOENT);
+
+	assert(bootable_fs_lookup_at(a, "..", &dir, NULL) == 0);
+	assert(dir == a);
+
+	bootable_fs_free(&fs);
+}
+
+static void test_round_trip(void) {
+
+	char path[64];
+	struct bootable_fs fs;
+	struct bootable_fs fs2;
+	struct bootable_file *file;
+	struct bootable_memstream out;
+	struct bootable_memstream out2;
+
+	bootable_fs_init(&fs);
+
+	for (unsigned int i = 0; i < 50; i++) {
+		snprintf(path, sizeof(path), "/d%u", i);
+		assert(bootable_fs_make_dir(&fs, path) == 0);
+		snprintf(path, sizeof(path), "/d%u/f", i);
+		assert(bootable_fs_make_file(&fs, path) == 0);
+		file = bootable_fs_open_file(&fs, path);
+		assert(file != NULL);
+		assert(bootable_file_resize(file, i) == 0);
+		memset(file->data, (int) i, i);
+	}
+
+	bootable_memstream_init(&out);
+	assert(bootable_fs_export(&fs, &out.stream) == 0);
+	assert(fs.size == out.size);
+
+	bootable_fs_init(&fs2);
+	assert(bootable_stream_set_pos(&out.stream, 0) == 0);
+	assert(bootable_fs_import(&fs2, &out.stream) == 0);
+	assert(fs2.size == out.size);
+
+	file = bootable_fs_open_file(&fs2, "/d49/f");
+	assert(file != NULL);
+	assert(file->data_size == 49);
+	assert(((unsigned char *) file->data)[48] == 49);
+
+	/* the imported tree can still grow */
+	assert(bootable_fs_make_file(&fs2, "/d0/g") == 0);
+	assert(bootable_fs_make_file(&fs2, "/d0/h") == 0);
+	assert(bootable_fs_open_file(&fs2, "/d0/f") != NULL);
+
+	bootable_memstream_init(&out2);
+	assert(bootable_fs_export(&fs2, &out2.stream) == 0);
+	assert(out2.size > out.size);
+
+	bootable_memstream_done(&out2);
+	bootable_memstream_done(&out);
+	bootable_fs_free(&fs2);
+	bootable_fs_free(&fs);
+}
+
+static void fill(struct bootable_file *file, unsigned char seed) {
+	for (bootable_uint64 i = 0; i < file->data_size; i++)
+		((unsigned char *) file->data)[i] = (unsigned char) (seed + i);
+}
+
+static int check(struct bootable_file *file, unsigned char seed) {
+
+	unsigned char buf[7];
+
+	for (bootable_uint64 i = 0; i < file->data_size; i += sizeof(buf)) {
+		bootable_uint64 size = file->data_size - i;
+		if (size > sizeof(buf))
+			size = sizeof(buf);
+		if (bootable_file_read(file, i, buf, size) != 0)
+			return 0;
+		for (bootable_uint64 j = 0; j < size; j++) {
+			if (buf[j] != (unsigned char) (seed + i + j))
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+static void test_lazy(void) {
+
+	char path[64];
+	unsigned char buf[4];
+	struct bootable_fs fs;
+	struct bootable_file *file;
+	struct bootable_memstream stream;
+
+	bootable_fs_init(&fs);
+
+	for (unsigned int i = 0; i < 20; i++) {
+		snprintf(path, sizeof(path), "/f%u", i);
+		assert(bootable_fs_make_file(&fs, path) == 0);
+		file = bootable_fs_open_file(&fs, path);
+		assert(bootable_file_resize(file, 1000 + i) == 0);
+		fill(file, (unsigned char) i);
+	}
+
+	bootable_memstream_init(&stream);
+	assert(bootable_fs_export(&fs, &stream.stream) == 0);
+	bootable_fs_free(&fs);
+
+	bootable_fs_init(&fs);
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_import_lazy(&fs, &stream.stream, 0) == 0);
+
+	file = bootable_fs_open_file(&fs, "/f3");
+	assert(file != NULL);
+	assert(file->data == NULL);
+	assert(check(file, 3));
+	assert(file->data == NULL);
+	assert(bootable_file_read(file, 1000, buf, 4) == BOOTABLE_EINVAL);
+
+	/* New entries go in front of all of the
+	 * file data, so every file has to move
+	 * towards the end of the stream. */
+	assert(bootable_fs_make_dir(&fs, "/d") == 0);
+	assert(bootable_fs_make_file(&fs, "/d/new") == 0);
+	file = bootable_fs_open_file(&fs, "/d/new");
+	assert(bootable_file_resize(file, 100) == 0);
+	fill(file, 100);
+
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_export(&fs, &stream.stream) == 0);
+
+	for (unsigned int i = 0; i < 20; i++) {
+		snprintf(path, sizeof(path), "/f%u", i);
+		file = bootable_fs_open_file(&fs, path);
+		assert(file->data == NULL);
+		assert(check(file, (unsigned char) i));
+	}
+
+	bootable_fs_free(&fs);
+
+	/* import again, with a cache */
+	bootable_fs_init(&fs);
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_import_lazy(&fs, &stream.stream, 2500) == 0);
+
+	file = bootable_fs_open_file(&fs, "/d/new");
+	assert(check(file, 100));
+	assert(file->data != NULL);
+
+	for (unsigned int i = 0; i < 20; i++) {
+		snprintf(path, sizeof(path), "/f%u", i);
+		file = bootable_fs_open_file(&fs, path);
+		assert(check(file, (unsigned char) i));
+	}
+
+	/* only the first two fit in what was left */
+	assert(bootable_fs_open_file(&fs, "/f1")->data != NULL);
+	assert(bootable_fs_open_file(&fs, "/f2")->data == NULL);
+
+	bootable_fs_free(&fs);
+	bootable_memstream_done(&stream);
+}
+
+static int count_entries(void *data, struct bootable_dir *dir, bootable_uint64 depth) {
+	bootable_uint64 *counts = (bootable_uint64 *) data;
+	counts[0]++;
+	counts[1] += dir->file_count;
+	if (depth > counts[2])
+		counts[2] = depth;
+	return 0;
+}
+
+static void test_walk(void) {
+
+	struct bootable_fs fs;
+	struct bootable_dir_visitor visitor;
+	bootable_uint64 counts[3] = { 0, 0, 0 };
+
+	bootable_fs_init(&fs);
+	assert(bootable_fs_make_dir(&fs, "/a") == 0);
+	assert(bootable_fs_make_dir(&fs, "/a/b") == 0);
+	assert(bootable_fs_make_dir(&fs, "/c") == 0);
+	assert(bootable_fs_make_file(&fs, "/a/b/f") == 0);
+	assert(bootable_fs_make_file(&fs, "/g") == 0);
+
+	bootable_dir_visitor_init(&visitor);
+	visitor.data = counts;
+	visitor.leave = count_entries;
+
+	assert(bootable_fs_walk(&fs, &visitor) == 0);
+	assert(counts[0] == 4);
+	assert(counts[1] == 2);
+	assert(counts[2] == 2);
+
+	bootable_fs_free(&fs);
+}
+
+static void check_locate(struct bootable_memstream *stream,
+                         const char *path,
+                         unsigned char seed,
+                         bootable_uint64 size) {
+
+	bootable_uint64 offset;
+	bootable_uint64 data_size;
+	bootable_uint32 flags;
+	const unsigned char *data;
+
+	assert(bootable_fs_locate(&stream->stream, path, &offset, &data_size, &flags) == 0);
+	assert(flags == 0);
+	assert((offset % BOOTABLE_FS_DATA_ALIGNMENT) == 0);
+	assert(data_size == size);
+
+	data = stream->data + offset;
+
+	for (bootable_uint64 i = 0; i < size; i++)
+		assert(data[i] == (unsigned char) (seed + i));
+}
+
+static void test_v2(void) {
+
+	static const char *paths[] = { "/boot/kernel", "/boot/k", "/boot/kernel2", "/a", "/boot/x/y" };
+	struct bootable_fs fs;
+	struct bootable_file *file;
+	struct bootable_memstream stream;
+	bootable_uint64 offset;
+	bootable_uint64 size;
+	bootable_uint32 flags;
+
+	bootable_fs_init(&fs);
+	fs.signature = BOOTABLE_SIGNATURE_V2;
+
+	assert(bootable_fs_make_dir(&fs, "/boot") == 0);
+	assert(bootable_fs_make_dir(&fs, "/boot/x") == 0);
+
+	for (unsigned int i = 0; i < 5; i++) {
+		assert(bootable_fs_make_file(&fs, paths[i]) == 0);
+		file = bootable_fs_open_file(&fs, paths[i]);
+		assert(bootable_file_resize(file, 700 * i) == 0);
+		fill(file, (unsigned char) i);
+	}
+
+	bootable_memstream_init(&stream);
+	assert(bootable_fs_export(&fs, &stream.stream) == 0);
+	bootable_fs_free(&fs);
+
+	for (unsigned int i = 0; i < 5; i++)
+		check_locate(&stream, paths[i], (unsigned char) i, 700 * i);
+
+	assert(bootable_fs_locate(&stream.stream, "/boot", &offset, &size, &flags) == BOOTABLE_EISDIR);
+	assert(bootable_fs_locate(&stream.stream, "/boot/kern", &offset, &size, &flags) == BOOTABLE_ENOENT);
+	assert(bootable_fs_locate(&stream.stream, "/a/b", &offset, &size, &flags) == BOOTABLE_ENOTDIR);
+
+	bootable_fs_init(&fs);
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_import(&fs, &stream.stream) == 0);
+	assert(fs.signature == BOOTABLE_SIGNATURE_V2);
+
+	for (unsigned int i = 0; i < 5; i++) {
+		file = bootable_fs_open_file(&fs, paths[i]);
+		assert(file != NULL);
+		assert(check(file, (unsigned char) i));
+	}
+
+	bootable_fs_free(&fs);
+
+	/* Adding entries makes the node table
+	 * larger, so the data that was left in
+	 * the stream has to move. */
+	bootable_fs_init(&fs);
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_import_lazy(&fs, &stream.stream, 0) == 0);
+
+	for (unsigned int i = 0; i < 20; i++) {
+		char path[64];
+		snprintf(path, sizeof(path), "/boot/x/new%u", i);
+		assert(bootable_fs_make_file(&fs, path) == 0);
+	}
+
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_export(&fs, &stream.stream) == 0);
+
+	for (unsigned int i = 0; i < 5; i++) {
+		file = bootable_fs_open_file(&fs, paths[i]);
+		assert(file->data == NULL);
+		assert(check(file, (unsigned char) i));
+		check_locate(&stream, paths[i], (unsigned char) i, 700 * i);
+	}
+
+	/* and back to the first version */
+	fs.signature = BOOTABLE_SIGNATURE;
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_export(&fs, &stream.stream) == 0);
+	bootable_fs_free(&fs);
+
+	assert(bootable_fs_locate(&stream.stream, "/boot/kernel", &offset, &size, &flags) == BOOTABLE_EINVAL);
+
+	bootable_fs_init(&fs);
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_import(&fs, &stream.stream) == 0);
+	assert(fs.signature == BOOTABLE_SIGNATURE);
+
+	for (unsigned int i = 0; i < 5; i++)
+		assert(check(bootable_fs_open_file(&fs, paths[i]), (unsigned char) i));
+
+	assert(bootable_fs_open_file(&fs, "/boot/x/new19") != NULL);
+
+	bootable_fs_free(&fs);
+	bootable_memstream_done(&stream);
+}
+
+static void test_dedup(void) {
+
+	static const char *paths[] = { "/m/a", "/m/b", "/m/c", "/m/d" };
+	static const unsigned char seeds[] = { 7, 7, 9, 7 };
+	struct bootable_fs fs;
+	struct bootable_fs_stats stats;
+	struct bootable_file *file;
+	struct bootable_memstream stream;
+	bootable_uint64 offsets[4];
+	bootable_uint64 size;
+	bootable_uint32 flags;
+
+	bootable_fs_init(&fs);
+	fs.signature = BOOTABLE_SIGNATURE_V2;
+
+	assert(bootable_fs_make_dir(&fs, "/m") == 0);
+
+	for (unsigned int i = 0; i < 4; i++) {
+		assert(bootable_fs_make_file(&fs, paths[i]) == 0);
+		file = bootable_fs_open_file(&fs, paths[i]);
+		assert(bootable_file_resize(file, 5000) == 0);
+		fill(file, seeds[i]);
+	}
+
+	assert(bootable_fs_stats(&fs, &stats) == 0);
+	assert(stats.dir_count == 2);
+	assert(stats.file_count == 4);
+	assert(stats.data_size == 20000);
+	assert(stats.unique_data_size == 10000);
+
+	/* the first version stores every copy */
+	fs.signature = BOOTABLE_SIGNATURE;
+	assert(bootable_fs_stats(&fs, &stats) == 0);
+	assert(stats.data_size == 20000);
+	assert(stats.unique_data_size == 20000);
+	fs.signature = BOOTABLE_SIGNATURE_V2;
+
+	bootable_memstream_init(&stream);
+	assert(bootable_fs_export(&fs, &stream.stream) == 0);
+	assert(stream.size < 15000);
+	bootable_fs_free(&fs);
+
+	for (unsigned int i = 0; i < 4; i++) {
+		check_locate(&stream, paths[i], seeds[i], 5000);
+		assert(bootable_fs_locate(&stream.stream, paths[i], &offsets[i], &size, &flags) == 0);
+	}
+
+	assert(offsets[0] == offsets[1]);
+	assert(offsets[0] == offsets[3]);
+	assert(offsets[0] != offsets[2]);
+
+	/* The hashes are stored, so the shared
+	 * data is found again without reading it. */
+	bootable_fs_init(&fs);
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_import_lazy(&fs, &stream.stream, 0) == 0);
+	assert(bootable_fs_open_file(&fs, "/m/b")->data_hash_valid);
+
+	for (unsigned int i = 0; i < 20; i++) {
+		char path[64];
+		snprintf(path, sizeof(path), "/a%u", i);
+		assert(bootable_fs_make_dir(&fs, path) == 0);
+	}
+
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_export(&fs, &stream.stream) == 0);
+
+	for (unsigned int i = 0; i < 4; i++) {
+		file = bootable_fs_open_file(&fs, paths[i]);
+		assert(file->data == NULL);
+		assert(check(file, seeds[i]));
+		check_locate(&stream, paths[i], seeds[i], 5000);
+	}
+
+	/* In the first version, every file has data
+	 * of its own, so shared data is copied apart. */
+	fs.signature = BOOTABLE_SIGNATURE;
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_export(&fs, &stream.stream) == 0);
+	bootable_fs_free(&fs);
+
+	bootable_fs_init(&fs);
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_import(&fs, &stream.stream) == 0);
+
+	for (unsigned int i = 0; i < 4; i++)
+		assert(check(bootable_fs_open_file(&fs, paths[i]), seeds[i]));
+
+	bootable_fs_free(&fs);
+	bootable_memstream_done(&stream);
+}
+
+/** Checks a range of data that was
+ * made with @ref fill, in one read. */
+
+static int check_range(struct bootable_file *file,
+                       unsigned char seed,
+                       bootable_uint64 offset,
+                       bootable_uint64 size) {
+
+	static unsigned char buf[0x30000];
+
+	assert(size <= sizeof(buf));
+
+	if (bootable_file_read(file, offset, buf, size) != 0)
+		return 0;
+
+	for (bootable_uint64 i = 0; i < size; i++) {
+		if (buf[i] != (unsigned char) (seed + offset + i))
+			return 0;
+	}
+
+	return 1;
+}
+
+static int check_blocks(struct bootable_file *file, unsigned char seed) {
+
+	/* Reads that start and end inside of blocks,
+	 * that cover whole blocks, and that span them. */
+	static const bootable_uint64 ranges[][2] = {
+		{ 0, 1 },
+		{ 65530, 20 },
+		{ 1000, 0x20005 },
+		{ 0x10000, 0x10000 },
+		{ 0, 0x30000 },
+		{ 199990, 10 }
+	};
+
+	for (unsigned int i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+		if (!check_range(file, seed, ranges[i][0], ranges[i][1]))
+			return 0;
+	}
+
+	return 1;
+}
+
+static void test_compress(void) {
+
+	static const char *paths[] = { "/c/text", "/c/plain", "/c/small" };
+	static const bootable_uint64 sizes[] = { 200000, 200000, 10 };
+	struct bootable_fs fs;
+	struct bootable_file *file;
+	struct bootable_memstream stream;
+	bootable_uint64 offsets[3];
+	bootable_uint64 size;
+	bootable_uint32 flags;
+	unsigned int seed = 1;
+
+	bootable_fs_init(&fs);
+	fs.signature = BOOTABLE_SIGNATURE_V2;
+
+	assert(bootable_fs_make_dir(&fs, "/c") == 0);
+
+	for (unsigned int i = 0; i < 3; i++) {
+		assert(bootable_fs_make_file(&fs, paths[i]) == 0);
+		file = bootable_fs_open_file(&fs, paths[i]);
+		assert(bootable_file_resize(file, sizes[i]) == 0);
+		fill(file, 3);
+		file->compress = (i != 1);
+	}
+
+	/* Data that does not get smaller is stored as it is. */
+	assert(bootable_fs_make_file(&fs, "/c/random") == 0);
+	file = bootable_fs_open_file(&fs, "/c/random");
+	assert(bootable_file_resize(file, 70000) == 0);
+	file->compress = bootable_true;
+	for (bootable_uint64 i = 0; i < file->data_size; i++) {
+		seed = (seed * 1103515245) + 12345;
+		((unsigned char *) file->data)[i] = (unsigned char) (seed >> 16);
+	}
+
+	/* This file comes first, and moves
+	 * the others once it is compressed. */
+	assert(bootable_fs_make_file(&fs, "/a") == 0);
+	file = bootable_fs_open_file(&fs, "/a");
+	assert(bootable_file_resize(file, 100000) == 0);
+	fill(file, 5);
+
+	bootable_memstream_init(&stream);
+	assert(bootable_fs_export(&fs, &stream.stream) == 0);
+	assert(fs.size == stream.size);
+	assert(stream.size < 200000);
+	bootable_fs_free(&fs);
+
+	/* The plain copy shares the data of the
+	 * compressed one, so it is compressed too. */
+	for (unsigned int i = 0; i < 3; i++) {
+		assert(bootable_fs_locate(&stream.stream, paths[i], &offsets[i], &size, &flags) == 0);
+		assert(flags == BOOTABLE_FS_NODE_COMPRESSED);
+		assert(size < sizes[i] + BOOTABLE_FS_BLOCKS_HEADER_SIZE + 16);
+	}
+
+	assert(offsets[0] == offsets[1]);
+
+	assert(bootable_fs_locate(&stream.stream, "/c/random", &offsets[0], &size, &flags) == 0);
+	assert(flags == BOOTABLE_FS_NODE_COMPRESSED);
+	assert(size == 70000 + BOOTABLE_FS_BLOCKS_HEADER_SIZE + 8);
+
+	/* Compressed files are read one block
+	 * at a time, without being loaded. */
+	bootable_fs_init(&fs);
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_import_lazy(&fs, &stream.stream, 0) == 0);
+
+	for (unsigned int i = 0; i < 2; i++) {
+		file = bootable_fs_open_file(&fs, paths[i]);
+		assert(file->blocks != NULL);
+		assert(file->data_size == 200000);
+		assert(check_blocks(file, 3));
+		assert(file->data == NULL);
+	}
+
+	assert(check_range(bootable_fs_open_file(&fs, "/c/small"), 3, 0, 10));
+
+	/* Growing the tables moves the compressed
+	 * data forward, without decompressing it. */
+	for (unsigned int i = 0; i < 20; i++) {
+		char path[64];
+		snprintf(path, sizeof(path), "/c/new%u", i);
+		assert(bootable_fs_make_dir(&fs, path) == 0);
+	}
+
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_export(&fs, &stream.stream) == 0);
+
+	for (unsigned int i = 0; i < 2; i++) {
+		file = bootable_fs_open_file(&fs, paths[i]);
+		assert(file->data == NULL);
+		assert(file->blocks != NULL);
+		assert(check_blocks(file, 3));
+	}
+
+	/* Compressing the first file moves the
+	 * compressed data of the others backward. */
+	bootable_fs_open_file(&fs, "/a")->compress = bootable_true;
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_export(&fs, &stream.stream) == 0);
+	assert(bootable_fs_open_file(&fs, "/c/plain")->data != NULL);
+	bootable_fs_free(&fs);
+
+	bootable_fs_init(&fs);
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_import_lazy(&fs, &stream.stream, 0) == 0);
+
+	assert(check_range(bootable_fs_open_file(&fs, "/a"), 5, 0, 100000));
+	assert(bootable_fs_open_file(&fs, "/a")->blocks != NULL);
+
+	for (unsigned int i = 0; i < 2; i++)
+		assert(check_blocks(bootable_fs_open_file(&fs, paths[i]), 3));
+
+	/* The first version does not compress,
+	 * so the data is decompressed in place. */
+	fs.signature = BOOTABLE_SIGNATURE;
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_export(&fs, &stream.stream) == 0);
+	bootable_fs_free(&fs);
+
+	bootable_fs_init(&fs);
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_fs_import(&fs, &stream.stream) == 0);
+	assert(fs.signature == BOOTABLE_SIGNATURE);
+
+	for (unsigned int i = 0; i < 3; i++)
+		assert(check(bootable_fs_open_file(&fs, paths[i]), 3));
+
+	assert(check(bootable_fs_open_file(&fs, "/a"), 5));
+	assert(bootable_fs_open_file(&fs, "/c/random")->data_size == 70000);
+
+	bootable_fs_free(&fs);
+	bootable_memstream_done(&stream);
+}
+
+int main(void) {
+	test_cache();
+	test_lookup_at();
+	test_round_trip();
+	test_lazy();
+	test_v2();
+	test_walk();
+	test_dedup();
+	test_compress();
+	return EXIT_SUCCESS;
+}
@@ -19,58 +19,433 @@
 #include <bootable/core/fs.h>
 #include <bootable/core/file.h>
 #include <bootable/core/path.h>
+#include <bootable/core/stream.h>
 #include <bootable/core/error.h>
+#include <bootable/core/memory.h>
 #include <bootable/core/string.h>
 
+#include "dedup.h"
+#include "fs2.h"
 #include "misc.h"
+#include "relocate.h"
 
 #ifndef NULL
 #define NULL ((void *) 0x00)
 #endif
 
-static bootable_uint64 bootable_file_size(const struct bootable_file *file) {
-	return 16 + file->name_size + file->data_size;
+/** The number of slots in the directory
+ * entry table when it is first allocated. */
+
+#define DENTRY_MIN_TABLE_SIZE 64
+
+#define HASH_INIT 0xcbf29ce484222325ULL
+
+static bootable_uint64 hash_bytes(bootable_uint64 hash,
+                                  const char *data,
+                                  bootable_uint64 size) {
+
+	for (bootable_uint64 i = 0; i < size; i++) {
+		hash ^= (unsigned char) data[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/** Hashes the first few names of a path,
+ * as if they were joined with '/'. */
+
+static bootable_uint64 hash_path(const struct bootable_path_view *path,
+                                 bootable_uint64 name_count) {
+
+	bootable_uint64 hash = HASH_INIT;
+
+	for (bootable_uint64 i = 0; i < name_count; i++) {
+		if (i > 0)
+			hash = hash_bytes(hash, "/", 1);
+		hash = hash_bytes(hash, path->names[i].data, path->names[i].size);
+	}
+
+	return hash;
+}
+
+static void dentry_flush(struct bootable_fs *fs) {
+
+	for (bootable_uint64 i = 0; i < fs->dentry_table_size; i++) {
+		bootable_free(fs->dentries[i].path);
+		fs->dentries[i].path = NULL;
+	}
+
+	fs->dentry_count = 0;
+}
+
+static bootable_bool dentry_matches(const struct bootable_dentry *dentry,
+                                    bootable_uint64 hash,
+                                    const struct bootable_path_view *path,
+                                    bootable_uint64 name_count) {
+
+	bootable_uint64 offset = 0;
+	const struct bootable_path_slice *name;
+
+	if (dentry->hash != hash)
+		return bootable_false;
+
+	for (bootable_uint64 i = 0; i < name_count; i++) {
+
+		if (i > 0) {
+			if ((offset >= dentry->path_size)
+			 || (dentry->path[offset] != '/'))
+				return bootable_false;
+			offset++;
+		}
+
+		name = &path->names[i];
+
+		if ((dentry->path_size - offset) < name->size)
+			return bootable_false;
+
+		if (bootable_memcmp(&dentry->path[offset], name->data, name->size) != 0)
+			return bootable_false;
+
+		offset += name->size;
+	}
+
+	return offset == dentry->path_size;
+}
+
+static struct bootable_dir *dentry_find(struct bootable_fs *fs,
+                                        bootable_uint64 hash,
+                                        const struct bootable_path_view *path,
+                                        bootable_uint64 name_count) {
+
+	bootable_uint64 i;
+	bootable_uint64 mask;
+
+	if (fs->dentry_count == 0)
+		return NULL;
+
+	mask = fs->dentry_table_size - 1;
+
+	for (i = hash & mask; fs->dentries[i].path != NULL; i = (i + 1) & mask) {
+		if (dentry_matches(&fs->dentries[i], hash, path, name_count))
+			return fs->dentries[i].dir;
+	}
+
+	return NULL;
+}
+
+static void dentry_place(struct bootable_dentry *table,
+                         bootable_uint64 table_size,
+                         const struct bootable_dentry *dentry) {
+
+	bootable_uint64 mask = table_size - 1;
+	bootable_uint64 i = dentry->hash & mask;
+
+	while (table[i].path != NULL)
+		i = (i + 1) & mask;
+
+	table[i] = *dentry;
+}
+
+static int dentry_grow(struct bootable_fs *fs) {
+
+	bootable_uint64 table_size;
+	struct bootable_dentry *table;
+
+	table_size = fs->dentry_table_size * 2;
+	if (table_size < DENTRY_MIN_TABLE_SIZE)
+		table_size = DENTRY_MIN_TABLE_SIZE;
+
+	table = bootable_malloc(table_size * sizeof(table[0]));
+	if (table == NULL)
+		return BOOTABLE_ENOMEM;
+
+	for (bootable_uint64 i = 0; i < table_size; i++)
+		table[i].path = NULL;
+
+	for (bootable_uint64 i = 0; i < fs->dentry_table_size; i++) {
+		if (fs->dentries[i].path != NULL)
+			dentry_place(table, table_size, &fs->dentries[i]);
+	}
+
+	bootable_free(fs->dentries);
+
+	fs->dentries = table;
+	fs->dentry_table_size = table_size;
+
+	return 0;
+}
+
+/** Adds a directory to the directory entry table.
+ * The table is only a cache, so if memory runs
+ * out the directory is simply not added. */
+
+static void dentry_insert(struct bootable_fs *fs,
+                          bootable_uint64 hash,
+                          const struct bootable_path_view *path,
+                          bootable_uint64 name_count,
+                          struct bootable_dir *dir) {
+
+	bootable_uint64 offset;
+	struct bootable_dentry dentry;
+
+	if (((fs->dentry_count + 1) * 2) > fs->dentry_table_size) {
+		if (dentry_grow(fs) != 0)
+			return;
+	}
+
+	dentry.hash = hash;
+	dentry.dir = dir;
+	dentry.path_size = 0;
+
+	for (bootable_uint64 i = 0; i < name_count; i++)
+		dentry.path_size += path->names[i].size + 1;
+
+	dentry.path = bootable_malloc(dentry.path_size);
+	if (dentry.path == NULL)
+		return;
+
+	/* The last separator is left out. */
+	dentry.path_size--;
+
+	offset = 0;
+
+	for (bootable_uint64 i = 0; i < name_count; i++) {
+		if (i > 0)
+			dentry.path[offset++] = '/';
+		bootable_memcpy(&dentry.path[offset], path->names[i].data, path->names[i].size);
+		offset += path->names[i].size;
+	}
+
+	dentry_place(fs->dentries, fs->dentry_table_size, &dentry);
+
+	fs->dentry_count++;
 }
 
-static bootable_uint64 bootable_dir_size(const struct bootable_dir *dir) {
+/** Resolves the directory that is named by
+ * the first few names of a normalized path.
+ * Every directory found on the way is added
+ * to the directory entry table.
+ * @param fs An initialized file system.
+ * @param path A normalized path.
+ * @param name_count The number of names in
+ * the path that lead to the directory.
+ * @param dir Receives the directory.
+ * @returns Zero on success, @ref BOOTABLE_ENOENT
+ * if one of the directories does not exist.
+ * */
+
+static int resolve_dir(struct bootable_fs *fs,
+                       const struct bootable_path_view *path,
+                       bootable_uint64 name_count,
+                       struct bootable_dir **dir) {
+
+	bootable_uint64 hash;
+	struct bootable_dir *parent_dir;
+	struct bootable_dir *subdir;
+
+	if (name_count == 0) {
+		*dir = &fs->root;
+		return 0;
+	}
+
+	subdir = dentry_find(fs, hash_path(path, name_count), path, name_count);
+	if (subdir != NULL) {
+		*dir = subdir;
+		return 0;
+	}
+
+	parent_dir = &fs->root;
+
+	hash = HASH_INIT;
+
+	for (bootable_uint64 i = 0; i < name_count; i++) {
 
-	bootable_uint64 size = 24;
+		if (i > 0)
+			hash = hash_bytes(hash, "/", 1);
 
-	for (bootable_uint64 i = 0; i < dir->subdir_count; i++)
-		size += bootable_dir_size(&dir->subdirs[i]);
+		hash = hash_bytes(hash, path->names[i].data, path->names[i].size);
 
-	for (bootable_uint64 i = 0; i < dir->file_count; i++)
-		size += bootable_file_size(&dir->files[i]);
+		subdir = dentry_find(fs, hash, path, i + 1);
+		if (subdir == NULL) {
 
-	return size;
+			subdir = bootable_dir_find_subdir_n(parent_dir, path->names[i].data, path->names[i].size);
+			if (subdir == NULL)
+				return BOOTABLE_ENOENT;
+
+			dentry_insert(fs, hash, path, i + 1, subdir);
+		}
+
+		parent_dir = subdir;
+	}
+
+	*dir = parent_dir;
+
+	return 0;
 }
 
-static bootable_uint64 bootable_fs_size(const struct bootable_fs *fs) {
+/** Parses and normalizes a path string.
+ * On failure, the view is released. */
+
+static int parse_path(struct bootable_path_view *path, const char *path_string) {
+
+	int err;
+
+	bootable_path_view_init(path);
+
+	err = bootable_path_view_parse(path, path_string);
+	if (err != 0)
+		bootable_path_view_done(path);
 
-	return 16 + bootable_dir_size(&fs->root);
+	return err;
 }
 
 void bootable_fs_init(struct bootable_fs *fs) {
 	fs->signature = BOOTABLE_SIGNATURE;
 	fs->size = 0;
+	bootable_arena_init(&fs->arena);
 	bootable_dir_init(&fs->root);
+	fs->root.arena = &fs->arena;
+	fs->source.stream = NULL;
+	fs->source.cache_budget = 0;
+	fs->source.fd = -1;
+	fs->dentries = NULL;
+	fs->dentry_table_size = 0;
+	fs->dentry_count = 0;
 }
 
 void bootable_fs_free(struct bootable_fs *fs) {
+	dentry_flush(fs);
+	bootable_free(fs->dentries);
+	fs->dentries = NULL;
+	fs->dentry_table_size = 0;
 	bootable_dir_free(&fs->root);
+	bootable_arena_done(&fs->arena);
+}
+
+/** The state of the walk that plans
+ * how file data is moved in a stream. */
+
+struct move_plan {
+	/** The stream that is exported to. */
+	struct bootable_stream *out;
+	/** The position that the walk is at in the export. */
+	bootable_uint64 offset;
+	/** The data that has to be moved. */
+	struct bootable_move_list moves;
+};
+
+static int plan_enter(void *data, struct bootable_dir *dir, bootable_uint64 depth) {
+
+	struct move_plan *plan = (struct move_plan *) data;
+
+	(void) depth;
+
+	plan->offset += 24 + dir->name_size;
+
+	return 0;
+}
+
+static int plan_leave(void *data, struct bootable_dir *dir, bootable_uint64 depth) {
+
+	int err;
+	struct move_plan *plan = (struct move_plan *) data;
+	struct bootable_file *file;
+
+	(void) depth;
+
+	for (bootable_uint64 i = 0; i < dir->file_count; i++) {
+
+		file = &dir->files[i];
+
+		plan->offset += 16 + file->name_size;
+
+		/* This version does not compress data, so
+		 * compressed data would be decompressed over
+		 * itself if it was left in the stream. */
+		if ((file->blocks != bootable_null) && (file->source->stream == plan->out)) {
+			err = bootable_file_load(file);
+			if (err != 0)
+				return err;
+		}
+
+		err = bootable_move_list_add(&plan->moves, plan->out, file, plan->offset);
+		if (err != 0)
+			return err;
+
+		plan->offset += file->data_size;
+	}
+
+	return 0;
+}
+
+/** Prepares for exporting the file system to the
+ * stream that its file data has not been loaded from. */
+
+static int relocate_unloaded(struct bootable_fs *fs, struct bootable_stream *out) {
+
+	int err;
+	bootable_uint64 start;
+	struct move_plan plan;
+	struct bootable_dir_visitor visitor;
+
+	err = bootable_stream_get_pos(out, &start);
+	if (err != 0)
+		return err;
+
+	plan.out = out;
+	plan.offset = start + 16;
+	bootable_move_list_init(&plan.moves);
+
+	bootable_dir_visitor_init(&visitor);
+	visitor.data = &plan;
+	visitor.enter = plan_enter;
+	visitor.leave = plan_leave;
+
+	err = bootable_dir_walk(&fs->root, &visitor);
+	if (err == 0)
+		err = bootable_move_list_apply(&plan.moves, out);
+
+	bootable_move_list_done(&plan.moves);
+
+	if (err != 0)
+		return err;
+
+	/* Data that was moved may have
+	 * been moved with the stream position. */
+	return bootable_stream_set_pos(out, start);
 }
 
 int bootable_fs_export(struct bootable_fs *fs, struct bootable_stream *out) {
 
 	int err;
+	unsigned char header[16];
+	bootable_uint64 start;
+	bootable_uint64 end;
 
-	fs->size = bootable_fs_size(fs);
+	if (fs->signature == BOOTABLE_SIGNATURE_V2)
+		return bootable_fs2_export(fs, out);
+	else if (fs->signature != BOOTABLE_SIGNATURE)
+		return BOOTABLE_EINVAL;
 
-	err = encode_uint64(fs->signature, out);
+	err = bootable_stream_get_pos(out, &start);
 	if (err != 0)
 		return err;
 
-	err = encode_uint64(fs->size, out);
+	if ((fs->source.stream != NULL) && (fs->source.stream == out)) {
+		err = relocate_unloaded(fs, out);
+		if (err != 0)
+			return err;
+	}
+
+	/* The size is not known until the tree has
+	 * been written, so it is filled in afterwards.
+	 * That way, the tree is only walked once. */
+
+	store_uint64(&header[0], fs->signature);
+	store_uint64(&header[8], 0);
+
+	err = bootable_stream_write(out, header, sizeof(header));
 	if (err != 0)
 		return err;
 
@@ -78,319 +453,345 @@ int bootable_fs_export(struct bootable_fs *fs, struct bootable_stream *out) {
 	if (err != 0)
 		return err;
 
-	return 0;
+	err = bootable_stream_get_pos(out, &end);
+	if (err != 0)
+		return err;
+
+	fs->size = end - start;
+
+	store_uint64(&header[8], fs->size);
+
+	err = bootable_stream_write_at(out, start + 8, &header[8], 8);
+	if (err != 0)
+		return err;
+
+	return bootable_stream_set_pos(out, end);
 }
 
-int bootable_fs_import(struct bootable_fs *fs, struct bootable_stream *in) {
+static int import_fs(struct bootable_fs *fs,
+                     struct bootable_stream *in,
+                     struct bootable_file_source *source) {
 
 	int err;
+	bootable_uint64 start;
+	bootable_uint64 signature;
 
-	err = decode_uint64(&fs->signature, in);
+	dentry_flush(fs);
+
+	err = bootable_stream_get_pos(in, &start);
 	if (err != 0)
 		return err;
 
-	if (fs->signature != BOOTABLE_SIGNATURE)
+	err = decode_uint64(&signature, in);
+	if (err != 0)
+		return err;
+
+	if (signature == BOOTABLE_SIGNATURE_V2) {
+		fs->signature = signature;
+		return bootable_fs2_import(fs, in, start, source);
+	} else if (signature != BOOTABLE_SIGNATURE) {
 		return BOOTABLE_EINVAL;
+	}
+
+	fs->signature = signature;
 
 	err = decode_uint64(&fs->size, in);
 	if (err != 0)
 		return err;
 
-	err = bootable_dir_import(&fs->root, in);
+	err = bootable_dir_import_lazy(&fs->root, in, source);
 	if (err != 0)
 		return err;
 
 	return 0;
 }
 
-int bootable_fs_make_dir(struct bootable_fs *fs, const char *path_str) {
+int bootable_fs_import(struct bootable_fs *fs, struct bootable_stream *in) {
+	return import_fs(fs, in, NULL);
+}
 
-	int err;
-	const char *name;
-	unsigned int name_count;
-	unsigned int subdir_count;
-	unsigned int i;
-	unsigned int j;
-	struct bootable_path path;
-	struct bootable_dir *parent_dir;
-	struct bootable_dir *subdir;
+int bootable_fs_import_lazy(struct bootable_fs *fs,
+                            struct bootable_stream *in,
+                            bootable_uint64 cache_size) {
 
-	bootable_path_init(&path);
+	fs->source.stream = in;
+	fs->source.cache_budget = cache_size;
+	fs->source.fd = -1;
 
-	err = bootable_path_parse(&path, path_str);
-	if (err != 0) {
-		bootable_path_free(&path);
-		return err;
-	}
+	return import_fs(fs, in, &fs->source);
+}
 
-	err = bootable_path_normalize(&path);
-	if (err != 0) {
-		bootable_path_free(&path);
-		return err;
-	}
+int bootable_fs_walk(struct bootable_fs *fs,
+                     const struct bootable_dir_visitor *visitor) {
 
-	parent_dir = &fs->root;
+	return bootable_dir_walk(&fs->root, visitor);
+}
 
-	name_count = bootable_path_get_name_count(&path);
+/** The state of the walk that
+ * computes file system statistics. */
 
-	if (name_count == 0) {
-		bootable_path_free(&path);
-		return BOOTABLE_EINVAL;
-	}
+struct stats_walk {
+	/** The statistics being computed. */
+	struct bootable_fs_stats *stats;
+	/** The files seen so far, by contents. */
+	struct bootable_dedup dedup;
+	/** Whether or not the format of the file
+	 * system stores identical data only once. */
+	bootable_bool shared;
+};
 
-	for (i = 0; i < (name_count - 1); i++) {
+static int stats_visit(void *data, struct bootable_dir *dir, bootable_uint64 depth) {
 
-		name = bootable_path_get_name(&path, i);
-		if (name == NULL) {
-			bootable_path_free(&path);
-			return BOOTABLE_EFAULT;
-		}
+	int err;
+	struct stats_walk *walk = (struct stats_walk *) data;
+	struct bootable_file *file;
+	bootable_uint64 hash;
+	bootable_uint64 original;
 
-		subdir_count = parent_dir->subdir_count;
+	(void) depth;
 
-		for (j = 0; j < subdir_count; j++) {
-			subdir = &parent_dir->subdirs[j];
-			if (subdir == NULL) {
-				continue;
-			} else if (bootable_strcmp(subdir->name, name) == 0) {
-				parent_dir = subdir;
-				break;
-			}
-		}
+	walk->stats->dir_count++;
 
-		if (j >= subdir_count) {
-			/* not found */
-			bootable_path_free(&path);
-			return BOOTABLE_ENOENT;
+	for (bootable_uint64 i = 0; i < dir->file_count; i++) {
+
+		file = &dir->files[i];
+
+		if (!walk->shared) {
+			/* every copy is stored */
+			original = walk->stats->file_count;
+		} else {
+
+			err = bootable_file_hash(file, &hash);
+			if (err != 0)
+				return err;
+
+			err = bootable_dedup_add(&walk->dedup, file, hash, walk->stats->file_count, &original);
+			if (err != 0)
+				return err;
 		}
-	}
 
-	if (i != (name_count - 1)) {
-		bootable_path_free(&path);
-		return BOOTABLE_ENOENT;
-	}
+		if (original == walk->stats->file_count)
+			walk->stats->unique_data_size += file->data_size;
 
-	err = bootable_dir_add_subdir(parent_dir, path.name_array[i].data);
-	if (err != 0) {
-		bootable_path_free(&path);
-		return err;
+		walk->stats->data_size += file->data_size;
+		walk->stats->file_count++;
 	}
 
-	bootable_path_free(&path);
-
 	return 0;
 }
 
-int bootable_fs_make_file(struct bootable_fs *fs, const char *path_str) {
+int bootable_fs_stats(struct bootable_fs *fs, struct bootable_fs_stats *stats) {
 
 	int err;
-	const char *name;
-	unsigned int name_count;
-	unsigned int subdir_count;
-	unsigned int i;
-	unsigned int j;
-	struct bootable_path path;
-	struct bootable_dir *parent_dir;
-	struct bootable_dir *subdir;
+	struct stats_walk walk;
+	struct bootable_dir_visitor visitor;
 
-	bootable_path_init(&path);
+	stats->dir_count = 0;
+	stats->file_count = 0;
+	stats->data_size = 0;
+	stats->unique_data_size = 0;
 
-	err = bootable_path_parse(&path, path_str);
-	if (err != 0) {
-		bootable_path_free(&path);
-		return err;
-	}
+	walk.stats = stats;
+	walk.shared = (fs->signature == BOOTABLE_SIGNATURE_V2);
+	bootable_dedup_init(&walk.dedup);
 
-	err = bootable_path_normalize(&path);
-	if (err != 0) {
-		bootable_path_free(&path);
-		return err;
-	}
+	bootable_dir_visitor_init(&visitor);
+	visitor.data = &walk;
+	visitor.enter = stats_visit;
 
-	parent_dir = &fs->root;
+	err = bootable_fs_walk(fs, &visitor);
 
-	name_count = bootable_path_get_name_count(&path);
+	bootable_dedup_done(&walk.dedup);
 
-	if (name_count == 0) {
-		bootable_path_free(&path);
-		return BOOTABLE_EINVAL;
-	}
-
-	for (i = 0; i < (name_count - 1); i++) {
+	return err;
+}
 
-		name = bootable_path_get_name(&path, i);
-		if (name == NULL) {
-			bootable_path_free(&path);
-			return BOOTABLE_EINVAL;
-		}
+int bootable_fs_make_dir(struct bootable_fs *fs, const char *path_str) {
 
-		subdir_count = parent_dir->subdir_count;
+	int err;
+	bootable_uint64 name_count;
+	struct bootable_path_view path;
+	struct bootable_dir *parent_dir;
+	struct bootable_dir *subdirs;
 
-		for (j = 0; j < subdir_count; j++) {
-			subdir = &parent_dir->subdirs[j];
-			if (subdir == NULL) {
-				continue;
-			} else if (bootable_strcmp(subdir->name, name) == 0) {
-				parent_dir = subdir;
-				break;
-			}
-		}
+	err = parse_path(&path, path_str);
+	if (err != 0)
+		return err;
 
-		if (j >= subdir_count) {
-			/* not found */
-			bootable_path_free(&path);
-			return BOOTABLE_ENOENT;
-		}
-	}
+	name_count = path.name_count;
 
-	if (i != (name_count - 1)) {
-		bootable_path_free(&path);
-		return BOOTABLE_ENOENT;
+	if (name_count == 0) {
+		bootable_path_view_done(&path);
+		return BOOTABLE_EINVAL;
 	}
 
-	err = bootable_dir_add_file(parent_dir, path.name_array[i].data);
+	err = resolve_dir(fs, &path, name_count - 1, &parent_dir);
 	if (err != 0) {
-		bootable_path_free(&path);
+		bootable_path_view_done(&path);
 		return err;
 	}
 
-	bootable_path_free(&path);
+	subdirs = parent_dir->subdirs;
 
-	return 0;
+	err = bootable_dir_add_subdir_n(parent_dir, path.names[name_count - 1].data, path.names[name_count - 1].size);
+
+	/* If the subdirectories were moved, the
+	 * directory entries that point into them
+	 * (and into their children) are stale. */
+	if ((subdirs != NULL) && (subdirs != parent_dir->subdirs))
+		dentry_flush(fs);
+
+	bootable_path_view_done(&path);
+
+	return err;
 }
 
-struct bootable_dir *bootable_fs_open_dir(struct bootable_fs *fs, const char *path_string) {
+int bootable_fs_make_file(struct bootable_fs *fs, const char *path_str) {
 
 	int err;
-	unsigned int i;
-	unsigned int j;
-	const char *name;
-	unsigned int name_count;
-	unsigned int subdir_count;
-	struct bootable_path path;
+	bootable_uint64 name_count;
+	struct bootable_path_view path;
 	struct bootable_dir *parent_dir;
 
-	bootable_path_init(&path);
+	err = parse_path(&path, path_str);
+	if (err != 0)
+		return err;
 
-	err = bootable_path_parse(&path, path_string);
-	if (err != 0) {
-		bootable_path_free(&path);
-		return NULL;
+	name_count = path.name_count;
+
+	if (name_count == 0) {
+		bootable_path_view_done(&path);
+		return BOOTABLE_EINVAL;
 	}
 
-	err = bootable_path_normalize(&path);
+	err = resolve_dir(fs, &path, name_count - 1, &parent_dir);
 	if (err != 0) {
-		bootable_path_free(&path);
-		return NULL;
+		bootable_path_view_done(&path);
+		return err;
 	}
 
-	parent_dir = &fs->root;
+	err = bootable_dir_add_file_n(parent_dir, path.names[name_count - 1].data, path.names[name_count - 1].size);
 
-	name_count = bootable_path_get_name_count(&path);
+	bootable_path_view_done(&path);
 
-	for (i = 0; i < name_count; i++) {
-		name = bootable_path_get_name(&path, i);
-		if (name == NULL) {
-			bootable_path_free(&path);
-			return NULL;
-		}
+	return err;
+}
 
-		subdir_count = parent_dir->subdir_count;
-		for (j = 0; j < subdir_count; j++) {
-			if (bootable_strcmp(parent_dir->subdirs[j].name, name) == 0) {
-				parent_dir = &parent_dir->subdirs[j];
-				break;
-			}
-		}
+struct bootable_dir *bootable_fs_open_dir(struct bootable_fs *fs, const char *path_string) {
 
-		if (j >= subdir_count) {
-			bootable_path_free(&path);
-			return NULL;
-		}
-	}
+	int err;
+	struct bootable_path_view path;
+	struct bootable_dir *dir;
+
+	err = parse_path(&path, path_string);
+	if (err != 0)
+		return NULL;
+
+	err = resolve_dir(fs, &path, path.name_count, &dir);
 
-	bootable_path_free(&path);
+	bootable_path_view_done(&path);
 
-	return parent_dir;
+	if (err != 0)
+		return NULL;
+
+	return dir;
 }
 
 struct bootable_file *bootable_fs_open_file(struct bootable_fs *fs, const char *path_string) {
 
 	int err;
-	unsigned int i;
-	unsigned int j;
-	const char *name;
-	unsigned int subdir_count;
-	unsigned int name_count;
-	struct bootable_path path;
+	bootable_uint64 name_count;
+	struct bootable_path_view path;
 	struct bootable_dir *parent_dir;
+	struct bootable_file *file;
 
-	bootable_path_init(&path);
+	err = parse_path(&path, path_string);
+	if (err != 0)
+		return NULL;
 
-	err = bootable_path_parse(&path, path_string);
-	if (err != 0) {
-		bootable_path_free(&path);
+	name_count = path.name_count;
+
+	if (name_count == 0) {
+		/* there must be at least one
+		 * entry name in the path */
+		bootable_path_view_done(&path);
 		return NULL;
 	}
 
-	err = bootable_path_normalize(&path);
+	err = resolve_dir(fs, &path, name_count - 1, &parent_dir);
 	if (err != 0) {
-		bootable_path_free(&path);
+		bootable_path_view_done(&path);
 		return NULL;
 	}
 
-	parent_dir = &fs->root;
+	file = bootable_dir_find_file_n(parent_dir, path.names[name_count - 1].data, path.names[name_count - 1].size);
 
-	name_count = bootable_path_get_name_count(&path);
+	bootable_path_view_done(&path);
 
-	if (name_count == 0) {
-		/* there must be at least one
-		 * entry name in the path */
-		bootable_path_free(&path);
-		return NULL;
-	}
+	return file;
+}
 
-	for (i = 0; i < (name_count - 1); i++) {
-		name = bootable_path_get_name(&path, i);
-		if (name == NULL) {
-			bootable_path_free(&path);
-			return NULL;
-		}
+int bootable_fs_lookup_at(struct bootable_dir *dir,
+                          const char *path_string,
+                          struct bootable_dir **subdir,
+                          struct bootable_file **file) {
 
-		subdir_count = parent_dir->subdir_count;
-		for (j = 0; j < subdir_count; j++) {
-			if (bootable_strcmp(parent_dir->subdirs[j].name, name) == 0) {
-				parent_dir = &parent_dir->subdirs[j];
-				break;
-			}
-		}
+	int err;
+	const struct bootable_path_slice *name;
+	bootable_uint64 name_count;
+	struct bootable_path_view path;
+	struct bootable_dir *found_dir;
+	struct bootable_file *found_file;
 
-		if (j >= subdir_count) {
-			bootable_path_free(&path);
-			return NULL;
-		}
+	if (subdir != NULL)
+		*subdir = NULL;
+
+	if (file != NULL)
+		*file = NULL;
+
+	err = parse_path(&path, path_string);
+	if (err != 0)
+		return err;
+
+	name_count = path.name_count;
+
+	if (name_count == 0) {
+		bootable_path_view_done(&path);
+		if (subdir == NULL)
+			return BOOTABLE_ENOENT;
+		*subdir = dir;
+		return 0;
 	}
 
-	name = bootable_path_get_name(&path, i);
-	if (name == NULL) {
-		/* This shouldn't happen, so
-		 * this check is a precaution */
-		bootable_path_free(&path);
-		return NULL;
+	for (bootable_uint64 i = 0; i < (name_count - 1); i++) {
+		dir = bootable_dir_find_subdir_n(dir, path.names[i].data, path.names[i].size);
+		if (dir == NULL) {
+			bootable_path_view_done(&path);
+			return BOOTABLE_ENOENT;
+		}
 	}
 
-	/* 'name' is now the basename of the file. */
+	name = &path.names[name_count - 1];
 
-	for (j = 0; j < parent_dir->file_count; j++) {
-		if (bootable_strcmp(parent_dir->files[j].name, name) == 0) {
-			bootable_path_free(&path);
-			return &parent_dir->files[j];
+	err = BOOTABLE_ENOENT;
+
+	if (subdir != NULL) {
+		found_dir = bootable_dir_find_subdir_n(dir, name->data, name->size);
+		if (found_dir != NULL) {
+			*subdir = found_dir;
+			err = 0;
 		}
 	}
 
-	/* file not found */
+	if ((err != 0) && (file != NULL)) {
+		found_file = bootable_dir_find_file_n(dir, name->data, name->size);
+		if (found_file != NULL) {
+			*file = found_file;
+			err = 0;
+		}
+	}
 
-	bootable_path_free(&path);
+	bootable_path_view_done(&path);
 
-	return NULL;
+	return err;
 }
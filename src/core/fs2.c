@@ -0,0 +1,1173 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fs2.h"
+
+#include <bootable/core/arena.h>
+#include <bootable/core/dir.h>
+#include <bootable/core/error.h>
+#include <bootable/core/file.h>
+#include <bootable/core/fs.h>
+#include <bootable/core/memory.h>
+#include <bootable/core/path.h>
+#include <bootable/core/stream.h>
+#include <bootable/core/string.h>
+
+#include "blocks.h"
+#include "dedup.h"
+#include "relocate.h"
+#include "schema.h"
+#include "writer.h"
+
+#define HEADER_FIELDS(X, T) \
+	X(T, signature,   0x00, BOOTABLE_SCHEMA_UINT64, 8) \
+	X(T, size,        0x08, BOOTABLE_SCHEMA_UINT64, 8) \
+	X(T, node_count,  0x10, BOOTABLE_SCHEMA_UINT64, 8) \
+	X(T, node_offset, 0x18, BOOTABLE_SCHEMA_UINT64, 8) \
+	X(T, name_offset, 0x20, BOOTABLE_SCHEMA_UINT64, 8) \
+	X(T, name_size,   0x28, BOOTABLE_SCHEMA_UINT64, 8) \
+	X(T, data_offset, 0x30, BOOTABLE_SCHEMA_UINT64, 8) \
+	X(T, hash_offset, 0x38, BOOTABLE_SCHEMA_UINT64, 8)
+
+static const struct bootable_schema_field header_fields[] = {
+	HEADER_FIELDS(BOOTABLE_SCHEMA_FIELD, struct bootable_fs_header)
+};
+
+HEADER_FIELDS(BOOTABLE_SCHEMA_CHECK_FIELD, struct bootable_fs_header)
+
+static const struct bootable_schema header_schema = BOOTABLE_SCHEMA_INIT(struct bootable_fs_header, header_fields, BOOTABLE_FS_HEADER_SIZE,
+	BOOTABLE_SCHEMA_IDENTITY(struct bootable_fs_header, BOOTABLE_FS_HEADER_SIZE,
+	                         HEADER_FIELDS(BOOTABLE_SCHEMA_SAME_OFFSET, struct bootable_fs_header),
+	                         HEADER_FIELDS(BOOTABLE_SCHEMA_FIELD_SIZE, struct bootable_fs_header)));
+
+#define NODE_FIELDS(X, T) \
+	X(T, name_offset, 0x00, BOOTABLE_SCHEMA_UINT32, 4) \
+	X(T, name_size,   0x04, BOOTABLE_SCHEMA_UINT32, 4) \
+	X(T, flags,       0x08, BOOTABLE_SCHEMA_UINT32, 4) \
+	X(T, first,       0x10, BOOTABLE_SCHEMA_UINT64, 8) \
+	X(T, count,       0x18, BOOTABLE_SCHEMA_UINT64, 8)
+
+static const struct bootable_schema_field node_fields[] = {
+	NODE_FIELDS(BOOTABLE_SCHEMA_FIELD, struct bootable_fs_node)
+};
+
+NODE_FIELDS(BOOTABLE_SCHEMA_CHECK_FIELD, struct bootable_fs_node)
+
+static const struct bootable_schema node_schema = BOOTABLE_SCHEMA_INIT(struct bootable_fs_node, node_fields, BOOTABLE_FS_NODE_SIZE,
+	BOOTABLE_SCHEMA_IDENTITY(struct bootable_fs_node, BOOTABLE_FS_NODE_SIZE,
+	                         NODE_FIELDS(BOOTABLE_SCHEMA_SAME_OFFSET, struct bootable_fs_node),
+	                         NODE_FIELDS(BOOTABLE_SCHEMA_FIELD_SIZE, struct bootable_fs_node)));
+
+/** The largest offset or size of a name. */
+
+#define FS_NAME_MAX 0xffffffffULL
+
+/** The number of name bytes that are read at a
+ * time when a name is compared in @ref bootable_fs_locate. */
+
+#define LOCATE_NAME_PIECE 64
+
+static bootable_uint64 align_data(bootable_uint64 offset) {
+	return (offset + (BOOTABLE_FS_DATA_ALIGNMENT - 1)) & ~((bootable_uint64) (BOOTABLE_FS_DATA_ALIGNMENT - 1));
+}
+
+/** Compares two names in the order
+ * that the node table is sorted in. */
+
+static int compare_names(const char *a,
+                         bootable_uint64 a_size,
+                         const char *b,
+                         bootable_uint64 b_size) {
+
+	int cmp;
+
+	cmp = bootable_memcmp(a, b, (a_size < b_size) ? a_size : b_size);
+	if (cmp != 0)
+		return cmp;
+	else if (a_size < b_size)
+		return -1;
+	else if (a_size > b_size)
+		return 1;
+	else
+		return 0;
+}
+
+/** A node that is about to be exported. */
+
+struct export_node {
+	/** The entry that is written to the node table. */
+	struct bootable_fs_node node;
+	/** The name of the node. */
+	const char *name;
+	/** If the node is a directory, this is it. */
+	struct bootable_dir *dir;
+	/** If the node is a file, this is it. */
+	struct bootable_file *file;
+	/** The hash of the file data. */
+	bootable_uint64 hash;
+	/** The index of the first node with the same
+	 * file data. The data is only stored for that node. */
+	bootable_uint64 original;
+	/** Whether or not the file data is stored
+	 * compressed. This is set if any of the files
+	 * that share the data should be compressed. */
+	bootable_bool compress;
+	/** If the file data is compressed during the
+	 * export, this is the compressed data. */
+	unsigned char *packed;
+};
+
+/** The node table of a file system
+ * that is about to be exported. */
+
+struct export_list {
+	/** The nodes, in the order of the table. */
+	struct export_node *nodes;
+	/** The number of nodes. */
+	bootable_uint64 count;
+	/** The number of nodes that fit in the array. */
+	bootable_uint64 capacity;
+};
+
+static int push_node(struct export_list *list,
+                     const char *name,
+                     bootable_uint64 name_size,
+                     struct bootable_dir *dir,
+                     struct bootable_file *file) {
+
+	bootable_uint64 capacity;
+	struct export_node *nodes;
+	struct export_node *node;
+
+	if (name_size > FS_NAME_MAX)
+		return BOOTABLE_EINVAL;
+
+	if (list->count >= list->capacity) {
+
+		capacity = list->capacity * 2;
+		if (capacity < 64)
+			capacity = 64;
+
+		nodes = bootable_realloc(list->nodes, capacity * sizeof(nodes[0]));
+		if (nodes == bootable_null)
+			return BOOTABLE_ENOMEM;
+
+		list->nodes = nodes;
+		list->capacity = capacity;
+	}
+
+	node = &list->nodes[list->count++];
+	node->node.name_offset = 0;
+	node->node.name_size = (bootable_uint32) name_size;
+	node->node.flags = (dir != bootable_null) ? BOOTABLE_FS_NODE_DIR : 0;
+	node->node.first = 0;
+	node->node.count = 0;
+	node->name = name;
+	node->dir = dir;
+	node->file = file;
+	node->hash = 0;
+	node->original = list->count - 1;
+	node->compress = (file != bootable_null) ? file->compress : bootable_false;
+	node->packed = bootable_null;
+
+	return 0;
+}
+
+static bootable_bool node_before(const struct export_node *a,
+                                 const struct export_node *b) {
+
+	return compare_names(a->name, a->node.name_size, b->name, b->node.name_size) < 0;
+}
+
+static void sift_down(struct export_node *nodes,
+                      bootable_uint64 root,
+                      bootable_uint64 count) {
+
+	bootable_uint64 child;
+	struct export_node tmp;
+
+	while ((root * 2 + 1) < count) {
+
+		child = root * 2 + 1;
+
+		if (((child + 1) < count) && node_before(&nodes[child], &nodes[child + 1]))
+			child++;
+
+		if (!node_before(&nodes[root], &nodes[child]))
+			return;
+
+		tmp = nodes[root];
+		nodes[root] = nodes[child];
+		nodes[child] = tmp;
+
+		root = child;
+	}
+}
+
+/** Sorts the children of a directory by name. */
+
+static void sort_nodes(struct export_node *nodes, bootable_uint64 count) {
+
+	struct export_node tmp;
+
+	for (bootable_uint64 i = count / 2; i > 0; i--)
+		sift_down(nodes, i - 1, count);
+
+	for (bootable_uint64 i = count; i > 1; i--) {
+		tmp = nodes[0];
+		nodes[0] = nodes[i - 1];
+		nodes[i - 1] = tmp;
+		sift_down(nodes, 0, i - 1);
+	}
+}
+
+/** Puts the nodes into the order of the table.
+ * The tree is walked one level at a time, so
+ * that the children of each directory end up
+ * next to each other. */
+
+static int collect_nodes(struct bootable_fs *fs, struct export_list *list) {
+
+	int err;
+	struct bootable_dir *dir;
+	bootable_uint64 first;
+
+	err = push_node(list, fs->root.name, fs->root.name_size, &fs->root, bootable_null);
+	if (err != 0)
+		return err;
+
+	for (bootable_uint64 i = 0; i < list->count; i++) {
+
+		dir = list->nodes[i].dir;
+		if (dir == bootable_null)
+			continue;
+
+		first = list->count;
+
+		for (bootable_uint64 j = 0; j < dir->subdir_count; j++) {
+			err = push_node(list, dir->subdirs[j].name, dir->subdirs[j].name_size, &dir->subdirs[j], bootable_null);
+			if (err != 0)
+				return err;
+		}
+
+		for (bootable_uint64 j = 0; j < dir->file_count; j++) {
+			err = push_node(list, dir->files[j].name, dir->files[j].name_size, bootable_null, &dir->files[j]);
+			if (err != 0)
+				return err;
+		}
+
+		sort_nodes(&list->nodes[first], list->count - first);
+
+		list->nodes[i].node.first = first;
+		list->nodes[i].node.count = list->count - first;
+	}
+
+	return 0;
+}
+
+/** Finds the files that have the same contents
+ * as a file that comes before them in the table. */
+
+static int find_duplicates(struct export_list *list) {
+
+	int err;
+	struct bootable_dedup dedup;
+	struct export_node *node;
+
+	bootable_dedup_init(&dedup);
+
+	for (bootable_uint64 i = 0; i < list->count; i++) {
+
+		node = &list->nodes[i];
+		if (node->file == bootable_null)
+			continue;
+
+		err = bootable_file_hash(node->file, &node->hash);
+		if (err == 0)
+			err = bootable_dedup_add(&dedup, node->file, node->hash, i, &node->original);
+
+		if (err != 0) {
+			bootable_dedup_done(&dedup);
+			return err;
+		}
+	}
+
+	bootable_dedup_done(&dedup);
+
+	return 0;
+}
+
+/** Decides how the data of a file is stored, once
+ * the offset of the data is known. Data that is already
+ * compressed is copied as it is, unless it is in the
+ * output stream and has to move towards the start of it.
+ * Such data is loaded, like all other data that has to
+ * change form, since it could be overwritten before it
+ * is copied. */
+
+static int pack_node(struct export_node *node,
+                     struct bootable_stream *out,
+                     bootable_uint64 offset) {
+
+	int err;
+	struct bootable_file *file = node->file;
+
+	if ((file->blocks != bootable_null)
+	 && node->compress
+	 && ((file->source->stream != out) || (offset >= file->data_offset))) {
+		node->node.flags |= BOOTABLE_FS_NODE_COMPRESSED;
+		node->node.count = file->blocks->stored_size;
+		return 0;
+	}
+
+	if ((file->blocks != bootable_null) || node->compress) {
+		err = bootable_file_load(file);
+		if (err != 0)
+			return err;
+	}
+
+	if (!node->compress) {
+		node->node.count = file->data_size;
+		return 0;
+	}
+
+	err = bootable_blocks_pack(file->data, file->data_size, &node->packed, &node->node.count);
+	if (err != 0)
+		return err;
+
+	node->node.flags |= BOOTABLE_FS_NODE_COMPRESSED;
+
+	return 0;
+}
+
+/** Assigns the offsets of the names
+ * and the file data, and fills in the header. */
+
+static int lay_out(struct export_list *list,
+                   struct bootable_fs_header *header,
+                   struct bootable_stream *out,
+                   bootable_uint64 start) {
+
+	int err;
+	bootable_uint64 name_offset;
+	bootable_uint64 data_offset;
+	struct export_node *node;
+	struct export_node *original;
+
+	name_offset = 0;
+
+	for (bootable_uint64 i = 0; i < list->count; i++) {
+
+		if (name_offset > FS_NAME_MAX)
+			return BOOTABLE_EINVAL;
+
+		list->nodes[i].node.name_offset = (bootable_uint32) name_offset;
+
+		name_offset += list->nodes[i].node.name_size;
+	}
+
+	err = find_duplicates(list);
+	if (err != 0)
+		return err;
+
+	for (bootable_uint64 i = 0; i < list->count; i++) {
+		node = &list->nodes[i];
+		if ((node->file != bootable_null) && node->compress)
+			list->nodes[node->original].compress = bootable_true;
+	}
+
+	header->signature = BOOTABLE_SIGNATURE_V2;
+	header->node_count = list->count;
+	header->node_offset = BOOTABLE_FS_HEADER_SIZE;
+	header->name_offset = header->node_offset + (list->count * BOOTABLE_FS_NODE_SIZE);
+	header->name_size = name_offset;
+	header->hash_offset = (header->name_offset + header->name_size + 7) & ~7ULL;
+	header->data_offset = align_data(header->hash_offset + (list->count * 8));
+
+	data_offset = header->data_offset;
+
+	for (bootable_uint64 i = 0; i < list->count; i++) {
+
+		node = &list->nodes[i];
+		if (node->file == bootable_null)
+			continue;
+
+		if (node->original != i) {
+			original = &list->nodes[node->original];
+			node->node.first = original->node.first;
+			node->node.count = original->node.count;
+			node->node.flags = original->node.flags;
+			continue;
+		}
+
+		data_offset = align_data(data_offset);
+
+		node->node.first = data_offset;
+
+		err = pack_node(node, out, start + data_offset);
+		if (err != 0)
+			return err;
+
+		data_offset += node->node.count;
+	}
+
+	header->size = data_offset;
+
+	return 0;
+}
+
+/** Moves the file data that is still in the
+ * output stream to where the export puts it. */
+
+static int relocate_unloaded(struct export_list *list,
+                             struct bootable_stream *out,
+                             bootable_uint64 start) {
+
+	int err;
+	struct bootable_move_list moves;
+
+	bootable_move_list_init(&moves);
+
+	for (bootable_uint64 i = 0; i < list->count; i++) {
+		if ((list->nodes[i].file != bootable_null) && (list->nodes[i].original == i)) {
+			err = bootable_move_list_add(&moves, out, list->nodes[i].file, start + list->nodes[i].node.first);
+			if (err != 0) {
+				bootable_move_list_done(&moves);
+				return err;
+			}
+		}
+	}
+
+	err = bootable_move_list_apply(&moves, out);
+
+	bootable_move_list_done(&moves);
+
+	return err;
+}
+
+/** Writes the padding in front of file data.
+ * The padding is always less than a sector. */
+
+static int write_padding(struct bootable_writer *writer, bootable_uint64 size) {
+
+	unsigned char zeros[BOOTABLE_FS_DATA_ALIGNMENT];
+
+	bootable_memset(zeros, 0, size);
+
+	return bootable_writer_write(writer, zeros, size);
+}
+
+static int write_tables(struct export_list *list,
+                        const struct bootable_fs_header *header,
+                        struct bootable_writer *writer) {
+
+	int err;
+	unsigned char buf[BOOTABLE_FS_HEADER_SIZE];
+
+	bootable_schema_encode(&header_schema, header, buf);
+
+	err = bootable_writer_write(writer, buf, BOOTABLE_FS_HEADER_SIZE);
+	if (err != 0)
+		return err;
+
+	for (bootable_uint64 i = 0; i < list->count; i++) {
+
+		bootable_schema_encode(&node_schema, &list->nodes[i].node, buf);
+
+		err = bootable_writer_write(writer, buf, BOOTABLE_FS_NODE_SIZE);
+		if (err != 0)
+			return err;
+	}
+
+	for (bootable_uint64 i = 0; i < list->count; i++) {
+		err = bootable_writer_write(writer, list->nodes[i].name, list->nodes[i].node.name_size);
+		if (err != 0)
+			return err;
+	}
+
+	err = write_padding(writer, header->hash_offset - (header->name_offset + header->name_size));
+	if (err != 0)
+		return err;
+
+	for (bootable_uint64 i = 0; i < list->count; i++) {
+		err = bootable_writer_uint64(writer, list->nodes[i].hash);
+		if (err != 0)
+			return err;
+	}
+
+	return write_padding(writer, header->data_offset - (header->hash_offset + (list->count * 8)));
+}
+
+static int write_data(struct export_list *list,
+                      const struct bootable_fs_header *header,
+                      struct bootable_writer *writer) {
+
+	int err;
+	bootable_uint64 offset;
+	struct export_node *node;
+
+	offset = header->data_offset;
+
+	for (bootable_uint64 i = 0; i < list->count; i++) {
+
+		node = &list->nodes[i];
+		if ((node->file == bootable_null) || (node->original != i))
+			continue;
+
+		err = write_padding(writer, node->node.first - offset);
+		if (err != 0)
+			return err;
+
+		offset = node->node.first + node->node.count;
+
+		if (node->packed != bootable_null) {
+			err = bootable_writer_write(writer, node->packed, node->node.count);
+			if (err != 0)
+				return err;
+			continue;
+		}
+
+		if (node->file->source == bootable_null) {
+			err = bootable_writer_write(writer, node->file->data, node->file->data_size);
+			if (err != 0)
+				return err;
+			continue;
+		}
+
+		/* The data is copied or skipped
+		 * at the position of the stream. */
+
+		err = bootable_writer_flush(writer);
+		if (err != 0)
+			return err;
+
+		err = bootable_file_export_stored(node->file, writer->stream);
+		if (err != 0)
+			return err;
+	}
+
+	return bootable_writer_flush(writer);
+}
+
+/** Points a file that was not loaded at the data
+ * that it shares with another file. The data may be
+ * stored differently from how it was before. */
+
+static int share_data(struct bootable_file *file,
+                      const struct bootable_fs_node *node,
+                      struct bootable_stream *out,
+                      bootable_uint64 start) {
+
+	bootable_blocks_free(file->blocks, file->arena);
+
+	file->blocks = bootable_null;
+	file->data_offset = start + node->first;
+
+	if (node->flags & BOOTABLE_FS_NODE_COMPRESSED)
+		return bootable_blocks_open(&file->blocks, file->arena, out, file->data_offset, node->count);
+
+	return 0;
+}
+
+int bootable_fs2_export(struct bootable_fs *fs, struct bootable_stream *out) {
+
+	int err;
+	bootable_uint64 start;
+	struct bootable_fs_header header;
+	struct export_list list;
+	struct bootable_writer writer;
+	struct bootable_file *file;
+
+	err = bootable_stream_get_pos(out, &start);
+	if (err != 0)
+		return err;
+
+	list.nodes = bootable_null;
+	list.count = 0;
+	list.capacity = 0;
+
+	err = collect_nodes(fs, &list);
+	if (err == 0)
+		err = lay_out(&list, &header, out, start);
+
+	if ((err == 0) && (fs->source.stream == out))
+		err = relocate_unloaded(&list, out, start);
+
+	/* Data that was moved may have
+	 * been moved with the stream position. */
+	if (err == 0)
+		err = bootable_stream_set_pos(out, start);
+
+	if (err == 0)
+		err = bootable_writer_init(&writer, out);
+
+	if (err == 0) {
+
+		err = write_tables(&list, &header, &writer);
+		if (err == 0)
+			err = write_data(&list, &header, &writer);
+
+		bootable_writer_done(&writer);
+	}
+
+	if (err == 0) {
+
+		fs->size = header.size;
+
+		/* Files that share data with another file were
+		 * not written, so if they are still read from the
+		 * stream, they have to read the data that was. */
+		for (bootable_uint64 i = 0; (err == 0) && (i < list.count); i++) {
+			file = list.nodes[i].file;
+			if ((file != bootable_null)
+			 && (list.nodes[i].original != i)
+			 && (file->source != bootable_null)
+			 && (file->source->stream == out))
+				err = share_data(file, &list.nodes[i].node, out, start);
+		}
+	}
+
+	for (bootable_uint64 i = 0; i < list.count; i++)
+		bootable_free(list.nodes[i].packed);
+
+	bootable_free(list.nodes);
+
+	return err;
+}
+
+/** Checks that a header describes a table
+ * that fits in the file system. */
+
+static bootable_bool header_valid(const struct bootable_fs_header *header) {
+
+	if (header->signature != BOOTABLE_SIGNATURE_V2)
+		return bootable_false;
+
+	if ((header->node_count == 0)
+	 || (header->node_offset < BOOTABLE_FS_HEADER_SIZE)
+	 || (header->node_offset > header->size)
+	 || (header->node_count > ((header->size - header->node_offset) / BOOTABLE_FS_NODE_SIZE)))
+		return bootable_false;
+
+	if ((header->name_offset > header->size)
+	 || (header->name_size > (header->size - header->name_offset)))
+		return bootable_false;
+
+	if ((header->hash_offset != 0)
+	 && ((header->hash_offset > header->size)
+	  || (header->node_count > ((header->size - header->hash_offset) / 8))))
+		return bootable_false;
+
+	return bootable_true;
+}
+
+static bootable_uint64 load_uint64(const unsigned char *buf) {
+
+	bootable_uint64 n = 0;
+
+	for (unsigned int i = 0; i < 8; i++)
+		n |= ((bootable_uint64) buf[i]) << (i * 8);
+
+	return n;
+}
+
+static bootable_bool name_valid(const struct bootable_fs_header *header,
+                                const struct bootable_fs_node *node) {
+
+	return (((bootable_uint64) node->name_offset) + node->name_size) <= header->name_size;
+}
+
+static char *copy_name(struct bootable_arena *arena,
+                       const char *names,
+                       const struct bootable_fs_node *node) {
+
+	char *name;
+
+	name = bootable_arena_alloc(arena, ((bootable_uint64) node->name_size) + 1);
+	if (name == bootable_null)
+		return bootable_null;
+
+	bootable_memcpy(name, &names[node->name_offset], node->name_size);
+
+	name[node->name_size] = 0;
+
+	return name;
+}
+
+/** The state of an import in progress. */
+
+struct import_state {
+	/** The file system being imported. */
+	struct bootable_fs *fs;
+	/** The stream that the file system is in. */
+	struct bootable_stream *in;
+	/** The position of the file system. */
+	bootable_uint64 start;
+	/** Where the file data is read from later,
+	 * or null if it is read during the import. */
+	struct bootable_file_source *source;
+	/** The header of the file system. */
+	struct bootable_fs_header header;
+	/** The encoded node table. */
+	unsigned char *table;
+	/** The name table. */
+	char *names;
+	/** The hash table, if the file data is not
+	 * read during the import and there is one. */
+	unsigned char *hashes;
+	/** The directory of each node. This is
+	 * assigned when the parent of the node is
+	 * imported, and stays null for files. */
+	struct bootable_dir **dirs;
+};
+
+static void get_node(const struct import_state *state,
+                     bootable_uint64 index,
+                     struct bootable_fs_node *node) {
+
+	bootable_schema_decode(&node_schema, node, &state->table[index * BOOTABLE_FS_NODE_SIZE]);
+}
+
+static int import_file(struct import_state *state,
+                       struct bootable_file *file,
+                       const struct bootable_fs_node *node,
+                       bootable_uint64 index) {
+
+	int err;
+	struct bootable_file_source source;
+
+	if ((node->first > state->header.size)
+	 || (node->count > (state->header.size - node->first)))
+		return BOOTABLE_EINVAL;
+
+	file->data_size = node->count;
+	file->data_offset = state->start + node->first;
+
+	if (node->flags & BOOTABLE_FS_NODE_COMPRESSED) {
+
+		err = bootable_blocks_open(&file->blocks, file->arena, state->in, file->data_offset, node->count);
+		if (err != 0)
+			return err;
+
+		file->data_size = file->blocks->data_size;
+		file->compress = bootable_true;
+	}
+
+	if (state->source != bootable_null) {
+		file->source = state->source;
+		if (state->hashes != bootable_null) {
+			file->data_hash = load_uint64(&state->hashes[index * 8]);
+			file->data_hash_valid = bootable_true;
+		}
+		return 0;
+	}
+
+	source.stream = state->in;
+	source.cache_budget = 0;
+	source.fd = -1;
+
+	file->source = &source;
+
+	err = bootable_file_load(file);
+
+	file->source = bootable_null;
+
+	return err;
+}
+
+/** Builds the children of a directory from a
+ * range of the node table. The children have to
+ * start at the first node that no other directory
+ * has claimed, which keeps the tree free of cycles. */
+
+static int import_children(struct import_state *state,
+                           struct bootable_dir *dir,
+                           const struct bootable_fs_node *node,
+                           bootable_uint64 *next) {
+
+	int err;
+	struct bootable_arena *arena = &state->fs->arena;
+	struct bootable_fs_node child;
+	struct bootable_fs_node prev = { 0, 0, 0, 0, 0 };
+	struct bootable_dir *subdir;
+	struct bootable_file *file;
+	bootable_uint64 subdir_count;
+	bootable_uint64 file_count;
+
+	if ((node->first != *next) || (node->count > (state->header.node_count - *next)))
+		return BOOTABLE_EINVAL;
+
+	*next += node->count;
+
+	subdir_count = 0;
+
+	for (bootable_uint64 i = 0; i < node->count; i++) {
+
+		get_node(state, node->first + i, &child);
+
+		if ((child.name_size == 0) || !name_valid(&state->header, &child))
+			return BOOTABLE_EINVAL;
+
+		if ((i > 0) && (compare_names(&state->names[prev.name_offset], prev.name_size,
+		                              &state->names[child.name_offset], child.name_size) >= 0))
+			return BOOTABLE_EINVAL;
+
+		if (child.flags & BOOTABLE_FS_NODE_DIR)
+			subdir_count++;
+
+		prev = child;
+	}
+
+	file_count = node->count - subdir_count;
+
+	if (subdir_count > 0) {
+		dir->subdirs = bootable_arena_alloc(arena, subdir_count * sizeof(dir->subdirs[0]));
+		if (dir->subdirs == bootable_null)
+			return BOOTABLE_ENOMEM;
+	}
+
+	if (file_count > 0) {
+		dir->files = bootable_arena_alloc(arena, file_count * sizeof(dir->files[0]));
+		if (dir->files == bootable_null)
+			return BOOTABLE_ENOMEM;
+	}
+
+	dir->subdir_capacity = subdir_count;
+	dir->file_capacity = file_count;
+
+	for (bootable_uint64 i = 0; i < node->count; i++) {
+
+		get_node(state, node->first + i, &child);
+
+		if (child.flags & BOOTABLE_FS_NODE_DIR) {
+
+			subdir = &dir->subdirs[dir->subdir_count++];
+			bootable_dir_init(subdir);
+			subdir->arena = arena;
+
+			subdir->name = copy_name(arena, state->names, &child);
+			if (subdir->name == bootable_null)
+				return BOOTABLE_ENOMEM;
+
+			subdir->name_size = child.name_size;
+
+			state->dirs[node->first + i] = subdir;
+
+		} else {
+
+			file = &dir->files[dir->file_count++];
+			bootable_file_init(file);
+			file->arena = arena;
+
+			file->name = copy_name(arena, state->names, &child);
+			if (file->name == bootable_null)
+				return BOOTABLE_ENOMEM;
+
+			file->name_size = child.name_size;
+
+			err = import_file(state, file, &child, node->first + i);
+			if (err != 0)
+				return err;
+		}
+	}
+
+	return 0;
+}
+
+static int import_tree(struct import_state *state) {
+
+	int err;
+	struct bootable_dir *root = &state->fs->root;
+	struct bootable_fs_node node;
+	bootable_uint64 next;
+
+	get_node(state, 0, &node);
+
+	if (!(node.flags & BOOTABLE_FS_NODE_DIR) || !name_valid(&state->header, &node))
+		return BOOTABLE_EINVAL;
+
+	bootable_dir_free(root);
+
+	root->name = copy_name(&state->fs->arena, state->names, &node);
+	if (root->name == bootable_null)
+		return BOOTABLE_ENOMEM;
+
+	root->name_size = node.name_size;
+
+	state->dirs[0] = root;
+
+	next = 1;
+
+	for (bootable_uint64 i = 0; i < state->header.node_count; i++) {
+
+		get_node(state, i, &node);
+
+		if (!(node.flags & BOOTABLE_FS_NODE_DIR))
+			continue;
+
+		/* A directory that no other directory
+		 * claimed as a child is not in the tree. */
+		if (state->dirs[i] == bootable_null)
+			return BOOTABLE_EINVAL;
+
+		err = import_children(state, state->dirs[i], &node, &next);
+		if (err != 0)
+			return err;
+	}
+
+	if (next != state->header.node_count)
+		return BOOTABLE_EINVAL;
+
+	return 0;
+}
+
+int bootable_fs2_import(struct bootable_fs *fs,
+                        struct bootable_stream *in,
+                        bootable_uint64 start,
+                        struct bootable_file_source *source) {
+
+	int err;
+	bootable_uint64 stream_size;
+	struct import_state state;
+
+	err = bootable_stream_set_pos(in, start);
+	if (err != 0)
+		return err;
+
+	err = bootable_schema_read(&header_schema, &state.header, in);
+	if (err != 0)
+		return err;
+
+	if (!header_valid(&state.header))
+		return BOOTABLE_EINVAL;
+
+	/* Checked before anything is allocated, so
+	 * that a damaged header can not ask for more
+	 * memory than the stream could contain. */
+	err = bootable_stream_get_size(in, &stream_size);
+	if ((err == 0) && ((start > stream_size) || (state.header.size > (stream_size - start))))
+		return BOOTABLE_EINVAL;
+
+	state.fs = fs;
+	state.in = in;
+	state.start = start;
+	state.source = source;
+	state.table = bootable_malloc(state.header.node_count * BOOTABLE_FS_NODE_SIZE);
+	state.names = bootable_malloc(state.header.name_size + 1);
+	state.dirs = bootable_malloc(state.header.node_count * sizeof(state.dirs[0]));
+	state.hashes = bootable_null;
+
+	if ((state.table == bootable_null)
+	 || (state.names == bootable_null)
+	 || (state.dirs == bootable_null)) {
+		err = BOOTABLE_ENOMEM;
+	} else {
+		err = bootable_stream_read_at(in, start + state.header.node_offset, state.table, state.header.node_count * BOOTABLE_FS_NODE_SIZE);
+	}
+
+	if (err == 0)
+		err = bootable_stream_read_at(in, start + state.header.name_offset, state.names, state.header.name_size);
+
+	if ((err == 0) && (source != bootable_null) && (state.header.hash_offset != 0)) {
+		state.hashes = bootable_malloc(state.header.node_count * 8);
+		if (state.hashes == bootable_null)
+			err = BOOTABLE_ENOMEM;
+		else
+			err = bootable_stream_read_at(in, start + state.header.hash_offset, state.hashes, state.header.node_count * 8);
+	}
+
+	if (err == 0) {
+		for (bootable_uint64 i = 0; i < state.header.node_count; i++)
+			state.dirs[i] = bootable_null;
+		err = import_tree(&state);
+	}
+
+	if (err == 0) {
+		fs->size = state.header.size;
+		err = bootable_stream_set_pos(in, start + state.header.size);
+	}
+
+	bootable_free(state.table);
+	bootable_free(state.names);
+	bootable_free(state.dirs);
+	bootable_free(state.hashes);
+
+	return err;
+}
+
+static int locate_node(struct bootable_stream *stream,
+                       const struct bootable_fs_header *header,
+                       bootable_uint64 index,
+                       struct bootable_fs_node *node) {
+
+	int err;
+	unsigned char buf[BOOTABLE_FS_NODE_SIZE];
+
+	if (index >= header->node_count)
+		return BOOTABLE_EINVAL;
+
+	err = bootable_stream_read_at(stream, header->node_offset + (index * BOOTABLE_FS_NODE_SIZE), buf, sizeof(buf));
+	if (err != 0)
+		return err;
+
+	bootable_schema_decode(&node_schema, node, buf);
+
+	if (!name_valid(header, node))
+		return BOOTABLE_EINVAL;
+
+	return 0;
+}
+
+/** Compares the name of a node with a name
+ * from a path, reading the name of the node
+ * only as far as it has to. */
+
+static int locate_compare(struct bootable_stream *stream,
+                          const struct bootable_fs_header *header,
+                          const struct bootable_fs_node *node,
+                          const struct bootable_path_slice *name,
+                          int *result) {
+
+	int err;
+	char buf[LOCATE_NAME_PIECE];
+	bootable_uint64 offset;
+	bootable_uint64 piece;
+
+	for (offset = 0; (offset < node->name_size) && (offset < name->size); offset += piece) {
+
+		piece = node->name_size - offset;
+		if (piece > (name->size - offset))
+			piece = name->size - offset;
+		if (piece > LOCATE_NAME_PIECE)
+			piece = LOCATE_NAME_PIECE;
+
+		err = bootable_stream_read_at(stream, header->name_offset + node->name_offset + offset, buf, piece);
+		if (err != 0)
+			return err;
+
+		*result = compare_names(buf, piece, &name->data[offset], piece);
+		if (*result != 0)
+			return 0;
+	}
+
+	if (node->name_size < name->size)
+		*result = -1;
+	else if (node->name_size > name->size)
+		*result = 1;
+	else
+		*result = 0;
+
+	return 0;
+}
+
+static int locate_child(struct bootable_stream *stream,
+                        const struct bootable_fs_header *header,
+                        struct bootable_fs_node *node,
+                        const struct bootable_path_slice *name) {
+
+	int err;
+	int cmp;
+	bootable_uint64 lo;
+	bootable_uint64 hi;
+	bootable_uint64 mid;
+	struct bootable_fs_node child;
+
+	if (!(node->flags & BOOTABLE_FS_NODE_DIR))
+		return BOOTABLE_ENOTDIR;
+
+	if ((node->first > header->node_count)
+	 || (node->count > (header->node_count - node->first)))
+		return BOOTABLE_EINVAL;
+
+	lo = node->first;
+	hi = node->first + node->count;
+
+	while (lo < hi) {
+
+		mid = lo + ((hi - lo) / 2);
+
+		err = locate_node(stream, header, mid, &child);
+		if (err != 0)
+			return err;
+
+		err = locate_compare(stream, header, &child, name, &cmp);
+		if (err != 0)
+			return err;
+
+		if (cmp == 0) {
+			*node = child;
+			return 0;
+		} else if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return BOOTABLE_ENOENT;
+}
+
+int bootable_fs_locate(struct bootable_stream *stream,
+                       const char *path,
+                       bootable_uint64 *offset,
+                       bootable_uint64 *size,
+                       bootable_uint32 *flags) {
+
+	int err;
+	unsigned char buf[BOOTABLE_FS_HEADER_SIZE];
+	struct bootable_fs_header header;
+	struct bootable_fs_node node;
+	struct bootable_path_view view;
+
+	err = bootable_stream_read_at(stream, 0, buf, sizeof(buf));
+	if (err != 0)
+		return err;
+
+	bootable_schema_decode(&header_schema, &header, buf);
+
+	if (!header_valid(&header))
+		return BOOTABLE_EINVAL;
+
+	err = locate_node(stream, &header, 0, &node);
+	if (err != 0)
+		return err;
+
+	bootable_path_view_init(&view);
+
+	err = bootable_path_view_parse(&view, path);
+
+	for (bootable_uint64 i = 0; (err == 0) && (i < view.name_count); i++)
+		err = locate_child(stream, &header, &node, &view.names[i]);
+
+	bootable_path_view_done(&view);
+
+	if (err != 0)
+		return err;
+
+	if (node.flags & BOOTABLE_FS_NODE_DIR)
+		return BOOTABLE_EISDIR;
+
+	if ((node.first > header.size) || (node.count > (header.size - node.first)))
+		return BOOTABLE_EINVAL;
+
+	*offset = node.first;
+	*size = node.count;
+	*flags = node.flags;
+
+	return 0;
+}
@@ -0,0 +1,59 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOOTABLE_FS2_H
+#define BOOTABLE_FS2_H
+
+#include <bootable/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct bootable_fs;
+struct bootable_file_source;
+struct bootable_stream;
+
+/** Exports a file system in the second version
+ * of the format, at the current position of the stream.
+ * @param fs An initialized file system structure.
+ * @param out The stream to export the file system to.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_fs2_export(struct bootable_fs *fs, struct bootable_stream *out);
+
+/** Imports a file system in the second version of the format.
+ * @param fs An initialized file system structure.
+ * @param in The stream to import the file system from.
+ * @param start The position of the file system signature.
+ * @param source If this is not null, the file data is
+ * left in the stream and read from this source later.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_fs2_import(struct bootable_fs *fs,
+                        struct bootable_stream *in,
+                        bootable_uint64 start,
+                        struct bootable_file_source *source);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_FS2_H */
@@ -0,0 +1,448 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bootable/core/error.h>
+#include <bootable/core/gpt.h>
+#include <bootable/core/memstream.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TYPE_A "6e65efa4-cfde-44cb-82a3-13d4c396e04c"
+#define TYPE_B "0fc63daf-8483-4772-8e79-3d69d8477de4"
+
+#define DISK_SIZE (64 * 1024 * 1024)
+
+#define ENTRY_COUNT 1500
+
+static void add_partitions(struct bootable_gpt *gpt) {
+
+	char name[32];
+
+	for (unsigned int i = 0; i < ENTRY_COUNT; i++) {
+
+		bootable_uint32 entry_index = 0;
+
+		assert(bootable_gpt_find_unused_entry(gpt, &entry_index) == 0);
+		assert(entry_index == i);
+
+		assert(bootable_gpt_set_entry_type(gpt, entry_index, (i % 3) ? TYPE_A : TYPE_B) == 0);
+
+		snprintf(name, sizeof(name), "tenant-%u", i);
+
+		assert(bootable_gpt_set_entry_name_utf8(gpt, entry_index, name) == 0);
+
+		assert(bootable_gpt_set_entry_size(gpt, entry_index, 4096) == 0);
+	}
+}
+
+static void check_partitions(struct bootable_gpt *gpt) {
+
+	char name[32];
+
+	for (unsigned int i = 0; i < ENTRY_COUNT; i++) {
+
+		bootable_uint32 entry_index = BOOTABLE_GPT_NO_ENTRY;
+
+		snprintf(name, sizeof(name), "tenant-%u", i);
+
+		assert(bootable_gpt_find_entry_by_name_utf8(gpt, name, &entry_index) == 0);
+		assert(entry_index == i);
+	}
+
+	bootable_uint32 entry_index = 0;
+
+	assert(bootable_gpt_find_entry_by_name_utf8(gpt, "tenant-x", &entry_index) == BOOTABLE_ENOENT);
+
+	/* every third entry is of type B */
+
+	unsigned int count = 0;
+
+	int err = bootable_gpt_find_entry_by_type(gpt, TYPE_B, &entry_index);
+
+	while (err == 0) {
+		assert((entry_index % 3) == 0);
+		count++;
+		err = bootable_gpt_find_next_entry_by_type(gpt, TYPE_B, &entry_index);
+	}
+
+	assert(err == BOOTABLE_ENOENT);
+	assert(count == ((ENTRY_COUNT + 2) / 3));
+
+	assert(bootable_gpt_find_entry_by_type(gpt, "c12a7328-f81f-11d2-ba4b-00a0c93ec93b", &entry_index) == BOOTABLE_ENOENT);
+}
+
+static void test_large_table(void) {
+
+	struct bootable_gpt gpt;
+	bootable_gpt_init(&gpt);
+
+	assert(bootable_gpt_set_entry_count(&gpt, 2048) == 0);
+	assert(bootable_gpt_format(&gpt, DISK_SIZE) == 0);
+
+	/* 2048 entries take 512 sectors */
+	assert(gpt.header.first_usable_lba == (2 + 512));
+	assert(gpt.header.last_usable_lba == (gpt.header.backup_lba - 512 - 1));
+
+	add_partitions(&gpt);
+	check_partitions(&gpt);
+
+	/* renaming moves the entry in the index */
+	assert(bootable_gpt_set_entry_name_utf8(&gpt, 7, "renamed") == 0);
+
+	bootable_uint32 entry_index = 0;
+	assert(bootable_gpt_find_entry_by_name_utf8(&gpt, "renamed", &entry_index) == 0);
+	assert(entry_index == 7);
+	assert(bootable_gpt_find_entry_by_name_utf8(&gpt, "tenant-7", &entry_index) == BOOTABLE_ENOENT);
+
+	/* removed slots are reused first */
+	assert(bootable_gpt_remove_entry(&gpt, 42) == 0);
+	assert(bootable_gpt_find_unused_entry(&gpt, &entry_index) == 0);
+	assert(entry_index == 42);
+	assert(bootable_gpt_find_entry_by_name_utf8(&gpt, "tenant-42", &entry_index) == BOOTABLE_ENOENT);
+
+	assert(bootable_gpt_set_entry_name_utf8(&gpt, 42, "tenant-42") == 0);
+	assert(bootable_gpt_set_entry_name_utf8(&gpt, 7, "tenant-7") == 0);
+	assert(bootable_gpt_set_entry_type(&gpt, 42, TYPE_B) == 0);
+	assert(bootable_gpt_set_entry_size(&gpt, 42, 4096) == 0);
+
+	check_partitions(&gpt);
+
+	/* export and import again */
+
+	struct bootable_memstream memstream;
+	bootable_memstream_init(&memstream);
+
+	assert(bootable_memstream_resize(&memstream, DISK_SIZE) == 0);
+	assert(bootable_gpt_export(&gpt, &memstream.stream) == 0);
+
+	struct bootable_gpt gpt2;
+	bootable_gpt_init(&gpt2);
+
+	assert(bootable_gpt_import(&gpt2, &memstream.stream) == 0);
+	assert(gpt2.entry_count == 2048);
+	assert(gpt2.header.partition_entry_count == 2048);
+
+	check_partitions(&gpt2);
+
+	assert(bootable_gpt_find_unused_entry(&gpt2, &entry_index) == 0);
+	assert(entry_index == ENTRY_COUNT);
+
+	bootable_gpt_done(&gpt2);
+	bootable_memstream_done(&memstream);
+	bootable_gpt_done(&gpt);
+}
+
+static void test_full_table(void) {
+
+	struct bootable_gpt gpt;
+	bootable_gpt_init(&gpt);
+
+	assert(bootable_gpt_set_entry_count(&gpt, 0) == BOOTABLE_EINVAL);
+	assert(bootable_gpt_set_entry_count(&gpt, 4) == 0);
+	assert(bootable_gpt_format(&gpt, 1024 * 1024) == 0);
+
+	bootable_uint32 entry_index = 0;
+
+	for (bootable_uint32 i = 0; i < 4; i++) {
+		assert(bootable_gpt_find_unused_entry(&gpt, &entry_index) == 0);
+		assert(entry_index == i);
+		assert(bootable_gpt_set_entry_type(&gpt, i, TYPE_A) == 0);
+	}
+
+	assert(bootable_gpt_find_unused_entry(&gpt, &entry_index) == BOOTABLE_ENOSPC);
+	assert(bootable_gpt_set_entry_type(&gpt, 4, TYPE_A) == BOOTABLE_EINVAL);
+
+	bootable_gpt_done(&gpt);
+}
+
+static void import_checked(struct bootable_memstream *memstream,
+                           bootable_bool repair_expected) {
+
+	struct bootable_gpt gpt;
+	bootable_gpt_init(&gpt);
+
+	bootable_bool repair_needed = !repair_expected;
+
+	assert(bootable_gpt_import_verified(&gpt, &memstream->stream, &repair_needed) == 0);
+	assert(repair_needed == repair_expected);
+
+	bootable_uint32 entry_index = 0;
+	assert(bootable_gpt_find_entry_by_name_utf8(&gpt, "data", &entry_index) == 0);
+	assert(entry_index == 3);
+	assert(gpt.entries[3].first_lba == 2048);
+
+	/* write both tables again */
+	assert(bootable_gpt_export(&gpt, &memstream->stream) == 0);
+
+	bootable_gpt_done(&gpt);
+}
+
+static void test_repair(void) {
+
+	struct bootable_gpt gpt;
+	bootable_gpt_init(&gpt);
+
+	assert(bootable_gpt_format(&gpt, 4 * 1024 * 1024) == 0);
+	assert(bootable_gpt_set_entry_type(&gpt, 3, TYPE_A) == 0);
+	assert(bootable_gpt_set_entry_name_utf8(&gpt, 3, "data") == 0);
+	assert(bootable_gpt_set_entry_size(&gpt, 3, 4096) == 0);
+
+	struct bootable_memstream memstream;
+	bootable_memstream_init(&memstream);
+
+	assert(bootable_memstream_resize(&memstream, 4 * 1024 * 1024) == 0);
+	assert(bootable_gpt_export(&gpt, &memstream.stream) == 0);
+
+	unsigned char *disk = memstream.data;
+
+	bootable_uint64 backup_header = gpt.header.backup_lba * 512;
+	bootable_uint64 backup_entries = backup_header - (128 * 128);
+
+	import_checked(&memstream, bootable_false);
+
+	/* damaged primary entries */
+	disk[1024 + (3 * 128) + 32] ^= 0xff;
+	import_checked(&memstream, bootable_true);
+	import_checked(&memstream, bootable_false);
+
+	/* damaged primary header */
+	disk[512 + 40] ^= 0xff;
+	import_checked(&memstream, bootable_true);
+
+	/* damaged backup entries */
+	disk[backup_entries + (3 * 128) + 32] ^= 0xff;
+	import_checked(&memstream, bootable_true);
+
+	/* damaged backup header */
+	disk[backup_header] ^= 0xff;
+	import_checked(&memstream, bootable_true);
+	import_checked(&memstream, bootable_false);
+
+	/* both damaged */
+	disk[512 + 40] ^= 0xff;
+	disk[backup_header + 40] ^= 0xff;
+
+	struct bootable_gpt gpt2;
+	bootable_gpt_init(&gpt2);
+
+	bootable_bool repair_needed = bootable_false;
+	assert(bootable_gpt_import_verified(&gpt2, &memstream.stream, &repair_needed) == BOOTABLE_EINVAL);
+
+	bootable_gpt_done(&gpt2);
+	bootable_memstream_done(&memstream);
+	bootable_gpt_done(&gpt);
+}
+
+static void test_lazy_import(void) {
+
+	struct bootable_gpt gpt;
+	bootable_gpt_init(&gpt);
+
+	assert(bootable_gpt_format(&gpt, 4 * 1024 * 1024) == 0);
+	assert(bootable_gpt_set_entry_type(&gpt, 2, TYPE_A) == 0);
+	assert(bootable_gpt_set_entry_name_utf8(&gpt, 2, "fs") == 0);
+	assert(bootable_gpt_set_entry_size(&gpt, 2, 8192) == 0);
+
+	struct bootable_memstream memstream;
+	bootable_memstream_init(&memstream);
+
+	assert(bootable_memstream_resize(&memstream, 4 * 1024 * 1024) == 0);
+	assert(bootable_gpt_export(&gpt, &memstream.stream) == 0);
+
+	struct bootable_gpt gpt2;
+	bootable_gpt_init(&gpt2);
+
+	assert(bootable_gpt_import(&gpt2, &memstream.stream) == 0);
+	assert(gpt2.raw_entries != NULL);
+
+	/* only the requested entry is decoded */
+
+	bootable_uint64 offset = 0;
+	assert(bootable_gpt_get_partition_offset(&gpt2, 2, &offset) == 0);
+	assert(offset == (2048 * 512));
+	assert(gpt2.decoded_entries[0] == (1 << 2));
+
+	/* exporting an unchanged table writes the imported bytes */
+	assert(bootable_gpt_export(&gpt2, &memstream.stream) == 0);
+
+	/* a search decodes everything */
+	bootable_uint32 entry_index = 0;
+	assert(bootable_gpt_find_entry_by_name_utf8(&gpt2, "fs", &entry_index) == 0);
+	assert(entry_index == 2);
+	assert(gpt2.raw_entries == NULL);
+
+	bootable_gpt_done(&gpt2);
+
+	/* a damaged primary table falls back to the backup */
+
+	unsigned char *disk = memstream.data;
+
+	disk[1024 + (2 * 128) + 40] ^= 0xff;
+
+	bootable_gpt_init(&gpt2);
+	assert(bootable_gpt_import(&gpt2, &memstream.stream) == 0);
+	assert(bootable_gpt_get_entry(&gpt2, 2)->last_lba == (2048 + 15));
+	assert(bootable_gpt_set_entry_size(&gpt2, 5, 512) == 0);
+	assert(gpt2.entries[5].first_lba == 4096);
+	bootable_gpt_done(&gpt2);
+
+	bootable_memstream_done(&memstream);
+	bootable_gpt_done(&gpt);
+}
+
+static void test_failed_resize(void) {
+
+	struct bootable_gpt gpt;
+	bootable_gpt_init(&gpt);
+
+	assert(bootable_gpt_format(&gpt, DISK_SIZE) == 0);
+
+	assert(bootable_gpt_set_entry_type(&gpt, 0, TYPE_A) == 0);
+	assert(bootable_gpt_set_entry_size(&gpt, 0, 1024 * 1024) == 0);
+	assert(bootable_gpt_set_entry_type(&gpt, 1, TYPE_A) == 0);
+	assert(bootable_gpt_set_entry_size(&gpt, 1, 1024 * 1024) == 0);
+
+	const struct bootable_gpt_entry *entry = bootable_gpt_get_entry(&gpt, 0);
+	assert(entry != NULL);
+
+	bootable_uint64 first_lba = entry->first_lba;
+	bootable_uint64 last_lba = entry->last_lba;
+
+	const struct bootable_gpt_entry *other = bootable_gpt_get_entry(&gpt, 1);
+	assert(other != NULL);
+
+	/* a failed resize keeps the partition where it was */
+	assert(bootable_gpt_set_entry_size(&gpt, 0, DISK_SIZE) == BOOTABLE_ENOSPC);
+	assert(entry->first_lba == first_lba);
+	assert(entry->last_lba == last_lba);
+
+	/* so does a failed move onto another partition */
+	assert(bootable_gpt_set_entry_offset(&gpt, 0, other->first_lba * 512, 4096) == BOOTABLE_ENOSPC);
+	assert(entry->first_lba == first_lba);
+	assert(entry->last_lba == last_lba);
+
+	/* and its space is still in use */
+	assert(bootable_gpt_set_entry_offset(&gpt, 1, first_lba * 512, 4096) == BOOTABLE_ENOSPC);
+	assert(bootable_gpt_set_entry_offset(&gpt, 1, last_lba * 512, 4096) == BOOTABLE_ENOSPC);
+
+	/* its own range can still be set again */
+	assert(bootable_gpt_set_entry_offset(&gpt, 0, first_lba * 512, ((last_lba - first_lba) + 1) * 512) == 0);
+	assert(entry->first_lba == first_lba);
+	assert(entry->last_lba == last_lba);
+
+	bootable_gpt_done(&gpt);
+}
+
+static void test_entry_count(void) {
+
+	struct bootable_gpt gpt;
+	bootable_gpt_init(&gpt);
+
+	/* the count can change until there is a table */
+	assert(bootable_gpt_set_entry_count(&gpt, 1024) == 0);
+	assert(bootable_gpt_set_entry_count(&gpt, 128) == 0);
+	assert(bootable_gpt_format(&gpt, 4 * 1024 * 1024) == 0);
+	assert(gpt.header.partition_entry_count == 128);
+
+	/* after that, it is fixed */
+	assert(bootable_gpt_set_entry_count(&gpt, 1024) == BOOTABLE_EINVAL);
+	assert(bootable_gpt_set_entry_count(&gpt, 128) == 0);
+	assert(gpt.entry_count == 128);
+	assert(bootable_gpt_get_entry(&gpt, 900) == NULL);
+	assert(bootable_gpt_set_entry_type(&gpt, 900, TYPE_A) == BOOTABLE_EINVAL);
+
+	struct bootable_memstream memstream;
+	bootable_memstream_init(&memstream);
+
+	assert(bootable_memstream_resize(&memstream, 4 * 1024 * 1024) == 0);
+	assert(bootable_gpt_export(&gpt, &memstream.stream) == 0);
+
+	/* the same goes for an imported table */
+	struct bootable_gpt gpt2;
+	bootable_gpt_init(&gpt2);
+
+	assert(bootable_gpt_import(&gpt2, &memstream.stream) == 0);
+	assert(bootable_gpt_set_entry_count(&gpt2, 1024) == BOOTABLE_EINVAL);
+	assert(gpt2.entry_count == 128);
+	assert(bootable_gpt_get_entry(&gpt2, 900) == NULL);
+
+	bootable_uint32 entry_index = 0;
+	assert(bootable_gpt_find_unused_entry(&gpt2, &entry_index) == 0);
+	assert(entry_index == 0);
+
+	bootable_gpt_done(&gpt2);
+	bootable_memstream_done(&memstream);
+	bootable_gpt_done(&gpt);
+}
+
+static void test_utf8_names(void) {
+
+	struct bootable_gpt gpt;
+	bootable_gpt_init(&gpt);
+
+	assert(bootable_gpt_format(&gpt, 4 * 1024 * 1024) == 0);
+	assert(bootable_gpt_set_entry_type(&gpt, 0, TYPE_A) == 0);
+	assert(bootable_gpt_set_entry_type(&gpt, 1, TYPE_A) == 0);
+
+	/* two, three and four byte sequences */
+	assert(bootable_gpt_set_entry_name_utf8(&gpt, 0, "\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80") == 0);
+
+	const bootable_uint16 *name = gpt.entries[0].name;
+	assert(name[0] == 0x00e9);
+	assert(name[1] == 0x20ac);
+	assert(name[2] == 0xd83d);
+	assert(name[3] == 0xde00);
+	assert(name[4] == 0);
+
+	bootable_uint32 entry_index = BOOTABLE_GPT_NO_ENTRY;
+	assert(bootable_gpt_find_entry_by_name_utf8(&gpt, "\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80", &entry_index) == 0);
+	assert(entry_index == 0);
+
+	/* long names are cut off between characters */
+	char long_name[64];
+	for (unsigned int i = 0; i < 34; i++)
+		long_name[i] = 'a';
+	memcpy(&long_name[34], "\xf0\x9f\x98\x80", 5);
+
+	assert(bootable_gpt_set_entry_name_utf8(&gpt, 1, long_name) == 0);
+	assert(gpt.entries[1].name[33] == 'a');
+	assert(gpt.entries[1].name[34] == 0);
+
+	/* malformed, overlong and surrogate sequences */
+	assert(bootable_gpt_set_entry_name_utf8(&gpt, 1, "\xc3") == BOOTABLE_EINVAL);
+	assert(bootable_gpt_set_entry_name_utf8(&gpt, 1, "\xc0\xaf") == BOOTABLE_EINVAL);
+	assert(bootable_gpt_set_entry_name_utf8(&gpt, 1, "\xed\xa0\x80") == BOOTABLE_EINVAL);
+	assert(bootable_gpt_find_entry_by_name_utf8(&gpt, "\xff", &entry_index) == BOOTABLE_EINVAL);
+	assert(gpt.entries[1].name[33] == 'a');
+
+	bootable_gpt_done(&gpt);
+}
+
+int main(void) {
+	test_large_table();
+	test_full_table();
+	test_repair();
+	test_lazy_import();
+	test_failed_resize();
+	test_entry_count();
+	test_utf8_names();
+	return EXIT_SUCCESS;
+}
@@ -18,13 +18,15 @@
 
 #include <bootable/core/gpt.h>
 
+#include <bootable/core/crc32.h>
 #include <bootable/core/error.h>
+#include <bootable/core/extent.h>
 #include <bootable/core/memory.h>
 #include <bootable/core/stream.h>
 #include <bootable/core/string.h>
 #include <bootable/core/uuid.h>
 
-#include "misc.h"
+#include "schema.h"
 
 #ifndef NULL
 #define NULL ((void *) 0x00)
@@ -46,6 +48,10 @@
 #define GPT_INVALID_LBA BOOTABLE_GPT_INVALID_LBA
 #endif
 
+#ifndef GPT_DEFAULT_ALIGNMENT
+#define GPT_DEFAULT_ALIGNMENT (1024 * 1024)
+#endif
+
 static void init_header(struct bootable_gpt_header *header) {
 	header->signature[0] = 'E';
 	header->signature[1] = 'F';
@@ -69,679 +75,1281 @@ static void init_header(struct bootable_gpt_header *header) {
 	header->partition_entries_checksum = 0;
 }
 
-static bootable_uint32 crc32(const void *buf, bootable_uint64 buf_size) {
+static void put_uint32(unsigned char *buf, bootable_uint32 n) {
+	buf[0] = (n >> 0) & 0xff;
+	buf[1] = (n >> 8) & 0xff;
+	buf[2] = (n >> 16) & 0xff;
+	buf[3] = (n >> 24) & 0xff;
+}
 
-	bootable_uint64 i;
-	bootable_uint64 j;
-	bootable_uint32 byte;
-	bootable_uint32 crc;
-	bootable_uint32 mask;
-	const bootable_uint8 *buf8;
+#define GPT_HEADER_FIELDS(X, T) \
+	X(T, signature,                  0x00, BOOTABLE_SCHEMA_BYTES,   8) \
+	X(T, version,                    0x08, BOOTABLE_SCHEMA_UINT32,  4) \
+	X(T, header_size,                0x0c, BOOTABLE_SCHEMA_UINT32,  4) \
+	X(T, checksum,                   0x10, BOOTABLE_SCHEMA_UINT32,  4) \
+	X(T, reserved,                   0x14, BOOTABLE_SCHEMA_UINT32,  4) \
+	X(T, current_lba,                0x18, BOOTABLE_SCHEMA_UINT64,  8) \
+	X(T, backup_lba,                 0x20, BOOTABLE_SCHEMA_UINT64,  8) \
+	X(T, first_usable_lba,           0x28, BOOTABLE_SCHEMA_UINT64,  8) \
+	X(T, last_usable_lba,            0x30, BOOTABLE_SCHEMA_UINT64,  8) \
+	X(T, disk_uuid,                  0x38, BOOTABLE_SCHEMA_BYTES,  16) \
+	X(T, partition_entries_lba,      0x48, BOOTABLE_SCHEMA_UINT64,  8) \
+	X(T, partition_entry_count,      0x50, BOOTABLE_SCHEMA_UINT32,  4) \
+	X(T, partition_entry_size,       0x54, BOOTABLE_SCHEMA_UINT32,  4) \
+	X(T, partition_entries_checksum, 0x58, BOOTABLE_SCHEMA_UINT32,  4)
+
+#define GPT_ENTRY_FIELDS(X, T) \
+	X(T, type_uuid,  0x00, BOOTABLE_SCHEMA_BYTES,  16) \
+	X(T, entry_uuid, 0x10, BOOTABLE_SCHEMA_BYTES,  16) \
+	X(T, first_lba,  0x20, BOOTABLE_SCHEMA_UINT64,  8) \
+	X(T, last_lba,   0x28, BOOTABLE_SCHEMA_UINT64,  8) \
+	X(T, attributes, 0x30, BOOTABLE_SCHEMA_UINT64,  8) \
+	X(T, name,       0x38, BOOTABLE_SCHEMA_BYTES,  72)
+
+static const struct bootable_schema_field header_fields[] = {
+	GPT_HEADER_FIELDS(BOOTABLE_SCHEMA_FIELD, struct bootable_gpt_header)
+};
+
+GPT_HEADER_FIELDS(BOOTABLE_SCHEMA_CHECK_FIELD, struct bootable_gpt_header)
+
+static const struct bootable_schema header_schema = BOOTABLE_SCHEMA_INIT(struct bootable_gpt_header, header_fields, GPT_HEADER_SIZE,
+	BOOTABLE_SCHEMA_IDENTITY(struct bootable_gpt_header, GPT_HEADER_SIZE,
+	                         GPT_HEADER_FIELDS(BOOTABLE_SCHEMA_SAME_OFFSET, struct bootable_gpt_header),
+	                         GPT_HEADER_FIELDS(BOOTABLE_SCHEMA_FIELD_SIZE, struct bootable_gpt_header)));
+
+static const struct bootable_schema_field entry_fields[] = {
+	GPT_ENTRY_FIELDS(BOOTABLE_SCHEMA_FIELD, struct bootable_gpt_entry)
+};
+
+GPT_ENTRY_FIELDS(BOOTABLE_SCHEMA_CHECK_FIELD, struct bootable_gpt_entry)
+
+static const struct bootable_schema entry_schema = BOOTABLE_SCHEMA_INIT(struct bootable_gpt_entry, entry_fields, GPT_ENTRY_SIZE,
+	BOOTABLE_SCHEMA_IDENTITY(struct bootable_gpt_entry, GPT_ENTRY_SIZE,
+	                         GPT_ENTRY_FIELDS(BOOTABLE_SCHEMA_SAME_OFFSET, struct bootable_gpt_entry),
+	                         GPT_ENTRY_FIELDS(BOOTABLE_SCHEMA_FIELD_SIZE, struct bootable_gpt_entry)));
+
+/* Encodes a header into a sector. The fields that
+ * this library always writes the same way are set
+ * here, and both checksums are left zero. */
+
+static void encode_header(const struct bootable_gpt_header *header,
+                          unsigned char *buf) {
+
+	struct bootable_gpt_header tmp;
+
+	bootable_memcpy(&tmp, header, sizeof(tmp));
+
+	bootable_memcpy(tmp.signature, "EFI PART", 8);
+	tmp.version = 0x010000;
+	tmp.header_size = GPT_HEADER_SIZE;
+	tmp.checksum = 0;
+	tmp.reserved = 0;
+	tmp.partition_entry_size = GPT_ENTRY_SIZE;
+	tmp.partition_entries_checksum = 0;
+
+	bootable_memset(buf, 0, 512);
+
+	bootable_schema_encode(&header_schema, &tmp, buf);
+}
 
-	crc = 0xFFFFFFFF;
+static void encode_entry(const struct bootable_gpt_entry *entry,
+                         unsigned char *buf) {
+	bootable_schema_encode(&entry_schema, entry, buf);
+}
 
-	buf8 = (const bootable_uint8 *) buf;
+static void decode_entry(struct bootable_gpt_entry *entry,
+                         const unsigned char *buf) {
+	bootable_schema_decode(&entry_schema, entry, buf);
+}
 
-	for (i = 0; i < buf_size; i++) {
-		byte = buf8[i];
-		crc = crc ^ byte;
-		for (j = 0; j < 8; j++) {
-			mask = -(crc & 1);
-			crc = (crc >> 1) ^ (0xEDB88320 & mask);
-		}
-	}
+/* Gets the number of sectors that
+ * an entry array takes on the disk. */
 
-	return ~crc;
+static bootable_uint64 entries_lba_count(bootable_uint32 entry_count) {
+	return ((((bootable_uint64) entry_count) * GPT_ENTRY_SIZE) + 511) / 512;
 }
 
-static int encode_uint32_at(bootable_uint32 n, struct bootable_stream *stream, bootable_uint64 pos) {
+static void decode_header(struct bootable_gpt_header *header,
+                          const unsigned char *buf) {
+	bootable_schema_decode(&header_schema, header, buf);
+}
 
-	int err = bootable_stream_set_pos(stream, pos);
-	if (err != 0)
-		return err;
+/* Makes the backup header that
+ * goes along with a primary header. */
+
+static void make_backup_header(const struct bootable_gpt_header *header,
+                               struct bootable_gpt_header *backup) {
+
+	bootable_memcpy(backup, header, sizeof(*backup));
+
+	backup->current_lba = header->backup_lba;
+	backup->backup_lba = header->current_lba;
+	backup->partition_entries_lba = header->backup_lba;
+	backup->partition_entries_lba -= entries_lba_count(header->partition_entry_count);
+}
+
+/* Writes a header and its entry array. The entry
+ * array is encoded by the caller, so that the primary
+ * and the backup table share it and its checksum. */
+
+static int export_table(const struct bootable_gpt_header *header,
+                        const unsigned char *entries_buf,
+                        bootable_uint32 entries_checksum,
+                        struct bootable_stream *stream) {
+
+	bootable_uint64 entries_size = ((bootable_uint64) header->partition_entry_count) * GPT_ENTRY_SIZE;
+
+	unsigned char header_buf[512];
+
+	encode_header(header, header_buf);
+
+	put_uint32(&header_buf[88], entries_checksum);
+
+	put_uint32(&header_buf[16], bootable_crc32(header_buf, GPT_HEADER_SIZE));
 
-	err = encode_uint32(n, stream);
+	int err = bootable_stream_write_at(stream, header->current_lba * 512, header_buf, sizeof(header_buf));
 	if (err != 0)
 		return err;
 
+	return bootable_stream_write_at(stream, header->partition_entries_lba * 512, entries_buf, entries_size);
+}
+
+int bootable_gpt_header_import(struct bootable_gpt_header *header,
+                             struct bootable_stream *stream) {
+	return bootable_schema_read(&header_schema, header, stream);
+}
+
+int bootable_gpt_header_export(const struct bootable_gpt_header *header,
+                             struct bootable_stream *stream) {
+
+	unsigned char buf[512];
+
+	encode_header(header, buf);
+
+	return bootable_stream_write(stream, buf, sizeof(buf));
+}
+
+void bootable_gpt_entry_init(struct bootable_gpt_entry *entry) {
+	bootable_uuid_zero(&entry->type_uuid);
+	bootable_uuid_zero(&entry->entry_uuid);
+	entry->first_lba = BOOTABLE_GPT_INVALID_LBA;
+	entry->last_lba = BOOTABLE_GPT_INVALID_LBA;
+	entry->attributes = 0;
+	bootable_memset(entry->name, 0, sizeof(entry->name));
+}
+
+int bootable_gpt_entry_import(struct bootable_gpt_entry *entry,
+                            struct bootable_stream *stream) {
+	return bootable_schema_read(&entry_schema, entry, stream);
+}
+
+int bootable_gpt_entry_export(const struct bootable_gpt_entry *entry,
+                            struct bootable_stream *stream) {
+	return bootable_schema_write(&entry_schema, entry, stream);
+}
+
+bootable_uint64 bootable_gpt_entry_get_offset(const struct bootable_gpt_entry *entry) {
+	return entry->first_lba * 512;
+}
+
+bootable_uint64 bootable_gpt_entry_get_size(const struct bootable_gpt_entry *entry) {
+	return ((entry->last_lba - entry->first_lba) + 1) * 512;
+}
+
+int bootable_gpt_entry_is_used(const struct bootable_gpt_entry *entry) {
+
+	if ((entry->first_lba == GPT_INVALID_LBA)
+	 || (entry->last_lba == GPT_INVALID_LBA))
+		return 0;
+	else
+		return 1;
+}
+
+int bootable_gpt_entry_is_type(const struct bootable_gpt_entry *entry,
+                             const char *type_uuid_str) {
+
+	struct bootable_uuid type_uuid;
+
+	if (bootable_uuid_parse(&type_uuid, type_uuid_str) != 0) {
+		/* If the UUID is invalid, then
+		 * this partition must not be of
+		 * this type. */
+		return 0;
+	}
+
+	if (bootable_uuid_cmp(&type_uuid, &entry->type_uuid) == 0) {
+		/* The UUIDs match */
+		return 1;
+	}
+
 	return 0;
 }
 
-static int calculate_header_checksum(struct bootable_stream *stream, bootable_uint64 header_location) {
+/* Hash indices */
 
-	bootable_uint32 checksum;
+static void index_init(struct bootable_gpt_index *index) {
+	index->buckets = NULL;
+	index->bucket_count = 0;
+	index->next = NULL;
+	index->prev = NULL;
+	index->hashes = NULL;
+}
 
-	/* start with header */
+static void index_done(struct bootable_gpt_index *index) {
+	/* all arrays share the bucket allocation */
+	bootable_free(index->buckets);
+	index_init(index);
+}
 
-	int err = bootable_stream_set_pos(stream, header_location);
-	if (err != 0)
-		return err;
+static int index_setup(struct bootable_gpt_index *index,
+                       bootable_uint32 entry_count) {
 
-	unsigned char buf[GPT_HEADER_SIZE];
+	bootable_uint32 bucket_count = 16;
 
-	err = bootable_stream_read(stream, buf, sizeof(buf));
-	if (err != 0)
-		return err;
+	while (bucket_count < entry_count)
+		bucket_count *= 2;
 
-	checksum = crc32(buf, sizeof(buf));
+	bootable_uint64 size = bucket_count;
+	size += ((bootable_uint64) entry_count) * 3;
+	size *= sizeof(bootable_uint32);
 
-	err = bootable_stream_set_pos(stream, header_location + 16);
-	if (err != 0)
-		return err;
+	bootable_uint32 *buckets = bootable_malloc(size);
+	if (buckets == NULL)
+		return BOOTABLE_ENOMEM;
 
-	err = encode_uint32(checksum, stream);
-	if (err != 0)
-		return err;
+	index_done(index);
+
+	for (bootable_uint32 i = 0; i < bucket_count; i++)
+		buckets[i] = BOOTABLE_GPT_NO_ENTRY;
+
+	index->buckets = buckets;
+	index->bucket_count = bucket_count;
+	index->next = &buckets[bucket_count];
+	index->prev = &index->next[entry_count];
+	index->hashes = &index->prev[entry_count];
 
 	return 0;
 }
 
-static int calculate_entries_checksum(struct bootable_stream *stream) {
+static void index_insert(struct bootable_gpt_index *index,
+                         bootable_uint32 entry_index,
+                         bootable_uint32 hash) {
 
-	/* start with header */
+	bootable_uint32 *bucket = &index->buckets[hash & (index->bucket_count - 1)];
 
-	int err = bootable_stream_set_pos(stream, 1024);
-	if (err != 0)
-		return err;
+	index->hashes[entry_index] = hash;
+	index->prev[entry_index] = BOOTABLE_GPT_NO_ENTRY;
+	index->next[entry_index] = *bucket;
 
-	bootable_uint64 buf_size = GPT_ENTRY_SIZE * GPT_ENTRY_COUNT;
+	if (*bucket != BOOTABLE_GPT_NO_ENTRY)
+		index->prev[*bucket] = entry_index;
 
-	void *buf = bootable_malloc(buf_size);
+	*bucket = entry_index;
+}
 
-	err = bootable_stream_read(stream, buf, buf_size);
-	if (err != 0) {
-		bootable_free(buf);
-		return err;
-	}
+static void index_remove(struct bootable_gpt_index *index,
+                         bootable_uint32 entry_index) {
 
-	bootable_uint32 checksum = crc32(buf, buf_size);
+	bootable_uint32 hash = index->hashes[entry_index];
+	bootable_uint32 prev = index->prev[entry_index];
+	bootable_uint32 next = index->next[entry_index];
 
-	/* write the checksum to the primary header */
+	if (prev != BOOTABLE_GPT_NO_ENTRY)
+		index->next[prev] = next;
+	else
+		index->buckets[hash & (index->bucket_count - 1)] = next;
 
-	err = encode_uint32_at(checksum, stream, 512 + 88);
-	if (err != 0) {
-		bootable_free(buf);
-		return err;
-	}
+	if (next != BOOTABLE_GPT_NO_ENTRY)
+		index->prev[next] = prev;
+}
 
-	/* find the backup header LBA from the primary header  */
+static bootable_uint32 hash_bytes(const unsigned char *bytes,
+                                  bootable_uint64 size) {
 
-	err = bootable_stream_set_pos(stream, 512 + 32);
-	if (err != 0) {
-		bootable_free(buf);
-		return err;
+	/* FNV-1a */
+
+	bootable_uint32 hash = 0x811c9dc5;
+
+	for (bootable_uint64 i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x01000193;
 	}
 
-	bootable_uint64 backup_lba = 0;
+	return hash;
+}
 
-	err = decode_uint64(&backup_lba, stream);
-	if (err != 0) {
-		bootable_free(buf);
-		return err;
+static bootable_uint64 name_length(const bootable_uint16 *name) {
+
+	bootable_uint64 length = 0;
+
+	while ((length < 36) && (name[length] != 0))
+		length++;
+
+	return length;
+}
+
+static bootable_uint32 hash_name(const bootable_uint16 *name) {
+
+	bootable_uint32 hash = 0x811c9dc5;
+
+	for (bootable_uint64 i = 0; i < name_length(name); i++) {
+		hash ^= name[i] & 0xff;
+		hash *= 0x01000193;
+		hash ^= name[i] >> 8;
+		hash *= 0x01000193;
 	}
 
-	/* go to the backup entry array */
+	return hash;
+}
 
-	bootable_uint64 backup_pos = backup_lba * 512;
-	backup_pos -= GPT_ENTRY_COUNT * GPT_ENTRY_SIZE;
+static bootable_bool name_equal(const bootable_uint16 *a,
+                                const bootable_uint16 *b) {
 
-	err = bootable_stream_set_pos(stream, backup_pos);
-	if (err != 0) {
-		bootable_free(buf);
-		return err;
+	for (bootable_uint64 i = 0; i < 36; i++) {
+		if (a[i] != b[i])
+			return bootable_false;
+		else if (a[i] == 0)
+			break;
 	}
 
-	err = bootable_stream_read(stream, buf, buf_size);
-	if (err != 0) {
-		bootable_free(buf);
-		return err;
+	return bootable_true;
+}
+
+static bootable_uint32 hash_type(const struct bootable_uuid *type_uuid) {
+	return hash_bytes(type_uuid->bytes, sizeof(type_uuid->bytes));
+}
+
+/* Entry slots */
+
+static bootable_bool slot_is_used(const struct bootable_gpt *gpt,
+                                  bootable_uint32 entry_index) {
+
+	return (gpt->used_slots[entry_index / 64] >> (entry_index % 64)) & 1;
+}
+
+/** Marks an entry slot as used and
+ * adds the entry to the indices.
+ * */
+
+static void claim_slot(struct bootable_gpt *gpt,
+                       bootable_uint32 entry_index) {
+
+	if (slot_is_used(gpt, entry_index))
+		return;
+
+	gpt->used_slots[entry_index / 64] |= ((bootable_uint64) 1) << (entry_index % 64);
+
+	const struct bootable_gpt_entry *entry = &gpt->entries[entry_index];
+
+	index_insert(&gpt->name_index, entry_index, hash_name(entry->name));
+	index_insert(&gpt->type_index, entry_index, hash_type(&entry->type_uuid));
+}
+
+static void release_slot(struct bootable_gpt *gpt,
+                         bootable_uint32 entry_index) {
+
+	if (!slot_is_used(gpt, entry_index))
+		return;
+
+	gpt->used_slots[entry_index / 64] &= ~(((bootable_uint64) 1) << (entry_index % 64));
+
+	index_remove(&gpt->name_index, entry_index);
+	index_remove(&gpt->type_index, entry_index);
+}
+
+static bootable_bool entry_has_type(const struct bootable_gpt_entry *entry) {
+
+	for (bootable_uint64 i = 0; i < sizeof(entry->type_uuid.bytes); i++) {
+		if (entry->type_uuid.bytes[i] != 0)
+			return bootable_true;
 	}
 
-	checksum = crc32(buf, buf_size);
+	return bootable_false;
+}
+
+/** Resizes the entry arrays, the slot bitmap and
+ * the indices to fit a certain number of entries.
+ * All entries are left empty.
+ * */
+
+static int setup_entries(struct bootable_gpt *gpt,
+                         bootable_uint32 entry_count) {
 
-	bootable_free(buf);
+	bootable_uint64 array_size = ((bootable_uint64) entry_count) * sizeof(struct bootable_gpt_entry);
+
+	struct bootable_gpt_entry *entries = bootable_realloc(gpt->entries, array_size);
+	if (entries == NULL)
+		return BOOTABLE_ENOMEM;
 
-	/* encode the checksum for the backup entry array */
+	gpt->entries = entries;
 
-	err = bootable_stream_set_pos(stream, (backup_lba * 512) + 88);
+	bootable_uint64 word_count = (((bootable_uint64) entry_count) + 63) / 64;
+
+	bootable_uint64 *used_slots = bootable_realloc(gpt->used_slots, word_count * sizeof(bootable_uint64));
+	if (used_slots == NULL)
+		return BOOTABLE_ENOMEM;
+
+	gpt->used_slots = used_slots;
+
+	bootable_uint64 *decoded_entries = bootable_realloc(gpt->decoded_entries, word_count * sizeof(bootable_uint64));
+	if (decoded_entries == NULL)
+		return BOOTABLE_ENOMEM;
+
+	gpt->decoded_entries = decoded_entries;
+
+	bootable_free(gpt->raw_entries);
+	gpt->raw_entries = NULL;
+
+	int err = index_setup(&gpt->name_index, entry_count);
 	if (err != 0)
 		return err;
 
-	err = encode_uint32(checksum, stream);
+	err = index_setup(&gpt->type_index, entry_count);
 	if (err != 0)
 		return err;
 
+	for (bootable_uint64 i = 0; i < word_count; i++) {
+		gpt->used_slots[i] = 0;
+		gpt->decoded_entries[i] = 0;
+	}
+
+	for (bootable_uint32 i = 0; i < entry_count; i++) {
+		bootable_gpt_entry_init(&gpt->entries[i]);
+	}
+
+	bootable_extent_map_clear(&gpt->free_extents);
+
+	gpt->entry_count = entry_count;
+
 	return 0;
 }
 
-static int calculate_checksums(struct bootable_stream *stream) {
+/** Marks the slots of imported entries as used. */
 
-	int err = calculate_entries_checksum(stream);
-	if (err != 0) {
-		return err;
+static void claim_used_slots(struct bootable_gpt *gpt) {
+
+	for (bootable_uint32 i = 0; i < gpt->entry_count; i++) {
+
+		const struct bootable_gpt_entry *entry = &gpt->entries[i];
+
+		if (entry_has_type(entry) || bootable_gpt_entry_is_used(entry))
+			claim_slot(gpt, i);
 	}
+}
 
-	err = calculate_header_checksum(stream, 512);
-	if (err != 0)
-		return err;
+/** Decodes an entry from the imported entry
+ * array, if it has not been decoded yet.
+ * */
 
-	err = bootable_stream_set_pos(stream, 512 + 32);
-	if (err != 0)
-		return err;
+static void decode_pending(struct bootable_gpt *gpt,
+                           bootable_uint32 entry_index) {
 
-	bootable_uint64 backup_lba = 0;
+	if (gpt->raw_entries == NULL)
+		return;
 
-	err = decode_uint64(&backup_lba, stream);
-	if (err != 0)
-		return err;
+	bootable_uint64 *word = &gpt->decoded_entries[entry_index / 64];
+	bootable_uint64 bit = ((bootable_uint64) 1) << (entry_index % 64);
+
+	if ((*word & bit) != 0)
+		return;
+
+	decode_entry(&gpt->entries[entry_index], &gpt->raw_entries[entry_index * GPT_ENTRY_SIZE]);
+
+	*word |= bit;
+}
+
+static int build_free_extents(struct bootable_gpt *gpt);
+
+/** Decodes the rest of an imported entry array
+ * and builds the slot bitmap, the indices and the
+ * map of free LBAs. This is done before the table is
+ * searched or changed. Read-only access to single
+ * entries does not need it.
+ * */
+
+static int load_all(struct bootable_gpt *gpt) {
+
+	if (gpt->raw_entries == NULL)
+		return 0;
+
+	for (bootable_uint32 i = 0; i < gpt->entry_count; i++)
+		decode_pending(gpt, i);
 
-	err = calculate_header_checksum(stream, backup_lba * 512);
+	bootable_free(gpt->raw_entries);
+	gpt->raw_entries = NULL;
+
+	claim_used_slots(gpt);
+
+	return build_free_extents(gpt);
+}
+
+void bootable_gpt_init(struct bootable_gpt *gpt) {
+	init_header(&gpt->header);
+	gpt->entries = NULL;
+	gpt->entry_count = GPT_ENTRY_COUNT;
+	gpt->used_slots = NULL;
+	gpt->raw_entries = NULL;
+	gpt->decoded_entries = NULL;
+	index_init(&gpt->name_index);
+	index_init(&gpt->type_index);
+	bootable_extent_map_init(&gpt->free_extents);
+	gpt->alignment = GPT_DEFAULT_ALIGNMENT;
+	gpt->placement = BOOTABLE_PLACEMENT_FIRST_FIT;
+}
+
+void bootable_gpt_done(struct bootable_gpt *gpt) {
+	bootable_free(gpt->entries);
+	bootable_free(gpt->used_slots);
+	bootable_free(gpt->raw_entries);
+	bootable_free(gpt->decoded_entries);
+	index_done(&gpt->name_index);
+	index_done(&gpt->type_index);
+	bootable_extent_map_done(&gpt->free_extents);
+}
+
+/** Builds the map of free LBAs from
+ * the usable range and the used entries.
+ * Entries that overlap another entry or
+ * that are outside of the usable range
+ * are left out of the map.
+ * */
+
+static int build_free_extents(struct bootable_gpt *gpt) {
+
+	bootable_uint64 first_lba = gpt->header.first_usable_lba;
+	bootable_uint64 last_lba = gpt->header.last_usable_lba;
+
+	bootable_extent_map_clear(&gpt->free_extents);
+
+	if (last_lba < first_lba)
+		return 0;
+
+	int err = bootable_extent_map_free(&gpt->free_extents, first_lba, (last_lba - first_lba) + 1);
 	if (err != 0)
 		return err;
 
+	for (bootable_uint32 i = 0; i < gpt->entry_count; i++) {
+
+		const struct bootable_gpt_entry *entry = &gpt->entries[i];
+
+		if (!bootable_gpt_entry_is_used(entry)
+		 || (entry->last_lba < entry->first_lba))
+			continue;
+
+		err = bootable_extent_map_reserve(&gpt->free_extents,
+		                                  entry->first_lba,
+		                                  (entry->last_lba - entry->first_lba) + 1);
+		if ((err != 0) && (err != BOOTABLE_ENOSPC))
+			return err;
+	}
+
 	return 0;
 }
 
-int bootable_gpt_header_import(struct bootable_gpt_header *header,
-                             struct bootable_stream *stream) {
+/** Returns the space of an entry
+ * to the map of free LBAs.
+ * */
 
-	/* signature */
-	int err = bootable_stream_read(stream, header->signature, sizeof(header->signature));
-	if (err != 0)
-		return err;
+static int free_entry_space(struct bootable_gpt *gpt,
+                            bootable_uint32 entry_index) {
 
-	/* version */
-	err = decode_uint32(&header->version, stream);
-	if (err != 0)
-		return err;
+	const struct bootable_gpt_entry *entry = &gpt->entries[entry_index];
 
-	/* header size */
-	err = decode_uint32(&header->header_size, stream);
-	if (err != 0)
-		return err;
+	if (!bootable_gpt_entry_is_used(entry))
+		return 0;
 
-	/* crc32 of header (zero during calculation) */
-	err = decode_uint32(&header->checksum, stream);
-	if (err != 0)
-		return err;
+	return bootable_extent_map_free(&gpt->free_extents,
+	                                entry->first_lba,
+	                                (entry->last_lba - entry->first_lba) + 1);
+}
 
-	/* reserved */
-	err = decode_uint32(&header->reserved, stream);
-	if (err != 0)
-		return err;
+/** Marks the space of an entry as used
+ * again, after changing its size or offset
+ * failed, so that the entry is left as it was.
+ * */
 
-	err = decode_uint64(&header->current_lba, stream);
-	if (err != 0)
-		return err;
+static void restore_entry_space(struct bootable_gpt *gpt,
+                                bootable_uint32 entry_index) {
 
-	/* backup lba */
-	err = decode_uint64(&header->backup_lba, stream);
-	if (err != 0)
-		return err;
+	const struct bootable_gpt_entry *entry = &gpt->entries[entry_index];
 
-	/* first usable lba */
-	err = decode_uint64(&header->first_usable_lba, stream);
-	if (err != 0)
-		return err;
+	if (!bootable_gpt_entry_is_used(entry))
+		return;
 
-	/* last usable lba */
-	err = decode_uint64(&header->last_usable_lba, stream);
-	if (err != 0)
-		return err;
+	bootable_extent_map_reserve(&gpt->free_extents,
+	                            entry->first_lba,
+	                            (entry->last_lba - entry->first_lba) + 1);
+}
 
-	/* disk UUID */
-	err = bootable_stream_read(stream, header->disk_uuid.bytes, 16);
-	if (err != 0)
-		return err;
+static void set_entry_lba(struct bootable_gpt *gpt,
+                          bootable_uint32 entry_index,
+                          bootable_uint64 first_lba,
+                          bootable_uint64 last_lba) {
 
-	/* lba of partition entries */
-	err = decode_uint64(&header->partition_entries_lba, stream);
-	if (err != 0)
-		return err;
+	gpt->entries[entry_index].first_lba = first_lba;
+	gpt->entries[entry_index].last_lba = last_lba;
 
-	/* number of partition entries */
-	err = decode_uint32(&header->partition_entry_count, stream);
-	if (err != 0)
-		return err;
+	if (bootable_gpt_entry_is_used(&gpt->entries[entry_index]))
+		claim_slot(gpt, entry_index);
+}
 
-	/* partition entry size */
-	err = decode_uint32(&header->partition_entry_size, stream);
-	if (err != 0)
-		return err;
+static bootable_uint64 size_to_lba_count(bootable_uint64 size) {
 
-	/* crc32 of partition header array */
-	err = decode_uint32(&header->partition_entries_checksum, stream);
-	if (err != 0)
-		return err;
+	bootable_uint64 lba_count = (size + 511) / 512;
+	if (lba_count == 0)
+		lba_count = 1;
+
+	return lba_count;
+}
+
+static int check_entry_index(const struct bootable_gpt *gpt,
+                             bootable_uint32 entry_index) {
+
+	if ((gpt->entries == NULL)
+	 || (entry_index >= gpt->entry_count))
+		return BOOTABLE_EINVAL;
 
 	return 0;
 }
 
-int bootable_gpt_header_export(const struct bootable_gpt_header *header,
-                             struct bootable_stream *stream) {
+/** Checks an entry index and loads the whole
+ * table, before an entry is changed.
+ * */
 
-	/* signature */
-	int err = bootable_stream_write(stream, "EFI PART", 8);
-	if (err != 0)
-		return err;
+static int prepare_entry(struct bootable_gpt *gpt,
+                         bootable_uint32 entry_index) {
 
-	/* version */
-	err |= encode_uint32(0x010000, stream);
+	int err = check_entry_index(gpt, entry_index);
 	if (err != 0)
 		return err;
 
-	/* header size */
-	err |= encode_uint32(0x5c, stream);
-	if (err != 0)
-		return err;
+	return load_all(gpt);
+}
 
-	/* crc32 of header (zero during calculation) */
-	err |= encode_uint32(0x00, stream);
-	if (err != 0)
-		return err;
+int bootable_gpt_set_entry_count(struct bootable_gpt *gpt,
+                                 bootable_uint32 entry_count) {
 
-	/* reserved */
-	err |= encode_uint32(0x00, stream);
-	if (err != 0)
-		return err;
+	if ((entry_count == 0)
+	 || (entry_count == BOOTABLE_GPT_NO_ENTRY))
+		return BOOTABLE_EINVAL;
 
-	/* current lba */
-	err |= encode_uint64(header->current_lba, stream);
-	if (err != 0)
-		return err;
+	/* The entry arrays, the bitmaps and the
+	 * indices of an existing table are sized
+	 * for its count, so it cannot change. */
 
-	/* backup lba */
-	err |= encode_uint64(header->backup_lba, stream);
-	if (err != 0)
-		return err;
+	if ((gpt->entries != NULL)
+	 && (entry_count != gpt->entry_count))
+		return BOOTABLE_EINVAL;
+
+	gpt->entry_count = entry_count;
+
+	return 0;
+}
 
-	/* first usable lba */
-	err |= encode_uint64(header->first_usable_lba, stream);
+int bootable_gpt_find_unused_entry(struct bootable_gpt *gpt,
+                                 bootable_uint32 *entry_index) {
+
+	if (gpt->used_slots == NULL)
+		return BOOTABLE_ENOSPC;
+
+	int err = load_all(gpt);
 	if (err != 0)
 		return err;
 
-	/* last usable lba */
-	err |= encode_uint64(header->last_usable_lba, stream);
+	bootable_uint64 word_count = (((bootable_uint64) gpt->entry_count) + 63) / 64;
+
+	for (bootable_uint64 i = 0; i < word_count; i++) {
+
+		bootable_uint64 free_slots = ~gpt->used_slots[i];
+		if (free_slots == 0)
+			continue;
+
+		bootable_uint32 j = 0;
+
+		while (((free_slots >> j) & 1) == 0)
+			j++;
+
+		if (((i * 64) + j) >= gpt->entry_count)
+			break;
+
+		*entry_index = (bootable_uint32) ((i * 64) + j);
+
+		return 0;
+	}
+
+	return BOOTABLE_ENOSPC;
+}
+
+int bootable_gpt_find_entry_by_name(struct bootable_gpt *gpt,
+                                    const bootable_uint16 *name,
+                                    bootable_uint32 *entry_index) {
+
+	int err = load_all(gpt);
 	if (err != 0)
 		return err;
 
-	/* disk UUID */
-	err |= bootable_stream_write(stream, header->disk_uuid.bytes, 16);
+	const struct bootable_gpt_index *index = &gpt->name_index;
+
+	if (index->buckets == NULL)
+		return BOOTABLE_ENOENT;
+
+	bootable_uint32 hash = hash_name(name);
+
+	bootable_uint32 i = index->buckets[hash & (index->bucket_count - 1)];
+
+	while (i != BOOTABLE_GPT_NO_ENTRY) {
+
+		if ((index->hashes[i] == hash)
+		 && name_equal(gpt->entries[i].name, name)) {
+			*entry_index = i;
+			return 0;
+		}
+
+		i = index->next[i];
+	}
+
+	return BOOTABLE_ENOENT;
+}
+
+/** Converts a UTF-8 string to the UTF-16
+ * form of an entry name. Characters outside
+ * of the basic plane become surrogate pairs.
+ * Names longer than an entry can hold are cut
+ * off, but never in the middle of a pair.
+ * @returns Zero on success, @ref BOOTABLE_EINVAL
+ * if the string is not valid UTF-8.
+ * */
+
+static int utf8_to_name(const char *name,
+                        bootable_uint16 name16[36]) {
+
+	const unsigned char *in = (const unsigned char *) name;
+
+	bootable_uint32 i = 0;
+
+	while (*in != 0) {
+
+		bootable_uint32 c = *in;
+		bootable_uint32 min = 0;
+		unsigned int extra = 0;
+
+		if (c < 0x80) {
+			extra = 0;
+		} else if ((c & 0xe0) == 0xc0) {
+			c &= 0x1f;
+			min = 0x80;
+			extra = 1;
+		} else if ((c & 0xf0) == 0xe0) {
+			c &= 0x0f;
+			min = 0x800;
+			extra = 2;
+		} else if ((c & 0xf8) == 0xf0) {
+			c &= 0x07;
+			min = 0x10000;
+			extra = 3;
+		} else {
+			return BOOTABLE_EINVAL;
+		}
+
+		in++;
+
+		for (unsigned int j = 0; j < extra; j++) {
+			if ((*in & 0xc0) != 0x80)
+				return BOOTABLE_EINVAL;
+			c = (c << 6) | (*in & 0x3f);
+			in++;
+		}
+
+		if ((c < min)
+		 || (c > 0x10ffff)
+		 || ((c >= 0xd800) && (c <= 0xdfff)))
+			return BOOTABLE_EINVAL;
+
+		if (c < 0x10000) {
+			if (i >= 35)
+				break;
+			name16[i++] = (bootable_uint16) c;
+		} else {
+			if (i >= 34)
+				break;
+			c -= 0x10000;
+			name16[i++] = (bootable_uint16) (0xd800 | (c >> 10));
+			name16[i++] = (bootable_uint16) (0xdc00 | (c & 0x3ff));
+		}
+	}
+
+	name16[i] = 0;
+
+	return 0;
+}
+
+int bootable_gpt_find_entry_by_name_utf8(struct bootable_gpt *gpt,
+                                         const char *name,
+                                         bootable_uint32 *entry_index) {
+
+	bootable_uint16 name16[36];
+
+	int err = utf8_to_name(name, name16);
 	if (err != 0)
 		return err;
 
-	/* lba of partition entries */
-	err |= encode_uint64(header->partition_entries_lba, stream);
+	return bootable_gpt_find_entry_by_name(gpt, name16, entry_index);
+}
+
+/** Follows the type index from an
+ * entry, until an entry of the type
+ * is found.
+ * */
+
+static int find_type_from(const struct bootable_gpt *gpt,
+                          const struct bootable_uuid *type_uuid,
+                          bootable_uint32 hash,
+                          bootable_uint32 i,
+                          bootable_uint32 *entry_index) {
+
+	const struct bootable_gpt_index *index = &gpt->type_index;
+
+	while (i != BOOTABLE_GPT_NO_ENTRY) {
+
+		if ((index->hashes[i] == hash)
+		 && (bootable_uuid_cmp(&gpt->entries[i].type_uuid, type_uuid) == 0)) {
+			*entry_index = i;
+			return 0;
+		}
+
+		i = index->next[i];
+	}
+
+	return BOOTABLE_ENOENT;
+}
+
+int bootable_gpt_find_entry_by_type(struct bootable_gpt *gpt,
+                                    const char *type_uuid_str,
+                                    bootable_uint32 *entry_index) {
+
+	struct bootable_uuid type_uuid;
+
+	int err = bootable_uuid_parse(&type_uuid, type_uuid_str);
 	if (err != 0)
 		return err;
 
-	/* number of partition entries */
-	err |= encode_uint32(header->partition_entry_count, stream);
+	err = load_all(gpt);
 	if (err != 0)
 		return err;
 
-	/* partition entry size */
-	err |= encode_uint32(0x80, stream);
-	if (err != 0)
-		return err;
+	const struct bootable_gpt_index *index = &gpt->type_index;
 
-	/* crc32 of partition header array */
-	err |= encode_uint32(0x00, stream);
-	if (err != 0)
-		return err;
+	if (index->buckets == NULL)
+		return BOOTABLE_ENOENT;
 
-	/* zero the rest of the sector */
-	for (unsigned int i = 0; i < (512 - 92); i += 4) {
-		err = bootable_stream_write(stream, "\x00\x00\x00\x00", 4);
-		if (err != 0)
-			return err;
-	}
+	bootable_uint32 hash = hash_type(&type_uuid);
 
-	return 0;
-}
+	bootable_uint32 i = index->buckets[hash & (index->bucket_count - 1)];
 
-void bootable_gpt_entry_init(struct bootable_gpt_entry *entry) {
-	bootable_uuid_zero(&entry->type_uuid);
-	bootable_uuid_zero(&entry->entry_uuid);
-	entry->first_lba = BOOTABLE_GPT_INVALID_LBA;
-	entry->last_lba = BOOTABLE_GPT_INVALID_LBA;
-	entry->attributes = 0;
-	bootable_memset(entry->name, 0, sizeof(entry->name));
+	return find_type_from(gpt, &type_uuid, hash, i, entry_index);
 }
 
-int bootable_gpt_entry_import(struct bootable_gpt_entry *entry,
-                            struct bootable_stream *stream) {
+int bootable_gpt_find_next_entry_by_type(struct bootable_gpt *gpt,
+                                         const char *type_uuid_str,
+                                         bootable_uint32 *entry_index) {
 
-	int err = bootable_stream_read(stream, entry->type_uuid.bytes, sizeof(entry->type_uuid.bytes));
-	if (err != 0)
-		return err;
+	struct bootable_uuid type_uuid;
 
-	err = bootable_stream_read(stream, entry->entry_uuid.bytes, sizeof(entry->entry_uuid.bytes));
+	int err = bootable_uuid_parse(&type_uuid, type_uuid_str);
 	if (err != 0)
 		return err;
 
-	err = decode_uint64(&entry->first_lba, stream);
+	err = load_all(gpt);
 	if (err != 0)
 		return err;
 
-	err = decode_uint64(&entry->last_lba, stream);
-	if (err != 0)
-		return err;
+	if ((*entry_index >= gpt->entry_count)
+	 || (gpt->used_slots == NULL)
+	 || !slot_is_used(gpt, *entry_index))
+		return BOOTABLE_EINVAL;
 
-	err = decode_uint64(&entry->attributes, stream);
-	if (err != 0)
-		return err;
+	bootable_uint32 i = gpt->type_index.next[*entry_index];
 
-	err = bootable_stream_read(stream, entry->name, sizeof(entry->name));
-	if (err != 0)
-		return err;
+	return find_type_from(gpt, &type_uuid, hash_type(&type_uuid), i, entry_index);
+}
 
-	return 0;
+void bootable_gpt_set_disk_uuid(struct bootable_gpt *gpt,
+                              const struct bootable_uuid *disk_uuid) {
+
+	bootable_memcpy(gpt->header.disk_uuid.bytes,
+	              disk_uuid->bytes,
+	              sizeof(disk_uuid->bytes));
 }
 
-int bootable_gpt_entry_export(const struct bootable_gpt_entry *entry,
-                            struct bootable_stream *stream) {
+int bootable_gpt_format(struct bootable_gpt *gpt,
+                      bootable_uint64 disk_size) {
 
-	int err = bootable_stream_write(stream, entry->type_uuid.bytes, sizeof(entry->type_uuid.bytes));
-	if (err != 0)
-		return err;
+	bootable_uint64 table_lba_count = entries_lba_count(gpt->entry_count);
 
-	err = bootable_stream_write(stream, entry->entry_uuid.bytes, sizeof(entry->entry_uuid.bytes));
-	if (err != 0)
-		return err;
+	/* mbr, two headers, two entry arrays
+	 * and at least one usable sector */
+	if ((disk_size / 512) < ((table_lba_count * 2) + 4))
+		return BOOTABLE_EINVAL;
 
-	err = encode_uint64(entry->first_lba, stream);
-	if (err != 0)
-		return err;
+	/* Initialize header */
 
-	err = encode_uint64(entry->last_lba, stream);
-	if (err != 0)
-		return err;
+	gpt->header.current_lba = 1;
+	gpt->header.backup_lba = (disk_size - 512) / 512;
+	gpt->header.first_usable_lba = 2 + table_lba_count; /* mbr + gpt header + entries */
+	gpt->header.last_usable_lba = gpt->header.backup_lba;
+	gpt->header.last_usable_lba -= table_lba_count;
+	gpt->header.last_usable_lba -= 1;
+	gpt->header.partition_entries_lba = 2;
+	gpt->header.partition_entry_count = gpt->entry_count;
 
-	err = encode_uint64(entry->attributes, stream);
-	if (err != 0)
-		return err;
+	/* Initialize entries */
 
-	err = bootable_stream_write(stream, entry->name, sizeof(entry->name));
+	int err = setup_entries(gpt, gpt->entry_count);
 	if (err != 0)
 		return err;
 
-	return 0;
+	return build_free_extents(gpt);
 }
 
-bootable_uint64 bootable_gpt_entry_get_offset(const struct bootable_gpt_entry *entry) {
-	return entry->first_lba * 512;
+/** A partition table, as it was read from the disk. */
+
+struct table_copy {
+	/** The decoded header. */
+	struct bootable_gpt_header header;
+	/** The encoded entry array. */
+	unsigned char *entries_buf;
+	/** Whether both checksums matched. */
+	bootable_bool valid;
+};
+
+static void table_copy_init(struct table_copy *copy) {
+	init_header(&copy->header);
+	copy->entries_buf = NULL;
+	copy->valid = bootable_false;
 }
 
-bootable_uint64 bootable_gpt_entry_get_size(const struct bootable_gpt_entry *entry) {
-	return ((entry->last_lba - entry->first_lba) + 1) * 512;
+static void table_copy_done(struct table_copy *copy) {
+	bootable_free(copy->entries_buf);
+	copy->entries_buf = NULL;
 }
 
-int bootable_gpt_entry_is_used(const struct bootable_gpt_entry *entry) {
+/** Checks that the entry array of a header is
+ * one that can be read, and that it fits between
+ * the header and the first usable LBA, or between
+ * the last usable LBA and the header.
+ * */
 
-	if ((entry->first_lba == GPT_INVALID_LBA)
-	 || (entry->last_lba == GPT_INVALID_LBA))
-		return 0;
-	else
-		return 1;
-}
+static bootable_bool header_is_sane(const struct bootable_gpt_header *header) {
 
-int bootable_gpt_entry_is_type(const struct bootable_gpt_entry *entry,
-                             const char *type_uuid_str) {
+	bootable_uint32 entry_count = header->partition_entry_count;
 
-	struct bootable_uuid type_uuid;
+	if ((entry_count == 0)
+	 || (entry_count == BOOTABLE_GPT_NO_ENTRY)
+	 || (header->partition_entry_size != GPT_ENTRY_SIZE)
+	 || (header->first_usable_lba > header->last_usable_lba))
+		return bootable_false;
 
-	if (bootable_uuid_parse(&type_uuid, type_uuid_str) != 0) {
-		/* If the UUID is invalid, then
-		 * this partition must not be of
-		 * this type. */
-		return 0;
-	}
+	bootable_uint64 entries_end = header->partition_entries_lba + entries_lba_count(entry_count);
 
-	if (bootable_uuid_cmp(&type_uuid, &entry->type_uuid) == 0) {
-		/* The UUIDs match */
-		return 1;
+	if (header->current_lba < header->first_usable_lba) {
+		return (header->partition_entries_lba > header->current_lba)
+		    && (entries_end <= header->first_usable_lba);
+	} else {
+		return (header->partition_entries_lba > header->last_usable_lba)
+		    && (entries_end <= header->current_lba);
 	}
-
-	return 0;
-}
-
-void bootable_gpt_init(struct bootable_gpt *gpt) {
-	init_header(&gpt->primary_header);
-	init_header(&gpt->backup_header);
-	gpt->primary_entries = NULL;
-	gpt->backup_entries = NULL;
 }
 
-void bootable_gpt_done(struct bootable_gpt *gpt) {
-	bootable_free(gpt->primary_entries);
-	bootable_free(gpt->backup_entries);
-}
+/** Reads a header and its entry array, with one
+ * call each, and checks their checksums.
+ * @returns Zero if the table could be read, even if
+ * it is not valid. An error code is returned if the
+ * table could not be read at all.
+ * */
 
-int bootable_gpt_find_unused_entry(const struct bootable_gpt *gpt,
-                                 bootable_uint32 *entry_index) {
+static int read_table(struct table_copy *copy,
+                      struct bootable_stream *stream,
+                      bootable_uint64 lba) {
 
-	for (bootable_uint32 i = 0; i < gpt->primary_header.partition_entry_count; i++) {
-		struct bootable_gpt_entry *entry = &gpt->primary_entries[i];
-		if (!bootable_gpt_entry_is_used(entry)) {
-			*entry_index = i;
-			return 0;
-		}
-	}
+	unsigned char header_buf[512];
 
-	return BOOTABLE_ENOSPC;
-}
+	copy->valid = bootable_false;
 
-void bootable_gpt_set_disk_uuid(struct bootable_gpt *gpt,
-                              const struct bootable_uuid *disk_uuid) {
+	int err = bootable_stream_read_at(stream, lba * 512, header_buf, sizeof(header_buf));
+	if (err != 0)
+		return err;
 
-	bootable_memcpy(gpt->primary_header.disk_uuid.bytes,
-	              disk_uuid->bytes,
-	              sizeof(disk_uuid->bytes));
+	decode_header(&copy->header, header_buf);
 
-	bootable_memcpy(gpt->backup_header.disk_uuid.bytes,
-	              disk_uuid->bytes,
-	              sizeof(disk_uuid->bytes));
-}
+	if (!header_is_sane(&copy->header))
+		return BOOTABLE_EINVAL;
 
-int bootable_gpt_format(struct bootable_gpt *gpt,
-                      bootable_uint64 disk_size) {
+	bootable_uint64 entries_size = ((bootable_uint64) copy->header.partition_entry_count) * GPT_ENTRY_SIZE;
 
-	/* Initialize primary */
-
-	gpt->primary_header.current_lba = 1;
-	gpt->primary_header.backup_lba = (disk_size - 512) / 512;
-	gpt->primary_header.first_usable_lba = (1 + 1) * 512; /* mbr + gpt header */
-	gpt->primary_header.first_usable_lba += GPT_ENTRY_COUNT * GPT_ENTRY_SIZE;
-	gpt->primary_header.first_usable_lba /= 512;
-	gpt->primary_header.last_usable_lba = (gpt->primary_header.backup_lba * 512);
-	gpt->primary_header.last_usable_lba -= (GPT_ENTRY_COUNT * GPT_ENTRY_SIZE);
-	gpt->primary_header.last_usable_lba -= 512;
-	gpt->primary_header.last_usable_lba /= 512;
-	gpt->primary_header.partition_entries_lba = 2;
-	gpt->primary_header.partition_entry_count = GPT_ENTRY_COUNT;
-
-	/* Initialize backup header */
-
-	gpt->backup_header.first_usable_lba = gpt->primary_header.first_usable_lba;
-	gpt->backup_header.last_usable_lba = gpt->primary_header.last_usable_lba;
-	gpt->backup_header.partition_entry_count = GPT_ENTRY_COUNT;
-	gpt->backup_header.current_lba = gpt->primary_header.backup_lba;
-	gpt->backup_header.backup_lba = gpt->primary_header.current_lba;
-	gpt->backup_header.partition_entries_lba = gpt->backup_header.current_lba * 512;
-	gpt->backup_header.partition_entries_lba -= GPT_ENTRY_COUNT * GPT_ENTRY_SIZE;
-	gpt->backup_header.partition_entries_lba /= 512;
-
-	/* Initialize primary entries */
-
-	struct bootable_gpt_entry *entries;
-
-	entries = bootable_realloc(gpt->primary_entries, BOOTABLE_GPT_ENTRY_COUNT * sizeof(struct bootable_gpt_entry));
-	if (entries == NULL) {
+	unsigned char *entries_buf = bootable_realloc(copy->entries_buf, entries_size);
+	if (entries_buf == NULL)
 		return BOOTABLE_ENOMEM;
-	}
 
-	for (bootable_uint32 i = 0; i < BOOTABLE_GPT_ENTRY_COUNT; i++)
-		bootable_gpt_entry_init(&entries[i]);
+	copy->entries_buf = entries_buf;
+
+	err = bootable_stream_read_at(stream, copy->header.partition_entries_lba * 512, entries_buf, entries_size);
+	if (err != 0)
+		return err;
 
-	gpt->primary_entries = entries;
+	if ((bootable_memcmp(copy->header.signature, "EFI PART", 8) != 0)
+	 || (copy->header.current_lba != lba)
+	 || (copy->header.header_size < GPT_HEADER_SIZE)
+	 || (copy->header.header_size > sizeof(header_buf)))
+		return 0;
 
-	/* Initialize backup entries */
+	/* The header checksum is calculated
+	 * with the checksum field set to zero. */
+	put_uint32(&header_buf[16], 0);
 
-	entries = bootable_realloc(gpt->backup_entries, BOOTABLE_GPT_ENTRY_COUNT * sizeof(struct bootable_gpt_entry));
-	if (entries == NULL) {
-		return BOOTABLE_ENOMEM;
-	}
+	if (bootable_crc32(header_buf, copy->header.header_size) != copy->header.checksum)
+		return 0;
 
-	for (bootable_uint32 i = 0; i < BOOTABLE_GPT_ENTRY_COUNT; i++)
-		bootable_gpt_entry_init(&entries[i]);
+	if (bootable_crc32(entries_buf, entries_size) != copy->header.partition_entries_checksum)
+		return 0;
 
-	gpt->backup_entries = entries;
+	copy->valid = bootable_true;
 
 	return 0;
 }
 
-int bootable_gpt_import(struct bootable_gpt *gpt,
-                      struct bootable_stream *stream) {
-
-	/* TODO : verify checksums */
+/** Replaces the table with a header and an
+ * encoded entry array. The entry array is taken
+ * from the table copy.
+ * */
 
-	/* Read the primary header */
+static int load_table(struct bootable_gpt *gpt,
+                      const struct bootable_gpt_header *header,
+                      struct table_copy *copy) {
 
-	int err = bootable_stream_set_pos(stream, 512);
+	int err = setup_entries(gpt, header->partition_entry_count);
 	if (err != 0)
 		return err;
 
-	err = bootable_gpt_header_import(&gpt->primary_header, stream);
-	if (err != 0)
-		return err;
+	bootable_memcpy(&gpt->header, header, sizeof(gpt->header));
 
-	/* Read the primary entries */
+	/* Entries are decoded when they are
+	 * first accessed. See @ref load_all. */
 
-	struct bootable_gpt_entry *entries;
+	gpt->raw_entries = copy->entries_buf;
 
-	entries = bootable_realloc(gpt->primary_entries, 128 * sizeof(struct bootable_gpt_entry));
-	if (entries == NULL)
-		return BOOTABLE_ENOMEM;
+	copy->entries_buf = NULL;
 
-	gpt->primary_entries = entries;
+	return 0;
+}
 
-	err = bootable_stream_set_pos(stream, 1024);
-	if (err != 0)
+/** Checks whether or not the backup table
+ * is exactly what would be exported along
+ * with a primary table.
+ * */
+
+static bootable_bool backup_matches(const struct table_copy *primary,
+                                    const struct table_copy *backup) {
+
+	struct bootable_gpt_header expected;
+
+	make_backup_header(&primary->header, &expected);
+
+	if ((backup->header.current_lba != expected.current_lba)
+	 || (backup->header.backup_lba != expected.backup_lba)
+	 || (backup->header.first_usable_lba != expected.first_usable_lba)
+	 || (backup->header.last_usable_lba != expected.last_usable_lba)
+	 || (backup->header.partition_entries_lba != expected.partition_entries_lba)
+	 || (backup->header.partition_entry_count != expected.partition_entry_count)
+	 || (backup->header.partition_entries_checksum != expected.partition_entries_checksum)
+	 || (bootable_memcmp(backup->header.disk_uuid.bytes, expected.disk_uuid.bytes, 16) != 0))
+		return bootable_false;
+
+	bootable_uint64 entries_size = ((bootable_uint64) expected.partition_entry_count) * GPT_ENTRY_SIZE;
+
+	return bootable_memcmp(primary->entries_buf, backup->entries_buf, entries_size) == 0;
+}
+
+/** Reads the partition table. The backup table is
+ * read if the primary table is damaged, or if @p
+ * check_backup is set. Neither entry array is decoded.
+ * */
+
+static int import_table(struct bootable_gpt *gpt,
+                        struct bootable_stream *stream,
+                        bootable_bool check_backup,
+                        bootable_bool *repair_needed) {
+
+	struct table_copy primary;
+	struct table_copy backup;
+
+	table_copy_init(&primary);
+	table_copy_init(&backup);
+
+	int err = read_table(&primary, stream, 1);
+	if ((err != 0) && (err != BOOTABLE_EINVAL) && (err != BOOTABLE_EIO)) {
+		table_copy_done(&primary);
 		return err;
+	}
+
+	/* If the primary header can't be trusted, the
+	 * backup header is expected in the last sector. */
 
-	for (bootable_uint32 i = 0; i < BOOTABLE_GPT_ENTRY_COUNT; i++) {
+	bootable_uint64 backup_lba = 0;
 
-		bootable_gpt_entry_init(&entries[i]);
+	if (primary.valid) {
+		if (check_backup)
+			backup_lba = primary.header.backup_lba;
+	} else {
+		bootable_uint64 disk_size = 0;
+		err = bootable_stream_get_size(stream, &disk_size);
+		if ((err == 0) && (disk_size >= 1024))
+			backup_lba = (disk_size / 512) - 1;
+	}
 
-		err = bootable_gpt_entry_import(&entries[i], stream);
-		if (err != 0)
+	if (backup_lba > 1) {
+		err = read_table(&backup, stream, backup_lba);
+		if ((err != 0) && (err != BOOTABLE_EINVAL) && (err != BOOTABLE_EIO)) {
+			table_copy_done(&primary);
+			table_copy_done(&backup);
 			return err;
+		}
 	}
 
-	/* Read the backup header */
+	if (primary.valid) {
 
-	err = bootable_stream_set_pos(stream, gpt->primary_header.backup_lba * 512);
-	if (err != 0)
-		return err;
+		if (check_backup)
+			*repair_needed = !backup.valid || !backup_matches(&primary, &backup);
+		else
+			*repair_needed = bootable_false;
 
-	err = bootable_gpt_header_import(&gpt->backup_header, stream);
-	if (err != 0)
-		return err;
+		err = load_table(gpt, &primary.header, &primary);
 
-	/* Read the backup partition entries. */
+	} else if (backup.valid) {
 
-	err = bootable_stream_set_pos(stream, gpt->backup_header.partition_entries_lba * 512);
-	if (err != 0)
-		return err;
+		/* Rebuild the primary header from the backup. */
 
-	entries = bootable_realloc(gpt->backup_entries, 128 * sizeof(struct bootable_gpt_entry));
-	if (entries == NULL)
-		return BOOTABLE_ENOMEM;
+		struct bootable_gpt_header header;
 
-	gpt->backup_entries = entries;
+		bootable_memcpy(&header, &backup.header, sizeof(header));
 
-	for (bootable_uint32 i = 0; i < BOOTABLE_GPT_ENTRY_COUNT; i++) {
+		header.current_lba = 1;
+		header.backup_lba = backup.header.current_lba;
+		header.partition_entries_lba = 2;
 
-		bootable_gpt_entry_init(&entries[i]);
+		*repair_needed = bootable_true;
 
-		err = bootable_gpt_entry_import(&entries[i], stream);
-		if (err != 0)
-			return err;
+		if (!header_is_sane(&header))
+			err = BOOTABLE_EINVAL;
+		else
+			err = load_table(gpt, &header, &backup);
+
+	} else {
+		err = BOOTABLE_EINVAL;
 	}
 
-	return 0;
+	table_copy_done(&primary);
+	table_copy_done(&backup);
+
+	return err;
+}
+
+int bootable_gpt_import(struct bootable_gpt *gpt,
+                      struct bootable_stream *stream) {
+
+	bootable_bool repair_needed = bootable_false;
+
+	return import_table(gpt, stream, bootable_false, &repair_needed);
+}
+
+int bootable_gpt_import_verified(struct bootable_gpt *gpt,
+                                 struct bootable_stream *stream,
+                                 bootable_bool *repair_needed) {
+
+	return import_table(gpt, stream, bootable_true, repair_needed);
 }
 
 int bootable_gpt_export(const struct bootable_gpt *gpt,
                       struct bootable_stream *stream) {
 
-	int err = bootable_stream_set_pos(stream, 512);
-	if (err != 0)
-		return err;
+	bootable_uint32 entry_count = gpt->entry_count;
 
-	err = bootable_gpt_header_export(&gpt->primary_header, stream);
-	if (err != 0)
-		return err;
+	if (gpt->header.partition_entry_count != entry_count)
+		return BOOTABLE_EINVAL;
 
-	for (bootable_uint32 i = 0; i < gpt->primary_header.partition_entry_count; i++) {
-		err = bootable_gpt_entry_export(&gpt->primary_entries[i], stream);
-		if (err != 0)
-			return err;
-	}
+	bootable_uint64 entries_size = ((bootable_uint64) entry_count) * GPT_ENTRY_SIZE;
 
-	err = bootable_stream_set_pos(stream, gpt->backup_header.partition_entries_lba * 512);
-	if (err != 0)
-		return err;
+	/* If nothing was changed since the import,
+	 * the imported entry array is current. */
 
-	for (bootable_uint32 i = 0; i < gpt->backup_header.partition_entry_count; i++) {
-		err = bootable_gpt_entry_export(&gpt->backup_entries[i], stream);
-		if (err != 0)
-			return err;
+	const unsigned char *entries_buf = gpt->raw_entries;
+
+	unsigned char *encoded_buf = NULL;
+
+	if (entries_buf == NULL) {
+
+		encoded_buf = bootable_malloc(entries_size);
+		if (encoded_buf == NULL)
+			return BOOTABLE_ENOMEM;
+
+		for (bootable_uint32 i = 0; i < entry_count; i++)
+			encode_entry(&gpt->entries[i], &encoded_buf[i * GPT_ENTRY_SIZE]);
+
+		entries_buf = encoded_buf;
 	}
 
-	err = bootable_gpt_header_export(&gpt->backup_header, stream);
-	if (err != 0)
-		return err;
+	bootable_uint32 entries_checksum = bootable_crc32(entries_buf, entries_size);
 
-	err = calculate_checksums(stream);
-	if (err != 0)
+	int err = export_table(&gpt->header, entries_buf, entries_checksum, stream);
+	if (err != 0) {
+		bootable_free(encoded_buf);
 		return err;
+	}
 
-	return 0;
+	struct bootable_gpt_header backup_header;
+
+	make_backup_header(&gpt->header, &backup_header);
+
+	err = export_table(&backup_header, entries_buf, entries_checksum, stream);
+
+	bootable_free(encoded_buf);
+
+	return err;
 }
 
-const struct bootable_gpt_entry *bootable_gpt_get_entry(const struct bootable_gpt *gpt,
+const struct bootable_gpt_entry *bootable_gpt_get_entry(struct bootable_gpt *gpt,
                                                     bootable_uint32 entry_index) {
 
-	if (entry_index >= gpt->primary_header.partition_entry_count)
+	if ((gpt->entries == NULL)
+	 || (entry_index >= gpt->entry_count))
 		return NULL;
-	else
-		return &gpt->primary_entries[entry_index];
+
+	decode_pending(gpt, entry_index);
+
+	return &gpt->entries[entry_index];
 }
 
-int bootable_gpt_get_partition_offset(const struct bootable_gpt *gpt,
+int bootable_gpt_get_partition_offset(struct bootable_gpt *gpt,
                                     bootable_uint32 entry_index,
                                     bootable_uint64 *offset) {
 
-	if ((entry_index > gpt->primary_header.partition_entry_count)
-	 || (entry_index > gpt->backup_header.partition_entry_count))
+	const struct bootable_gpt_entry *entry = bootable_gpt_get_entry(gpt, entry_index);
+	if (entry == NULL)
 		return BOOTABLE_EINVAL;
 
-	*offset = bootable_gpt_entry_get_offset(&gpt->primary_entries[entry_index]);
+	*offset = bootable_gpt_entry_get_offset(entry);
 
 	return 0;
 }
 
-int bootable_gpt_get_partition_size(const struct bootable_gpt *gpt,
+int bootable_gpt_get_partition_size(struct bootable_gpt *gpt,
                                   bootable_uint32 entry_index,
                                   bootable_uint64 *size) {
 
-	if ((entry_index > gpt->primary_header.partition_entry_count)
-	 || (entry_index > gpt->backup_header.partition_entry_count))
+	const struct bootable_gpt_entry *entry = bootable_gpt_get_entry(gpt, entry_index);
+	if (entry == NULL)
 		return BOOTABLE_EINVAL;
 
-	*size = bootable_gpt_entry_get_size(&gpt->primary_entries[entry_index]);
+	*size = bootable_gpt_entry_get_size(entry);
 
 	return 0;
 }
@@ -750,20 +1358,24 @@ int bootable_gpt_set_entry_name(struct bootable_gpt *gpt,
                               bootable_uint32 entry_index,
                               const bootable_uint16 *name) {
 
-	if ((entry_index > gpt->primary_header.partition_entry_count)
-	 || (entry_index > gpt->backup_header.partition_entry_count))
-		return BOOTABLE_EINVAL;
+	int err = prepare_entry(gpt, entry_index);
+	if (err != 0)
+		return err;
+
+	claim_slot(gpt, entry_index);
+
+	index_remove(&gpt->name_index, entry_index);
 
 	bootable_uint64 i = 0;
 
 	while ((name[i] != 0) && (i < 35)) {
-		gpt->primary_entries[entry_index].name[i] = name[i];
-		gpt->backup_entries[entry_index].name[i] = name[i];
+		gpt->entries[entry_index].name[i] = name[i];
 		i++;
 	}
 
-	gpt->primary_entries[entry_index].name[i] = 0;
-	gpt->backup_entries[entry_index].name[i] = 0;
+	gpt->entries[entry_index].name[i] = 0;
+
+	index_insert(&gpt->name_index, entry_index, hash_name(gpt->entries[entry_index].name));
 
 	return 0;
 }
@@ -772,42 +1384,36 @@ int bootable_gpt_set_entry_name_utf8(struct bootable_gpt *gpt,
                                    bootable_uint32 entry_index,
                                    const char *name) {
 
-	if ((entry_index > gpt->primary_header.partition_entry_count)
-	 || (entry_index > gpt->backup_header.partition_entry_count))
-		return BOOTABLE_EINVAL;
-
-	bootable_uint64 i = 0;
-
-	while ((name[i] != 0) && (i < 35)) {
-		/* TODO : properly convert to UTF-16 */
-		gpt->primary_entries[entry_index].name[i] = name[i];
-		gpt->backup_entries[entry_index].name[i] = name[i];
-		i++;
-	}
+	bootable_uint16 name16[36];
 
-	gpt->primary_entries[entry_index].name[i] = 0;
-	gpt->backup_entries[entry_index].name[i] = 0;
+	int err = utf8_to_name(name, name16);
+	if (err != 0)
+		return err;
 
-	return 0;
+	return bootable_gpt_set_entry_name(gpt, entry_index, name16);
 }
 
 int bootable_gpt_set_entry_type(struct bootable_gpt *gpt,
                               bootable_uint32 entry_index,
                               const char *type_uuid_str) {
 
-	if ((entry_index > gpt->primary_header.partition_entry_count)
-	 || (entry_index > gpt->backup_header.partition_entry_count))
-		return BOOTABLE_EINVAL;
+	int err = prepare_entry(gpt, entry_index);
+	if (err != 0)
+		return err;
 
 	struct bootable_uuid type_uuid;
 
-	int err = bootable_uuid_parse(&type_uuid, type_uuid_str);
+	err = bootable_uuid_parse(&type_uuid, type_uuid_str);
 	if (err != 0)
 		return err;
 
-	bootable_uuid_copy(&gpt->primary_entries[entry_index].type_uuid, &type_uuid);
+	claim_slot(gpt, entry_index);
+
+	index_remove(&gpt->type_index, entry_index);
+
+	bootable_uuid_copy(&gpt->entries[entry_index].type_uuid, &type_uuid);
 
-	bootable_uuid_copy(&gpt->backup_entries[entry_index].type_uuid, &type_uuid);
+	index_insert(&gpt->type_index, entry_index, hash_type(&type_uuid));
 
 	return 0;
 }
@@ -816,42 +1422,102 @@ int bootable_gpt_set_entry_size(struct bootable_gpt *gpt,
                               bootable_uint32 entry_index,
                               bootable_uint64 size) {
 
-	if ((entry_index > gpt->primary_header.partition_entry_count)
-	 || (entry_index > gpt->backup_header.partition_entry_count))
-		return BOOTABLE_EINVAL;
+	int err = prepare_entry(gpt, entry_index);
+	if (err != 0)
+		return err;
 
-	/* TODO : sort entries here */
+	err = free_entry_space(gpt, entry_index);
+	if (err != 0)
+		return err;
 
-	bootable_uint64 first_lba = gpt->primary_header.first_usable_lba;
+	bootable_uint64 lba_count = size_to_lba_count(size);
 
-	bootable_uint64 lba_count = (size + 511) / 512;
-	if (lba_count == 0)
-		lba_count = 1;
+	bootable_uint64 first_lba = 0;
 
-	bootable_uint64 last_lba = first_lba + lba_count - 1;
+	err = bootable_extent_map_allocate(&gpt->free_extents,
+	                                   lba_count,
+	                                   gpt->alignment / 512,
+	                                   gpt->placement,
+	                                   &first_lba);
+	if (err == BOOTABLE_ENOSPC) {
+		/* Small disks may not have room
+		 * for aligned partitions. */
+		err = bootable_extent_map_allocate(&gpt->free_extents,
+		                                   lba_count,
+		                                   1,
+		                                   gpt->placement,
+		                                   &first_lba);
+	}
 
-	for (bootable_uint64 i = 0; i < gpt->primary_header.partition_entry_count; i++) {
+	if (err != 0) {
+		restore_entry_space(gpt, entry_index);
+		return err;
+	}
 
-		struct bootable_gpt_entry *entry = &gpt->primary_entries[i];
+	set_entry_lba(gpt, entry_index, first_lba, first_lba + lba_count - 1);
 
-		if (!bootable_gpt_entry_is_used(entry))
-			continue;
+	return 0;
+}
 
-		if ((first_lba >= entry->first_lba)
-		 || (last_lba >= entry->first_lba)) {
-			first_lba = entry->last_lba + 1;
-			last_lba = first_lba + lba_count - 1;
-		}
+int bootable_gpt_set_entry_offset(struct bootable_gpt *gpt,
+                                  bootable_uint32 entry_index,
+                                  bootable_uint64 offset,
+                                  bootable_uint64 size) {
+
+	int err = prepare_entry(gpt, entry_index);
+	if (err != 0)
+		return err;
+	else if ((offset % 512) != 0)
+		return BOOTABLE_EINVAL;
+
+	err = free_entry_space(gpt, entry_index);
+	if (err != 0)
+		return err;
+
+	bootable_uint64 first_lba = offset / 512;
+	bootable_uint64 lba_count = size_to_lba_count(size);
+
+	err = bootable_extent_map_reserve(&gpt->free_extents, first_lba, lba_count);
+	if (err != 0) {
+		restore_entry_space(gpt, entry_index);
+		return err;
 	}
 
-	if (last_lba > gpt->primary_header.last_usable_lba)
-		return BOOTABLE_ENOSPC;
+	set_entry_lba(gpt, entry_index, first_lba, first_lba + lba_count - 1);
+
+	return 0;
+}
 
-	gpt->primary_entries[entry_index].first_lba = first_lba;
-	gpt->primary_entries[entry_index].last_lba = last_lba;
+int bootable_gpt_remove_entry(struct bootable_gpt *gpt,
+                              bootable_uint32 entry_index) {
 
-	gpt->backup_entries[entry_index].first_lba = first_lba;
-	gpt->backup_entries[entry_index].last_lba = last_lba;
+	int err = prepare_entry(gpt, entry_index);
+	if (err != 0)
+		return err;
+
+	err = free_entry_space(gpt, entry_index);
+	if (err != 0)
+		return err;
+
+	release_slot(gpt, entry_index);
+
+	bootable_gpt_entry_init(&gpt->entries[entry_index]);
+
+	return 0;
+}
+
+int bootable_gpt_set_alignment(struct bootable_gpt *gpt,
+                               bootable_uint64 alignment) {
+
+	if ((alignment == 0) || ((alignment % 512) != 0))
+		return BOOTABLE_EINVAL;
+
+	gpt->alignment = alignment;
 
 	return 0;
 }
+
+void bootable_gpt_set_placement(struct bootable_gpt *gpt,
+                                enum bootable_placement placement) {
+	gpt->placement = placement;
+}
@@ -0,0 +1,140 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bootable/core/lz4.h>
+#include <bootable/core/error.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned char src[BOOTABLE_LZ4_MAX_INPUT];
+
+static unsigned char packed[BOOTABLE_LZ4_MAX_INPUT * 2];
+
+static unsigned char unpacked[BOOTABLE_LZ4_MAX_INPUT];
+
+static struct bootable_lz4 lz4;
+
+static bootable_uint64 round_trip(bootable_uint64 size) {
+
+	bootable_uint64 packed_size = 0;
+	bootable_uint64 unpacked_size = 0;
+
+	assert(bootable_lz4_compress(&lz4, src, size, packed, sizeof(packed), &packed_size) == 0);
+	assert(bootable_lz4_decompress(packed, packed_size, unpacked, sizeof(unpacked), &unpacked_size) == 0);
+	assert(unpacked_size == size);
+	assert(memcmp(src, unpacked, size) == 0);
+
+	return packed_size;
+}
+
+static void test_random(void) {
+
+	unsigned int seed = 1;
+
+	for (size_t i = 0; i < sizeof(src); i++) {
+		seed = (seed * 1103515245) + 12345;
+		src[i] = (unsigned char) (seed >> 16);
+	}
+
+	static const bootable_uint64 sizes[] = { 0, 1, 4, 12, 13, 17, 255, 256, 4096, BOOTABLE_LZ4_MAX_INPUT };
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		round_trip(sizes[i]);
+}
+
+static void test_repeated(void) {
+
+	memset(src, 0, sizeof(src));
+
+	assert(round_trip(sizeof(src)) < 512);
+
+	for (size_t i = 0; i < sizeof(src); i++)
+		src[i] = "The quick brown fox jumps over the lazy dog\n"[i % 44];
+
+	assert(round_trip(sizeof(src)) < 1024);
+
+	for (bootable_uint64 size = 1; size < 64; size++)
+		round_trip(size);
+}
+
+static void test_no_space(void) {
+
+	bootable_uint64 size = 0;
+
+	memset(src, 'a', 1000);
+
+	assert(bootable_lz4_compress(&lz4, src, 1000, packed, 4, &size) == BOOTABLE_ENOSPC);
+
+	assert(bootable_lz4_compress(&lz4, src, 1000, packed, sizeof(packed), &size) == 0);
+
+	assert(bootable_lz4_decompress(packed, size, unpacked, 999, &size) == BOOTABLE_ENOSPC);
+
+	assert(bootable_lz4_compress(&lz4, src, BOOTABLE_LZ4_MAX_INPUT + 1, packed, sizeof(packed), &size) == BOOTABLE_EINVAL);
+}
+
+static void test_malformed(void) {
+
+	bootable_uint64 size = 0;
+
+	/* empty input */
+	assert(bootable_lz4_decompress(packed, 0, unpacked, sizeof(unpacked), &size) == BOOTABLE_EINVAL);
+
+	/* literals past the end of the input */
+	packed[0] = 0x50;
+	packed[1] = 'a';
+	assert(bootable_lz4_decompress(packed, 2, unpacked, sizeof(unpacked), &size) == BOOTABLE_EINVAL);
+
+	/* a match before the start of the output */
+	packed[0] = 0x10;
+	packed[1] = 'a';
+	packed[2] = 0x02;
+	packed[3] = 0x00;
+	assert(bootable_lz4_decompress(packed, 4, unpacked, sizeof(unpacked), &size) == BOOTABLE_EINVAL);
+
+	/* a zero offset */
+	packed[2] = 0x00;
+	assert(bootable_lz4_decompress(packed, 4, unpacked, sizeof(unpacked), &size) == BOOTABLE_EINVAL);
+
+	/* a truncated offset */
+	assert(bootable_lz4_decompress(packed, 3, unpacked, sizeof(unpacked), &size) == BOOTABLE_EINVAL);
+
+	/* an unterminated length */
+	packed[0] = 0xf0;
+	packed[1] = 0xff;
+	assert(bootable_lz4_decompress(packed, 2, unpacked, sizeof(unpacked), &size) == BOOTABLE_EINVAL);
+
+	/* a valid overlapping match */
+	packed[0] = 0x10;
+	packed[1] = 'a';
+	packed[2] = 0x01;
+	packed[3] = 0x00;
+	packed[4] = 0x00;
+	assert(bootable_lz4_decompress(packed, 5, unpacked, sizeof(unpacked), &size) == 0);
+	assert(size == 5);
+	assert(memcmp(unpacked, "aaaaa", 5) == 0);
+}
+
+int main(void) {
+	test_random();
+	test_repeated();
+	test_no_space();
+	test_malformed();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,290 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bootable/core/lz4.h>
+#include <bootable/core/error.h>
+
+/** The smallest match that is encoded. */
+
+#define MIN_MATCH 4
+
+/** The number of bytes at the end of a
+ * block that are always literals. */
+
+#define LAST_LITERALS 5
+
+/** No match may start in this many
+ * bytes at the end of a block. */
+
+#define MATCH_LIMIT 12
+
+/** The largest distance of a match. */
+
+#define MAX_OFFSET 0xffff
+
+static bootable_uint32 read32(const unsigned char *p) {
+	return ((bootable_uint32) p[0])
+	     | (((bootable_uint32) p[1]) << 8)
+	     | (((bootable_uint32) p[2]) << 16)
+	     | (((bootable_uint32) p[3]) << 24);
+}
+
+static bootable_uint32 hash32(bootable_uint32 sequence) {
+	return (sequence * 2654435761U) >> 20;
+}
+
+/** Writes a length that did not fit in a token,
+ * as a series of bytes that are added together. */
+
+static int put_length(unsigned char *dst,
+                      bootable_uint64 dst_capacity,
+                      bootable_uint64 *op,
+                      bootable_uint64 length) {
+
+	while (length >= 255) {
+		if (*op >= dst_capacity)
+			return BOOTABLE_ENOSPC;
+		dst[(*op)++] = 255;
+		length -= 255;
+	}
+
+	if (*op >= dst_capacity)
+		return BOOTABLE_ENOSPC;
+
+	dst[(*op)++] = (unsigned char) length;
+
+	return 0;
+}
+
+/** Writes the literals in front of a match, and
+ * the match. If @p match_length is zero, this is
+ * the last sequence and only has literals. */
+
+static int put_sequence(unsigned char *dst,
+                        bootable_uint64 dst_capacity,
+                        bootable_uint64 *op,
+                        const unsigned char *literals,
+                        bootable_uint64 literal_count,
+                        bootable_uint64 offset,
+                        bootable_uint64 match_length) {
+
+	int err;
+	bootable_uint64 token_match;
+	unsigned char *token;
+
+	if (*op >= dst_capacity)
+		return BOOTABLE_ENOSPC;
+
+	token = &dst[(*op)++];
+
+	token_match = (match_length > 0) ? (match_length - MIN_MATCH) : 0;
+
+	*token = (unsigned char) ((((literal_count < 15) ? literal_count : 15) << 4)
+	                        | ((token_match < 15) ? token_match : 15));
+
+	if (literal_count >= 15) {
+		err = put_length(dst, dst_capacity, op, literal_count - 15);
+		if (err != 0)
+			return err;
+	}
+
+	if (literal_count > (dst_capacity - *op))
+		return BOOTABLE_ENOSPC;
+
+	for (bootable_uint64 i = 0; i < literal_count; i++)
+		dst[(*op)++] = literals[i];
+
+	if (match_length == 0)
+		return 0;
+
+	if ((dst_capacity - *op) < 2)
+		return BOOTABLE_ENOSPC;
+
+	dst[(*op)++] = (unsigned char) (offset & 0xff);
+	dst[(*op)++] = (unsigned char) (offset >> 8);
+
+	if (token_match >= 15)
+		return put_length(dst, dst_capacity, op, token_match - 15);
+
+	return 0;
+}
+
+int bootable_lz4_compress(struct bootable_lz4 *lz4,
+                          const void *src,
+                          bootable_uint64 src_size,
+                          void *dst,
+                          bootable_uint64 dst_capacity,
+                          bootable_uint64 *dst_size) {
+
+	int err;
+	const unsigned char *in = (const unsigned char *) src;
+	unsigned char *out = (unsigned char *) dst;
+	bootable_uint64 ip;
+	bootable_uint64 anchor;
+	bootable_uint64 op;
+	bootable_uint64 candidate;
+	bootable_uint64 length;
+	bootable_uint32 sequence;
+	bootable_uint32 h;
+
+	if (src_size > BOOTABLE_LZ4_MAX_INPUT)
+		return BOOTABLE_EINVAL;
+
+	ip = 0;
+	anchor = 0;
+	op = 0;
+
+	if (src_size > MATCH_LIMIT) {
+
+		/* Stale entries are harmless, since a candidate
+		 * is only used if its bytes actually match. */
+		for (unsigned int i = 0; i < BOOTABLE_LZ4_TABLE_SIZE; i++)
+			lz4->table[i] = 0;
+
+		while (ip < (src_size - MATCH_LIMIT)) {
+
+			sequence = read32(&in[ip]);
+			h = hash32(sequence);
+			candidate = lz4->table[h];
+			lz4->table[h] = (bootable_uint16) ip;
+
+			if ((candidate >= ip)
+			 || ((ip - candidate) > MAX_OFFSET)
+			 || (read32(&in[candidate]) != sequence)) {
+				ip++;
+				continue;
+			}
+
+			length = MIN_MATCH;
+
+			while (((ip + length) < (src_size - LAST_LITERALS))
+			    && (in[candidate + length] == in[ip + length]))
+				length++;
+
+			err = put_sequence(out, dst_capacity, &op, &in[anchor], ip - anchor, ip - candidate, length);
+			if (err != 0)
+				return err;
+
+			ip += length;
+			anchor = ip;
+		}
+	}
+
+	err = put_sequence(out, dst_capacity, &op, &in[anchor], src_size - anchor, 0, 0);
+	if (err != 0)
+		return err;
+
+	*dst_size = op;
+
+	return 0;
+}
+
+/** Reads a length that did not fit in a token. */
+
+static int get_length(const unsigned char *src,
+                      bootable_uint64 src_size,
+                      bootable_uint64 *ip,
+                      bootable_uint64 *length) {
+
+	unsigned char byte;
+
+	do {
+		if (*ip >= src_size)
+			return BOOTABLE_EINVAL;
+		byte = src[(*ip)++];
+		*length += byte;
+	} while (byte == 255);
+
+	return 0;
+}
+
+int bootable_lz4_decompress(const void *src,
+                            bootable_uint64 src_size,
+                            void *dst,
+                            bootable_uint64 dst_capacity,
+                            bootable_uint64 *dst_size) {
+
+	int err;
+	const unsigned char *in = (const unsigned char *) src;
+	unsigned char *out = (unsigned char *) dst;
+	bootable_uint64 ip;
+	bootable_uint64 op;
+	bootable_uint64 length;
+	bootable_uint64 offset;
+	unsigned char token;
+
+	ip = 0;
+	op = 0;
+
+	for (;;) {
+
+		if (ip >= src_size)
+			return BOOTABLE_EINVAL;
+
+		token = in[ip++];
+
+		length = token >> 4;
+		if (length == 15) {
+			err = get_length(in, src_size, &ip, &length);
+			if (err != 0)
+				return err;
+		}
+
+		if (length > (src_size - ip))
+			return BOOTABLE_EINVAL;
+		else if (length > (dst_capacity - op))
+			return BOOTABLE_ENOSPC;
+
+		for (bootable_uint64 i = 0; i < length; i++)
+			out[op++] = in[ip++];
+
+		/* The last sequence has no match. */
+		if (ip == src_size)
+			break;
+
+		if ((src_size - ip) < 2)
+			return BOOTABLE_EINVAL;
+
+		offset = ((bootable_uint64) in[ip]) | (((bootable_uint64) in[ip + 1]) << 8);
+		ip += 2;
+
+		if ((offset == 0) || (offset > op))
+			return BOOTABLE_EINVAL;
+
+		length = token & 0x0f;
+		if (length == 15) {
+			err = get_length(in, src_size, &ip, &length);
+			if (err != 0)
+				return err;
+		}
+
+		length += MIN_MATCH;
+
+		if (length > (dst_capacity - op))
+			return BOOTABLE_ENOSPC;
+
+		/* The match may overlap the bytes it produces,
+		 * so it is copied one byte at a time. */
+		for (bootable_uint64 i = 0; i < length; i++, op++)
+			out[op] = out[op - offset];
+	}
+
+	*dst_size = op;
+
+	return 0;
+}
@@ -22,7 +22,24 @@
 #include <bootable/core/string.h>
 #include <bootable/core/stream.h>
 
-#include "misc.h"
+#include "schema.h"
+
+#define MBR_FIELDS(X, T, N) \
+	X(T, code,           0x000, BOOTABLE_SCHEMA_BYTES, 476) \
+	N(T, st2dap,         0x1dc, bootable_dap_schema) \
+	N(T, st3dap,         0x1ec, bootable_dap_schema) \
+	X(T, boot_signature, 0x1fc, BOOTABLE_SCHEMA_UINT16, 2)
+
+static const struct bootable_schema_field mbr_fields[] = {
+	MBR_FIELDS(BOOTABLE_SCHEMA_FIELD, struct bootable_mbr, BOOTABLE_SCHEMA_NESTED_FIELD)
+};
+
+MBR_FIELDS(BOOTABLE_SCHEMA_CHECK_FIELD, struct bootable_mbr, BOOTABLE_SCHEMA_CHECK_NESTED_FIELD)
+
+/* The MBR nests disk address packets,
+ * so it is encoded field by field. */
+
+static const struct bootable_schema mbr_schema = BOOTABLE_SCHEMA_INIT(struct bootable_mbr, mbr_fields, 0x1fe, bootable_false);
 
 void bootable_mbr_zero(struct bootable_mbr *mbr) {
 	bootable_memset(mbr, 0, sizeof(*mbr));
@@ -38,54 +55,18 @@ int bootable_mbr_check(const struct bootable_mbr *mbr) {
 
 int bootable_mbr_read(struct bootable_mbr *mbr, struct bootable_stream *stream) {
 
-	int err;
-
-	err = bootable_stream_set_pos(stream, 0x00);
-	if (err != 0)
-		return err;
-
-	err = bootable_stream_read(stream, mbr->code, sizeof(mbr->code));
+	int err = bootable_stream_set_pos(stream, 0x00);
 	if (err != 0)
 		return err;
 
-	err = bootable_dap_read(&mbr->st2dap, stream);
-	if (err != 0)
-		return err;
-
-	err = bootable_dap_read(&mbr->st3dap, stream);
-	if (err != 0)
-		return err;
-
-	err = decode_uint16(&mbr->boot_signature, stream);
-	if (err != 0)
-		return err;
-
-	return 0;
+	return bootable_schema_read(&mbr_schema, mbr, stream);
 }
 
 int bootable_mbr_write(const struct bootable_mbr *mbr, struct bootable_stream *stream) {
 
-	int err;
-
-	err = bootable_stream_set_pos(stream, 0x00);
-	if (err != 0)
-		return err;
-
-	err = bootable_stream_write(stream, mbr->code, sizeof(mbr->code));
-	if (err != 0)
-		return err;
-
-	err = bootable_dap_write(&mbr->st2dap, stream);
-	if (err != 0)
-		return err;
-
-	err = bootable_dap_write(&mbr->st3dap, stream);
+	int err = bootable_stream_set_pos(stream, 0x00);
 	if (err != 0)
 		return err;
 
-	err = encode_uint16(mbr->boot_signature, stream);
-	if (err != 0)
-		return err;
-
-	return 0;
+	return bootable_schema_write(&mbr_schema, mbr, stream);
 }
@@ -0,0 +1,163 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bootable/core/memstream.h>
+#include <bootable/core/error.h>
+#include <bootable/core/memory.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void test_growth(void) {
+
+	struct bootable_memstream memstream;
+	unsigned char buf[100];
+	bootable_uint64 size = 0;
+
+	bootable_memstream_init(&memstream);
+
+	/* Enough small writes to grow the
+	 * block past its first reservation. */
+	for (unsigned int i = 0; i < 100; i++) {
+		memset(buf, (int) i, sizeof(buf));
+		assert(bootable_stream_write(&memstream.stream, buf, sizeof(buf)) == 0);
+	}
+
+	assert(memstream.size == 10000);
+	assert(memstream.reserved >= memstream.size);
+	assert(bootable_stream_get_size(&memstream.stream, &size) == 0);
+	assert(size == 10000);
+
+	for (unsigned int i = 0; i < 100; i++) {
+		assert(memstream.data[i * 100] == i);
+		assert(memstream.data[(i * 100) + 99] == i);
+	}
+
+	/* Resizing down and up again zeroes the new bytes. */
+	assert(bootable_memstream_resize(&memstream, 50) == 0);
+	assert(bootable_memstream_resize(&memstream, 150) == 0);
+	assert(memstream.data[49] == 0);
+	assert(memstream.data[50] == 0);
+	assert(memstream.data[149] == 0);
+
+	bootable_memstream_done(&memstream);
+}
+
+static void test_set_pos(void) {
+
+	struct bootable_memstream memstream;
+	unsigned char buf[4];
+	bootable_uint64 pos = 0;
+
+	bootable_memstream_init(&memstream);
+
+	memset(buf, 0xff, sizeof(buf));
+	assert(bootable_stream_write(&memstream.stream, buf, sizeof(buf)) == 0);
+
+	assert(bootable_stream_set_pos(&memstream.stream, 100) == 0);
+	assert(bootable_stream_get_pos(&memstream.stream, &pos) == 0);
+	assert(pos == 100);
+
+	/* Nothing can be read past the end. */
+	assert(bootable_stream_read(&memstream.stream, buf, 1) == BOOTABLE_EINVAL);
+	assert(memstream.size == 4);
+
+	/* Writing past the end fills the gap with zeros. */
+	assert(bootable_stream_write(&memstream.stream, buf, sizeof(buf)) == 0);
+	assert(memstream.size == 104);
+	for (unsigned int i = 4; i < 100; i++)
+		assert(memstream.data[i] == 0);
+	assert(memstream.data[100] == 0xff);
+	assert(memstream.data[103] == 0xff);
+
+	assert(bootable_stream_get_pos(&memstream.stream, &pos) == 0);
+	assert(pos == 104);
+
+	bootable_memstream_done(&memstream);
+}
+
+static void test_read_write_at(void) {
+
+	struct bootable_memstream memstream;
+	unsigned char buf[8];
+	bootable_uint64 pos = 0;
+
+	bootable_memstream_init(&memstream);
+
+	assert(bootable_stream_write_at(&memstream.stream, 10, "abcdefgh", 8) == 0);
+	assert(memstream.size == 18);
+
+	assert(bootable_stream_write_at(&memstream.stream, 12, "XY", 2) == 0);
+	assert(memstream.size == 18);
+
+	assert(bootable_stream_read_at(&memstream.stream, 10, buf, 8) == 0);
+	assert(memcmp(buf, "abXYefgh", 8) == 0);
+
+	/* Reads may not go past the end. */
+	assert(bootable_stream_read_at(&memstream.stream, 12, buf, 8) == BOOTABLE_EINVAL);
+	assert(bootable_stream_read_at(&memstream.stream, 19, buf, 0) == BOOTABLE_EINVAL);
+	assert(bootable_stream_read_at(&memstream.stream, 18, buf, 0) == 0);
+
+	/* Writes may not wrap around. */
+	assert(bootable_stream_write_at(&memstream.stream, (bootable_uint64) -4, buf, 8) == BOOTABLE_EINVAL);
+
+	/* The position is not used or changed. */
+	assert(bootable_stream_get_pos(&memstream.stream, &pos) == 0);
+	assert(pos == 0);
+
+	bootable_memstream_done(&memstream);
+}
+
+static void test_wrap(void) {
+
+	struct bootable_memstream memstream;
+	unsigned char block[16];
+	unsigned char buf[4];
+	bootable_uint64 size = 0;
+
+	memset(block, 0, sizeof(block));
+
+	bootable_memstream_init(&memstream);
+	bootable_memstream_wrap(&memstream, block, sizeof(block));
+
+	assert(bootable_stream_write_at(&memstream.stream, 12, "wxyz", 4) == 0);
+	assert(memcmp(&block[12], "wxyz", 4) == 0);
+
+	/* A caller's buffer cannot grow. */
+	assert(bootable_stream_write_at(&memstream.stream, 14, "wxyz", 4) == BOOTABLE_ENOSPC);
+	assert(memcmp(&block[12], "wxyz", 4) == 0);
+
+	assert(bootable_stream_read_at(&memstream.stream, 12, buf, 4) == 0);
+	assert(memcmp(buf, "wxyz", 4) == 0);
+
+	assert(bootable_memstream_release(&memstream, &size) == block);
+	assert(size == sizeof(block));
+	assert(memstream.data == NULL);
+	assert(memstream.size == 0);
+
+	bootable_memstream_done(&memstream);
+}
+
+int main(void) {
+	test_growth();
+	test_set_pos();
+	test_read_write_at();
+	test_wrap();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,259 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bootable/core/memstream.h>
+
+#include <bootable/core/error.h>
+#include <bootable/core/memory.h>
+#include <bootable/core/string.h>
+
+#ifndef NULL
+#define NULL ((void *) 0x00)
+#endif
+
+/** The smallest block allocated by
+ * a stream that grows. */
+
+#ifndef BOOTABLE_MEMSTREAM_MIN_RESERVE
+#define BOOTABLE_MEMSTREAM_MIN_RESERVE 4096
+#endif
+
+static int grow(struct bootable_memstream *memstream,
+                bootable_uint64 size) {
+
+	if (size <= memstream->reserved)
+		return 0;
+
+	if (memstream->fixed)
+		return BOOTABLE_ENOSPC;
+
+	/* Double the reservation so that a
+	 * series of small writes allocates
+	 * a logarithmic number of times. */
+
+	bootable_uint64 reserved = memstream->reserved;
+	if (reserved < BOOTABLE_MEMSTREAM_MIN_RESERVE)
+		reserved = BOOTABLE_MEMSTREAM_MIN_RESERVE;
+
+	while (reserved < size) {
+		if (reserved > (((bootable_uint64) -1) / 2)) {
+			reserved = size;
+			break;
+		}
+		reserved *= 2;
+	}
+
+	return bootable_memstream_reserve(memstream, reserved);
+}
+
+static int memstream_read_at(void *memstream_ptr,
+                             bootable_uint64 pos,
+                             void *buf,
+                             bootable_uint64 buf_size) {
+
+	struct bootable_memstream *memstream = (struct bootable_memstream *) memstream_ptr;
+	if (memstream == NULL)
+		return BOOTABLE_EFAULT;
+
+	if ((pos > memstream->size) || (buf_size > (memstream->size - pos)))
+		return BOOTABLE_EINVAL;
+
+	bootable_memcpy(buf, &memstream->data[pos], buf_size);
+
+	return 0;
+}
+
+static int memstream_write_at(void *memstream_ptr,
+                              bootable_uint64 pos,
+                              const void *buf,
+                              bootable_uint64 buf_size) {
+
+	struct bootable_memstream *memstream = (struct bootable_memstream *) memstream_ptr;
+	if (memstream == NULL)
+		return BOOTABLE_EFAULT;
+
+	if ((pos + buf_size) < pos)
+		return BOOTABLE_EINVAL;
+
+	if ((pos + buf_size) > memstream->size) {
+		int err = bootable_memstream_resize(memstream, pos + buf_size);
+		if (err != 0)
+			return err;
+	}
+
+	bootable_memcpy(&memstream->data[pos], buf, buf_size);
+
+	return 0;
+}
+
+static int memstream_read(void *memstream_ptr, void *buf, bootable_uint64 buf_size) {
+
+	struct bootable_memstream *memstream = (struct bootable_memstream *) memstream_ptr;
+	if (memstream == NULL)
+		return BOOTABLE_EFAULT;
+
+	int err = memstream_read_at(memstream, memstream->position, buf, buf_size);
+	if (err != 0)
+		return err;
+
+	memstream->position += buf_size;
+
+	return 0;
+}
+
+static int memstream_write(void *memstream_ptr, const void *buf, bootable_uint64 buf_size) {
+
+	struct bootable_memstream *memstream = (struct bootable_memstream *) memstream_ptr;
+	if (memstream == NULL)
+		return BOOTABLE_EFAULT;
+
+	int err = memstream_write_at(memstream, memstream->position, buf, buf_size);
+	if (err != 0)
+		return err;
+
+	memstream->position += buf_size;
+
+	return 0;
+}
+
+static int memstream_set_pos(void *memstream_ptr, bootable_uint64 pos) {
+
+	struct bootable_memstream *memstream = (struct bootable_memstream *) memstream_ptr;
+	if (memstream == NULL)
+		return BOOTABLE_EFAULT;
+
+	memstream->position = pos;
+
+	return 0;
+}
+
+static int memstream_get_pos(void *memstream_ptr, bootable_uint64 *pos) {
+
+	struct bootable_memstream *memstream = (struct bootable_memstream *) memstream_ptr;
+	if (memstream == NULL)
+		return BOOTABLE_EFAULT;
+
+	if (pos != NULL)
+		*pos = memstream->position;
+
+	return 0;
+}
+
+static int memstream_get_size(void *memstream_ptr, bootable_uint64 *size) {
+
+	struct bootable_memstream *memstream = (struct bootable_memstream *) memstream_ptr;
+	if (memstream == NULL)
+		return BOOTABLE_EFAULT;
+
+	if (size != NULL)
+		*size = memstream->size;
+
+	return 0;
+}
+
+void bootable_memstream_init(struct bootable_memstream *memstream) {
+	bootable_stream_init(&memstream->stream);
+	memstream->stream.data = memstream;
+	memstream->stream.read = memstream_read;
+	memstream->stream.write = memstream_write;
+	memstream->stream.read_at = memstream_read_at;
+	memstream->stream.write_at = memstream_write_at;
+	memstream->stream.set_pos = memstream_set_pos;
+	memstream->stream.get_pos = memstream_get_pos;
+	memstream->stream.get_size = memstream_get_size;
+	memstream->data = NULL;
+	memstream->size = 0;
+	memstream->reserved = 0;
+	memstream->position = 0;
+	memstream->fixed = bootable_false;
+}
+
+void bootable_memstream_done(struct bootable_memstream *memstream) {
+
+	if (!memstream->fixed)
+		bootable_free(memstream->data);
+
+	memstream->data = NULL;
+	memstream->size = 0;
+	memstream->reserved = 0;
+	memstream->position = 0;
+	memstream->fixed = bootable_false;
+}
+
+void bootable_memstream_wrap(struct bootable_memstream *memstream,
+                             void *buf,
+                             bootable_uint64 buf_size) {
+
+	bootable_memstream_done(memstream);
+
+	memstream->data = (unsigned char *) buf;
+	memstream->size = buf_size;
+	memstream->reserved = buf_size;
+	memstream->fixed = bootable_true;
+}
+
+int bootable_memstream_reserve(struct bootable_memstream *memstream,
+                               bootable_uint64 size) {
+
+	if (size <= memstream->reserved)
+		return 0;
+
+	if (memstream->fixed)
+		return BOOTABLE_ENOSPC;
+
+	unsigned char *data = bootable_realloc(memstream->data, size);
+	if (data == NULL)
+		return BOOTABLE_ENOMEM;
+
+	memstream->data = data;
+	memstream->reserved = size;
+
+	return 0;
+}
+
+int bootable_memstream_resize(struct bootable_memstream *memstream,
+                              bootable_uint64 size) {
+
+	int err = grow(memstream, size);
+	if (err != 0)
+		return err;
+
+	if (size > memstream->size)
+		bootable_memset(&memstream->data[memstream->size], 0, size - memstream->size);
+
+	memstream->size = size;
+
+	return 0;
+}
+
+void *bootable_memstream_release(struct bootable_memstream *memstream,
+                                 bootable_uint64 *size) {
+
+	void *data = memstream->data;
+
+	if (size != NULL)
+		*size = memstream->size;
+
+	memstream->data = NULL;
+	memstream->size = 0;
+	memstream->reserved = 0;
+	memstream->position = 0;
+	memstream->fixed = bootable_false;
+
+	return data;
+}
@@ -50,11 +50,7 @@ int encode_uint32(bootable_uint32 n, struct bootable_stream *file) {
 	return 0;
 }
 
-int encode_uint64(bootable_uint64 n, struct bootable_stream *file) {
-
-	int err;
-	unsigned char buf[8];
-
+void store_uint64(unsigned char *buf, bootable_uint64 n) {
 	buf[0] = (n >> 0x00) & 0xff;
 	buf[1] = (n >> 0x08) & 0xff;
 	buf[2] = (n >> 0x10) & 0xff;
@@ -63,6 +59,14 @@ int encode_uint64(bootable_uint64 n, struct bootable_stream *file) {
 	buf[5] = (n >> 0x28) & 0xff;
 	buf[6] = (n >> 0x30) & 0xff;
 	buf[7] = (n >> 0x38) & 0xff;
+}
+
+int encode_uint64(bootable_uint64 n, struct bootable_stream *file) {
+
+	int err;
+	unsigned char buf[8];
+
+	store_uint64(buf, n);
 
 	err = bootable_stream_write(file, buf, 8);
 	if (err != 0)
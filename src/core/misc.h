@@ -21,6 +21,8 @@ int encode_uint32(bootable_uint32 n, struct bootable_stream *file);
 
 int encode_uint64(bootable_uint64 n, struct bootable_stream *file);
 
+void store_uint64(unsigned char *buf, bootable_uint64 n);
+
 int decode_uint16(bootable_uint16 *n_ptr, struct bootable_stream *file);
 
 int decode_uint32(bootable_uint32 *n_ptr, struct bootable_stream *file);
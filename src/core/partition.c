@@ -24,34 +24,71 @@
 #define NULL ((void *) 0x00)
 #endif
 
-static int partition_read(void *partition_ptr, void *buf, bootable_uint64 buf_size) {
+static int partition_read_at(void *partition_ptr,
+                             bootable_uint64 pos,
+                             void *buf,
+                             bootable_uint64 buf_size) {
+
+	struct bootable_partition *partition = (struct bootable_partition *) partition_ptr;
+	if ((partition == NULL) || (partition->disk == NULL))
+		return BOOTABLE_EFAULT;
+
+	return bootable_stream_read_at(partition->disk, partition->offset + pos, buf, buf_size);
+}
+
+static int partition_write_at(void *partition_ptr,
+                              bootable_uint64 pos,
+                              const void *buf,
+                              bootable_uint64 buf_size) {
 
 	struct bootable_partition *partition = (struct bootable_partition *) partition_ptr;
 	if ((partition == NULL) || (partition->disk == NULL))
 		return BOOTABLE_EFAULT;
 
-	int err = bootable_stream_set_pos(partition->disk, partition->offset + partition->position);
+	return bootable_stream_write_at(partition->disk, partition->offset + pos, buf, buf_size);
+}
+
+static int partition_copy_from_fd(void *partition_ptr,
+                                  bootable_uint64 pos,
+                                  int fd,
+                                  bootable_uint64 fd_offset,
+                                  bootable_uint64 size) {
+
+	struct bootable_partition *partition = (struct bootable_partition *) partition_ptr;
+	if ((partition == NULL) || (partition->disk == NULL))
+		return BOOTABLE_EFAULT;
+
+	return bootable_stream_copy_from_fd(partition->disk, partition->offset + pos, fd, fd_offset, size);
+}
+
+static int partition_read(void *partition_ptr, void *buf, bootable_uint64 buf_size) {
+
+	struct bootable_partition *partition = (struct bootable_partition *) partition_ptr;
+	if (partition == NULL)
+		return BOOTABLE_EFAULT;
+
+	int err = partition_read_at(partition, partition->position, buf, buf_size);
 	if (err != 0)
 		return err;
 
 	partition->position += buf_size;
 
-	return bootable_stream_read(partition->disk, buf, buf_size);
+	return 0;
 }
 
 static int partition_write(void *partition_ptr, const void *buf, bootable_uint64 buf_size) {
 
 	struct bootable_partition *partition = (struct bootable_partition *) partition_ptr;
-	if ((partition == NULL) || (partition->disk == NULL))
+	if (partition == NULL)
 		return BOOTABLE_EFAULT;
 
-	int err = bootable_stream_set_pos(partition->disk, partition->offset + partition->position);
+	int err = partition_write_at(partition, partition->position, buf, buf_size);
 	if (err != 0)
 		return err;
 
 	partition->position += buf_size;
 
-	return bootable_stream_write(partition->disk, buf, buf_size);
+	return 0;
 }
 
 static int partition_set_pos(void *partition_ptr, bootable_uint64 pos) {
@@ -97,6 +134,9 @@ void bootable_partition_init(struct bootable_partition *partition) {
 	partition->stream.data = partition;
 	partition->stream.read = partition_read;
 	partition->stream.write = partition_write;
+	partition->stream.read_at = partition_read_at;
+	partition->stream.write_at = partition_write_at;
+	partition->stream.copy_from_fd = partition_copy_from_fd;
 	partition->stream.set_pos = partition_set_pos;
 	partition->stream.get_pos = partition_get_pos;
 	partition->stream.get_size = partition_get_size;
@@ -0,0 +1,99 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <bootable/core/path.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int slice_is(const struct bootable_path_slice *name, const char *str) {
+	return (name->size == strlen(str))
+	    && (memcmp(name->data, str, name->size) == 0);
+}
+
+static void test_iterator(void) {
+
+	struct bootable_path_iterator iterator;
+	struct bootable_path_slice name;
+
+	bootable_path_iterator_init(&iterator, "//a\\bc/./..//");
+
+	assert(bootable_path_iterator_next(&iterator, &name));
+	assert(slice_is(&name, "a"));
+	assert(bootable_path_iterator_next(&iterator, &name));
+	assert(slice_is(&name, "bc"));
+	assert(bootable_path_iterator_next(&iterator, &name));
+	assert(slice_is(&name, "."));
+	assert(bootable_path_iterator_next(&iterator, &name));
+	assert(slice_is(&name, ".."));
+	assert(!bootable_path_iterator_next(&iterator, &name));
+	assert(!bootable_path_iterator_next(&iterator, &name));
+}
+
+static void test_view(void) {
+
+	char deep[256];
+	struct bootable_path_view view;
+
+	bootable_path_view_init(&view);
+
+	assert(bootable_path_view_parse(&view, "/../a/./b/../c/") == 0);
+	assert(view.name_count == 2);
+	assert(slice_is(&view.names[0], "a"));
+	assert(slice_is(&view.names[1], "c"));
+	assert(view.names == view.inline_names);
+
+	assert(bootable_path_view_parse(&view, "") == 0);
+	assert(view.name_count == 0);
+
+	/* deeper than the inline storage */
+	deep[0] = 0;
+	for (unsigned int i = 0; i < 40; i++)
+		strcat(deep, (i % 2) ? "/y" : "/x");
+
+	assert(bootable_path_view_parse(&view, deep) == 0);
+	assert(view.name_count == 40);
+	assert(view.names != view.inline_names);
+	assert(slice_is(&view.names[38], "x"));
+	assert(slice_is(&view.names[39], "y"));
+
+	bootable_path_view_done(&view);
+	assert(view.names == view.inline_names);
+}
+
+static void test_path(void) {
+
+	struct bootable_path path;
+
+	bootable_path_init(&path);
+
+	assert(bootable_path_parse(&path, "/a/./b/../c") == 0);
+	assert(bootable_path_normalize(&path) == 0);
+	assert(bootable_path_get_name_count(&path) == 2);
+	assert(strcmp(bootable_path_get_name(&path, 0), "a") == 0);
+	assert(strcmp(bootable_path_get_name(&path, 1), "c") == 0);
+
+	bootable_path_free(&path);
+}
+
+int main(void) {
+	test_iterator();
+	test_view();
+	test_path();
+	return EXIT_SUCCESS;
+}
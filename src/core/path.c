@@ -110,97 +110,164 @@ int bootable_path_normalize(struct bootable_path *path) {
 	return 0;
 }
 
-int bootable_path_parse(struct bootable_path *path,
-                      const char *path_str) {
+static int push_name(struct bootable_path *path,
+                     const char *name,
+                     bootable_uint64 name_size) {
 
-	int err;
-	bootable_uint64 i;
-	char *tmp;
-	char *tmp2;
-	bootable_uint64 tmp_size;
-	bootable_uint64 tmp_res;
+	char *tmp_name;
+	struct bootable_path_name *name_array;
+	bootable_uint64 name_array_size;
 
-	tmp = bootable_null;
-	tmp_size = 0;
-	tmp_res = 0;
+	name_array = path->name_array;
 
-	for (i = 0; path_str[i]; i++) {
-		if (is_separator(path_str[i])) {
+	name_array_size = path->name_count + 1;
+	name_array_size *= sizeof(path->name_array[0]);
 
-			if (tmp_size == 0)
-				continue;
+	name_array = bootable_realloc(name_array, name_array_size);
+	if (name_array == bootable_null)
+		return BOOTABLE_ENOMEM;
 
-			err = bootable_path_push_child(path, tmp);
-			if (err != 0) {
-				bootable_free(tmp);
-				return err;
-			}
+	path->name_array = name_array;
 
-			tmp_size = 0;
+	tmp_name = bootable_malloc(name_size + 1);
+	if (tmp_name == bootable_null)
+		return BOOTABLE_ENOMEM;
 
-		} else {
+	bootable_memcpy(tmp_name, name, name_size);
 
-			if ((tmp_size + 1) >= tmp_res) {
-				tmp_res += 64;
-				tmp2 = bootable_realloc(tmp, tmp_res);
-				if (tmp2 == bootable_null) {
-					bootable_free(tmp);
-					return BOOTABLE_ENOMEM;
-				}
-				tmp = tmp2;
-			}
+	tmp_name[name_size] = 0;
 
-			tmp[tmp_size++] = path_str[i];
-			tmp[tmp_size] = 0;
-		}
-	}
+	path->name_array[path->name_count].data = tmp_name;
+	path->name_array[path->name_count].size = name_size;
+
+	path->name_count++;
+
+	return 0;
+}
+
+int bootable_path_parse(struct bootable_path *path,
+                      const char *path_str) {
 
-	if (tmp_size > 0) {
-		err = bootable_path_push_child(path, tmp);
-		if (err != 0) {
-			bootable_free(tmp);
+	int err;
+	struct bootable_path_iterator iterator;
+	struct bootable_path_slice name;
+
+	bootable_path_iterator_init(&iterator, path_str);
+
+	while (bootable_path_iterator_next(&iterator, &name)) {
+		err = push_name(path, name.data, name.size);
+		if (err != 0)
 			return err;
-		}
 	}
 
-	bootable_free(tmp);
-
 	return 0;
 }
 
 int bootable_path_push_child(struct bootable_path *path,
                            const char *name) {
 
-	char *tmp_name;
-	bootable_uint64 name_size;
-	struct bootable_path_name *name_array;
-	bootable_uint64 name_array_size;
+	return push_name(path, name, bootable_strlen(name));
+}
 
-	name_array = path->name_array;
+void bootable_path_iterator_init(struct bootable_path_iterator *iterator,
+                                 const char *path_string) {
 
-	name_array_size = path->name_count + 1;
-	name_array_size *= sizeof(path->name_array[0]);
+	iterator->pos = path_string;
+}
 
-	name_array = bootable_realloc(name_array, name_array_size);
-	if (name_array == bootable_null)
-		return BOOTABLE_ENOMEM;
+bootable_bool bootable_path_iterator_next(struct bootable_path_iterator *iterator,
+                                          struct bootable_path_slice *name) {
 
-	path->name_array = name_array;
+	const char *pos = iterator->pos;
 
-	name_size = bootable_strlen(name);
+	while (is_separator(*pos))
+		pos++;
 
-	tmp_name = bootable_malloc(name_size + 1);
-	if (tmp_name == bootable_null)
+	if (*pos == 0) {
+		iterator->pos = pos;
+		return bootable_false;
+	}
+
+	name->data = pos;
+
+	while ((*pos != 0) && !is_separator(*pos))
+		pos++;
+
+	name->size = (bootable_uint64) (pos - name->data);
+
+	iterator->pos = pos;
+
+	return bootable_true;
+}
+
+void bootable_path_view_init(struct bootable_path_view *view) {
+	view->names = view->inline_names;
+	view->name_count = 0;
+	view->name_capacity = BOOTABLE_PATH_VIEW_DEPTH;
+}
+
+void bootable_path_view_done(struct bootable_path_view *view) {
+
+	if (view->names != view->inline_names)
+		bootable_free(view->names);
+
+	view->names = view->inline_names;
+	view->name_count = 0;
+	view->name_capacity = BOOTABLE_PATH_VIEW_DEPTH;
+}
+
+static int view_grow(struct bootable_path_view *view) {
+
+	bootable_uint64 name_capacity;
+	struct bootable_path_slice *names;
+
+	name_capacity = view->name_capacity * 2;
+
+	names = bootable_malloc(name_capacity * sizeof(names[0]));
+	if (names == bootable_null)
 		return BOOTABLE_ENOMEM;
 
-	bootable_memcpy(tmp_name, name, name_size);
+	bootable_memcpy(names, view->names, view->name_count * sizeof(names[0]));
 
-	tmp_name[name_size] = 0;
+	if (view->names != view->inline_names)
+		bootable_free(view->names);
 
-	path->name_array[path->name_count].data = tmp_name;
-	path->name_array[path->name_count].size = name_size;
+	view->names = names;
+	view->name_capacity = name_capacity;
 
-	path->name_count++;
+	return 0;
+}
+
+int bootable_path_view_parse(struct bootable_path_view *view,
+                             const char *path_string) {
+
+	int err;
+	struct bootable_path_iterator iterator;
+	struct bootable_path_slice name;
+
+	view->name_count = 0;
+
+	bootable_path_iterator_init(&iterator, path_string);
+
+	while (bootable_path_iterator_next(&iterator, &name)) {
+
+		if ((name.size == 1) && (name.data[0] == '.'))
+			continue;
+
+		if ((name.size == 2) && (name.data[0] == '.') && (name.data[1] == '.')) {
+			if (view->name_count > 0)
+				view->name_count--;
+			continue;
+		}
+
+		if (view->name_count >= view->name_capacity) {
+			err = view_grow(view);
+			if (err != 0)
+				return err;
+		}
+
+		view->names[view->name_count++] = name;
+	}
 
 	return 0;
 }
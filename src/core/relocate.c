@@ -0,0 +1,235 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "relocate.h"
+
+#include <bootable/core/error.h>
+#include <bootable/core/file.h>
+#include <bootable/core/memory.h>
+#include <bootable/core/stream.h>
+
+/** The number of bytes moved at a time. */
+
+#define MOVE_SIZE 0x10000
+
+void bootable_move_list_init(struct bootable_move_list *list) {
+	list->moves = bootable_null;
+	list->count = 0;
+	list->capacity = 0;
+}
+
+void bootable_move_list_done(struct bootable_move_list *list) {
+	bootable_free(list->moves);
+	list->moves = bootable_null;
+	list->count = 0;
+	list->capacity = 0;
+}
+
+int bootable_move_list_add(struct bootable_move_list *list,
+                           struct bootable_stream *stream,
+                           struct bootable_file *file,
+                           bootable_uint64 offset) {
+
+	bootable_uint64 capacity;
+	struct bootable_move *moves;
+
+	if ((file->source == bootable_null)
+	 || (file->source->stream != stream)
+	 || (file->data_offset == offset))
+		return 0;
+
+	if (list->count >= list->capacity) {
+
+		capacity = list->capacity * 2;
+		if (capacity < 64)
+			capacity = 64;
+
+		moves = bootable_realloc(list->moves, capacity * sizeof(moves[0]));
+		if (moves == bootable_null)
+			return BOOTABLE_ENOMEM;
+
+		list->moves = moves;
+		list->capacity = capacity;
+	}
+
+	list->moves[list->count].file = file;
+	list->moves[list->count].offset = offset;
+	list->count++;
+
+	return 0;
+}
+
+/** Checks if a move should come before another one.
+ * Data that is further into the stream goes first. */
+
+static bootable_bool move_before(const struct bootable_move *a,
+                                 const struct bootable_move *b) {
+
+	return a->file->data_offset > b->file->data_offset;
+}
+
+static void sift_down(struct bootable_move *moves,
+                      bootable_uint64 root,
+                      bootable_uint64 count) {
+
+	bootable_uint64 child;
+	struct bootable_move tmp;
+
+	while ((root * 2 + 1) < count) {
+
+		child = root * 2 + 1;
+
+		if (((child + 1) < count) && move_before(&moves[child], &moves[child + 1]))
+			child++;
+
+		if (!move_before(&moves[root], &moves[child]))
+			return;
+
+		tmp = moves[root];
+		moves[root] = moves[child];
+		moves[child] = tmp;
+
+		root = child;
+	}
+}
+
+/** Sorts the moves with a heap sort, so
+ * that no extra memory is needed. */
+
+static void sort_moves(struct bootable_move *moves, bootable_uint64 count) {
+
+	struct bootable_move tmp;
+
+	for (bootable_uint64 i = count / 2; i > 0; i--)
+		sift_down(moves, i - 1, count);
+
+	for (bootable_uint64 i = count; i > 1; i--) {
+		tmp = moves[0];
+		moves[0] = moves[i - 1];
+		moves[i - 1] = tmp;
+		sift_down(moves, 0, i - 1);
+	}
+}
+
+/** Moves data towards the end of a stream.
+ * The pieces are moved starting from the end,
+ * so that the source and destination may overlap. */
+
+static int move_data(struct bootable_stream *stream,
+                     bootable_uint64 dst,
+                     bootable_uint64 src,
+                     bootable_uint64 size,
+                     void *buf) {
+
+	int err;
+	bootable_uint64 piece;
+
+	while (size > 0) {
+
+		piece = (size < MOVE_SIZE) ? size : MOVE_SIZE;
+
+		size -= piece;
+
+		err = bootable_stream_read_at(stream, src + size, buf, piece);
+		if (err != 0)
+			return err;
+
+		err = bootable_stream_write_at(stream, dst + size, buf, piece);
+		if (err != 0)
+			return err;
+	}
+
+	return 0;
+}
+
+int bootable_move_list_apply(struct bootable_move_list *list,
+                             struct bootable_stream *stream) {
+
+	int err;
+	void *buf;
+	struct bootable_move *move;
+	bootable_uint64 src;
+	bootable_uint64 shared_src;
+	bootable_uint64 shared_dst;
+	bootable_uint64 shared_size;
+	bootable_bool shared;
+
+	/* Nothing is written until all of the data
+	 * that moves backwards has been read. */
+
+	for (bootable_uint64 i = 0; i < list->count; i++) {
+		move = &list->moves[i];
+		if (move->offset < move->file->data_offset) {
+			err = bootable_file_load(move->file);
+			if (err != 0)
+				return err;
+		}
+	}
+
+	sort_moves(list->moves, list->count);
+
+	buf = bootable_null;
+	shared = bootable_false;
+	shared_src = 0;
+	shared_dst = 0;
+	shared_size = 0;
+
+	for (bootable_uint64 i = 0; i < list->count; i++) {
+
+		move = &list->moves[i];
+
+		if (move->file->source == bootable_null)
+			continue;
+
+		src = move->file->data_offset;
+
+		/* Files may share their data. Once the data
+		 * has been moved, it may have been overwritten
+		 * where it was, so the next file that shares it
+		 * takes it from where it went instead. */
+		if (shared && (src == shared_src) && (bootable_file_stored_size(move->file) == shared_size)) {
+			src = shared_dst;
+		} else {
+			shared = bootable_true;
+			shared_src = src;
+			shared_dst = move->offset;
+			shared_size = bootable_file_stored_size(move->file);
+		}
+
+		if (src != move->offset) {
+
+			if (buf == bootable_null) {
+				buf = bootable_malloc(MOVE_SIZE);
+				if (buf == bootable_null)
+					return BOOTABLE_ENOMEM;
+			}
+
+			err = move_data(stream, move->offset, src, bootable_file_stored_size(move->file), buf);
+			if (err != 0) {
+				bootable_free(buf);
+				return err;
+			}
+		}
+
+		move->file->data_offset = move->offset;
+	}
+
+	bootable_free(buf);
+
+	return 0;
+}
@@ -0,0 +1,103 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOOTABLE_RELOCATE_H
+#define BOOTABLE_RELOCATE_H
+
+#include <bootable/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct bootable_file;
+struct bootable_stream;
+
+/** Describes where the data of a file that
+ * has not been loaded goes in an export.
+ * */
+
+struct bootable_move {
+	/** The file that is being exported. */
+	struct bootable_file *file;
+	/** The position that the data is
+	 * exported to in the output stream. */
+	bootable_uint64 offset;
+};
+
+/** A list of file data that has to be
+ * moved before a file system is exported
+ * to the stream it was imported from.
+ * */
+
+struct bootable_move_list {
+	/** The moves in the list. */
+	struct bootable_move *moves;
+	/** The number of moves in the list. */
+	bootable_uint64 count;
+	/** The number of moves that fit in the array. */
+	bootable_uint64 capacity;
+};
+
+/** Initializes an empty move list.
+ * @param list An uninitialized move list.
+ * */
+
+void bootable_move_list_init(struct bootable_move_list *list);
+
+/** Releases the memory of a move list.
+ * @param list An initialized move list.
+ * */
+
+void bootable_move_list_done(struct bootable_move_list *list);
+
+/** Adds a file to a move list, if its data has
+ * not been loaded and is in a certain stream.
+ * Otherwise, the list is not changed.
+ * @param list An initialized move list.
+ * @param stream The stream that is exported to.
+ * @param file The file to add.
+ * @param offset The position the data will have in the stream.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_move_list_add(struct bootable_move_list *list,
+                           struct bootable_stream *stream,
+                           struct bootable_file *file,
+                           bootable_uint64 offset);
+
+/** Moves the data of every file in the list to the
+ * position that it will have after the export. Files
+ * whose data moves towards the start of the stream are
+ * loaded first. The rest are moved starting with the data
+ * that is furthest into the stream, so that no data is
+ * overwritten before it is moved. Files that share their
+ * data in the stream may be in the list together.
+ * @param list A list of files. The list is sorted by this function.
+ * @param stream The stream that the data is in.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_move_list_apply(struct bootable_move_list *list,
+                             struct bootable_stream *stream);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_RELOCATE_H */
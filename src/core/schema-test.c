@@ -0,0 +1,285 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The schema code is built into this test with the
+ * byte order conversions of big endian hosts, so
+ * that they are tested on any host. The library code
+ * that uses the schemas is linked against it. */
+
+#define LITTLE_ENDIAN_HOST 0
+
+#include "schema.c"
+
+#include <bootable/core/dap.h>
+#include <bootable/core/gpt.h>
+#include <bootable/core/mbr.h>
+#include <bootable/core/memstream.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const unsigned char dap_image[16] = {
+	0x10, 0x00, 0x40, 0x00, 0x00, 0x80, 0x00, 0x00,
+	0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11
+};
+
+static void make_dap(struct bootable_dap *dap) {
+	dap->reserved[0] = 0x10;
+	dap->reserved[1] = 0x00;
+	dap->sector_count = 0x0040;
+	dap->address = 0x8000;
+	dap->segment = 0x0000;
+	dap->sector = 0x1122334455667788ULL;
+}
+
+static void check_dap(const struct bootable_dap *dap) {
+	assert(dap->reserved[0] == 0x10);
+	assert(dap->reserved[1] == 0x00);
+	assert(dap->sector_count == 0x0040);
+	assert(dap->address == 0x8000);
+	assert(dap->segment == 0x0000);
+	assert(dap->sector == 0x1122334455667788ULL);
+}
+
+static void test_dap(void) {
+
+	struct bootable_memstream stream;
+	struct bootable_dap dap;
+
+	bootable_memstream_init(&stream);
+
+	make_dap(&dap);
+	assert(bootable_dap_write(&dap, &stream.stream) == 0);
+	assert(stream.size == sizeof(dap_image));
+	assert(memcmp(stream.data, dap_image, sizeof(dap_image)) == 0);
+
+	memset(&dap, 0xff, sizeof(dap));
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_dap_read(&dap, &stream.stream) == 0);
+	check_dap(&dap);
+
+	bootable_memstream_done(&stream);
+}
+
+static void test_mbr(void) {
+
+	struct bootable_memstream stream;
+	struct bootable_mbr mbr;
+
+	bootable_memstream_init(&stream);
+
+	/* Garbage in the padding must not reach the disk. */
+	memset(&mbr, 0xcc, sizeof(mbr));
+	memset(mbr.code, 0x90, sizeof(mbr.code));
+	make_dap(&mbr.st2dap);
+	make_dap(&mbr.st3dap);
+	mbr.st3dap.sector_count = 0x0102;
+	mbr.boot_signature = 0xaa55;
+
+	assert(bootable_mbr_write(&mbr, &stream.stream) == 0);
+	assert(stream.size == 0x1fe);
+
+	for (unsigned int i = 0; i < 476; i++)
+		assert(stream.data[i] == 0x90);
+
+	assert(memcmp(&stream.data[0x1dc], dap_image, sizeof(dap_image)) == 0);
+	assert(stream.data[0x1ec + 2] == 0x02);
+	assert(stream.data[0x1ec + 3] == 0x01);
+	assert(memcmp(&stream.data[0x1ec + 4], &dap_image[4], sizeof(dap_image) - 4) == 0);
+	assert(stream.data[0x1fc] == 0x55);
+	assert(stream.data[0x1fd] == 0xaa);
+
+	memset(&mbr, 0, sizeof(mbr));
+	assert(bootable_mbr_read(&mbr, &stream.stream) == 0);
+	assert(bootable_mbr_check(&mbr) == 0);
+	assert(mbr.code[0] == 0x90);
+	assert(mbr.code[475] == 0x90);
+	check_dap(&mbr.st2dap);
+	assert(mbr.st3dap.sector_count == 0x0102);
+	assert(mbr.st3dap.sector == 0x1122334455667788ULL);
+
+	bootable_memstream_done(&stream);
+}
+
+static const unsigned char header_image[92] = {
+	'E',  'F',  'I',  ' ',  'P',  'A',  'R',  'T',
+	0x00, 0x00, 0x01, 0x00, 0x5c, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0xff, 0x1f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x22, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0xde, 0x1f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+	0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+	0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x80, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00
+};
+
+static void test_gpt_header(void) {
+
+	struct bootable_memstream stream;
+	struct bootable_gpt_header header;
+
+	bootable_memstream_init(&stream);
+
+	memset(&header, 0xcc, sizeof(header));
+	header.current_lba = 1;
+	header.backup_lba = 0x1fff;
+	header.first_usable_lba = 0x22;
+	header.last_usable_lba = 0x1fde;
+	for (unsigned int i = 0; i < 16; i++)
+		header.disk_uuid.bytes[i] = (bootable_uint8) i;
+	header.partition_entries_lba = 2;
+	header.partition_entry_count = 128;
+
+	/* The signature, sizes and checksums are
+	 * filled in by the export. */
+	assert(bootable_gpt_header_export(&header, &stream.stream) == 0);
+	assert(stream.size == 512);
+	assert(memcmp(stream.data, header_image, sizeof(header_image)) == 0);
+
+	for (unsigned int i = sizeof(header_image); i < 512; i++)
+		assert(stream.data[i] == 0);
+
+	memset(&header, 0, sizeof(header));
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_gpt_header_import(&header, &stream.stream) == 0);
+	assert(memcmp(header.signature, "EFI PART", 8) == 0);
+	assert(header.version == 0x010000);
+	assert(header.header_size == 92);
+	assert(header.current_lba == 1);
+	assert(header.backup_lba == 0x1fff);
+	assert(header.first_usable_lba == 0x22);
+	assert(header.last_usable_lba == 0x1fde);
+	assert(header.disk_uuid.bytes[15] == 0x0f);
+	assert(header.partition_entries_lba == 2);
+	assert(header.partition_entry_count == 128);
+	assert(header.partition_entry_size == 128);
+
+	bootable_memstream_done(&stream);
+}
+
+static const unsigned char entry_image[64] = {
+	0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+	0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
+	0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7,
+	0xb8, 0xb9, 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf,
+	0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0xff, 0x0f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80,
+	'f',  0x00, 's',  0x00, 0xac, 0x20, 0x00, 0x00
+};
+
+static void test_gpt_entry(void) {
+
+	struct bootable_memstream stream;
+	struct bootable_gpt_entry entry;
+
+	bootable_memstream_init(&stream);
+
+	bootable_gpt_entry_init(&entry);
+	for (unsigned int i = 0; i < 16; i++) {
+		entry.type_uuid.bytes[i] = (bootable_uint8) (0xa0 + i);
+		entry.entry_uuid.bytes[i] = (bootable_uint8) (0xb0 + i);
+	}
+	entry.first_lba = 0x800;
+	entry.last_lba = 0xfff;
+	entry.attributes = 0x8000000000000001ULL;
+	entry.name[0] = 'f';
+	entry.name[1] = 's';
+	entry.name[2] = 0x20ac;
+
+	assert(bootable_gpt_entry_export(&entry, &stream.stream) == 0);
+	assert(stream.size == 128);
+	assert(memcmp(stream.data, entry_image, sizeof(entry_image)) == 0);
+
+	for (unsigned int i = sizeof(entry_image); i < 128; i++)
+		assert(stream.data[i] == 0);
+
+	memset(&entry, 0xff, sizeof(entry));
+	assert(bootable_stream_set_pos(&stream.stream, 0) == 0);
+	assert(bootable_gpt_entry_import(&entry, &stream.stream) == 0);
+	assert(entry.type_uuid.bytes[0] == 0xa0);
+	assert(entry.entry_uuid.bytes[15] == 0xbf);
+	assert(entry.first_lba == 0x800);
+	assert(entry.last_lba == 0xfff);
+	assert(entry.attributes == 0x8000000000000001ULL);
+	assert(entry.name[2] == 0x20ac);
+	assert(entry.name[3] == 0);
+
+	bootable_memstream_done(&stream);
+}
+
+struct padded {
+	bootable_uint32 a;
+	bootable_uint64 b;
+};
+
+#define PADDED_FIELDS(X, T) \
+	X(T, a, 0x00, BOOTABLE_SCHEMA_UINT32, 4) \
+	X(T, b, 0x08, BOOTABLE_SCHEMA_UINT64, 8)
+
+static const struct bootable_schema_field padded_fields[] = {
+	PADDED_FIELDS(BOOTABLE_SCHEMA_FIELD, struct padded)
+};
+
+static const struct bootable_schema padded_schema = BOOTABLE_SCHEMA_INIT(struct padded, padded_fields, 16,
+	BOOTABLE_SCHEMA_IDENTITY(struct padded, 16,
+	                         PADDED_FIELDS(BOOTABLE_SCHEMA_SAME_OFFSET, struct padded),
+	                         PADDED_FIELDS(BOOTABLE_SCHEMA_FIELD_SIZE, struct padded)));
+
+static void test_identity(void) {
+
+	/* every byte of a disk address packet is a field */
+	assert(bootable_dap_schema.identity);
+
+	/* a hole in a structure is not copied */
+	assert(!padded_schema.identity);
+
+	struct padded obj;
+	unsigned char buf[16];
+
+	memset(&obj, 0xcc, sizeof(obj));
+	obj.a = 0x01020304;
+	obj.b = 0x05;
+
+	bootable_schema_encode(&padded_schema, &obj, buf);
+
+	static const unsigned char image[16] = {
+		0x04, 0x03, 0x02, 0x01, 0x00, 0x00, 0x00, 0x00,
+		0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	};
+
+	assert(memcmp(buf, image, sizeof(image)) == 0);
+
+	memset(&obj, 0, sizeof(obj));
+	bootable_schema_decode(&padded_schema, &obj, image);
+	assert(obj.a == 0x01020304);
+	assert(obj.b == 0x05);
+}
+
+int main(void) {
+	test_dap();
+	test_mbr();
+	test_gpt_header();
+	test_gpt_entry();
+	test_identity();
+	return EXIT_SUCCESS;
+}
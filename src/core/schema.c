@@ -0,0 +1,178 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "schema.h"
+
+#include <bootable/core/error.h>
+#include <bootable/core/stream.h>
+#include <bootable/core/string.h>
+
+/* This may be set to zero, to test the byte
+ * order conversions of big endian hosts. */
+
+#ifndef LITTLE_ENDIAN_HOST
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define LITTLE_ENDIAN_HOST 1
+#else
+#define LITTLE_ENDIAN_HOST 0
+#endif
+#endif
+
+static void encode_uint(unsigned char *buf,
+                        const unsigned char *src,
+                        bootable_uint32 size) {
+
+	if (LITTLE_ENDIAN_HOST) {
+		bootable_memcpy(buf, src, size);
+		return;
+	}
+
+	bootable_uint64 n = 0;
+
+	if (size == 2)
+		n = *(const bootable_uint16 *) src;
+	else if (size == 4)
+		n = *(const bootable_uint32 *) src;
+	else
+		n = *(const bootable_uint64 *) src;
+
+	for (bootable_uint32 i = 0; i < size; i++)
+		buf[i] = (n >> (i * 8)) & 0xff;
+}
+
+static void decode_uint(unsigned char *dst,
+                        const unsigned char *buf,
+                        bootable_uint32 size) {
+
+	if (LITTLE_ENDIAN_HOST) {
+		bootable_memcpy(dst, buf, size);
+		return;
+	}
+
+	bootable_uint64 n = 0;
+
+	for (bootable_uint32 i = 0; i < size; i++)
+		n |= ((bootable_uint64) buf[i]) << (i * 8);
+
+	if (size == 2)
+		*(bootable_uint16 *) dst = (bootable_uint16) n;
+	else if (size == 4)
+		*(bootable_uint32 *) dst = (bootable_uint32) n;
+	else
+		*(bootable_uint64 *) dst = n;
+}
+
+static void encode_fields(const struct bootable_schema *schema,
+                          const unsigned char *obj,
+                          unsigned char *buf) {
+
+	for (bootable_uint32 i = 0; i < schema->field_count; i++) {
+
+		const struct bootable_schema_field *field = &schema->fields[i];
+
+		const unsigned char *src = &obj[field->struct_offset];
+
+		unsigned char *dst = &buf[field->disk_offset];
+
+		if (field->kind == BOOTABLE_SCHEMA_BYTES)
+			bootable_memcpy(dst, src, field->size);
+		else if (field->kind == BOOTABLE_SCHEMA_NESTED)
+			encode_fields(field->nested, src, dst);
+		else
+			encode_uint(dst, src, field->size);
+	}
+}
+
+static void decode_fields(const struct bootable_schema *schema,
+                          unsigned char *obj,
+                          const unsigned char *buf) {
+
+	for (bootable_uint32 i = 0; i < schema->field_count; i++) {
+
+		const struct bootable_schema_field *field = &schema->fields[i];
+
+		unsigned char *dst = &obj[field->struct_offset];
+
+		const unsigned char *src = &buf[field->disk_offset];
+
+		if (field->kind == BOOTABLE_SCHEMA_BYTES)
+			bootable_memcpy(dst, src, field->size);
+		else if (field->kind == BOOTABLE_SCHEMA_NESTED)
+			decode_fields(field->nested, dst, src);
+		else
+			decode_uint(dst, src, field->size);
+	}
+}
+
+void bootable_schema_encode(const struct bootable_schema *schema,
+                            const void *obj,
+                            unsigned char *buf) {
+
+	if (LITTLE_ENDIAN_HOST && schema->identity) {
+		bootable_memcpy(buf, obj, schema->size);
+		return;
+	}
+
+	bootable_memset(buf, 0, schema->size);
+
+	encode_fields(schema, (const unsigned char *) obj, buf);
+}
+
+void bootable_schema_decode(const struct bootable_schema *schema,
+                            void *obj,
+                            const unsigned char *buf) {
+
+	if (LITTLE_ENDIAN_HOST && schema->identity) {
+		bootable_memcpy(obj, buf, schema->size);
+		return;
+	}
+
+	decode_fields(schema, (unsigned char *) obj, buf);
+}
+
+int bootable_schema_write(const struct bootable_schema *schema,
+                          const void *obj,
+                          struct bootable_stream *stream) {
+
+	unsigned char buf[BOOTABLE_SCHEMA_MAX_SIZE];
+
+	if (schema->size > sizeof(buf))
+		return BOOTABLE_EINVAL;
+
+	bootable_schema_encode(schema, obj, buf);
+
+	return bootable_stream_write(stream, buf, schema->size);
+}
+
+int bootable_schema_read(const struct bootable_schema *schema,
+                         void *obj,
+                         struct bootable_stream *stream) {
+
+	unsigned char buf[BOOTABLE_SCHEMA_MAX_SIZE];
+
+	if (schema->size > sizeof(buf))
+		return BOOTABLE_EINVAL;
+
+	int err = bootable_stream_read(stream, buf, schema->size);
+	if (err != 0)
+		return err;
+
+	bootable_schema_decode(schema, obj, buf);
+
+	return 0;
+}
@@ -0,0 +1,203 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOOTABLE_SCHEMA_H
+#define BOOTABLE_SCHEMA_H
+
+#include <bootable/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct bootable_stream;
+
+/** The ways that a field can be encoded.
+ * All integers are little endian on disk.
+ * */
+
+enum bootable_schema_kind {
+	/** A 16-bit unsigned integer. */
+	BOOTABLE_SCHEMA_UINT16,
+	/** A 32-bit unsigned integer. */
+	BOOTABLE_SCHEMA_UINT32,
+	/** A 64-bit unsigned integer. */
+	BOOTABLE_SCHEMA_UINT64,
+	/** Bytes that are copied as they are. */
+	BOOTABLE_SCHEMA_BYTES,
+	/** A structure with a schema of its own. */
+	BOOTABLE_SCHEMA_NESTED
+};
+
+struct bootable_schema;
+
+/** Describes where a field is found, in
+ * the structure and in the encoded data.
+ * */
+
+struct bootable_schema_field {
+	/** The offset of the field in the encoded data. */
+	bootable_uint32 disk_offset;
+	/** The offset of the field in the structure. */
+	bootable_uint32 struct_offset;
+	/** The number of bytes that the field takes,
+	 * both in the structure and on disk. */
+	bootable_uint32 size;
+	/** How the field is encoded. */
+	enum bootable_schema_kind kind;
+	/** The schema of a nested structure. */
+	const struct bootable_schema *nested;
+};
+
+/** Describes how a structure
+ * is laid out on disk.
+ * */
+
+struct bootable_schema {
+	/** The fields of the structure. */
+	const struct bootable_schema_field *fields;
+	/** The number of fields. */
+	bootable_uint32 field_count;
+	/** The number of bytes in the encoded data.
+	 * Bytes not covered by a field are zero. */
+	bootable_uint32 size;
+	/** The size of the structure in memory. */
+	bootable_uint32 struct_size;
+	/** Whether or not the structure is laid out in
+	 * memory as it is on disk, with every byte covered
+	 * by a field. On little endian hosts, such structures
+	 * are copied with one call. See @ref BOOTABLE_SCHEMA_IDENTITY. */
+	bootable_bool identity;
+};
+
+/** The largest encoded size that
+ * can be read or written in one call. */
+
+#define BOOTABLE_SCHEMA_MAX_SIZE 512
+
+/** Makes a field entry. This is meant to be
+ * passed to an X-macro field list, like this:
+ *
+ * #define DAP_FIELDS(X, T) \
+ *   X(T, sector_count, 0x02, BOOTABLE_SCHEMA_UINT16, 2)
+ *
+ * static const struct bootable_schema_field dap_fields[] = {
+ *   DAP_FIELDS(BOOTABLE_SCHEMA_FIELD, struct bootable_dap)
+ * };
+ *
+ * DAP_FIELDS(BOOTABLE_SCHEMA_CHECK_FIELD, struct bootable_dap)
+ * */
+
+#define BOOTABLE_SCHEMA_FIELD(type, member, disk_offset, kind, size) \
+	{ (disk_offset), __builtin_offsetof(type, member), (size), (kind), 0 },
+
+/** Makes a field entry for a nested structure. */
+
+#define BOOTABLE_SCHEMA_NESTED_FIELD(type, member, disk_offset, schema) \
+	{ (disk_offset), __builtin_offsetof(type, member), sizeof(((type *) 0)->member), BOOTABLE_SCHEMA_NESTED, &(schema) },
+
+/** Checks, at compile time, that the size of a field
+ * on disk is the size of the member in the structure. */
+
+#define BOOTABLE_SCHEMA_CHECK_FIELD(type, member, disk_offset, kind, size) \
+	_Static_assert(sizeof(((type *) 0)->member) == (size), "size of " #type "." #member " does not match its schema");
+
+/** Nested structures are checked by their own schema. */
+
+#define BOOTABLE_SCHEMA_CHECK_NESTED_FIELD(type, member, disk_offset, schema)
+
+/** Used with an X-macro field list to check
+ * that every field is at the same offset in
+ * memory as it is on disk. */
+
+#define BOOTABLE_SCHEMA_SAME_OFFSET(type, member, disk_offset, kind, size) \
+	&& ((disk_offset) == __builtin_offsetof(type, member))
+
+/** Used with an X-macro field list to add
+ * up the sizes of all the fields. */
+
+#define BOOTABLE_SCHEMA_FIELD_SIZE(type, member, disk_offset, kind, size) \
+	+ (size)
+
+/** Computes the identity flag of a schema at compile
+ * time. The offsets and sizes are the field list expanded
+ * with @ref BOOTABLE_SCHEMA_SAME_OFFSET and @ref
+ * BOOTABLE_SCHEMA_FIELD_SIZE. If the fields line up and
+ * add up to the size of the structure, there is no padding
+ * that would have to be encoded as zero. Schemas with nested
+ * structures are always encoded field by field. */
+
+#define BOOTABLE_SCHEMA_IDENTITY(type, size, offsets, sizes) \
+	((sizeof(type) == (size)) && (1 offsets) && ((0 sizes) == (size)))
+
+/** Makes a schema from a field array and
+ * its identity flag. */
+
+#define BOOTABLE_SCHEMA_INIT(type, fields, size, identity) \
+	{ (fields), sizeof(fields) / sizeof((fields)[0]), (size), sizeof(type), (identity) }
+
+/** Encodes a structure into a buffer.
+ * @param schema The layout of the structure.
+ * @param obj The structure to encode.
+ * @param buf The buffer to encode the structure
+ * into. It must be at least as large as the schema
+ * says.
+ * */
+
+void bootable_schema_encode(const struct bootable_schema *schema,
+                            const void *obj,
+                            unsigned char *buf);
+
+/** Decodes a structure from a buffer.
+ * @param schema The layout of the structure.
+ * @param obj The structure to decode into.
+ * @param buf The encoded data.
+ * */
+
+void bootable_schema_decode(const struct bootable_schema *schema,
+                            void *obj,
+                            const unsigned char *buf);
+
+/** Encodes a structure and writes
+ * it with a single stream call.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_schema_write(const struct bootable_schema *schema,
+                          const void *obj,
+                          struct bootable_stream *stream);
+
+/** Reads a structure with a single
+ * stream call and decodes it.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_schema_read(const struct bootable_schema *schema,
+                         void *obj,
+                         struct bootable_stream *stream);
+
+/** The layout of a disk address packet. It is
+ * shared so that it can be nested in the MBR. */
+
+extern const struct bootable_schema bootable_dap_schema;
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_SCHEMA_H */
@@ -31,6 +31,9 @@ void bootable_stream_init(struct bootable_stream *stream) {
 	stream->read = NULL;
 	stream->set_pos = NULL;
 	stream->write = NULL;
+	stream->read_at = NULL;
+	stream->write_at = NULL;
+	stream->copy_from_fd = NULL;
 }
 
 int bootable_stream_get_size(struct bootable_stream *stream, bootable_uint64 *size) {
@@ -67,3 +70,45 @@ int bootable_stream_write(struct bootable_stream *stream, const void *buf, boota
 	else
 		return BOOTABLE_ENOSYS;
 }
+
+int bootable_stream_read_at(struct bootable_stream *stream,
+                            bootable_uint64 pos,
+                            void *buf,
+                            bootable_uint64 buf_size) {
+
+	if (stream->read_at != NULL)
+		return stream->read_at(stream->data, pos, buf, buf_size);
+
+	int err = bootable_stream_set_pos(stream, pos);
+	if (err != 0)
+		return err;
+
+	return bootable_stream_read(stream, buf, buf_size);
+}
+
+int bootable_stream_write_at(struct bootable_stream *stream,
+                             bootable_uint64 pos,
+                             const void *buf,
+                             bootable_uint64 buf_size) {
+
+	if (stream->write_at != NULL)
+		return stream->write_at(stream->data, pos, buf, buf_size);
+
+	int err = bootable_stream_set_pos(stream, pos);
+	if (err != 0)
+		return err;
+
+	return bootable_stream_write(stream, buf, buf_size);
+}
+
+int bootable_stream_copy_from_fd(struct bootable_stream *stream,
+                                 bootable_uint64 pos,
+                                 int fd,
+                                 bootable_uint64 fd_offset,
+                                 bootable_uint64 size) {
+
+	if (stream->copy_from_fd != NULL)
+		return stream->copy_from_fd(stream->data, pos, fd, fd_offset, size);
+	else
+		return BOOTABLE_ENOSYS;
+}
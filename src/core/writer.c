@@ -0,0 +1,92 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "writer.h"
+
+#include <bootable/core/error.h>
+#include <bootable/core/memory.h>
+#include <bootable/core/stream.h>
+#include <bootable/core/string.h>
+
+#include "misc.h"
+
+int bootable_writer_init(struct bootable_writer *writer,
+                         struct bootable_stream *stream) {
+
+	writer->stream = stream;
+	writer->used = 0;
+	writer->buf = bootable_malloc(BOOTABLE_WRITER_SIZE);
+	if (writer->buf == bootable_null)
+		return BOOTABLE_ENOMEM;
+
+	return 0;
+}
+
+void bootable_writer_done(struct bootable_writer *writer) {
+	bootable_free(writer->buf);
+	writer->buf = bootable_null;
+	writer->used = 0;
+}
+
+int bootable_writer_flush(struct bootable_writer *writer) {
+
+	int err;
+
+	if (writer->used == 0)
+		return 0;
+
+	err = bootable_stream_write(writer->stream, writer->buf, writer->used);
+	if (err != 0)
+		return err;
+
+	writer->used = 0;
+
+	return 0;
+}
+
+int bootable_writer_write(struct bootable_writer *writer,
+                          const void *data,
+                          bootable_uint64 size) {
+
+	int err;
+
+	if (size > (BOOTABLE_WRITER_SIZE - writer->used)) {
+
+		err = bootable_writer_flush(writer);
+		if (err != 0)
+			return err;
+
+		if (size >= BOOTABLE_WRITER_SIZE)
+			return bootable_stream_write(writer->stream, data, size);
+	}
+
+	bootable_memcpy(&writer->buf[writer->used], data, size);
+
+	writer->used += size;
+
+	return 0;
+}
+
+int bootable_writer_uint64(struct bootable_writer *writer, bootable_uint64 n) {
+
+	unsigned char buf[8];
+
+	store_uint64(buf, n);
+
+	return bootable_writer_write(writer, buf, sizeof(buf));
+}
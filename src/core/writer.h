@@ -0,0 +1,98 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOOTABLE_WRITER_H
+#define BOOTABLE_WRITER_H
+
+#include <bootable/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct bootable_stream;
+
+/** The number of bytes that a writer
+ * collects before writing them. */
+
+#define BOOTABLE_WRITER_SIZE 0x10000
+
+/** Collects small writes, such as the fields of
+ * a structure, so that they reach the stream in
+ * large pieces. Writes that are at least as large
+ * as the buffer go to the stream directly.
+ * */
+
+struct bootable_writer {
+	/** The stream that is written to. */
+	struct bootable_stream *stream;
+	/** The bytes that have not been written yet. */
+	unsigned char *buf;
+	/** The number of bytes in the buffer. */
+	bootable_uint64 used;
+};
+
+/** Initializes a writer.
+ * @param writer An uninitialized writer.
+ * @param stream The stream to write to. Data is
+ * written starting at the position of the stream.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_writer_init(struct bootable_writer *writer,
+                         struct bootable_stream *stream);
+
+/** Releases the buffer of a writer. Data that
+ * has not been flushed is discarded.
+ * @param writer An initialized writer.
+ * */
+
+void bootable_writer_done(struct bootable_writer *writer);
+
+/** Writes data through the buffer.
+ * @param writer An initialized writer.
+ * @param data The data to write.
+ * @param size The number of bytes to write.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_writer_write(struct bootable_writer *writer,
+                          const void *data,
+                          bootable_uint64 size);
+
+/** Writes a little endian 64-bit integer.
+ * @param writer An initialized writer.
+ * @param n The integer to write.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_writer_uint64(struct bootable_writer *writer, bootable_uint64 n);
+
+/** Writes the buffered data to the stream. This
+ * has to be done before the stream is used directly.
+ * @param writer An initialized writer.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_writer_flush(struct bootable_writer *writer);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_WRITER_H */
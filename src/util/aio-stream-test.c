@@ -0,0 +1,219 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "aio-stream.h"
+#include "sysio.h"
+
+#include <bootable/core/error.h>
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** The size of the file that is written. This
+ * is a few times the size of a single request,
+ * so that writes span and merge requests. */
+
+#define TEST_FILE_SIZE (4 * 1024 * 1024)
+
+/** The size of the file that data is copied from. */
+
+#define TEST_SOURCE_SIZE (3 * 1024 * 1024)
+
+/** The number of operations done on each stream. */
+
+#define TEST_STEPS 1000
+
+/** A small random number generator, so that
+ * every run does the same operations. */
+
+static unsigned int test_seed = 1;
+
+static unsigned int test_rand(void) {
+	test_seed = (test_seed * 1103515245u) + 12345u;
+	return (test_seed >> 8) & 0xffffff;
+}
+
+/** Picks a size. Most writes are small, like
+ * the ones made by the file system, and the rest
+ * are large enough to fill several requests. */
+
+static bootable_uint64 test_size(bootable_uint64 max) {
+
+	bootable_uint64 size;
+
+	switch (test_rand() % 4) {
+	case 0:
+		size = (test_rand() % (1536 * 1024)) + 1;
+		break;
+	case 1:
+		size = (test_rand() % 65536) + 1;
+		break;
+	default:
+		size = (test_rand() % 512) + 1;
+		break;
+	}
+
+	if (size > max)
+		size = max;
+
+	return size;
+}
+
+static int make_temp_file(char *path) {
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	return fd;
+}
+
+/** Does random writes, reads and copies on
+ * a stream and checks them against a copy of
+ * the file that is kept in memory. */
+
+static void test_random(bootable_bool allow_io_uring, unsigned int queue_depth) {
+
+	struct bootable_aio_stream stream;
+	char path[] = "/tmp/bootable-aio-test-XXXXXX";
+	char source_path[] = "/tmp/bootable-aio-source-XXXXXX";
+	unsigned char *model;
+	unsigned char *source;
+	unsigned char *buf;
+	int source_fd;
+	int fd;
+
+	model = calloc(1, TEST_FILE_SIZE);
+	source = malloc(TEST_SOURCE_SIZE);
+	buf = malloc(TEST_FILE_SIZE);
+	assert((model != NULL) && (source != NULL) && (buf != NULL));
+
+	for (bootable_uint64 i = 0; i < TEST_SOURCE_SIZE; i++)
+		source[i] = (unsigned char) test_rand();
+
+	source_fd = make_temp_file(source_path);
+	assert(bootable_pwrite_all(source_fd, source, TEST_SOURCE_SIZE, 0) == 0);
+
+	fd = make_temp_file(path);
+	close(fd);
+
+	bootable_aio_stream_init(&stream);
+	stream.allow_io_uring = allow_io_uring;
+	assert(bootable_aio_stream_open(&stream, path, O_RDWR, queue_depth) == 0);
+	assert(stream.queue_depth == queue_depth);
+	if (!allow_io_uring)
+		assert(!bootable_aio_stream_uses_io_uring(&stream));
+
+	/* Reads of regions that were never
+	 * written return zeros, as in the model. */
+	assert(bootable_aio_stream_resize(&stream, TEST_FILE_SIZE) == 0);
+
+	for (unsigned int step = 0; step < TEST_STEPS; step++) {
+
+		bootable_uint64 pos = test_rand() % TEST_FILE_SIZE;
+		bootable_uint64 size = test_size(TEST_FILE_SIZE - pos);
+		unsigned int op = test_rand() % 8;
+
+		if (op < 4) {
+			for (bootable_uint64 i = 0; i < size; i++)
+				buf[i] = (unsigned char) test_rand();
+			assert(bootable_stream_write_at(&stream.base, pos, buf, size) == 0);
+			memcpy(&model[pos], buf, size);
+		} else if (op < 7) {
+			assert(bootable_stream_read_at(&stream.base, pos, buf, size) == 0);
+			assert(memcmp(&model[pos], buf, size) == 0);
+		} else {
+			bootable_uint64 source_pos = test_rand() % TEST_SOURCE_SIZE;
+			if (size > (TEST_SOURCE_SIZE - source_pos))
+				size = TEST_SOURCE_SIZE - source_pos;
+			assert(bootable_stream_copy_from_fd(&stream.base, pos, source_fd, source_pos, size) == 0);
+			memcpy(&model[pos], &source[source_pos], size);
+		}
+	}
+
+	assert(bootable_aio_stream_barrier(&stream) == 0);
+	assert(stream.request_count == 0);
+
+	fd = open(path, O_RDONLY);
+	assert(fd >= 0);
+	assert(bootable_pread_all(fd, buf, TEST_FILE_SIZE, 0) == 0);
+	assert(memcmp(model, buf, TEST_FILE_SIZE) == 0);
+	close(fd);
+
+	bootable_aio_stream_done(&stream);
+
+	close(source_fd);
+	unlink(source_path);
+	unlink(path);
+	free(buf);
+	free(source);
+	free(model);
+}
+
+/** Copies from a file that ends before the
+ * range does. The error is reported by the copy,
+ * and the stream can still be used afterwards. */
+
+static void test_short_source(void) {
+
+	struct bootable_aio_stream stream;
+	char path[] = "/tmp/bootable-aio-test-XXXXXX";
+	char source_path[] = "/tmp/bootable-aio-source-XXXXXX";
+	unsigned char data[16];
+	int source_fd;
+	int fd;
+
+	memset(data, 0x5a, sizeof(data));
+
+	source_fd = make_temp_file(source_path);
+	assert(bootable_pwrite_all(source_fd, data, sizeof(data), 0) == 0);
+
+	fd = make_temp_file(path);
+	close(fd);
+
+	bootable_aio_stream_init(&stream);
+	assert(bootable_aio_stream_open(&stream, path, O_RDWR, 0) == 0);
+
+	assert(bootable_stream_copy_from_fd(&stream.base, 0, source_fd, 0, 32) == BOOTABLE_EIO);
+	assert(bootable_stream_copy_from_fd(&stream.base, 0, source_fd, 0, 16) == 0);
+	assert(bootable_aio_stream_barrier(&stream) == 0);
+
+	memset(data, 0, sizeof(data));
+	assert(bootable_stream_read_at(&stream.base, 0, data, sizeof(data)) == 0);
+	assert((data[0] == 0x5a) && (data[15] == 0x5a));
+
+	bootable_aio_stream_done(&stream);
+
+	close(source_fd);
+	unlink(source_path);
+	unlink(path);
+}
+
+int main(void) {
+
+	static const unsigned int queue_depths[] = { 1, 4, 32 };
+
+	for (unsigned int i = 0; i < (sizeof(queue_depths) / sizeof(queue_depths[0])); i++) {
+		test_random(bootable_true, queue_depths[i]);
+		test_random(bootable_false, queue_depths[i]);
+	}
+
+	test_short_source();
+
+	return EXIT_SUCCESS;
+}
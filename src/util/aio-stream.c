@@ -0,0 +1,1061 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "aio-stream.h"
+#include "sysio.h"
+
+#include <bootable/core/error.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef BOOTABLE_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define AIO_USE_IO_URING 1
+#endif
+#endif
+
+#ifndef NULL
+#define NULL ((void *) 0x00)
+#endif
+
+/** The number of bytes collected
+ * into a single request. */
+
+#ifndef BOOTABLE_AIO_REQUEST_SIZE
+#define BOOTABLE_AIO_REQUEST_SIZE (1024 * 1024)
+#endif
+
+/** The largest number of threads used
+ * when io_uring is not available. */
+
+#ifndef BOOTABLE_AIO_THREAD_COUNT
+#define BOOTABLE_AIO_THREAD_COUNT 4
+#endif
+
+/** The largest queue depth that is accepted. */
+
+#ifndef BOOTABLE_AIO_QUEUE_DEPTH_MAX
+#define BOOTABLE_AIO_QUEUE_DEPTH_MAX 4096
+#endif
+
+struct bootable_aio_request {
+	/** The next request in flight. */
+	struct bootable_aio_request *next;
+	/** The next request in the queue
+	 * of the thread pool, or in a list
+	 * of completed requests. */
+	struct bootable_aio_request *queue_next;
+	/** The offset to write the data to. */
+	bootable_uint64 offset;
+	/** The data to write. This is owned
+	 * by the request. */
+	unsigned char *data;
+	/** The number of bytes to write. */
+	bootable_uint64 size;
+	/** The vector passed to io_uring. */
+	struct iovec iov;
+	/** The result of the write. */
+	int err;
+};
+
+struct bootable_aio_engine {
+	/** The file descriptor being written to. */
+	int fd;
+	/** Whether or not the requests are
+	 * queued on io_uring. */
+	bootable_bool uses_io_uring;
+#ifdef AIO_USE_IO_URING
+	int ring_fd;
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+#endif
+	pthread_t threads[BOOTABLE_AIO_THREAD_COUNT];
+	unsigned int thread_count;
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	struct bootable_aio_request *queue_head;
+	struct bootable_aio_request *queue_tail;
+	struct bootable_aio_request *completed;
+	bootable_bool stopping;
+};
+
+/* * * * * * * * * * * *
+ * io_uring engine
+ * * * * * * * * * * * */
+
+#ifdef AIO_USE_IO_URING
+
+static int uring_enter(int ring_fd,
+                       unsigned int to_submit,
+                       unsigned int min_complete,
+                       unsigned int flags) {
+
+	for (;;) {
+		long int ret = syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+		if (ret >= 0)
+			return 0;
+		else if (errno != EINTR)
+			return bootable_error_from_errno(errno);
+	}
+}
+
+static void uring_unmap(struct bootable_aio_engine *engine) {
+
+	if (engine->sqes != NULL)
+		munmap(engine->sqes, engine->sqes_size);
+
+	if ((engine->cq_ring != NULL) && (engine->cq_ring != engine->sq_ring))
+		munmap(engine->cq_ring, engine->cq_ring_size);
+
+	if (engine->sq_ring != NULL)
+		munmap(engine->sq_ring, engine->sq_ring_size);
+
+	close(engine->ring_fd);
+}
+
+static int uring_setup(struct bootable_aio_engine *engine, unsigned int entries) {
+
+	struct io_uring_params params;
+
+	memset(&params, 0, sizeof(params));
+
+	int ring_fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+	if (ring_fd < 0)
+		return bootable_error_from_errno(errno);
+
+	engine->ring_fd = ring_fd;
+	engine->sq_ring = NULL;
+	engine->cq_ring = NULL;
+	engine->sqes = NULL;
+
+	engine->sq_ring_size = params.sq_off.array + (params.sq_entries * sizeof(unsigned int));
+	engine->cq_ring_size = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+	engine->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	bootable_bool single_mmap = bootable_false;
+
+#ifdef IORING_FEAT_SINGLE_MMAP
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (engine->cq_ring_size > engine->sq_ring_size)
+			engine->sq_ring_size = engine->cq_ring_size;
+		engine->cq_ring_size = engine->sq_ring_size;
+		single_mmap = bootable_true;
+	}
+#endif
+
+	void *sq_ring = mmap(NULL, engine->sq_ring_size, PROT_READ | PROT_WRITE,
+	                     MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	if (sq_ring == MAP_FAILED) {
+		uring_unmap(engine);
+		return BOOTABLE_ENOMEM;
+	}
+
+	engine->sq_ring = sq_ring;
+
+	if (single_mmap) {
+		engine->cq_ring = sq_ring;
+	} else {
+		void *cq_ring = mmap(NULL, engine->cq_ring_size, PROT_READ | PROT_WRITE,
+		                     MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+		if (cq_ring == MAP_FAILED) {
+			uring_unmap(engine);
+			return BOOTABLE_ENOMEM;
+		}
+		engine->cq_ring = cq_ring;
+	}
+
+	void *sqes = mmap(NULL, engine->sqes_size, PROT_READ | PROT_WRITE,
+	                  MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		uring_unmap(engine);
+		return BOOTABLE_ENOMEM;
+	}
+
+	engine->sqes = (struct io_uring_sqe *) sqes;
+
+	unsigned char *sq = (unsigned char *) engine->sq_ring;
+	unsigned char *cq = (unsigned char *) engine->cq_ring;
+
+	engine->sq_head = (unsigned int *) (sq + params.sq_off.head);
+	engine->sq_tail = (unsigned int *) (sq + params.sq_off.tail);
+	engine->sq_mask = (unsigned int *) (sq + params.sq_off.ring_mask);
+	engine->sq_array = (unsigned int *) (sq + params.sq_off.array);
+	engine->cq_head = (unsigned int *) (cq + params.cq_off.head);
+	engine->cq_tail = (unsigned int *) (cq + params.cq_off.tail);
+	engine->cq_mask = (unsigned int *) (cq + params.cq_off.ring_mask);
+	engine->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+	return 0;
+}
+
+static int uring_submit(struct bootable_aio_engine *engine,
+                        struct bootable_aio_request *request) {
+
+	/* Only this thread moves the tail,
+	 * so it may be read without ordering. */
+
+	unsigned int tail = *engine->sq_tail;
+	unsigned int index = tail & *engine->sq_mask;
+
+	struct io_uring_sqe *sqe = &engine->sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = engine->fd;
+	sqe->off = request->offset;
+	sqe->addr = (unsigned long int) &request->iov;
+	sqe->len = 1;
+	sqe->user_data = (unsigned long int) request;
+
+	engine->sq_array[index] = index;
+
+	__atomic_store_n(engine->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	int err = uring_enter(engine->ring_fd, 1, 0, 0);
+	if (err == 0)
+		return 0;
+
+	/* The caller frees a request that failed to
+	 * submit, so an entry that the kernel did not
+	 * take is withdrawn. One that it did take is
+	 * reported when it completes, like any other. */
+
+	if (__atomic_load_n(engine->sq_head, __ATOMIC_ACQUIRE) != tail)
+		return 0;
+
+	__atomic_store_n(engine->sq_tail, tail, __ATOMIC_RELEASE);
+
+	return err;
+}
+
+static int uring_reap(struct bootable_aio_engine *engine,
+                      bootable_bool wait,
+                      struct bootable_aio_request **completed) {
+
+	unsigned int head = *engine->cq_head;
+
+	for (;;) {
+
+		unsigned int tail = __atomic_load_n(engine->cq_tail, __ATOMIC_ACQUIRE);
+
+		while (head != tail) {
+
+			struct io_uring_cqe *cqe = &engine->cqes[head & *engine->cq_mask];
+
+			struct bootable_aio_request *request = (struct bootable_aio_request *) (uintptr_t) cqe->user_data;
+
+			if (cqe->res < 0) {
+				request->err = bootable_error_from_errno(-cqe->res);
+			} else if (((bootable_uint64) cqe->res) < request->size) {
+				/* finish a short write in place */
+				bootable_uint64 written = (bootable_uint64) cqe->res;
+				request->err = bootable_pwrite_all(engine->fd,
+				                                   request->data + written,
+				                                   request->size - written,
+				                                   request->offset + written);
+			} else {
+				request->err = 0;
+			}
+
+			request->queue_next = *completed;
+			*completed = request;
+
+			head++;
+		}
+
+		__atomic_store_n(engine->cq_head, head, __ATOMIC_RELEASE);
+
+		if ((*completed != NULL) || !wait)
+			break;
+
+		int err = uring_enter(engine->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+		if (err != 0)
+			return err;
+	}
+
+	return 0;
+}
+
+#endif /* AIO_USE_IO_URING */
+
+/* * * * * * * * * * * *
+ * Thread pool engine
+ * * * * * * * * * * * */
+
+static void *worker_main(void *engine_ptr) {
+
+	struct bootable_aio_engine *engine = (struct bootable_aio_engine *) engine_ptr;
+
+	pthread_mutex_lock(&engine->lock);
+
+	for (;;) {
+
+		while ((engine->queue_head == NULL) && !engine->stopping)
+			pthread_cond_wait(&engine->work_cond, &engine->lock);
+
+		struct bootable_aio_request *request = engine->queue_head;
+		if (request == NULL)
+			break;
+
+		engine->queue_head = request->queue_next;
+		if (engine->queue_head == NULL)
+			engine->queue_tail = NULL;
+
+		pthread_mutex_unlock(&engine->lock);
+
+		request->err = bootable_pwrite_all(engine->fd, request->data, request->size, request->offset);
+
+		pthread_mutex_lock(&engine->lock);
+
+		request->queue_next = engine->completed;
+		engine->completed = request;
+
+		pthread_cond_signal(&engine->done_cond);
+	}
+
+	pthread_mutex_unlock(&engine->lock);
+
+	return NULL;
+}
+
+static int threads_setup(struct bootable_aio_engine *engine, unsigned int queue_depth) {
+
+	engine->thread_count = 0;
+	engine->queue_head = NULL;
+	engine->queue_tail = NULL;
+	engine->completed = NULL;
+	engine->stopping = bootable_false;
+
+	unsigned int thread_count = queue_depth;
+	if (thread_count > BOOTABLE_AIO_THREAD_COUNT)
+		thread_count = BOOTABLE_AIO_THREAD_COUNT;
+
+	for (unsigned int i = 0; i < thread_count; i++) {
+		if (pthread_create(&engine->threads[i], NULL, worker_main, engine) != 0)
+			break;
+		engine->thread_count++;
+	}
+
+	if (engine->thread_count == 0)
+		return BOOTABLE_ENOMEM;
+
+	return 0;
+}
+
+static void threads_stop(struct bootable_aio_engine *engine) {
+
+	pthread_mutex_lock(&engine->lock);
+	engine->stopping = bootable_true;
+	pthread_cond_broadcast(&engine->work_cond);
+	pthread_mutex_unlock(&engine->lock);
+
+	for (unsigned int i = 0; i < engine->thread_count; i++)
+		pthread_join(engine->threads[i], NULL);
+
+	engine->thread_count = 0;
+}
+
+static int threads_submit(struct bootable_aio_engine *engine,
+                          struct bootable_aio_request *request) {
+
+	request->queue_next = NULL;
+
+	pthread_mutex_lock(&engine->lock);
+
+	if (engine->queue_tail == NULL)
+		engine->queue_head = request;
+	else
+		engine->queue_tail->queue_next = request;
+
+	engine->queue_tail = request;
+
+	pthread_cond_signal(&engine->work_cond);
+
+	pthread_mutex_unlock(&engine->lock);
+
+	return 0;
+}
+
+static int threads_reap(struct bootable_aio_engine *engine,
+                        bootable_bool wait,
+                        struct bootable_aio_request **completed) {
+
+	pthread_mutex_lock(&engine->lock);
+
+	while ((engine->completed == NULL) && wait)
+		pthread_cond_wait(&engine->done_cond, &engine->lock);
+
+	*completed = engine->completed;
+
+	engine->completed = NULL;
+
+	pthread_mutex_unlock(&engine->lock);
+
+	return 0;
+}
+
+/* * * * * * * * * * * *
+ * Engine selection
+ * * * * * * * * * * * */
+
+static struct bootable_aio_engine *engine_create(int fd,
+                                                 unsigned int queue_depth,
+                                                 bootable_bool allow_io_uring) {
+
+	struct bootable_aio_engine *engine = malloc(sizeof(*engine));
+	if (engine == NULL)
+		return NULL;
+
+	engine->fd = fd;
+	engine->uses_io_uring = bootable_false;
+	engine->thread_count = 0;
+
+	pthread_mutex_init(&engine->lock, NULL);
+	pthread_cond_init(&engine->work_cond, NULL);
+	pthread_cond_init(&engine->done_cond, NULL);
+
+#ifdef AIO_USE_IO_URING
+	if (allow_io_uring && (uring_setup(engine, queue_depth) == 0)) {
+		engine->uses_io_uring = bootable_true;
+		return engine;
+	}
+#endif
+
+	if (threads_setup(engine, queue_depth) != 0) {
+		pthread_cond_destroy(&engine->done_cond);
+		pthread_cond_destroy(&engine->work_cond);
+		pthread_mutex_destroy(&engine->lock);
+		free(engine);
+		return NULL;
+	}
+
+	return engine;
+}
+
+static void engine_free(struct bootable_aio_engine *engine) {
+
+#ifdef AIO_USE_IO_URING
+	if (engine->uses_io_uring)
+		uring_unmap(engine);
+#endif
+
+	threads_stop(engine);
+
+	pthread_cond_destroy(&engine->done_cond);
+	pthread_cond_destroy(&engine->work_cond);
+	pthread_mutex_destroy(&engine->lock);
+
+	free(engine);
+}
+
+static int engine_submit(struct bootable_aio_engine *engine,
+                         struct bootable_aio_request *request) {
+
+#ifdef AIO_USE_IO_URING
+	if (engine->uses_io_uring)
+		return uring_submit(engine, request);
+#endif
+
+	return threads_submit(engine, request);
+}
+
+static int engine_reap(struct bootable_aio_engine *engine,
+                       bootable_bool wait,
+                       struct bootable_aio_request **completed) {
+
+	*completed = NULL;
+
+#ifdef AIO_USE_IO_URING
+	if (engine->uses_io_uring)
+		return uring_reap(engine, wait, completed);
+#endif
+
+	return threads_reap(engine, wait, completed);
+}
+
+/* * * * * * * * * * * *
+ * Request management
+ * * * * * * * * * * * */
+
+static void finish_requests(struct bootable_aio_stream *stream,
+                            struct bootable_aio_request *completed) {
+
+	while (completed != NULL) {
+
+		struct bootable_aio_request *request = completed;
+
+		completed = request->queue_next;
+
+		struct bootable_aio_request **link = &stream->requests;
+
+		while (*link != NULL) {
+			if (*link == request) {
+				*link = request->next;
+				break;
+			}
+			link = &(*link)->next;
+		}
+
+		stream->request_count--;
+
+		if ((request->err != 0) && (stream->error == 0))
+			stream->error = request->err;
+
+		free(request->data);
+		free(request);
+	}
+}
+
+static int reap_requests(struct bootable_aio_stream *stream, bootable_bool wait) {
+
+	struct bootable_aio_request *completed = NULL;
+
+	int err = engine_reap(stream->engine, wait, &completed);
+
+	finish_requests(stream, completed);
+
+	return err;
+}
+
+static int drain_requests(struct bootable_aio_stream *stream) {
+
+	while (stream->request_count > 0) {
+		int err = reap_requests(stream, bootable_true);
+		if (err != 0)
+			return err;
+	}
+
+	return 0;
+}
+
+static bootable_bool overlaps_request(const struct bootable_aio_stream *stream,
+                                      bootable_uint64 offset,
+                                      bootable_uint64 size) {
+
+	const struct bootable_aio_request *request = stream->requests;
+
+	while (request != NULL) {
+		if ((offset < (request->offset + request->size))
+		 && ((offset + size) > request->offset))
+			return bootable_true;
+		request = request->next;
+	}
+
+	return bootable_false;
+}
+
+/* Queues a write. The data is owned by the
+ * request afterwards, even if this fails. */
+
+static int submit_request(struct bootable_aio_stream *stream,
+                          unsigned char *data,
+                          bootable_uint64 size,
+                          bootable_uint64 offset) {
+
+	struct bootable_aio_request *request = malloc(sizeof(*request));
+	if (request == NULL) {
+		free(data);
+		return BOOTABLE_ENOMEM;
+	}
+
+	request->next = NULL;
+	request->queue_next = NULL;
+	request->offset = offset;
+	request->data = data;
+	request->size = size;
+	request->iov.iov_base = data;
+	request->iov.iov_len = (size_t) size;
+	request->err = 0;
+
+	/* Writes to overlapping ranges may complete in any
+	 * order, so the earlier ones have to finish first. */
+
+	int err = 0;
+
+	while ((err == 0) && overlaps_request(stream, offset, size))
+		err = reap_requests(stream, bootable_true);
+
+	while ((err == 0) && (stream->request_count >= stream->queue_depth))
+		err = reap_requests(stream, bootable_true);
+
+	if (err == 0)
+		err = engine_submit(stream->engine, request);
+
+	if (err != 0) {
+		free(data);
+		free(request);
+		return err;
+	}
+
+	request->next = stream->requests;
+	stream->requests = request;
+	stream->request_count++;
+
+	/* pick up whatever finished already */
+
+	return reap_requests(stream, bootable_false);
+}
+
+static int submit_buffer(struct bootable_aio_stream *stream) {
+
+	if ((stream->buf == NULL) || (stream->buf_size == 0))
+		return 0;
+
+	unsigned char *data = stream->buf;
+
+	stream->buf = NULL;
+
+	bootable_uint64 size = stream->buf_size;
+
+	stream->buf_size = 0;
+
+	return submit_request(stream, data, size, stream->buf_offset);
+}
+
+/* Waits for the requests that overlap a range
+ * of the file. Data that is still being collected
+ * for that range is submitted first, so that it
+ * is in the file once this returns. */
+
+static int wait_for_range(struct bootable_aio_stream *stream,
+                          bootable_uint64 offset,
+                          bootable_uint64 size) {
+
+	int err = 0;
+
+	if ((stream->buf != NULL)
+	 && (offset < (stream->buf_offset + stream->buf_size))
+	 && ((offset + size) > stream->buf_offset))
+		err = submit_buffer(stream);
+
+	while ((err == 0) && overlaps_request(stream, offset, size))
+		err = reap_requests(stream, bootable_true);
+
+	return err;
+}
+
+/* * * * * * * * * * * *
+ * Stream callbacks
+ * * * * * * * * * * * */
+
+static int aio_stream_write_at(void *stream_ptr,
+                               bootable_uint64 pos,
+                               const void *buf,
+                               bootable_uint64 buf_size) {
+
+	struct bootable_aio_stream *stream = (struct bootable_aio_stream *) stream_ptr;
+	if ((stream == NULL) || (stream->fd < 0))
+		return BOOTABLE_EFAULT;
+
+	if ((pos > LLONG_MAX) || (buf_size > (LLONG_MAX - pos)))
+		return BOOTABLE_EINVAL;
+
+	const unsigned char *buf8 = (const unsigned char *) buf;
+
+	while (buf_size > 0) {
+
+		/* Merge the data into the request being collected,
+		 * if it starts within it or right after it. */
+
+		if ((stream->buf != NULL)
+		 && (pos >= stream->buf_offset)
+		 && (pos <= (stream->buf_offset + stream->buf_size))
+		 && ((pos - stream->buf_offset) < BOOTABLE_AIO_REQUEST_SIZE)) {
+
+			bootable_uint64 buf_pos = pos - stream->buf_offset;
+
+			bootable_uint64 copy_size = BOOTABLE_AIO_REQUEST_SIZE - buf_pos;
+			if (copy_size > buf_size)
+				copy_size = buf_size;
+
+			memcpy(&stream->buf[buf_pos], buf8, copy_size);
+
+			if ((buf_pos + copy_size) > stream->buf_size)
+				stream->buf_size = buf_pos + copy_size;
+
+			buf8 += copy_size;
+			buf_size -= copy_size;
+			pos += copy_size;
+
+			if (stream->buf_size == BOOTABLE_AIO_REQUEST_SIZE) {
+				int err = submit_buffer(stream);
+				if (err != 0)
+					return err;
+			}
+
+			continue;
+		}
+
+		int err = submit_buffer(stream);
+		if (err != 0)
+			return err;
+
+		if (stream->buf == NULL) {
+			stream->buf = malloc(BOOTABLE_AIO_REQUEST_SIZE);
+			if (stream->buf == NULL)
+				return BOOTABLE_ENOMEM;
+		}
+
+		stream->buf_offset = pos;
+		stream->buf_size = 0;
+	}
+
+	return 0;
+}
+
+static int aio_stream_read_at(void *stream_ptr,
+                              bootable_uint64 pos,
+                              void *buf,
+                              bootable_uint64 buf_size) {
+
+	struct bootable_aio_stream *stream = (struct bootable_aio_stream *) stream_ptr;
+	if ((stream == NULL) || (stream->fd < 0))
+		return BOOTABLE_EFAULT;
+
+	if ((pos > LLONG_MAX) || (buf_size > (LLONG_MAX - pos)))
+		return BOOTABLE_EINVAL;
+
+	/* Only the writes to the range
+	 * that is read have to land first. */
+
+	int err = wait_for_range(stream, pos, buf_size);
+	if (err != 0)
+		return err;
+
+	/* A failed write may have been to this range.
+	 * The error is kept for the next barrier. */
+
+	if (stream->error != 0)
+		return stream->error;
+
+	return bootable_pread_all(stream->fd, buf, buf_size, pos);
+}
+
+static int aio_stream_copy_from_fd(void *stream_ptr,
+                                   bootable_uint64 pos,
+                                   int fd,
+                                   bootable_uint64 fd_offset,
+                                   bootable_uint64 size) {
+
+	struct bootable_aio_stream *stream = (struct bootable_aio_stream *) stream_ptr;
+	if ((stream == NULL) || (stream->fd < 0))
+		return BOOTABLE_EFAULT;
+
+	if ((pos > LLONG_MAX) || (size > (LLONG_MAX - pos)))
+		return BOOTABLE_EINVAL;
+
+	/* Data collected for the range has to be queued
+	 * before the copy, so that it does not overwrite
+	 * the copied data when it is submitted later. */
+
+	int err = wait_for_range(stream, pos, size);
+	if (err != 0)
+		return err;
+
+	/* The data is read in pieces and queued like
+	 * any other write, so that the file is read
+	 * while the previous pieces are written. */
+
+	while (size > 0) {
+
+		bootable_uint64 piece = size;
+		if (piece > BOOTABLE_AIO_REQUEST_SIZE)
+			piece = BOOTABLE_AIO_REQUEST_SIZE;
+
+		unsigned char *data = malloc(piece);
+		if (data == NULL)
+			return BOOTABLE_ENOMEM;
+
+		err = bootable_pread_all(fd, data, piece, fd_offset);
+		if (err != 0) {
+			free(data);
+			return err;
+		}
+
+		err = submit_request(stream, data, piece, pos);
+		if (err != 0)
+			return err;
+
+		pos += piece;
+		fd_offset += piece;
+		size -= piece;
+	}
+
+	return 0;
+}
+
+static int aio_stream_read(void *stream_ptr, void *buf, bootable_uint64 buf_size) {
+
+	struct bootable_aio_stream *stream = (struct bootable_aio_stream *) stream_ptr;
+	if (stream == NULL)
+		return BOOTABLE_EFAULT;
+
+	int err = aio_stream_read_at(stream, stream->pos, buf, buf_size);
+	if (err != 0)
+		return err;
+
+	stream->pos += buf_size;
+
+	return 0;
+}
+
+static int aio_stream_write(void *stream_ptr, const void *buf, bootable_uint64 buf_size) {
+
+	struct bootable_aio_stream *stream = (struct bootable_aio_stream *) stream_ptr;
+	if (stream == NULL)
+		return BOOTABLE_EFAULT;
+
+	int err = aio_stream_write_at(stream, stream->pos, buf, buf_size);
+	if (err != 0)
+		return err;
+
+	stream->pos += buf_size;
+
+	return 0;
+}
+
+static int aio_stream_set_pos(void *stream_ptr, bootable_uint64 pos) {
+
+	struct bootable_aio_stream *stream = (struct bootable_aio_stream *) stream_ptr;
+	if (stream == NULL)
+		return BOOTABLE_EFAULT;
+
+	if (pos > LLONG_MAX)
+		return BOOTABLE_EINVAL;
+
+	stream->pos = pos;
+
+	return 0;
+}
+
+static int aio_stream_get_pos(void *stream_ptr, bootable_uint64 *pos) {
+
+	struct bootable_aio_stream *stream = (struct bootable_aio_stream *) stream_ptr;
+	if (stream == NULL)
+		return BOOTABLE_EFAULT;
+
+	if (pos != NULL)
+		*pos = stream->pos;
+
+	return 0;
+}
+
+static int aio_stream_get_size(void *stream_ptr, bootable_uint64 *size) {
+
+	struct bootable_aio_stream *stream = (struct bootable_aio_stream *) stream_ptr;
+	if ((stream == NULL) || (stream->fd < 0))
+		return BOOTABLE_EFAULT;
+
+	int err = bootable_aio_stream_barrier(stream);
+	if (err != 0)
+		return err;
+
+	struct stat st;
+
+	if (fstat(stream->fd, &st) != 0)
+		return bootable_error_from_errno(errno);
+
+	if (size != NULL)
+		*size = (bootable_uint64) st.st_size;
+
+	return 0;
+}
+
+void bootable_aio_stream_init(struct bootable_aio_stream *stream) {
+	bootable_stream_init(&stream->base);
+	stream->base.data = stream;
+	stream->base.set_pos = aio_stream_set_pos;
+	stream->base.get_pos = aio_stream_get_pos;
+	stream->base.get_size = aio_stream_get_size;
+	stream->base.read = aio_stream_read;
+	stream->base.write = aio_stream_write;
+	stream->base.read_at = aio_stream_read_at;
+	stream->base.write_at = aio_stream_write_at;
+	stream->base.copy_from_fd = aio_stream_copy_from_fd;
+	stream->fd = -1;
+	stream->pos = 0;
+	stream->queue_depth = BOOTABLE_AIO_QUEUE_DEPTH;
+	stream->buf = NULL;
+	stream->buf_size = 0;
+	stream->buf_offset = 0;
+	stream->requests = NULL;
+	stream->request_count = 0;
+	stream->error = 0;
+	stream->engine = NULL;
+	stream->allow_io_uring = bootable_true;
+}
+
+void bootable_aio_stream_done(struct bootable_aio_stream *stream) {
+
+	if (stream->fd >= 0) {
+		bootable_aio_stream_barrier(stream);
+		engine_free(stream->engine);
+		stream->engine = NULL;
+		close(stream->fd);
+		stream->fd = -1;
+	}
+
+	free(stream->buf);
+	stream->buf = NULL;
+	stream->buf_size = 0;
+}
+
+int bootable_aio_stream_open(struct bootable_aio_stream *stream,
+                             const char *path,
+                             int flags,
+                             unsigned int queue_depth) {
+
+	if (queue_depth == 0)
+		queue_depth = BOOTABLE_AIO_QUEUE_DEPTH;
+	else if (queue_depth > BOOTABLE_AIO_QUEUE_DEPTH_MAX)
+		queue_depth = BOOTABLE_AIO_QUEUE_DEPTH_MAX;
+
+	int fd = open(path, flags, 0644);
+	if (fd < 0)
+		return bootable_error_from_errno(errno);
+
+	struct bootable_aio_engine *engine = engine_create(fd, queue_depth, stream->allow_io_uring);
+	if (engine == NULL) {
+		close(fd);
+		return BOOTABLE_ENOMEM;
+	}
+
+	bootable_aio_stream_done(stream);
+
+	stream->fd = fd;
+	stream->pos = 0;
+	stream->queue_depth = queue_depth;
+	stream->error = 0;
+	stream->engine = engine;
+
+	return 0;
+}
+
+int bootable_aio_stream_barrier(struct bootable_aio_stream *stream) {
+
+	if (stream->fd < 0)
+		return 0;
+
+	int err = submit_buffer(stream);
+
+	int drain_err = drain_requests(stream);
+
+	if (err == 0)
+		err = drain_err;
+
+	if (err == 0)
+		err = stream->error;
+
+	stream->error = 0;
+
+	return err;
+}
+
+int bootable_aio_stream_resize(struct bootable_aio_stream *stream,
+                               bootable_uint64 size) {
+
+	if (stream->fd < 0)
+		return BOOTABLE_EFAULT;
+
+	if (size > LLONG_MAX)
+		return BOOTABLE_EINVAL;
+
+	int err = bootable_aio_stream_barrier(stream);
+	if (err != 0)
+		return err;
+
+	if (ftruncate(stream->fd, (off_t) size) != 0)
+		return bootable_error_from_errno(errno);
+
+	return 0;
+}
+
+int bootable_aio_stream_allocate(struct bootable_aio_stream *stream,
+                                 bootable_uint64 offset,
+                                 bootable_uint64 size) {
+
+	if (stream->fd < 0)
+		return BOOTABLE_EFAULT;
+
+	if ((offset > LLONG_MAX) || (size > (LLONG_MAX - offset)))
+		return BOOTABLE_EINVAL;
+
+	if (size == 0)
+		return 0;
+
+	int err = bootable_aio_stream_barrier(stream);
+	if (err != 0)
+		return err;
+
+	/* This returns the error code
+	 * instead of setting errno. */
+
+	err = posix_fallocate(stream->fd, (off_t) offset, (off_t) size);
+	if (err != 0)
+		return bootable_error_from_errno(err);
+
+	return 0;
+}
+
+int bootable_aio_stream_advise_sequential(struct bootable_aio_stream *stream) {
+
+	if (stream->fd < 0)
+		return BOOTABLE_EFAULT;
+
+	/* This returns the error code
+	 * instead of setting errno. */
+
+	int err = posix_fadvise(stream->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	if (err != 0)
+		return bootable_error_from_errno(err);
+
+	return 0;
+}
+
+bootable_bool bootable_aio_stream_uses_io_uring(const struct bootable_aio_stream *stream) {
+
+	if (stream->engine == NULL)
+		return bootable_false;
+
+	return stream->engine->uses_io_uring;
+}
@@ -0,0 +1,171 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOOTABLE_AIO_STREAM_H
+#define BOOTABLE_AIO_STREAM_H
+
+#include <bootable/core/stream.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The default number of writes that
+ * may be in flight at the same time.
+ * */
+
+#ifndef BOOTABLE_AIO_QUEUE_DEPTH
+#define BOOTABLE_AIO_QUEUE_DEPTH 32
+#endif
+
+struct bootable_aio_engine;
+struct bootable_aio_request;
+
+/** This structure represents a stream that
+ * writes to a file asynchronously. Contiguous
+ * writes are collected into large requests, which
+ * are queued on io_uring when the kernel supports
+ * it or on a pool of threads when it does not.
+ * Reads wait for the queued writes that overlap
+ * them to finish first, so they always see the
+ * written data.
+ * */
+
+struct bootable_aio_stream {
+	/** The base stream structure */
+	struct bootable_stream base;
+	/** The file descriptor of the stream.
+	 * If no file is open, this is negative. */
+	int fd;
+	/** The position of the next sequential
+	 * read or write operation. */
+	bootable_uint64 pos;
+	/** The maximum number of requests
+	 * that may be in flight. */
+	unsigned int queue_depth;
+	/** The buffer collecting the data
+	 * of the next request. */
+	unsigned char *buf;
+	/** The number of bytes in the buffer. */
+	bootable_uint64 buf_size;
+	/** The file offset of the first
+	 * byte in the buffer. */
+	bootable_uint64 buf_offset;
+	/** The requests that are in flight. */
+	struct bootable_aio_request *requests;
+	/** The number of requests in flight. */
+	unsigned int request_count;
+	/** The first error reported by a
+	 * request that completed. */
+	int error;
+	/** The engine executing the requests. */
+	struct bootable_aio_engine *engine;
+	/** Whether or not io_uring may be used when
+	 * the kernel supports it. If this is false, the
+	 * pool of threads is used. This is read when a
+	 * file is opened, and is true by default. */
+	bootable_bool allow_io_uring;
+};
+
+/** Initializes an asynchronous stream structure.
+ * @param stream The structure to initialize.
+ * */
+
+void bootable_aio_stream_init(struct bootable_aio_stream *stream);
+
+/** Waits for all requests to finish and
+ * closes the file, if there was one open.
+ * @param stream An initialized asynchronous stream.
+ * */
+
+void bootable_aio_stream_done(struct bootable_aio_stream *stream);
+
+/** Opens a file to be used in the stream.
+ * @param stream An initialized asynchronous stream.
+ * @param path The path of the file to open.
+ * @param flags The flags to pass to open(2).
+ * @param queue_depth The maximum number of writes
+ * that may be in flight. If this is zero, then
+ * @ref BOOTABLE_AIO_QUEUE_DEPTH is used.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_aio_stream_open(struct bootable_aio_stream *stream,
+                             const char *path,
+                             int flags,
+                             unsigned int queue_depth);
+
+/** Submits the data that is still being collected
+ * and waits for all requests to finish.
+ * @param stream An initialized asynchronous stream.
+ * @returns Zero if all requests since the last barrier
+ * succeeded, the first error code otherwise.
+ * */
+
+int bootable_aio_stream_barrier(struct bootable_aio_stream *stream);
+
+/** Resizes the file, after waiting for
+ * all requests to finish. If the file grows,
+ * the new region reads back as zero but is
+ * not allocated on file systems that support
+ * sparse files.
+ * @param stream An asynchronous stream with an open file.
+ * @param size The new size of the file, in bytes.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_aio_stream_resize(struct bootable_aio_stream *stream,
+                               bootable_uint64 size);
+
+/** Allocates storage for a region of the file,
+ * so that writing to it later cannot fail because
+ * the file system is full. The region reads back
+ * as zero, unless it was written before.
+ * @param stream An asynchronous stream with an open file.
+ * @param offset The offset of the region.
+ * @param size The number of bytes in the region.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_aio_stream_allocate(struct bootable_aio_stream *stream,
+                                 bootable_uint64 offset,
+                                 bootable_uint64 size);
+
+/** Tells the kernel that the file is going to be
+ * accessed from beginning to end, such as while
+ * a new disk image is written. This is only a hint.
+ * @param stream An asynchronous stream with an open file.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_aio_stream_advise_sequential(struct bootable_aio_stream *stream);
+
+/** Indicates whether or not the stream
+ * queues its requests on io_uring.
+ * @param stream An asynchronous stream with an open file.
+ * @returns True if io_uring is used, false if the
+ * requests are executed by a pool of threads.
+ * */
+
+bootable_bool bootable_aio_stream_uses_io_uring(const struct bootable_aio_stream *stream);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_AIO_STREAM_H */
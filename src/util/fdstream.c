@@ -0,0 +1,367 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fdstream.h"
+#include "sysio.h"
+
+#include <bootable/core/error.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef NULL
+#define NULL ((void *) 0x00)
+#endif
+
+#ifndef BOOTABLE_FDSTREAM_BUFFER_SIZE
+#define BOOTABLE_FDSTREAM_BUFFER_SIZE (64 * 1024)
+#endif
+
+/* The functions ending in '_locked' expect
+ * the caller to hold the stream lock. */
+
+static int flush_locked(struct bootable_fdstream *fdstream) {
+
+	if (fdstream->buf_size == 0)
+		return 0;
+
+	int err = bootable_pwrite_all(fdstream->fd, fdstream->buf, fdstream->buf_size, fdstream->buf_offset);
+	if (err != 0)
+		return err;
+
+	fdstream->buf_size = 0;
+
+	return 0;
+}
+
+static int read_at_locked(struct bootable_fdstream *fdstream,
+                          bootable_uint64 pos,
+                          void *buf,
+                          bootable_uint64 buf_size) {
+
+	if (fdstream->fd < 0)
+		return BOOTABLE_EFAULT;
+
+	if ((pos > LLONG_MAX) || (buf_size > (LLONG_MAX - pos)))
+		return BOOTABLE_EINVAL;
+
+	/* Dirty data that overlaps the
+	 * read has to reach the file first. */
+
+	if ((fdstream->buf_size > 0)
+	 && (pos < (fdstream->buf_offset + fdstream->buf_size))
+	 && ((pos + buf_size) > fdstream->buf_offset)) {
+		int err = flush_locked(fdstream);
+		if (err != 0)
+			return err;
+	}
+
+	return bootable_pread_all(fdstream->fd, buf, buf_size, pos);
+}
+
+static int write_at_locked(struct bootable_fdstream *fdstream,
+                           bootable_uint64 pos,
+                           const void *buf,
+                           bootable_uint64 buf_size) {
+
+	if (fdstream->fd < 0)
+		return BOOTABLE_EFAULT;
+
+	if ((pos > LLONG_MAX) || (buf_size > (LLONG_MAX - pos)))
+		return BOOTABLE_EINVAL;
+
+	/* If the write starts within the buffered range,
+	 * or right after it, and still fits in the buffer,
+	 * then it gets merged into the buffer. */
+
+	if ((fdstream->buf_size > 0)
+	 && (pos >= fdstream->buf_offset)
+	 && (pos <= (fdstream->buf_offset + fdstream->buf_size))
+	 && (((pos - fdstream->buf_offset) + buf_size) <= fdstream->buf_res)) {
+
+		bootable_uint64 buf_pos = pos - fdstream->buf_offset;
+
+		memcpy(&fdstream->buf[buf_pos], buf, buf_size);
+
+		if ((buf_pos + buf_size) > fdstream->buf_size)
+			fdstream->buf_size = buf_pos + buf_size;
+
+		return 0;
+	}
+
+	int err = flush_locked(fdstream);
+	if (err != 0)
+		return err;
+
+	if (buf_size >= fdstream->buf_res)
+		return bootable_pwrite_all(fdstream->fd, buf, buf_size, pos);
+
+	memcpy(fdstream->buf, buf, buf_size);
+
+	fdstream->buf_offset = pos;
+	fdstream->buf_size = buf_size;
+
+	return 0;
+}
+
+static int fdstream_read_at(void *fdstream_ptr,
+                            bootable_uint64 pos,
+                            void *buf,
+                            bootable_uint64 buf_size) {
+
+	struct bootable_fdstream *fdstream = (struct bootable_fdstream *) fdstream_ptr;
+	if (fdstream == NULL)
+		return BOOTABLE_EFAULT;
+
+	pthread_mutex_lock(&fdstream->lock);
+
+	int err = read_at_locked(fdstream, pos, buf, buf_size);
+
+	pthread_mutex_unlock(&fdstream->lock);
+
+	return err;
+}
+
+static int fdstream_write_at(void *fdstream_ptr,
+                             bootable_uint64 pos,
+                             const void *buf,
+                             bootable_uint64 buf_size) {
+
+	struct bootable_fdstream *fdstream = (struct bootable_fdstream *) fdstream_ptr;
+	if (fdstream == NULL)
+		return BOOTABLE_EFAULT;
+
+	pthread_mutex_lock(&fdstream->lock);
+
+	int err = write_at_locked(fdstream, pos, buf, buf_size);
+
+	pthread_mutex_unlock(&fdstream->lock);
+
+	return err;
+}
+
+static int fdstream_copy_from_fd(void *fdstream_ptr,
+                                 bootable_uint64 pos,
+                                 int fd,
+                                 bootable_uint64 fd_offset,
+                                 bootable_uint64 size) {
+
+	struct bootable_fdstream *fdstream = (struct bootable_fdstream *) fdstream_ptr;
+	if ((fdstream == NULL) || (fdstream->fd < 0))
+		return BOOTABLE_EFAULT;
+
+	pthread_mutex_lock(&fdstream->lock);
+
+	/* The buffered data has to be written first,
+	 * since it may be older than the copied data. */
+
+	int err = flush_locked(fdstream);
+	if (err == 0)
+		err = bootable_copy_fd_range(fdstream->fd, pos, fd, fd_offset, size);
+
+	pthread_mutex_unlock(&fdstream->lock);
+
+	return err;
+}
+
+static int fdstream_read(void *fdstream_ptr, void *buf, bootable_uint64 buf_size) {
+
+	struct bootable_fdstream *fdstream = (struct bootable_fdstream *) fdstream_ptr;
+	if (fdstream == NULL)
+		return BOOTABLE_EFAULT;
+
+	pthread_mutex_lock(&fdstream->lock);
+
+	int err = read_at_locked(fdstream, fdstream->pos, buf, buf_size);
+	if (err == 0)
+		fdstream->pos += buf_size;
+
+	pthread_mutex_unlock(&fdstream->lock);
+
+	return err;
+}
+
+static int fdstream_write(void *fdstream_ptr, const void *buf, bootable_uint64 buf_size) {
+
+	struct bootable_fdstream *fdstream = (struct bootable_fdstream *) fdstream_ptr;
+	if (fdstream == NULL)
+		return BOOTABLE_EFAULT;
+
+	pthread_mutex_lock(&fdstream->lock);
+
+	int err = write_at_locked(fdstream, fdstream->pos, buf, buf_size);
+	if (err == 0)
+		fdstream->pos += buf_size;
+
+	pthread_mutex_unlock(&fdstream->lock);
+
+	return err;
+}
+
+static int fdstream_set_pos(void *fdstream_ptr, bootable_uint64 pos) {
+
+	struct bootable_fdstream *fdstream = (struct bootable_fdstream *) fdstream_ptr;
+	if (fdstream == NULL)
+		return BOOTABLE_EFAULT;
+
+	if (pos > LLONG_MAX)
+		return BOOTABLE_EINVAL;
+
+	pthread_mutex_lock(&fdstream->lock);
+
+	fdstream->pos = pos;
+
+	pthread_mutex_unlock(&fdstream->lock);
+
+	return 0;
+}
+
+static int fdstream_get_pos(void *fdstream_ptr, bootable_uint64 *pos_ptr) {
+
+	struct bootable_fdstream *fdstream = (struct bootable_fdstream *) fdstream_ptr;
+	if (fdstream == NULL)
+		return BOOTABLE_EFAULT;
+
+	pthread_mutex_lock(&fdstream->lock);
+
+	if (pos_ptr != NULL)
+		*pos_ptr = fdstream->pos;
+
+	pthread_mutex_unlock(&fdstream->lock);
+
+	return 0;
+}
+
+static int fdstream_get_size(void *fdstream_ptr, bootable_uint64 *size_ptr) {
+
+	struct bootable_fdstream *fdstream = (struct bootable_fdstream *) fdstream_ptr;
+	if ((fdstream == NULL) || (fdstream->fd < 0))
+		return BOOTABLE_EFAULT;
+
+	struct stat st;
+
+	pthread_mutex_lock(&fdstream->lock);
+
+	if (fstat(fdstream->fd, &st) != 0) {
+		pthread_mutex_unlock(&fdstream->lock);
+		return bootable_error_from_errno(errno);
+	}
+
+	bootable_uint64 size = (bootable_uint64) st.st_size;
+
+	/* The buffer may extend past the end of the file. */
+
+	if ((fdstream->buf_size > 0)
+	 && ((fdstream->buf_offset + fdstream->buf_size) > size))
+		size = fdstream->buf_offset + fdstream->buf_size;
+
+	pthread_mutex_unlock(&fdstream->lock);
+
+	if (size_ptr != NULL)
+		*size_ptr = size;
+
+	return 0;
+}
+
+void bootable_fdstream_init(struct bootable_fdstream *fdstream) {
+	bootable_stream_init(&fdstream->base);
+	fdstream->base.data = fdstream;
+	fdstream->base.set_pos = fdstream_set_pos;
+	fdstream->base.get_pos = fdstream_get_pos;
+	fdstream->base.get_size = fdstream_get_size;
+	fdstream->base.write = fdstream_write;
+	fdstream->base.read = fdstream_read;
+	fdstream->base.read_at = fdstream_read_at;
+	fdstream->base.write_at = fdstream_write_at;
+	fdstream->base.copy_from_fd = fdstream_copy_from_fd;
+	fdstream->fd = -1;
+	fdstream->pos = 0;
+	fdstream->buf = NULL;
+	fdstream->buf_res = 0;
+	fdstream->buf_size = 0;
+	fdstream->buf_offset = 0;
+	pthread_mutex_init(&fdstream->lock, NULL);
+}
+
+void bootable_fdstream_done(struct bootable_fdstream *fdstream) {
+
+	if (fdstream->fd >= 0) {
+		flush_locked(fdstream);
+		close(fdstream->fd);
+		fdstream->fd = -1;
+	}
+
+	free(fdstream->buf);
+	fdstream->buf = NULL;
+	fdstream->buf_res = 0;
+	fdstream->buf_size = 0;
+
+	pthread_mutex_destroy(&fdstream->lock);
+}
+
+int bootable_fdstream_open(struct bootable_fdstream *fdstream,
+                           const char *path,
+                           int flags) {
+
+	if (fdstream->buf == NULL) {
+
+		long int page_size = sysconf(_SC_PAGESIZE);
+		if (page_size <= 0)
+			page_size = 4096;
+
+		void *buf = NULL;
+
+		if (posix_memalign(&buf, (size_t) page_size, BOOTABLE_FDSTREAM_BUFFER_SIZE) != 0)
+			return BOOTABLE_ENOMEM;
+
+		fdstream->buf = (unsigned char *) buf;
+		fdstream->buf_res = BOOTABLE_FDSTREAM_BUFFER_SIZE;
+	}
+
+	int fd = open(path, flags, 0644);
+	if (fd < 0)
+		return bootable_error_from_errno(errno);
+
+	if (fdstream->fd >= 0) {
+		flush_locked(fdstream);
+		close(fdstream->fd);
+	}
+
+	fdstream->fd = fd;
+	fdstream->pos = 0;
+	fdstream->buf_size = 0;
+	fdstream->buf_offset = 0;
+
+	return 0;
+}
+
+int bootable_fdstream_flush(struct bootable_fdstream *fdstream) {
+
+	pthread_mutex_lock(&fdstream->lock);
+
+	int err = flush_locked(fdstream);
+
+	pthread_mutex_unlock(&fdstream->lock);
+
+	return err;
+}
@@ -0,0 +1,102 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOOTABLE_FDSTREAM_H
+#define BOOTABLE_FDSTREAM_H
+
+#include <bootable/core/stream.h>
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** This structure represents a stream
+ * on a POSIX file descriptor. All transfers
+ * use positional I/O, so the stream never
+ * seeks. Small writes are collected in a
+ * page-aligned write-back buffer.
+ * */
+
+struct bootable_fdstream {
+	/** The base stream structure */
+	struct bootable_stream base;
+	/** The file descriptor of the
+	 * stream. If no file is open,
+	 * this is negative. */
+	int fd;
+	/** The position of the next sequential
+	 * read or write operation. */
+	bootable_uint64 pos;
+	/** The write-back buffer. */
+	unsigned char *buf;
+	/** The number of bytes that the
+	 * write-back buffer can hold. */
+	bootable_uint64 buf_res;
+	/** The number of dirty bytes in
+	 * the write-back buffer. */
+	bootable_uint64 buf_size;
+	/** The file offset of the first
+	 * byte in the write-back buffer. */
+	bootable_uint64 buf_offset;
+	/** Serializes access to the write-back
+	 * buffer between threads. */
+	pthread_mutex_t lock;
+};
+
+/** Initializes a file descriptor stream structure.
+ * @param fdstream The file descriptor stream
+ * structure to initialize.
+ * */
+
+void bootable_fdstream_init(struct bootable_fdstream *fdstream);
+
+/** Flushes the write-back buffer and closes
+ * the file, if there was one open.
+ * @param fdstream An initialized file descriptor stream.
+ * */
+
+void bootable_fdstream_done(struct bootable_fdstream *fdstream);
+
+/** Opens a file to be used in the stream.
+ * @param fdstream An initialized file descriptor stream.
+ * @param path The path of the file to open.
+ * @param flags The flags to pass to open(2), such
+ * as O_RDWR or O_CREAT. Files that are created get
+ * the mode 0644, before the umask is applied.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_fdstream_open(struct bootable_fdstream *fdstream,
+                           const char *path,
+                           int flags);
+
+/** Writes the contents of the write-back
+ * buffer to the file.
+ * @param fdstream An initialized file descriptor stream.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_fdstream_flush(struct bootable_fdstream *fdstream);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_FDSTREAM_H */
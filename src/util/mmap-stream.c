@@ -0,0 +1,376 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mmap-stream.h"
+#include "sysio.h"
+
+#include <bootable/core/error.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef NULL
+#define NULL ((void *) 0x00)
+#endif
+
+/** The largest file that is mapped. Anything
+ * larger than this does not fit into the address
+ * space and has to be accessed with a regular
+ * stream instead. */
+
+#ifndef BOOTABLE_MMAP_MAX_SIZE
+#define BOOTABLE_MMAP_MAX_SIZE ((bootable_uint64) (SIZE_MAX / 2))
+#endif
+
+static int check_range(const struct bootable_mmap_stream *stream,
+                       bootable_uint64 pos,
+                       bootable_uint64 size) {
+
+	if (stream->addr == NULL)
+		return BOOTABLE_EFAULT;
+
+	if ((pos > stream->size) || (size > (stream->size - pos)))
+		return BOOTABLE_EINVAL;
+
+	return 0;
+}
+
+static void mark_dirty(struct bootable_mmap_stream *stream,
+                       bootable_uint64 pos,
+                       bootable_uint64 size) {
+
+	pthread_mutex_lock(&stream->lock);
+
+	if (stream->dirty_begin == stream->dirty_end) {
+		stream->dirty_begin = pos;
+		stream->dirty_end = pos + size;
+	} else {
+		if (pos < stream->dirty_begin)
+			stream->dirty_begin = pos;
+		if ((pos + size) > stream->dirty_end)
+			stream->dirty_end = pos + size;
+	}
+
+	pthread_mutex_unlock(&stream->lock);
+}
+
+static int mmap_stream_read_at(void *stream_ptr,
+                               bootable_uint64 pos,
+                               void *buf,
+                               bootable_uint64 buf_size) {
+
+	struct bootable_mmap_stream *stream = (struct bootable_mmap_stream *) stream_ptr;
+	if (stream == NULL)
+		return BOOTABLE_EFAULT;
+
+	int err = check_range(stream, pos, buf_size);
+	if (err != 0)
+		return err;
+
+	memcpy(buf, &stream->addr[pos], buf_size);
+
+	return 0;
+}
+
+static int mmap_stream_write_at(void *stream_ptr,
+                                bootable_uint64 pos,
+                                const void *buf,
+                                bootable_uint64 buf_size) {
+
+	struct bootable_mmap_stream *stream = (struct bootable_mmap_stream *) stream_ptr;
+	if (stream == NULL)
+		return BOOTABLE_EFAULT;
+
+	int err = check_range(stream, pos, buf_size);
+	if (err == BOOTABLE_EINVAL)
+		/* the mapping cannot grow */
+		return BOOTABLE_ENOSPC;
+	else if (err != 0)
+		return err;
+
+	memcpy(&stream->addr[pos], buf, buf_size);
+
+	mark_dirty(stream, pos, buf_size);
+
+	return 0;
+}
+
+static int mmap_stream_copy_from_fd(void *stream_ptr,
+                                    bootable_uint64 pos,
+                                    int fd,
+                                    bootable_uint64 fd_offset,
+                                    bootable_uint64 size) {
+
+	struct bootable_mmap_stream *stream = (struct bootable_mmap_stream *) stream_ptr;
+	if (stream == NULL)
+		return BOOTABLE_EFAULT;
+
+	int err = check_range(stream, pos, size);
+	if (err == BOOTABLE_EINVAL)
+		return BOOTABLE_ENOSPC;
+	else if (err != 0)
+		return err;
+
+	/* The file is read straight into the mapping. */
+
+	err = bootable_pread_all(fd, &stream->addr[pos], size, fd_offset);
+	if (err != 0)
+		return err;
+
+	mark_dirty(stream, pos, size);
+
+	return 0;
+}
+
+static int mmap_stream_read(void *stream_ptr, void *buf, bootable_uint64 buf_size) {
+
+	struct bootable_mmap_stream *stream = (struct bootable_mmap_stream *) stream_ptr;
+	if (stream == NULL)
+		return BOOTABLE_EFAULT;
+
+	int err = mmap_stream_read_at(stream, stream->pos, buf, buf_size);
+	if (err != 0)
+		return err;
+
+	stream->pos += buf_size;
+
+	return 0;
+}
+
+static int mmap_stream_write(void *stream_ptr, const void *buf, bootable_uint64 buf_size) {
+
+	struct bootable_mmap_stream *stream = (struct bootable_mmap_stream *) stream_ptr;
+	if (stream == NULL)
+		return BOOTABLE_EFAULT;
+
+	int err = mmap_stream_write_at(stream, stream->pos, buf, buf_size);
+	if (err != 0)
+		return err;
+
+	stream->pos += buf_size;
+
+	return 0;
+}
+
+static int mmap_stream_set_pos(void *stream_ptr, bootable_uint64 pos) {
+
+	struct bootable_mmap_stream *stream = (struct bootable_mmap_stream *) stream_ptr;
+	if (stream == NULL)
+		return BOOTABLE_EFAULT;
+
+	if (pos > stream->size)
+		return BOOTABLE_EINVAL;
+
+	stream->pos = pos;
+
+	return 0;
+}
+
+static int mmap_stream_get_pos(void *stream_ptr, bootable_uint64 *pos) {
+
+	struct bootable_mmap_stream *stream = (struct bootable_mmap_stream *) stream_ptr;
+	if (stream == NULL)
+		return BOOTABLE_EFAULT;
+
+	if (pos != NULL)
+		*pos = stream->pos;
+
+	return 0;
+}
+
+static int mmap_stream_get_size(void *stream_ptr, bootable_uint64 *size) {
+
+	struct bootable_mmap_stream *stream = (struct bootable_mmap_stream *) stream_ptr;
+	if (stream == NULL)
+		return BOOTABLE_EFAULT;
+
+	if (size != NULL)
+		*size = stream->size;
+
+	return 0;
+}
+
+static int map_fd(struct bootable_mmap_stream *stream,
+                  int fd,
+                  bootable_uint64 size,
+                  bootable_bool writable) {
+
+	if (size > BOOTABLE_MMAP_MAX_SIZE)
+		return BOOTABLE_ENOMEM;
+
+	void *addr = NULL;
+
+	/* mmap(2) refuses empty mappings */
+
+	if (size > 0) {
+
+		int prot = PROT_READ;
+		if (writable)
+			prot |= PROT_WRITE;
+
+		addr = mmap(NULL, (size_t) size, prot, MAP_SHARED, fd, 0);
+		if (addr == MAP_FAILED)
+			return bootable_error_from_errno(errno);
+	}
+
+	bootable_mmap_stream_done(stream);
+	bootable_mmap_stream_init(stream);
+
+	stream->fd = fd;
+	stream->addr = (unsigned char *) addr;
+	stream->size = size;
+
+	return 0;
+}
+
+void bootable_mmap_stream_init(struct bootable_mmap_stream *stream) {
+	bootable_stream_init(&stream->base);
+	stream->base.data = stream;
+	stream->base.set_pos = mmap_stream_set_pos;
+	stream->base.get_pos = mmap_stream_get_pos;
+	stream->base.get_size = mmap_stream_get_size;
+	stream->base.read = mmap_stream_read;
+	stream->base.write = mmap_stream_write;
+	stream->base.read_at = mmap_stream_read_at;
+	stream->base.write_at = mmap_stream_write_at;
+	stream->base.copy_from_fd = mmap_stream_copy_from_fd;
+	stream->fd = -1;
+	stream->addr = NULL;
+	stream->size = 0;
+	stream->pos = 0;
+	stream->dirty_begin = 0;
+	stream->dirty_end = 0;
+	pthread_mutex_init(&stream->lock, NULL);
+}
+
+void bootable_mmap_stream_done(struct bootable_mmap_stream *stream) {
+
+	if (stream->addr != NULL) {
+		bootable_mmap_stream_sync(stream);
+		munmap(stream->addr, (size_t) stream->size);
+		stream->addr = NULL;
+	}
+
+	if (stream->fd >= 0) {
+		close(stream->fd);
+		stream->fd = -1;
+	}
+
+	pthread_mutex_destroy(&stream->lock);
+}
+
+int bootable_mmap_stream_open(struct bootable_mmap_stream *stream,
+                              const char *path,
+                              bootable_bool writable) {
+
+	int fd = open(path, writable ? O_RDWR : O_RDONLY);
+	if (fd < 0)
+		return bootable_error_from_errno(errno);
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0) {
+		int err = bootable_error_from_errno(errno);
+		close(fd);
+		return err;
+	}
+
+	int err = map_fd(stream, fd, (bootable_uint64) st.st_size, writable);
+	if (err != 0) {
+		close(fd);
+		return err;
+	}
+
+	return 0;
+}
+
+int bootable_mmap_stream_advise(struct bootable_mmap_stream *stream,
+                                enum bootable_mmap_advice advice) {
+
+	if (stream->addr == NULL)
+		return 0;
+
+	int posix_advice = POSIX_MADV_NORMAL;
+
+	switch (advice) {
+	case BOOTABLE_MMAP_NORMAL:
+		posix_advice = POSIX_MADV_NORMAL;
+		break;
+	case BOOTABLE_MMAP_RANDOM:
+		posix_advice = POSIX_MADV_RANDOM;
+		break;
+	}
+
+	/* posix_madvise returns the error number,
+	 * instead of setting errno. */
+
+	int err = posix_madvise(stream->addr, (size_t) stream->size, posix_advice);
+	if (err != 0)
+		return bootable_error_from_errno(err);
+
+	return 0;
+}
+
+int bootable_mmap_stream_sync(struct bootable_mmap_stream *stream) {
+
+	pthread_mutex_lock(&stream->lock);
+
+	bootable_uint64 begin = stream->dirty_begin;
+	bootable_uint64 end = stream->dirty_end;
+
+	stream->dirty_begin = 0;
+	stream->dirty_end = 0;
+
+	pthread_mutex_unlock(&stream->lock);
+
+	if ((stream->addr == NULL) || (begin == end))
+		return 0;
+
+	/* msync(2) needs a page aligned address */
+
+	long int page_size = sysconf(_SC_PAGESIZE);
+	if (page_size <= 0)
+		page_size = 4096;
+
+	bootable_uint64 page_begin = begin - (begin % ((bootable_uint64) page_size));
+
+	if (msync(&stream->addr[page_begin], (size_t) (end - page_begin), MS_SYNC) != 0) {
+		int err = bootable_error_from_errno(errno);
+		/* Keep the range, so that a
+		 * later sync writes it again. */
+		mark_dirty(stream, begin, end - begin);
+		return err;
+	}
+
+	return 0;
+}
+
+const void *bootable_mmap_stream_data(const struct bootable_mmap_stream *stream,
+                                      bootable_uint64 offset,
+                                      bootable_uint64 size) {
+
+	if (check_range(stream, offset, size) != 0)
+		return NULL;
+
+	return &stream->addr[offset];
+}
@@ -0,0 +1,135 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOOTABLE_MMAP_STREAM_H
+#define BOOTABLE_MMAP_STREAM_H
+
+#include <bootable/core/stream.h>
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Describes how a mapped disk
+ * image is about to be accessed.
+ * */
+
+enum bootable_mmap_advice {
+	/** No particular access pattern. */
+	BOOTABLE_MMAP_NORMAL,
+	/** The image is accessed at scattered
+	 * locations, such as when files are
+	 * listed or read. */
+	BOOTABLE_MMAP_RANDOM
+};
+
+/** This structure represents a stream
+ * on a file that is mapped into memory
+ * in its entirety. Reads and writes are
+ * copies to and from the mapping.
+ * */
+
+struct bootable_mmap_stream {
+	/** The base stream structure */
+	struct bootable_stream base;
+	/** The file descriptor of the mapped
+	 * file. If no file is open, this is
+	 * negative. */
+	int fd;
+	/** The address of the mapping. */
+	unsigned char *addr;
+	/** The number of bytes in the mapping. */
+	bootable_uint64 size;
+	/** The position of the next sequential
+	 * read or write operation. */
+	bootable_uint64 pos;
+	/** The offset of the first byte that was
+	 * written since the last synchronization. */
+	bootable_uint64 dirty_begin;
+	/** The offset after the last byte that was
+	 * written since the last synchronization. */
+	bootable_uint64 dirty_end;
+	/** Protects the dirty range between threads. */
+	pthread_mutex_t lock;
+};
+
+/** Initializes a memory mapped stream structure.
+ * @param stream The structure to initialize.
+ * */
+
+void bootable_mmap_stream_init(struct bootable_mmap_stream *stream);
+
+/** Synchronizes and unmaps the file, if
+ * there was one mapped.
+ * @param stream An initialized memory mapped stream.
+ * */
+
+void bootable_mmap_stream_done(struct bootable_mmap_stream *stream);
+
+/** Maps an existing file.
+ * @param stream An initialized memory mapped stream.
+ * @param path The path of the file to map.
+ * @param writable Whether or not the mapping
+ * may be written to.
+ * @returns Zero on success, an error code on failure.
+ * If the file does not fit into the address space,
+ * then @ref BOOTABLE_ENOMEM is returned.
+ * */
+
+int bootable_mmap_stream_open(struct bootable_mmap_stream *stream,
+                              const char *path,
+                              bootable_bool writable);
+
+/** Tells the kernel how the mapping
+ * is going to be accessed.
+ * @param stream A memory mapped stream with an open file.
+ * @param advice The expected access pattern.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_mmap_stream_advise(struct bootable_mmap_stream *stream,
+                                enum bootable_mmap_advice advice);
+
+/** Writes the pages that were modified since the
+ * last call to this function back to the file.
+ * @param stream A memory mapped stream with an open file.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_mmap_stream_sync(struct bootable_mmap_stream *stream);
+
+/** Gets the address of a region of the mapped file,
+ * so that it can be read without being copied.
+ * @param stream A memory mapped stream with an open file.
+ * @param offset The offset of the region within the file.
+ * @param size The number of bytes in the region.
+ * @returns The address of the region on success. If the
+ * region is outside of the file, then null is returned.
+ * */
+
+const void *bootable_mmap_stream_data(const struct bootable_mmap_stream *stream,
+                                      bootable_uint64 offset,
+                                      bootable_uint64 size);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_MMAP_STREAM_H */
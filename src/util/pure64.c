@@ -22,6 +22,7 @@
 #include <bootable/core/file.h>
 #include <bootable/core/types.h>
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -76,10 +77,16 @@ static void print_help(const char *argv0) {
 	printf("\n");
 	printf("Commands:\n");
 	printf("\tinit  : Initialize the disk image.\n");
+	printf("\t        --queue-depth N : Allow N writes in flight.\n");
+	printf("\t        --preallocate   : Allocate the whole image instead of creating a sparse file.\n");
+	printf("\t        --in-memory     : Build the image in memory, then write it at once.\n");
+	printf("\t        --fs-version N  : Use version N (1 or 2) of the file system format.\n");
 	printf("\tcat   : Print the contents of a file.\n");
 	printf("\tcp    : Copy file from host file system to Pure64 image.\n");
+	printf("\t        --compress      : Compress the file (version 2 of the file system only).\n");
 	printf("\tls    : List directory contents.\n");
 	printf("\tmkdir : Create a directory.\n");
+	printf("\tstats : Print how much file data there is, and how much of it is shared.\n");
 }
 
 static bootable_bool is_opt(const char *argv) {
@@ -95,13 +102,44 @@ static bootable_bool is_opt(const char *argv) {
 
 static int bootable_init(const char *config, const char *disk, int argc, const char **argv) {
 
-	(void) argc;
-	(void) argv;
-
 	struct bootable_util util;
 
 	bootable_util_init(&util);
 
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "--queue-depth") == 0) {
+			char *end = NULL;
+			unsigned long int queue_depth = ((i + 1) < argc) ? strtoul(argv[i + 1], &end, 10) : 0;
+			if ((end == NULL) || (end == argv[i + 1]) || (*end != 0) || (queue_depth == 0)) {
+				fprintf(stderr, "Option '--queue-depth' requires a positive number.\n");
+				bootable_util_done(&util);
+				return EXIT_FAILURE;
+			}
+			util.queue_depth = (unsigned int) queue_depth;
+			i++;
+		} else if (strcmp(argv[i], "--preallocate") == 0) {
+			util.preallocate = bootable_true;
+		} else if (strcmp(argv[i], "--in-memory") == 0) {
+			util.build_in_memory = bootable_true;
+		} else if (strcmp(argv[i], "--fs-version") == 0) {
+			const char *version = ((i + 1) < argc) ? argv[i + 1] : "";
+			if (strcmp(version, "1") == 0) {
+				util.fs.signature = BOOTABLE_SIGNATURE;
+			} else if (strcmp(version, "2") == 0) {
+				util.fs.signature = BOOTABLE_SIGNATURE_V2;
+			} else {
+				fprintf(stderr, "Option '--fs-version' requires either 1 or 2.\n");
+				bootable_util_done(&util);
+				return EXIT_FAILURE;
+			}
+			i++;
+		} else {
+			fprintf(stderr, "Unknown init option '%s'.\n", argv[i]);
+			bootable_util_done(&util);
+			return EXIT_FAILURE;
+		}
+	}
+
 	int err = bootable_util_open_config(&util, config);
 	if (err != 0) {
 		/* print message if it's not a syntax error */
@@ -169,6 +207,74 @@ static int bootable_mkdir(struct bootable_util *util, int argc, const char **arg
 	return EXIT_SUCCESS;
 }
 
+static int bootable_stats(struct bootable_util *util, int argc, const char **argv) {
+
+	struct bootable_fs_stats stats;
+
+	(void) argv;
+
+	if (argc > 0) {
+		fprintf(stderr, "The 'stats' command does not take arguments.\n");
+		return EXIT_FAILURE;
+	}
+
+	int err = bootable_fs_stats(&util->fs, &stats);
+	if (err != 0) {
+		fprintf(stderr, "Failed to get file system statistics: %s\n", bootable_strerror(err));
+		return EXIT_FAILURE;
+	}
+
+	printf("directories : %llu\n", (unsigned long long int) stats.dir_count);
+	printf("files       : %llu\n", (unsigned long long int) stats.file_count);
+	printf("data        : %llu\n", (unsigned long long int) stats.data_size);
+	printf("unique data : %llu\n", (unsigned long long int) stats.unique_data_size);
+	printf("saved       : %llu\n", (unsigned long long int) (stats.data_size - stats.unique_data_size));
+
+	return EXIT_SUCCESS;
+}
+
+/** Writes the contents of a file to the
+ * standard output. Data that is in the mapped
+ * disk image is written from the mapping. Other
+ * data is read a piece at a time, so that the
+ * whole file is never in memory.
+ * */
+
+static int cat_file(struct bootable_util *util, struct bootable_file *file) {
+
+	char buf[0x10000];
+
+	if (file->data_size == 0)
+		return 0;
+
+	/* Data in the mapped image is written
+	 * out without copying it first. */
+	const void *data = bootable_util_file_data(util, file);
+	if (data != NULL) {
+		if (fwrite(data, 1, file->data_size, stdout) != file->data_size)
+			return BOOTABLE_EIO;
+		return 0;
+	}
+
+	for (bootable_uint64 offset = 0; offset < file->data_size; ) {
+
+		bootable_uint64 piece = file->data_size - offset;
+		if (piece > sizeof(buf))
+			piece = sizeof(buf);
+
+		int err = bootable_file_read(file, offset, buf, piece);
+		if (err != 0)
+			return err;
+
+		if (fwrite(buf, 1, piece, stdout) != piece)
+			return BOOTABLE_EIO;
+
+		offset += piece;
+	}
+
+	return 0;
+}
+
 static int bootable_cat(struct bootable_util *util, int argc, const char **argv) {
 
 	struct bootable_fs *fs = &util->fs;
@@ -183,7 +289,11 @@ static int bootable_cat(struct bootable_util *util, int argc, const char **argv)
 			return EXIT_FAILURE;
 		}
 
-		fwrite(file->data, 1, file->data_size, stdout);
+		int err = cat_file(util, file);
+		if (err != 0) {
+			fprintf(stderr, "Failed to read '%s': %s\n", argv[i], bootable_strerror(err));
+			return EXIT_FAILURE;
+		}
 	}
 
 	return EXIT_SUCCESS;
@@ -191,32 +301,50 @@ static int bootable_cat(struct bootable_util *util, int argc, const char **argv)
 
 static int bootable_cp(struct bootable_util *util, int argc, const char **argv) {
 
-	if (argc <= 0) {
+	bootable_bool compress = bootable_false;
+
+	const char *paths[2] = { NULL, NULL };
+
+	int path_count = 0;
+
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "--compress") == 0) {
+			compress = bootable_true;
+		} else if (is_opt(argv[i])) {
+			fprintf(stderr, "Unknown option '%s'.\n", argv[i]);
+			return EXIT_FAILURE;
+		} else if (path_count < 2) {
+			paths[path_count++] = argv[i];
+		}
+	}
+
+	if (path_count <= 0) {
 		fprintf(stderr, "Missing source path.\n");
 		return EXIT_FAILURE;
-	} else if (argc <= 1) {
+	} else if (path_count <= 1) {
 		fprintf(stderr, "Missing destination path.\n");
 		return EXIT_FAILURE;
 	}
 
-	const char *src_path = argv[0];
-	const char *dst_path = argv[1];
-
-	FILE *src = fopen(src_path, "rb");
-	if (src == NULL) {
-		fprintf(stderr, "Failed to open source file '%s'.\n", src_path);
+	if (compress && (util->fs.signature != BOOTABLE_SIGNATURE_V2)) {
+		fprintf(stderr, "Files can only be compressed in version 2 of the file system.\n");
 		return EXIT_FAILURE;
 	}
 
-	int err = fseek(src, 0L, SEEK_END);
+	const char *src_path = paths[0];
+	const char *dst_path = paths[1];
 
-	long int src_size = ftell(src);
+	int err = bootable_fdstream_open(&util->host_file, src_path, O_RDONLY);
+	if (err != 0) {
+		fprintf(stderr, "Failed to open source file '%s': %s\n", src_path, bootable_strerror(err));
+		return EXIT_FAILURE;
+	}
 
-	err |= fseek(src, 0L, SEEK_SET);
+	bootable_uint64 src_size = 0;
 
-	if ((err != 0) || (src_size < 0)) {
-		fprintf(stderr, "Failed to get file size of '%s'.\n", src_path);
-		fclose(src);
+	err = bootable_stream_get_size(&util->host_file.base, &src_size);
+	if (err != 0) {
+		fprintf(stderr, "Failed to get file size of '%s': %s\n", src_path, bootable_strerror(err));
 		return EXIT_FAILURE;
 	}
 
@@ -225,7 +353,6 @@ static int bootable_cp(struct bootable_util *util, int argc, const char **argv)
 	err = bootable_fs_make_file(fs, dst_path);
 	if (err != 0) {
 		fprintf(stderr, "Failed to create destination file '%s': %s.\n", dst_path, bootable_strerror(err));
-		fclose(src);
 		return EXIT_FAILURE;
 	}
 
@@ -234,25 +361,18 @@ static int bootable_cp(struct bootable_util *util, int argc, const char **argv)
 	dst = bootable_fs_open_file(fs, dst_path);
 	if (dst == NULL) {
 		fprintf(stderr, "Failed to open destination file '%s'.\n", dst_path);
-		fclose(src);
 		return EXIT_FAILURE;
 	}
 
-	dst->data = malloc(src_size);
-	if (dst->data == NULL) {
-		fprintf(stderr, "Failed to allocate memory for destination file '%s'.\n", dst_path);
-		fclose(src);
-		return EXIT_FAILURE;
-	}
+	/* The data is not read here. It is copied
+	 * from the source file when the file system
+	 * is saved, or read from it if it is compressed. */
 
-	if (fread(dst->data, 1, src_size, src) != ((size_t) src_size)) {
-		fprintf(stderr, "Failed to read source file'%s'.\n", src_path);
-		fclose(src);
-		return EXIT_FAILURE;
-	}
-
-	fclose(src);
+	util->host_source.fd = util->host_file.fd;
 
+	dst->compress = compress;
+	dst->source = &util->host_source;
+	dst->data_offset = 0;
 	dst->data_size = src_size;
 
 	return EXIT_SUCCESS;
@@ -319,6 +439,11 @@ int main(int argc, const char **argv) {
 
 	bootable_util_init(&util);
 
+	if ((strcmp(command, "cat") == 0)
+	 || (strcmp(command, "ls") == 0)
+	 || (strcmp(command, "stats") == 0))
+		util.access = BOOTABLE_MMAP_RANDOM;
+
 	int err = bootable_util_open_config(&util, config);
 	if (err != 0) {
 		fprintf(stderr, "Failed to open '%s': %s\n", config, bootable_strerror(err));
@@ -343,6 +468,8 @@ int main(int argc, const char **argv) {
 		exit_code = bootable_ls(&util, argc, argv);
 	} else if (strcmp(command, "mkdir") == 0) {
 		exit_code = bootable_mkdir(&util, argc, argv);
+	} else if (strcmp(command, "stats") == 0) {
+		exit_code = bootable_stats(&util, argc, argv);
 	} else {
 		fprintf(stderr, "Unknown command '%s'.\n", command);
 		bootable_util_done(&util);
@@ -356,7 +483,7 @@ int main(int argc, const char **argv) {
 
 	err = bootable_util_save_disk(&util);
 	if (err != 0) {
-		fprintf(stderr, "Failed to save disk changes.\n");
+		fprintf(stderr, "Failed to save disk changes: %s\n", bootable_strerror(err));
 		bootable_util_done(&util);
 		return EXIT_FAILURE;
 	}
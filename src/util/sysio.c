@@ -0,0 +1,301 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "sysio.h"
+
+#include <bootable/core/error.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+/** The largest buffer used to copy
+ * data between files. */
+
+#ifndef BOOTABLE_COPY_BUFFER_SIZE
+#define BOOTABLE_COPY_BUFFER_SIZE (1024 * 1024)
+#endif
+
+/** The largest number of bytes passed
+ * to a single copy system call. */
+
+#define COPY_CHUNK_SIZE 0x40000000UL
+
+int bootable_error_from_errno(int errno_value) {
+
+	switch (errno_value) {
+	case EFAULT:
+		return BOOTABLE_EFAULT;
+	case ENOMEM:
+		return BOOTABLE_ENOMEM;
+	case EISDIR:
+		return BOOTABLE_EISDIR;
+	case ENOTDIR:
+		return BOOTABLE_ENOTDIR;
+	case ENOENT:
+		return BOOTABLE_ENOENT;
+	case EEXIST:
+		return BOOTABLE_EEXIST;
+	case EINVAL:
+		return BOOTABLE_EINVAL;
+	case ENOSYS:
+		return BOOTABLE_ENOSYS;
+	case ENOSPC:
+		return BOOTABLE_ENOSPC;
+	default:
+		break;
+	}
+
+	return BOOTABLE_EIO;
+}
+
+int bootable_pread_all(int fd, void *buf, bootable_uint64 buf_size, bootable_uint64 offset) {
+
+	unsigned char *buf8 = (unsigned char *) buf;
+
+	while (buf_size > 0) {
+
+		size_t chunk_size = (buf_size > SSIZE_MAX) ? SSIZE_MAX : (size_t) buf_size;
+
+		ssize_t read_count = pread(fd, buf8, chunk_size, (off_t) offset);
+		if (read_count < 0) {
+			if (errno == EINTR)
+				continue;
+			return bootable_error_from_errno(errno);
+		} else if (read_count == 0) {
+			/* end of file */
+			return BOOTABLE_EIO;
+		}
+
+		buf8 += read_count;
+		buf_size -= read_count;
+		offset += read_count;
+	}
+
+	return 0;
+}
+
+int bootable_pwrite_all(int fd, const void *buf, bootable_uint64 buf_size, bootable_uint64 offset) {
+
+	const unsigned char *buf8 = (const unsigned char *) buf;
+
+	while (buf_size > 0) {
+
+		size_t chunk_size = (buf_size > SSIZE_MAX) ? SSIZE_MAX : (size_t) buf_size;
+
+		ssize_t write_count = pwrite(fd, buf8, chunk_size, (off_t) offset);
+		if (write_count < 0) {
+			if (errno == EINTR)
+				continue;
+			return bootable_error_from_errno(errno);
+		} else if (write_count == 0) {
+			/* no progress */
+			return BOOTABLE_EIO;
+		}
+
+		buf8 += write_count;
+		buf_size -= write_count;
+		offset += write_count;
+	}
+
+	return 0;
+}
+
+static int copy_with_buffer(int dst_fd,
+                            bootable_uint64 dst_offset,
+                            int src_fd,
+                            bootable_uint64 src_offset,
+                            bootable_uint64 size) {
+
+	bootable_uint64 buf_size = BOOTABLE_COPY_BUFFER_SIZE;
+	if (buf_size > size)
+		buf_size = size;
+
+	unsigned char *buf = malloc(buf_size);
+	if (buf == NULL)
+		return BOOTABLE_ENOMEM;
+
+	while (size > 0) {
+
+		bootable_uint64 chunk_size = (size < buf_size) ? size : buf_size;
+
+		int err = bootable_pread_all(src_fd, buf, chunk_size, src_offset);
+		if (err == 0)
+			err = bootable_pwrite_all(dst_fd, buf, chunk_size, dst_offset);
+
+		if (err != 0) {
+			free(buf);
+			return err;
+		}
+
+		dst_offset += chunk_size;
+		src_offset += chunk_size;
+		size -= chunk_size;
+	}
+
+	free(buf);
+
+	return 0;
+}
+
+#ifdef __linux__
+
+/* Indicates whether a failed copy system call
+ * means that it cannot be used with these files,
+ * rather than that the copy itself failed. */
+
+static int is_unsupported(int errno_value) {
+	return (errno_value == EXDEV)
+	    || (errno_value == EINVAL)
+	    || (errno_value == ENOSYS)
+	    || (errno_value == EOPNOTSUPP)
+	    || (errno_value == EBADF);
+}
+
+#endif /* __linux__ */
+
+int bootable_copy_fd_range(int dst_fd,
+                           bootable_uint64 dst_offset,
+                           int src_fd,
+                           bootable_uint64 src_offset,
+                           bootable_uint64 size) {
+
+	if ((dst_offset > LLONG_MAX) || (size > (LLONG_MAX - dst_offset)))
+		return BOOTABLE_EINVAL;
+
+	if ((src_offset > LLONG_MAX) || (size > (LLONG_MAX - src_offset)))
+		return BOOTABLE_EINVAL;
+
+#ifdef __linux__
+
+	int use_copy_file_range = 1;
+
+	while ((size > 0) && use_copy_file_range) {
+
+		loff_t in_offset = (loff_t) src_offset;
+		loff_t out_offset = (loff_t) dst_offset;
+
+		size_t chunk_size = (size < COPY_CHUNK_SIZE) ? (size_t) size : COPY_CHUNK_SIZE;
+
+		ssize_t count = copy_file_range(src_fd, &in_offset, dst_fd, &out_offset, chunk_size, 0);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+			else if (is_unsupported(errno))
+				use_copy_file_range = 0;
+			else
+				return bootable_error_from_errno(errno);
+		} else if (count == 0) {
+			/* end of the source file */
+			return BOOTABLE_EIO;
+		} else {
+			dst_offset += count;
+			src_offset += count;
+			size -= count;
+		}
+	}
+
+	int use_sendfile = 1;
+
+	while ((size > 0) && use_sendfile) {
+
+		/* sendfile writes at the file offset of
+		 * the destination, which none of the streams
+		 * depend on because they use positional I/O. */
+
+		if (lseek(dst_fd, (off_t) dst_offset, SEEK_SET) < 0)
+			return bootable_error_from_errno(errno);
+
+		off_t in_offset = (off_t) src_offset;
+
+		size_t chunk_size = (size < COPY_CHUNK_SIZE) ? (size_t) size : COPY_CHUNK_SIZE;
+
+		ssize_t count = sendfile(dst_fd, src_fd, &in_offset, chunk_size);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+			else if (is_unsupported(errno))
+				use_sendfile = 0;
+			else
+				return bootable_error_from_errno(errno);
+		} else if (count == 0) {
+			return BOOTABLE_EIO;
+		} else {
+			dst_offset += count;
+			src_offset += count;
+			size -= count;
+		}
+	}
+
+#endif /* __linux__ */
+
+	if (size == 0)
+		return 0;
+
+	return copy_with_buffer(dst_fd, dst_offset, src_fd, src_offset, size);
+}
+
+int bootable_copy_fd_to_stream(struct bootable_stream *stream,
+                               bootable_uint64 pos,
+                               int fd,
+                               bootable_uint64 fd_offset,
+                               bootable_uint64 size) {
+
+	int err = bootable_stream_copy_from_fd(stream, pos, fd, fd_offset, size);
+	if (err != BOOTABLE_ENOSYS)
+		return err;
+
+	bootable_uint64 buf_size = BOOTABLE_COPY_BUFFER_SIZE;
+	if (buf_size > size)
+		buf_size = size;
+
+	unsigned char *buf = malloc(buf_size);
+	if ((buf == NULL) && (buf_size > 0))
+		return BOOTABLE_ENOMEM;
+
+	while (size > 0) {
+
+		bootable_uint64 chunk_size = (size < buf_size) ? size : buf_size;
+
+		err = bootable_pread_all(fd, buf, chunk_size, fd_offset);
+		if (err == 0)
+			err = bootable_stream_write_at(stream, pos, buf, chunk_size);
+
+		if (err != 0) {
+			free(buf);
+			return err;
+		}
+
+		pos += chunk_size;
+		fd_offset += chunk_size;
+		size -= chunk_size;
+	}
+
+	free(buf);
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+/* Copyright (C) 2018 Taylor Holberton
+ *
+ * This file is part of Bootable.
+ *
+ * Bootable is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Bootable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Bootable. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOOTABLE_SYSIO_H
+#define BOOTABLE_SYSIO_H
+
+#include <bootable/core/stream.h>
+#include <bootable/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Converts the value of errno, set by
+ * a failed system call, to an error code
+ * used by the library.
+ * @param errno_value The value of errno.
+ * @returns The closest matching error code.
+ * Errors without a closer match are reported
+ * as @ref BOOTABLE_EIO.
+ * */
+
+int bootable_error_from_errno(int errno_value);
+
+/** Reads data from a file descriptor at a certain
+ * offset. Partial reads and interruptions are retried
+ * until all of the data is read.
+ * @param fd The file descriptor to read from.
+ * @param buf The buffer to put the data in.
+ * @param buf_size The number of bytes to read.
+ * @param offset The offset to read the data from.
+ * @returns Zero on success, an error code on failure.
+ * Reaching the end of the file is reported as
+ * @ref BOOTABLE_EIO.
+ * */
+
+int bootable_pread_all(int fd, void *buf, bootable_uint64 buf_size, bootable_uint64 offset);
+
+/** Writes data to a file descriptor at a certain
+ * offset. Partial writes and interruptions are retried
+ * until all of the data is written.
+ * @param fd The file descriptor to write to.
+ * @param buf The buffer containing the data.
+ * @param buf_size The number of bytes to write.
+ * @param offset The offset to write the data to.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_pwrite_all(int fd, const void *buf, bootable_uint64 buf_size, bootable_uint64 offset);
+
+/** Copies a range of one file to another. This
+ * uses copy_file_range(2) when the kernel supports it
+ * for the two files, then sendfile(2), and otherwise
+ * a bounded buffer, so the memory used does not depend
+ * on the number of bytes copied.
+ * @param dst_fd The file descriptor to write to.
+ * @param dst_offset The offset to write the data to.
+ * @param src_fd The file descriptor to read from.
+ * @param src_offset The offset to read the data from.
+ * @param size The number of bytes to copy.
+ * @returns Zero on success, an error code on failure.
+ * If the source file ends early, @ref BOOTABLE_EIO
+ * is returned.
+ * */
+
+int bootable_copy_fd_range(int dst_fd,
+                           bootable_uint64 dst_offset,
+                           int src_fd,
+                           bootable_uint64 src_offset,
+                           bootable_uint64 size);
+
+/** Copies data from a file descriptor to a stream.
+ * If the stream can copy the data on its own, it is
+ * left to the stream. Otherwise, the data is read
+ * and written in chunks of a bounded size.
+ * @param stream The stream to write to.
+ * @param pos The position in the stream to write to.
+ * @param fd The file descriptor to read from.
+ * @param fd_offset The offset to read the data from.
+ * @param size The number of bytes to copy.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_copy_fd_to_stream(struct bootable_stream *stream,
+                               bootable_uint64 pos,
+                               int fd,
+                               bootable_uint64 fd_offset,
+                               bootable_uint64 size);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* BOOTABLE_SYSIO_H */
@@ -17,6 +17,7 @@
  */
 
 #include "util.h"
+#include "sysio.h"
 
 #include <bootable/lang/config.h>
 
@@ -27,8 +28,13 @@
 #include <bootable/core/types.h>
 #include <bootable/lang/syntax-error.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #ifndef BOOTABLE_INSTALL_PATH
 #define BOOTABLE_INSTALL_PATH "/opt/return-infinity"
@@ -44,61 +50,56 @@
 
 const unsigned long int bootable_data_size = BOOTABLE_SIZE;
 
-struct file_buf {
-	void *data;
-	unsigned long int size;
+/** A file of the host that is
+ * copied onto the disk image. */
+
+struct host_file {
+	/** The file descriptor, or a
+	 * negative value if it is closed. */
+	int fd;
+	/** The number of bytes in the file. */
+	bootable_uint64 size;
 };
 
-static int file_open(struct file_buf *file_buf,
-                       const char *path) {
+static int host_file_open(struct host_file *host_file,
+                          const char *path) {
 
-	file_buf->data = NULL;
-	file_buf->size = 0;
+	host_file->fd = -1;
+	host_file->size = 0;
 
-	FILE *kernel = fopen(path, "rb");
-	if (kernel == NULL)
-		return BOOTABLE_ENOENT;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return bootable_error_from_errno(errno);
 
-	if (fseek(kernel, 0UL, SEEK_END) != 0) {
-		fclose(kernel);
-		return BOOTABLE_EINVAL;
-	}
+	struct stat st;
 
-	long int kernel_size = ftell(kernel);
-	if (kernel_size == -1L) {
-		fclose(kernel);
-		return BOOTABLE_EINVAL;
-	}
-
-	if (fseek(kernel, 0UL, SEEK_SET) != 0) {
-		fclose(kernel);
-		return BOOTABLE_EINVAL;
+	if (fstat(fd, &st) != 0) {
+		int err = bootable_error_from_errno(errno);
+		close(fd);
+		return err;
 	}
 
-	void *buf = malloc(kernel_size);
-	if (buf == NULL) {
-		fclose(kernel);
-		return BOOTABLE_ENOMEM;
-	}
+	host_file->fd = fd;
+	host_file->size = (bootable_uint64) st.st_size;
 
-	if (fread(buf, 1, kernel_size, kernel) != ((size_t) kernel_size)) {
-		fclose(kernel);
-		free(buf);
-		return BOOTABLE_EIO;
-	}
+	return 0;
+}
 
-	fclose(kernel);
+static void host_file_close(struct host_file *host_file) {
+	if (host_file->fd >= 0)
+		close(host_file->fd);
+	host_file->fd = -1;
+	host_file->size = 0;
+}
 
-	file_buf->data = buf;
-	file_buf->size = (unsigned long int) kernel_size;
+/* Copies the file onto the disk without
+ * loading all of it into memory. */
 
-	return 0;
-}
+static int host_file_copy(struct host_file *host_file,
+                          struct bootable_stream *disk,
+                          bootable_uint64 offset) {
 
-static void file_done(struct file_buf *file_buf) {
-	free(file_buf->data);
-	file_buf->data = NULL;
-	file_buf->size = 0;
+	return bootable_copy_fd_to_stream(disk, offset, host_file->fd, 0, host_file->size);
 }
 
 static const char *get_root_resource_path(const struct bootable_config *config) {
@@ -176,14 +177,14 @@ static int resource_get_size(const struct bootable_config *config,
 }
 
 static int resource_open(const struct bootable_config *config,
-                         struct file_buf *file_buf,
+                         struct host_file *host_file,
                          const char *suffix_path) {
 
 	char *full_path = get_full_resource_path(config, suffix_path);
 	if (full_path == NULL)
 		return BOOTABLE_ENOMEM;
 
-	int err = file_open(file_buf, full_path);
+	int err = host_file_open(host_file, full_path);
 	if (err != 0) {
 		free(full_path);
 		return err;
@@ -195,18 +196,18 @@ static int resource_open(const struct bootable_config *config,
 }
 
 static int bootsector_open(const struct bootable_config *config,
-                           struct file_buf *file_buf,
+                           struct host_file *host_file,
                            enum bootable_bootsector bootsector) {
 
 	switch (bootsector) {
 	case BOOTABLE_BOOTSECTOR_MBR:
-		return resource_open(config, file_buf, "x86_64/bootsectors/mbr.sys");
+		return resource_open(config, host_file, "x86_64/bootsectors/mbr.sys");
 	case BOOTABLE_BOOTSECTOR_PXE:
-		return resource_open(config, file_buf, "x86_64/bootsectors/pxestart.sys");
+		return resource_open(config, host_file, "x86_64/bootsectors/pxestart.sys");
 	case BOOTABLE_BOOTSECTOR_MULTIBOOT:
-		return resource_open(config, file_buf, "x86_64/bootsectors/mulitboot.sys");
+		return resource_open(config, host_file, "x86_64/bootsectors/mulitboot.sys");
 	case BOOTABLE_BOOTSECTOR_MULTIBOOT2:
-		return resource_open(config, file_buf, "x86_64/bootsectors/mulitboot2.sys");
+		return resource_open(config, host_file, "x86_64/bootsectors/mulitboot2.sys");
 	default:
 		break;
 	}
@@ -216,26 +217,22 @@ static int bootsector_open(const struct bootable_config *config,
 
 static int write_bootsector(struct bootable_util *util) {
 
-	int err = bootable_stream_set_pos(&util->disk_file.base, 0);
-	if (err != 0)
-		return err;
+	struct host_file host_file;
 
-	struct file_buf file_buf;
-
-	err = bootsector_open(&util->config, &file_buf, util->config.bootsector);
+	int err = bootsector_open(&util->config, &host_file, util->config.bootsector);
 	if (err != 0) {
 		fprintf(util->errlog, "Failed to open bootsector: %s\n", bootable_strerror(err));
 		return err;
 	}
 
-	err = bootable_stream_write(&util->disk_file.base, file_buf.data, file_buf.size);
+	err = host_file_copy(&host_file, util->disk, 0);
 	if (err != 0) {
 		fprintf(util->errlog, "Failed to write bootsector: %s\n", bootable_strerror(err));
-		file_done(&file_buf);
+		host_file_close(&host_file);
 		return err;
 	}
 
-	file_done(&file_buf);
+	host_file_close(&host_file);
 
 	return 0;
 }
@@ -246,12 +243,12 @@ static int write_kernel_bin(struct bootable_util *util) {
 	if (path == NULL)
 		path = "kernel";
 
-	struct file_buf file_buf;
+	struct host_file host_file;
 
-	int err = file_open(&file_buf, path);
+	int err = host_file_open(&host_file, path);
 	if (err != 0) {
 		fprintf(util->errlog, "Failed to open '%s'.\n", path);
-		file_done(&file_buf);
+		host_file_close(&host_file);
 		return err;
 	}
 
@@ -259,19 +256,13 @@ static int write_kernel_bin(struct bootable_util *util) {
 	kernel_offset += bootable_bootsector_size(util->config.bootsector);
 	kernel_offset += bootable_data_size;
 
-	err = bootable_stream_set_pos(&util->disk_file.base, kernel_offset);
-	if (err != 0) {
-		file_done(&file_buf);
-		return err;
-	}
-
-	err = bootable_stream_write(&util->disk_file.base, file_buf.data, file_buf.size);
+	err = host_file_copy(&host_file, util->disk, kernel_offset);
 	if (err != 0) {
-		file_done(&file_buf);
+		host_file_close(&host_file);
 		return err;
 	}
 
-	file_done(&file_buf);
+	host_file_close(&host_file);
 
 	return 0;
 }
@@ -282,25 +273,21 @@ static int write_stage_two_bin(struct bootable_util *util) {
 
 	stage_two_offset += bootable_bootsector_size(util->config.bootsector);
 
-	int err = bootable_stream_set_pos(&util->disk_file.base, stage_two_offset);
-	if (err != 0)
-		return err;
-
-	struct file_buf file_buf;
+	struct host_file host_file;
 
-	err = resource_open(&util->config, &file_buf, "x86_64/bootable.sys");
+	int err = resource_open(&util->config, &host_file, "x86_64/bootable.sys");
 	if (err != 0) {
 		fprintf(util->errlog, "Failed to open 2nd stage bootloader file.");
 		return err;
 	}
 
-	err = bootable_stream_write(&util->disk_file.base, file_buf.data, file_buf.size);
+	err = host_file_copy(&host_file, util->disk, stage_two_offset);
 	if (err != 0) {
-		file_done(&file_buf);
+		host_file_close(&host_file);
 		return err;
 	}
 
-	file_done(&file_buf);
+	host_file_close(&host_file);
 
 	return 0;
 }
@@ -345,11 +332,11 @@ static int write_fs_gpt(struct bootable_util *util,
 
 	bootable_partition_init(&partition);
 
-	bootable_partition_set_offset(&partition, gpt->primary_entries[2].first_lba * 512);
+	bootable_partition_set_offset(&partition, gpt->entries[2].first_lba * 512);
 
 	bootable_partition_set_size(&partition, util->config.fs_size);
 
-	bootable_partition_set_disk(&partition, &util->disk_file.base);
+	bootable_partition_set_disk(&partition, util->disk);
 
 	err = bootable_fs_make_dir(&util->fs, "/boot");
 	if (err != 0)
@@ -377,9 +364,9 @@ static int write_kernel_gpt(struct bootable_util *util,
 	if (kernel_path == bootable_null)
 		kernel_path = "kernel";
 
-	struct file_buf kernel;
+	struct host_file kernel;
 
-	err = file_open(&kernel, kernel_path);
+	err = host_file_open(&kernel, kernel_path);
 	if (err != 0) {
 		fprintf(util->errlog, "Failed to open '%s'.\n", kernel_path);
 		return err;
@@ -387,23 +374,17 @@ static int write_kernel_gpt(struct bootable_util *util,
 
 	err = bootable_gpt_set_entry_size(gpt, 1, kernel.size);
 	if (err != 0) {
-		file_done(&kernel);
+		host_file_close(&kernel);
 		return err;
 	}
 
-	err = bootable_stream_set_pos(&util->disk_file.base, gpt->primary_entries[1].first_lba * 512);
+	err = host_file_copy(&kernel, util->disk, gpt->entries[1].first_lba * 512);
 	if (err != 0) {
-		file_done(&kernel);
+		host_file_close(&kernel);
 		return err;
 	}
 
-	err = bootable_stream_write(&util->disk_file.base, kernel.data, kernel.size);
-	if (err != 0) {
-		file_done(&kernel);
-		return err;
-	}
-
-	file_done(&kernel);
+	host_file_close(&kernel);
 
 	return 0;
 }
@@ -419,33 +400,27 @@ static int write_loader_gpt(struct bootable_util *util,
 	if (err != 0)
 		return err;
 
-	struct file_buf file_buf;
+	struct host_file host_file;
 
-	err = resource_open(&util->config, &file_buf, "x86_64/fs-loader.sys");
+	err = resource_open(&util->config, &host_file, "x86_64/fs-loader.sys");
 	if (err != 0) {
 		fprintf(util->errlog, "Failed to open file system loader.\n");
 		return err;
 	}
 
-	err = bootable_gpt_set_entry_size(gpt, 1, file_buf.size);
+	err = bootable_gpt_set_entry_size(gpt, 1, host_file.size);
 	if (err != 0) {
-		file_done(&file_buf);
+		host_file_close(&host_file);
 		return err;
 	}
 
-	err = bootable_stream_set_pos(&util->disk_file.base, gpt->primary_entries[1].first_lba * 512);
+	err = host_file_copy(&host_file, util->disk, gpt->entries[1].first_lba * 512);
 	if (err != 0) {
-		file_done(&file_buf);
+		host_file_close(&host_file);
 		return err;
 	}
 
-	err = bootable_stream_write(&util->disk_file.base, file_buf.data, file_buf.size);
-	if (err != 0) {
-		file_done(&file_buf);
-		return err;
-	}
-
-	file_done(&file_buf);
+	host_file_close(&host_file);
 
 	return 0;
 }
@@ -470,9 +445,9 @@ static int write_stage_two_gpt(struct bootable_util *util,
 	if (err != 0)
 		return err;
 
-	struct file_buf file_buf;
+	struct host_file host_file;
 
-	err = resource_open(&util->config, &file_buf, "x86_64/bootable.sys");
+	err = resource_open(&util->config, &host_file, "x86_64/bootable.sys");
 	if (err != 0) {
 		fprintf(util->errlog, "Failed to open 2nd stage bootloader file.");
 		return err;
@@ -480,23 +455,17 @@ static int write_stage_two_gpt(struct bootable_util *util,
 
 	err = bootable_gpt_set_entry_size(gpt, 0, bootable_data_size);
 	if (err != 0) {
-		file_done(&file_buf);
-		return err;
-	}
-
-	err = bootable_stream_set_pos(&util->disk_file.base, gpt->primary_entries[0].first_lba * 512);
-	if (err != 0) {
-		file_done(&file_buf);
+		host_file_close(&host_file);
 		return err;
 	}
 
-	err = bootable_stream_write(&util->disk_file.base, file_buf.data, file_buf.size);
+	err = host_file_copy(&host_file, util->disk, gpt->entries[0].first_lba * 512);
 	if (err != 0) {
-		file_done(&file_buf);
+		host_file_close(&host_file);
 		return err;
 	}
 
-	file_done(&file_buf);
+	host_file_close(&host_file);
 
 	return 0;
 }
@@ -526,17 +495,17 @@ static int update_mbr_gpt(struct bootable_util *util,
 
 	bootable_mbr_zero(&mbr);
 
-	err = bootable_mbr_read(&mbr, &util->disk_file.base);
+	err = bootable_mbr_read(&mbr, util->disk);
 	if (err != 0)
 		return err;
 
-	mbr.st2dap.sector = gpt->primary_entries[0].first_lba;
+	mbr.st2dap.sector = gpt->entries[0].first_lba;
 	mbr.st2dap.sector_count = (bootable_data_size + 511) / 512;
 
-	mbr.st3dap.sector = gpt->primary_entries[1].first_lba;
+	mbr.st3dap.sector = gpt->entries[1].first_lba;
 	mbr.st3dap.sector_count = (stage_three_data_size + 511) / 512;
 
-	err = bootable_mbr_write(&mbr, &util->disk_file.base);
+	err = bootable_mbr_write(&mbr, util->disk);
 	if (err != 0)
 		return err;
 
@@ -614,7 +583,7 @@ static int write_gpt_partitions(struct bootable_util *util) {
 		return err;
 	}
 
-	err = bootable_gpt_export(&gpt, &util->disk_file.base);
+	err = bootable_gpt_export(&gpt, util->disk);
 	if (err != 0) {
 		bootable_gpt_done(&gpt);
 		return err;
@@ -653,17 +622,21 @@ static int import_fs_gpt(struct bootable_util *util,
 	if (!util->config.fs_loader)
 		return 0;
 
-	struct bootable_partition partition;
+	bootable_uint64 offset = 0;
 
-	bootable_partition_init(&partition);
+	int err = bootable_gpt_get_partition_offset(gpt, 2, &offset);
+	if (err != 0)
+		return err;
 
-	bootable_partition_set_offset(&partition, gpt->primary_entries[2].first_lba * 512);
+	struct bootable_partition *partition = &util->fs_partition;
 
-	bootable_partition_set_size(&partition, util->config.fs_size);
+	bootable_partition_set_offset(partition, offset);
+
+	bootable_partition_set_size(partition, util->config.fs_size);
 
-	bootable_partition_set_disk(&partition, &util->disk_file.base);
+	bootable_partition_set_disk(partition, util->disk);
 
-	int err = bootable_fs_import(&util->fs, &partition.stream);
+	err = bootable_fs_import_lazy(&util->fs, &partition->stream, 0);
 	if (err != 0)
 		return err;
 
@@ -676,7 +649,7 @@ static int import_gpt(struct bootable_util *util) {
 
 	bootable_gpt_init(&gpt);
 
-	int err = bootable_gpt_import(&gpt, &util->disk_file.base);
+	int err = bootable_gpt_import(&gpt, util->disk);
 	if (err != 0)
 		return err;
 
@@ -694,17 +667,29 @@ static int import_gpt(struct bootable_util *util) {
 static int save_fs_gpt(struct bootable_util *util,
                        struct bootable_gpt *gpt) {
 
-	struct bootable_partition partition;
+	bootable_uint64 offset = 0;
 
-	bootable_partition_init(&partition);
+	int err = bootable_gpt_get_partition_offset(gpt, 2, &offset);
+	if (err != 0)
+		return err;
 
-	bootable_partition_set_offset(&partition, gpt->primary_entries[2].first_lba * 512);
+	/* This is the partition that the file system
+	 * was imported from, so the file data that was
+	 * not loaded is moved within the partition. */
 
-	bootable_partition_set_size(&partition, util->config.fs_size);
+	struct bootable_partition *partition = &util->fs_partition;
+
+	bootable_partition_set_offset(partition, offset);
 
-	bootable_partition_set_disk(&partition, &util->disk_file.base);
+	bootable_partition_set_size(partition, util->config.fs_size);
 
-	int err = bootable_fs_export(&util->fs, &partition.stream);
+	bootable_partition_set_disk(partition, util->disk);
+
+	err = bootable_stream_set_pos(&partition->stream, 0);
+	if (err != 0)
+		return err;
+
+	err = bootable_fs_export(&util->fs, &partition->stream);
 	if (err != 0)
 		return err;
 
@@ -717,7 +702,13 @@ static int save_gpt(struct bootable_util *util) {
 
 	bootable_gpt_init(&gpt);
 
-	int err = bootable_gpt_import(&gpt, &util->disk_file.base);
+	/* The table is exported again below, so a
+	 * damaged primary or backup table is repaired
+	 * from the copy that is still valid. */
+
+	bootable_bool repair_needed = bootable_false;
+
+	int err = bootable_gpt_import_verified(&gpt, util->disk, &repair_needed);
 	if (err != 0) {
 		bootable_gpt_done(&gpt);
 		return err;
@@ -729,7 +720,7 @@ static int save_gpt(struct bootable_util *util) {
 		return err;
 	}
 
-	err = bootable_gpt_export(&gpt, &util->disk_file.base);
+	err = bootable_gpt_export(&gpt, util->disk);
 	if (err != 0) {
 		bootable_gpt_done(&gpt);
 		return err;
@@ -740,39 +731,226 @@ static int save_gpt(struct bootable_util *util) {
 	return 0;
 }
 
+static int use_cache(struct bootable_util *util,
+                     struct bootable_stream *disk) {
+
+	int err = bootable_cache_setup(&util->disk_cache, disk, 0, 0);
+	if (err != 0)
+		return err;
+
+	util->disk = &util->disk_cache.stream;
+
+	return 0;
+}
+
+static int flush_disk(struct bootable_util *util) {
+
+	struct bootable_stream *disk = util->disk;
+
+	if (disk == &util->disk_cache.stream) {
+
+		int err = bootable_cache_flush(&util->disk_cache);
+		if (err != 0)
+			return err;
+
+		disk = util->disk_cache.backend;
+	}
+
+	if (disk == &util->disk_mem.stream)
+		return 0;
+	else if (disk == &util->disk_map.base)
+		return bootable_mmap_stream_sync(&util->disk_map);
+	else if (disk == &util->disk_aio.base)
+		return bootable_aio_stream_barrier(&util->disk_aio);
+	else
+		return bootable_fdstream_flush(&util->disk_file);
+}
+
 void bootable_util_init(struct bootable_util *util) {
 	bootable_config_init(&util->config);
-	bootable_fstream_init(&util->disk_file);
+	bootable_fdstream_init(&util->disk_file);
+	bootable_mmap_stream_init(&util->disk_map);
+	bootable_aio_stream_init(&util->disk_aio);
+	bootable_memstream_init(&util->disk_mem);
+	bootable_cache_init(&util->disk_cache);
+	bootable_partition_init(&util->fs_partition);
 	bootable_fs_init(&util->fs);
+	bootable_fdstream_init(&util->host_file);
+	util->host_source.stream = &util->host_file.base;
+	util->host_source.cache_budget = 0;
+	util->host_source.fd = -1;
+	util->disk = &util->disk_file.base;
+	util->access = BOOTABLE_MMAP_NORMAL;
+	util->queue_depth = 0;
+	util->preallocate = bootable_false;
+	util->build_in_memory = bootable_false;
 	util->errlog = stderr;
 }
 
 void bootable_util_done(struct bootable_util *util) {
 	bootable_config_done(&util->config);
-	bootable_fstream_done(&util->disk_file);
+	bootable_cache_done(&util->disk_cache);
+	bootable_memstream_done(&util->disk_mem);
+	bootable_aio_stream_done(&util->disk_aio);
+	bootable_mmap_stream_done(&util->disk_map);
+	bootable_fdstream_done(&util->disk_file);
 	bootable_fs_free(&util->fs);
+	bootable_fdstream_done(&util->host_file);
+	bootable_partition_done(&util->fs_partition);
 }
 
-int bootable_util_create_disk(struct bootable_util *util,
-                            const char *path) {
+static int write_image(struct bootable_util *util) {
+
+	int err = write_bootsector(util);
+	if (err != 0)
+		return err;
+
+	err = write_partitions(util);
+	if (err != 0)
+		return err;
+
+	return flush_disk(util);
+}
+
+/** The number of bytes checked at a time
+ * for data when an image built in memory
+ * is written to a file. */
+
+#define SAVE_CHUNK_SIZE 4096
+
+static bootable_bool is_zero(const unsigned char *data,
+                             bootable_uint64 size) {
+
+	for (bootable_uint64 i = 0; i < size; i++) {
+		if (data[i] != 0)
+			return bootable_false;
+	}
+
+	return bootable_true;
+}
+
+static int save_image(struct bootable_util *util,
+                      const char *path) {
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return bootable_error_from_errno(errno);
+
+	/* Like the images created on disk, the file is
+	 * sparse unless it is preallocated, so chunks that
+	 * are all zero are skipped instead of written. */
+
+	int err = 0;
+
+	if (util->disk_mem.size > LLONG_MAX)
+		err = BOOTABLE_EINVAL;
+	else if (ftruncate(fd, (off_t) util->disk_mem.size) != 0)
+		err = bootable_error_from_errno(errno);
+
+	if ((err == 0) && util->preallocate && (util->disk_mem.size > 0)) {
+		/* This returns the error code
+		 * instead of setting errno. */
+		err = posix_fallocate(fd, 0, (off_t) util->disk_mem.size);
+		if (err != 0)
+			err = bootable_error_from_errno(err);
+	}
+
+	bootable_uint64 offset = 0;
 
-	int err = bootable_fstream_open(&util->disk_file, path, "wb+");
+	while ((err == 0) && (offset < util->disk_mem.size)) {
+
+		/* Find the next run of chunks with
+		 * data and write it all at once. */
+
+		bootable_uint64 end = offset;
+
+		while (end < util->disk_mem.size) {
+
+			bootable_uint64 size = util->disk_mem.size - end;
+			if (size > SAVE_CHUNK_SIZE)
+				size = SAVE_CHUNK_SIZE;
+
+			if (is_zero(&util->disk_mem.data[end], size)) {
+				if (end == offset)
+					offset += size;
+				else
+					break;
+			}
+
+			end += size;
+		}
+
+		if (end > offset)
+			err = bootable_pwrite_all(fd, &util->disk_mem.data[offset], end - offset, offset);
+
+		offset = end;
+	}
+
+	if (err != 0) {
+		close(fd);
+		return err;
+	}
+
+	if (close(fd) != 0)
+		return bootable_error_from_errno(errno);
+
+	return 0;
+}
+
+int bootable_util_create_image(struct bootable_util *util) {
+
+	int err = bootable_memstream_resize(&util->disk_mem, util->config.disk_size);
 	if (err != 0)
 		return err;
 
-	err = bootable_fstream_zero(&util->disk_file, util->config.disk_size);
+	util->disk = &util->disk_mem.stream;
+
+	return write_image(util);
+}
+
+int bootable_util_create_disk(struct bootable_util *util,
+                            const char *path) {
+
+	if (util->build_in_memory) {
+
+		int err = bootable_util_create_image(util);
+		if (err != 0)
+			return err;
+
+		return save_image(util, path);
+	}
+
+	int err = bootable_aio_stream_open(&util->disk_aio, path,
+	                                   O_RDWR | O_CREAT | O_TRUNC,
+	                                   util->queue_depth);
 	if (err != 0)
 		return err;
 
-	err = write_bootsector(util);
+	util->disk = &util->disk_aio.base;
+
+	/* The image is written mostly in order, and
+	 * a failed hint does not affect the result. */
+
+	bootable_aio_stream_advise_sequential(&util->disk_aio);
+
+	/* The file is created sparse, so only the
+	 * payload is actually written to the host. */
+
+	err = bootable_aio_stream_resize(&util->disk_aio, util->config.disk_size);
 	if (err != 0)
 		return err;
 
-	err = write_partitions(util);
+	if (util->preallocate) {
+		err = bootable_aio_stream_allocate(&util->disk_aio, 0, util->config.disk_size);
+		if (err != 0)
+			return err;
+	}
+
+	err = use_cache(util, &util->disk_aio.base);
 	if (err != 0)
 		return err;
 
-	return 0;
+	return write_image(util);
 }
 
 int bootable_util_open_config(struct bootable_util *util,
@@ -797,9 +975,21 @@ int bootable_util_open_config(struct bootable_util *util,
 int bootable_util_open_disk(struct bootable_util *util,
                             const char *path) {
 
-	int err = bootable_fstream_open(&util->disk_file, path, "rb+");
-	if (err != 0)
+	int err = bootable_mmap_stream_open(&util->disk_map, path, bootable_true);
+	if (err == 0) {
+		util->disk = &util->disk_map.base;
+		bootable_mmap_stream_advise(&util->disk_map, util->access);
+	} else if (err == BOOTABLE_ENOMEM) {
+		err = bootable_fdstream_open(&util->disk_file, path, O_RDWR);
+		if (err != 0)
+			return err;
+
+		err = use_cache(util, &util->disk_file.base);
+		if (err != 0)
+			return err;
+	} else {
 		return err;
+	}
 
 	if (util->config.partition_scheme == BOOTABLE_PARTITION_SCHEME_GPT) {
 		err = import_gpt(util);
@@ -815,8 +1005,30 @@ int bootable_util_save_disk(struct bootable_util *util) {
 	if (!util->config.fs_loader)
 		return 0;
 
-	if (util->config.partition_scheme == BOOTABLE_PARTITION_SCHEME_GPT)
-		return save_gpt(util);
+	if (util->config.partition_scheme == BOOTABLE_PARTITION_SCHEME_GPT) {
+		int err = save_gpt(util);
+		if (err != 0)
+			return err;
+	}
 
-	return 0;
+	return flush_disk(util);
+}
+
+const void *bootable_util_file_data(struct bootable_util *util,
+                                    const struct bootable_file *file) {
+
+	const struct bootable_partition *partition = &util->fs_partition;
+
+	if (file->source == NULL)
+		return file->data;
+
+	if ((file->blocks != NULL)
+	 || (file->source->stream != &partition->stream)
+	 || (partition->disk != &util->disk_map.base))
+		return NULL;
+
+	if ((partition->offset + file->data_offset) < partition->offset)
+		return NULL;
+
+	return bootable_mmap_stream_data(&util->disk_map, partition->offset + file->data_offset, file->data_size);
 }
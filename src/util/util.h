@@ -19,10 +19,17 @@
 #ifndef BOOTABLE_UTIL_H
 #define BOOTABLE_UTIL_H
 
+#include <bootable/core/cache.h>
 #include <bootable/core/fs.h>
+#include <bootable/core/memstream.h>
+#include <bootable/core/partition.h>
 #include <bootable/lang/config.h>
 
-#include "fstream.h"
+#include "aio-stream.h"
+#include "fdstream.h"
+#include "mmap-stream.h"
+
+#include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,11 +40,62 @@ struct bootable_uuid;
 struct bootable_util {
 	struct bootable_config config;
 	/** The file associated with the
-	 * Pure64 disk image. */
-	struct bootable_fstream disk_file;
+	 * Pure64 disk image, when it is not
+	 * mapped into memory. */
+	struct bootable_fdstream disk_file;
+	/** The memory mapping of the disk image.
+	 * This is used whenever the image fits
+	 * into the address space. */
+	struct bootable_mmap_stream disk_map;
+	/** The asynchronous stream used to
+	 * write a new disk image. */
+	struct bootable_aio_stream disk_aio;
+	/** The disk image, when it is
+	 * built in memory. */
+	struct bootable_memstream disk_mem;
+	/** Collects the small writes made to @ref disk_file
+	 * or @ref disk_aio into blocks. The memory mapping
+	 * does not need it. */
+	struct bootable_cache disk_cache;
+	/** The stream used to access the disk
+	 * image. This points to either @ref disk_map,
+	 * @ref disk_mem or @ref disk_cache. */
+	struct bootable_stream *disk;
+	/** The expected access pattern of the disk
+	 * image, after it is opened. This should be
+	 * set before calling @ref bootable_util_open_disk. */
+	enum bootable_mmap_advice access;
+	/** The number of writes that may be in
+	 * flight while a disk image is created.
+	 * If this is zero, a default is used. */
+	unsigned int queue_depth;
+	/** Whether or not all of the storage for a
+	 * new disk image is allocated up front. If this
+	 * is false, the image is created as a sparse file
+	 * and only the regions that are written take up
+	 * space on the host file system. */
+	bootable_bool preallocate;
+	/** Whether or not @ref bootable_util_create_disk
+	 * builds the whole image in memory first and then
+	 * writes it to the file all at once. Regions that
+	 * are all zero are not written, so @ref preallocate
+	 * applies to these images as well. */
+	bootable_bool build_in_memory;
+	/** The partition that contains the file system.
+	 * The file system is imported without its file data,
+	 * which is read through this partition when needed. */
+	struct bootable_partition fs_partition;
 	/** The file system contained on
 	 * the disk image. */
 	struct bootable_fs fs;
+	/** A file on the host that is copied into
+	 * the file system. It stays open until the
+	 * file system is saved, since its data is
+	 * only read when the file system is exported. */
+	struct bootable_fdstream host_file;
+	/** Refers the copied file in the file
+	 * system to @ref host_file. */
+	struct bootable_file_source host_source;
 	/** The standard error output of
 	 * the utility. */
 	FILE *errlog;
@@ -65,6 +123,17 @@ void bootable_util_done(struct bootable_util *util);
 int bootable_util_create_disk(struct bootable_util *util,
                             const char *path);
 
+/** Builds a new disk image in memory, in
+ * @ref bootable_util::disk_mem. An application
+ * embedding the utility can take the image out with
+ * @ref bootable_memstream_release afterwards.
+ * @param util An initialized utility structure,
+ * with the configuration loaded.
+ * @returns Zero on success, an error code on failure.
+ * */
+
+int bootable_util_create_image(struct bootable_util *util);
+
 /** Opens an existing disk image.
  * @param util An initialized utility structure.
  * @param path The path of the disk image.
@@ -94,6 +163,20 @@ int bootable_util_open_config(struct bootable_util *util,
 
 int bootable_util_save_disk(struct bootable_util *util);
 
+/** Gets the address of the data of a file, so
+ * that it can be read without being copied. This
+ * works if the data is loaded, or if it is in the
+ * memory mapped disk image and is not compressed.
+ * @param util An initialized utility structure.
+ * @param file A file in the file system of the disk.
+ * @returns The address of the data. If the data has
+ * to be read with @ref bootable_file_read, then null
+ * is returned.
+ * */
+
+const void *bootable_util_file_data(struct bootable_util *util,
+                                    const struct bootable_file *file);
+
 #ifdef __cplusplus
 } /* extern "C" { */
 #endif